@@ -144,6 +144,9 @@ engine_config(const char* cfgfile,
         ecfg->num_worker_threads_enforcer = parse_conf_worker_threads(cfgfile, 1);
         ecfg->num_worker_threads_signer = parse_conf_worker_threads(cfgfile, 0);
         ecfg->num_signer_threads = parse_conf_signer_threads(cfgfile);
+        ecfg->num_listener_threads = parse_conf_listener_threads(cfgfile);
+        ecfg->num_signing_sessions = parse_conf_signing_sessions(cfgfile);
+        ecfg->num_output_threads = parse_conf_output_threads(cfgfile);
         ecfg->manual_keygen = parse_conf_manual_keygen(cfgfile);
         ecfg->repositories = parse_conf_repositories(cfgfile);
         /* If any verbosity has been specified at cmd line we will use that */
@@ -431,6 +434,14 @@ engine_config_print(FILE* out, engineconfig_type* config)
             config->num_worker_threads_signer);
         fprintf(out, "\t\t<SignerThreads>%i</SignerThreads>\n",
             config->num_signer_threads);
+        fprintf(out, "\t\t<ListenerThreads>%i</ListenerThreads>\n",
+            config->num_listener_threads);
+        if (config->num_signing_sessions > 0) {
+            fprintf(out, "\t\t<SigningSessions>%i</SigningSessions>\n",
+                config->num_signing_sessions);
+        }
+        fprintf(out, "\t\t<OutputThreads>%i</OutputThreads>\n",
+            config->num_output_threads);
         if (config->notify_command) {
             fprintf(out, "\t\t<NotifyCommand>%s</NotifyCommand>\n",
                 config->notify_command);
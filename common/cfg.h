@@ -48,6 +48,7 @@ struct engineconfig_repository {
     uint8_t use_pubkey;
     uint8_t require_backup;
     unsigned int allow_extract;
+    unsigned int software_sign;
 };
 
 struct engineconfig_listener {
@@ -97,6 +98,9 @@ struct engineconfig_struct {
     int num_worker_threads_enforcer;
     int num_worker_threads_signer;
     int num_signer_threads;
+    int num_listener_threads;
+    int num_signing_sessions;
+    int num_output_threads;
     int manual_keygen;
     int verbosity;
     int db_port; /* Datastore/MySQL/Host/@Port */
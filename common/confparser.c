@@ -41,131 +41,277 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/un.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 static const char* parser_str = "parser";
 
 /**
- * Parse elements from the configuration file.
+ * Compiled RelaxNG schemas, keyed by file name and the inode and
+ * modification time of the schema file.  Compiling a schema costs
+ * far more than validating a document against it, so each schema is
+ * compiled once and reused until the file on disk changes.
  *
  */
-ods_status
-parse_file_check(const char* cfgfile, const char* rngfile)
+struct parse_schema {
+    struct parse_schema* next;
+    char* rngfile;
+    dev_t device;
+    ino_t inode;
+    time_t mtime;
+    xmlDocPtr rngdoc;
+    xmlRelaxNGParserCtxtPtr rngpctx;
+    xmlRelaxNGPtr schema;
+    /* one for the list, one for every validation using the schema */
+    int refcount;
+};
+
+static pthread_mutex_t parse_schemas_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct parse_schema* parse_schemas = NULL;
+
+static void
+parse_schema_free(struct parse_schema* entry)
 {
-    xmlDocPtr doc = NULL;
-    xmlDocPtr rngdoc = NULL;
-    xmlRelaxNGParserCtxtPtr rngpctx = NULL;
-    xmlRelaxNGValidCtxtPtr rngctx = NULL;
-    xmlRelaxNGPtr schema = NULL;
-    int status;
+    if (entry->schema) {
+        xmlRelaxNGFree(entry->schema);
+    }
+    if (entry->rngpctx) {
+        xmlRelaxNGFreeParserCtxt(entry->rngpctx);
+    }
+    if (entry->rngdoc) {
+        xmlFreeDoc(entry->rngdoc);
+    }
+    free(entry->rngfile);
+    free(entry);
+}
 
-    if (!cfgfile || !rngfile) {
-        ods_log_error("[%s] no cfgfile or rngfile", parser_str);
-        return ODS_STATUS_ASSERT_ERR;
+/**
+ * Drop a reference to a schema.  Must be called with the schema lock held.
+ *
+ */
+static void
+parse_schema_release(struct parse_schema* entry)
+{
+    if (--entry->refcount == 0) {
+        parse_schema_free(entry);
     }
-    ods_log_assert(cfgfile);
-    ods_log_assert(rngfile);
-    ods_log_debug("[%s] check cfgfile %s with rngfile %s", parser_str,
-        cfgfile, rngfile);
+}
 
-    /* Load XML document */
-    doc = xmlParseFile(cfgfile);
-    if (doc == NULL) {
-        ods_log_error("[%s] unable to read cfgfile %s", parser_str,
-            cfgfile);
-        return ODS_STATUS_XML_ERR;
+/**
+ * Look up or compile the schema for a rng file, and take a reference to
+ * it.  Must be called with the schema lock held.  A schema replaced in
+ * the mean time stays valid until its last reference is released.
+ *
+ */
+static struct parse_schema*
+parse_schema_get(const char* rngfile, ods_status* status)
+{
+    struct parse_schema** entryptr;
+    struct parse_schema* entry;
+    struct stat statbuf;
+
+    if (stat(rngfile, &statbuf)) {
+        ods_log_error("[%s] unable to read rngfile %s", parser_str,
+            rngfile);
+        *status = ODS_STATUS_XML_ERR;
+        return NULL;
     }
+    for (entryptr = &parse_schemas; *entryptr; entryptr = &(*entryptr)->next) {
+        entry = *entryptr;
+        if (!strcmp(entry->rngfile, rngfile)) {
+            if (entry->device == statbuf.st_dev &&
+                entry->inode == statbuf.st_ino &&
+                entry->mtime == statbuf.st_mtime) {
+                entry->refcount++;
+                return entry;
+            }
+            *entryptr = entry->next;
+            parse_schema_release(entry);
+            break;
+        }
+    }
+    CHECKALLOC(entry = (struct parse_schema*) calloc(1, sizeof(struct parse_schema)));
+    entry->rngfile = strdup(rngfile);
+    entry->device = statbuf.st_dev;
+    entry->inode = statbuf.st_ino;
+    entry->mtime = statbuf.st_mtime;
     /* Load rng document */
-    rngdoc = xmlParseFile(rngfile);
-    if (rngdoc == NULL) {
+    entry->rngdoc = xmlParseFile(rngfile);
+    if (entry->rngdoc == NULL) {
         ods_log_error("[%s] unable to read rngfile %s", parser_str,
             rngfile);
-        xmlFreeDoc(doc);
-        return ODS_STATUS_XML_ERR;
+        parse_schema_free(entry);
+        *status = ODS_STATUS_XML_ERR;
+        return NULL;
     }
     /* Create an XML RelaxNGs parser context for the relax-ng document. */
-    rngpctx = xmlRelaxNGNewDocParserCtxt(rngdoc);
-    if (rngpctx == NULL) {
-        xmlFreeDoc(rngdoc);
-        xmlFreeDoc(doc);
+    entry->rngpctx = xmlRelaxNGNewDocParserCtxt(entry->rngdoc);
+    if (entry->rngpctx == NULL) {
         ods_log_error("[%s] unable to create XML RelaxNGs parser context",
            parser_str);
-        return ODS_STATUS_XML_ERR;
+        parse_schema_free(entry);
+        *status = ODS_STATUS_XML_ERR;
+        return NULL;
     }
     /* Parse a schema definition resource and
      * build an internal XML schema structure.
      */
-    schema = xmlRelaxNGParse(rngpctx);
-    if (schema == NULL) {
+    entry->schema = xmlRelaxNGParse(entry->rngpctx);
+    if (entry->schema == NULL) {
         ods_log_error("[%s] unable to parse a schema definition resource",
             parser_str);
-        xmlRelaxNGFreeParserCtxt(rngpctx);
-        xmlFreeDoc(rngdoc);
-        xmlFreeDoc(doc);
-        return ODS_STATUS_PARSE_ERR;
+        parse_schema_free(entry);
+        *status = ODS_STATUS_PARSE_ERR;
+        return NULL;
+    }
+    entry->next = parse_schemas;
+    parse_schemas = entry;
+    entry->refcount = 2;
+    return entry;
+}
+
+/**
+ * Validate an already parsed document with rng file.
+ *
+ */
+static ods_status
+parse_doc_check(xmlDocPtr doc, const char* cfgfile, const char* rngfile)
+{
+    xmlRelaxNGValidCtxtPtr rngctx = NULL;
+    struct parse_schema* entry = NULL;
+    ods_status status = ODS_STATUS_OK;
+
+    pthread_mutex_lock(&parse_schemas_lock);
+    entry = parse_schema_get(rngfile, &status);
+    pthread_mutex_unlock(&parse_schemas_lock);
+    if (entry == NULL) {
+        return status;
     }
     /* Create an XML RelaxNGs validation context. */
-    rngctx = xmlRelaxNGNewValidCtxt(schema);
+    rngctx = xmlRelaxNGNewValidCtxt(entry->schema);
     if (rngctx == NULL) {
         ods_log_error("[%s] unable to create RelaxNGs validation context",
             parser_str);
-        xmlRelaxNGFree(schema);
-        xmlRelaxNGFreeParserCtxt(rngpctx);
-        xmlFreeDoc(rngdoc);
-        xmlFreeDoc(doc);
-        return ODS_STATUS_RNG_ERR;
-    }
-    /* Validate a document tree in memory. */
-    status = xmlRelaxNGValidateDoc(rngctx,doc);
-    if (status != 0) {
-        ods_log_error("[%s] cfgfile validation failed %s", parser_str,
-            cfgfile);
+        status = ODS_STATUS_RNG_ERR;
+    } else {
+        /* Validate a document tree in memory. */
+        if (xmlRelaxNGValidateDoc(rngctx,doc) != 0) {
+            ods_log_error("[%s] cfgfile validation failed %s", parser_str,
+                cfgfile);
+            status = ODS_STATUS_RNG_ERR;
+        }
         xmlRelaxNGFreeValidCtxt(rngctx);
-        xmlRelaxNGFree(schema);
-        xmlRelaxNGFreeParserCtxt(rngpctx);
-        xmlFreeDoc(rngdoc);
-        xmlFreeDoc(doc);
-        return ODS_STATUS_RNG_ERR;
     }
+    pthread_mutex_lock(&parse_schemas_lock);
+    parse_schema_release(entry);
+    pthread_mutex_unlock(&parse_schemas_lock);
+    return status;
+}
 
-    xmlRelaxNGFreeValidCtxt(rngctx);
-    xmlRelaxNGFree(schema);
-    xmlRelaxNGFreeParserCtxt(rngpctx);
-    xmlFreeDoc(rngdoc);
+/**
+ * Parse elements from the configuration file.
+ *
+ */
+ods_status
+parse_file_check(const char* cfgfile, const char* rngfile)
+{
+    xmlDocPtr doc = NULL;
+    ods_status status;
+
+    if (!cfgfile || !rngfile) {
+        ods_log_error("[%s] no cfgfile or rngfile", parser_str);
+        return ODS_STATUS_ASSERT_ERR;
+    }
+    ods_log_assert(cfgfile);
+    ods_log_assert(rngfile);
+    ods_log_debug("[%s] check cfgfile %s with rngfile %s", parser_str,
+        cfgfile, rngfile);
+
+    /* Load XML document */
+    doc = xmlParseFile(cfgfile);
+    if (doc == NULL) {
+        ods_log_error("[%s] unable to read cfgfile %s", parser_str,
+            cfgfile);
+        return ODS_STATUS_XML_ERR;
+    }
+    status = parse_doc_check(doc, cfgfile, rngfile);
     xmlFreeDoc(doc);
-    return ODS_STATUS_OK;
+    return status;
 }
 
-/* TODO: look how the enforcer reads this now */
-
 /**
- * Parse elements from the configuration file.
+ * Load a configuration file once for repeated evaluation.
  *
  */
-const char*
-parse_conf_string(const char* cfgfile, const char* expr, int required)
+xmlXPathContextPtr
+parse_conf_open(const char* cfgfile, const char* rngfile, ods_status* status)
 {
     xmlDocPtr doc = NULL;
     xmlXPathContextPtr xpathCtx = NULL;
-    xmlXPathObjectPtr xpathObj = NULL;
-    xmlChar *xexpr = NULL;
-    const char* string = NULL;
+    ods_status dummy;
 
-    ods_log_assert(expr);
+    if (!status) {
+        status = &dummy;
+    }
     ods_log_assert(cfgfile);
-
     /* Load XML document */
     doc = xmlParseFile(cfgfile);
     if (doc == NULL) {
+        *status = ODS_STATUS_XML_ERR;
         return NULL;
     }
+    if (rngfile) {
+        ods_log_debug("[%s] check cfgfile %s with rngfile %s", parser_str,
+            cfgfile, rngfile);
+        *status = parse_doc_check(doc, cfgfile, rngfile);
+        if (*status != ODS_STATUS_OK) {
+            xmlFreeDoc(doc);
+            return NULL;
+        }
+    }
     /* Create xpath evaluation context */
     xpathCtx = xmlXPathNewContext(doc);
     if (xpathCtx == NULL) {
         ods_log_error("[%s] unable to create new XPath context for cfgile "
-            "%s expr %s", parser_str, cfgfile, (char*) expr);
+            "%s", parser_str, cfgfile);
         xmlFreeDoc(doc);
+        *status = ODS_STATUS_XML_ERR;
         return NULL;
     }
+    *status = ODS_STATUS_OK;
+    return xpathCtx;
+}
+
+/**
+ * Release a configuration file loaded with parse_conf_open.
+ *
+ */
+void
+parse_conf_close(xmlXPathContextPtr xpathCtx)
+{
+    xmlDocPtr doc;
+    if (xpathCtx) {
+        doc = xpathCtx->doc;
+        xmlXPathFreeContext(xpathCtx);
+        xmlFreeDoc(doc);
+    }
+}
+
+/**
+ * Evaluate an element of a loaded configuration file.
+ *
+ */
+const char*
+parse_conf_evaluate(xmlXPathContextPtr xpathCtx, const char* expr,
+    int required)
+{
+    xmlXPathObjectPtr xpathObj = NULL;
+    xmlChar *xexpr = NULL;
+    const char* string = NULL;
+
+    ods_log_assert(expr);
+    ods_log_assert(xpathCtx);
+
     /* Get string */
     xexpr = (unsigned char*) expr;
     xpathObj = xmlXPathEvalExpression(xexpr, xpathCtx);
@@ -173,27 +319,42 @@ parse_conf_string(const char* cfgfile, const char* expr, int required)
         xpathObj->nodesetval->nodeNr <= 0) {
         if (required) {
             ods_log_error("[%s] unable to evaluate required element %s in "
-                "cfgfile %s", parser_str, (char*) xexpr, cfgfile);
+                "cfgfile %s", parser_str, (char*) xexpr,
+                (xpathCtx->doc->URL ? (char*) xpathCtx->doc->URL : "(null)"));
         }
-        xmlXPathFreeContext(xpathCtx);
         if (xpathObj) {
             xmlXPathFreeObject(xpathObj);
         }
-        xmlFreeDoc(doc);
         return NULL;
     }
-    if (xpathObj->nodesetval != NULL &&
-        xpathObj->nodesetval->nodeNr > 0) {
-        string = (const char*) xmlXPathCastToString(xpathObj);
-        xmlXPathFreeContext(xpathCtx);
-        xmlXPathFreeObject(xpathObj);
-        xmlFreeDoc(doc);
-        return string;
-    }
-    xmlXPathFreeContext(xpathCtx);
+    string = (const char*) xmlXPathCastToString(xpathObj);
     xmlXPathFreeObject(xpathObj);
-    xmlFreeDoc(doc);
-    return NULL;
+    return string;
+}
+
+/* TODO: look how the enforcer reads this now */
+
+/**
+ * Parse elements from the configuration file.
+ *
+ */
+const char*
+parse_conf_string(const char* cfgfile, const char* expr, int required)
+{
+    xmlXPathContextPtr xpathCtx = NULL;
+    const char* string = NULL;
+
+    ods_log_assert(expr);
+    ods_log_assert(cfgfile);
+
+    /* Load XML document */
+    xpathCtx = parse_conf_open(cfgfile, NULL, NULL);
+    if (xpathCtx == NULL) {
+        return NULL;
+    }
+    string = parse_conf_evaluate(xpathCtx, expr, required);
+    parse_conf_close(xpathCtx);
+    return string;
 }
 
 /**
@@ -245,6 +406,7 @@ parse_conf_repositories(const char* cfgfile)
             cur->require_backup = 0;
             cur->use_pubkey = 1;
             cur->allow_extract = 0;
+            cur->software_sign = 0;
             cur->next = NULL;
 
             if (prev)
@@ -268,6 +430,8 @@ parse_conf_repositories(const char* cfgfile)
                     cur->use_pubkey = 0;
                 if (xmlStrEqual(curNode->name, (const xmlChar *)"AllowExtraction"))
                     cur->allow_extract = 1;
+                if (xmlStrEqual(curNode->name, (const xmlChar *)"SoftwareSigning"))
+                    cur->software_sign = 1;
 
                 curNode = curNode->next;
             }
@@ -896,3 +1060,51 @@ parse_conf_signer_threads(const char* cfgfile)
     /* no SignerThreads value configured, look at WorkerThreads */
     return parse_conf_worker_threads(cfgfile, 0);
 }
+
+int
+parse_conf_listener_threads(const char* cfgfile)
+{
+    int numlt = 1;
+    const char* str = parse_conf_string(cfgfile,
+                                        "//Configuration/Signer/ListenerThreads",
+                                        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            numlt = atoi(str);
+        }
+        free((void*)str);
+    }
+    return numlt;
+}
+
+int
+parse_conf_signing_sessions(const char* cfgfile)
+{
+    int numss = 0;
+    const char* str = parse_conf_string(cfgfile,
+                                        "//Configuration/Signer/SigningSessions",
+                                        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            numss = atoi(str);
+        }
+        free((void*)str);
+    }
+    return numss;
+}
+
+int
+parse_conf_output_threads(const char* cfgfile)
+{
+    int numot = 1;
+    const char* str = parse_conf_string(cfgfile,
+                                        "//Configuration/Signer/OutputThreads",
+                                        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            numot = atoi(str);
+        }
+        free((void*)str);
+    }
+    return numot;
+}
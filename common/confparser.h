@@ -37,6 +37,7 @@
 #include "status.h"
 #include "cfg.h"
 #include <stdint.h>
+#include <libxml/xpath.h>
 
 /**
  * Check config file with rng file.
@@ -47,6 +48,36 @@
  */
 ods_status parse_file_check(const char* cfgfile, const char* rngfile);
 
+/**
+ * Load a configuration file once, so that many elements can be
+ * evaluated without parsing the file again for each of them.
+ * \param[in] cfgfile the configuration file name
+ * \param[in] rngfile if not NULL, the rng file name to validate with
+ * \param[out] status if not NULL, set to the result of loading
+ * \return xmlXPathContextPtr evaluation context, NULL on failure
+ *
+ */
+xmlXPathContextPtr parse_conf_open(const char* cfgfile, const char* rngfile,
+    ods_status* status);
+
+/**
+ * Release a configuration file loaded with parse_conf_open().
+ * \param[in] xpathCtx the evaluation context
+ *
+ */
+void parse_conf_close(xmlXPathContextPtr xpathCtx);
+
+/**
+ * Evaluate an element of a loaded configuration file.
+ * \param[in] xpathCtx the evaluation context
+ * \param[in] expr xml expression
+ * \param[in] required if the element is required
+ * \return const char* string value
+ *
+ */
+const char* parse_conf_evaluate(xmlXPathContextPtr xpathCtx, const char* expr,
+    int required);
+
 /**
  * Parse elements from the configuration file.
  * \param[in] cfgfile configuration file
@@ -102,6 +133,9 @@ int parse_conf_verbosity(const char* cfgfile);
 /** Enforcer and signer specific */
 int parse_conf_worker_threads(const char* cfgfile, int is_enforcer);
 int parse_conf_signer_threads(const char* cfgfile);
+int parse_conf_listener_threads(const char* cfgfile);
+int parse_conf_signing_sessions(const char* cfgfile);
+int parse_conf_output_threads(const char* cfgfile);
 int parse_conf_manual_keygen(const char* cfgfile);
 int parse_conf_db_port(const char *cfgfile);
 time_t parse_conf_automatic_keygen_period(const char* cfgfile);
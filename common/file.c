@@ -37,6 +37,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -567,3 +568,140 @@ ods_str_list_add(char*** list, char* str)
         (*list)[0] = str;
     }
 }
+
+
+/* Files replaced within a batch, per thread */
+struct ods_filebatch {
+    int count;
+    int size;
+    char** tmpnames;
+    char** filenames;
+};
+
+static pthread_key_t filebatchkey;
+static pthread_once_t filebatchonce = PTHREAD_ONCE_INIT;
+
+static void
+ods_file_batchinit(void)
+{
+    pthread_key_create(&filebatchkey, NULL);
+}
+
+
+/**
+ * Replace a file by a newly written temporary file.
+ *
+ */
+ods_status
+ods_file_replace(const char* tmpname, const char* filename)
+{
+    struct ods_filebatch* batch;
+    pthread_once(&filebatchonce, ods_file_batchinit);
+    batch = pthread_getspecific(filebatchkey);
+    if (!batch) {
+        if (rename(tmpname, filename) != 0) {
+            ods_log_error("[%s] unable to rename %s to %s: %s", file_str,
+                tmpname, filename, strerror(errno));
+            return ODS_STATUS_RENAME_ERR;
+        }
+        return ODS_STATUS_OK;
+    }
+    if (batch->count == batch->size) {
+        batch->size = (batch->size ? batch->size * 2 : 16);
+        CHECKALLOC(batch->tmpnames = realloc(batch->tmpnames, sizeof(char*) * batch->size));
+        CHECKALLOC(batch->filenames = realloc(batch->filenames, sizeof(char*) * batch->size));
+    }
+    batch->tmpnames[batch->count] = strdup(tmpname);
+    batch->filenames[batch->count] = strdup(filename);
+    batch->count++;
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Open a file batch on the calling thread.
+ *
+ */
+void
+ods_file_batchopen(void)
+{
+    struct ods_filebatch* batch;
+    pthread_once(&filebatchonce, ods_file_batchinit);
+    if (pthread_getspecific(filebatchkey)) {
+        return;
+    }
+    CHECKALLOC(batch = calloc(1, sizeof(struct ods_filebatch)));
+    pthread_setspecific(filebatchkey, batch);
+}
+
+
+/**
+ * Flush all files of the batch to disk and rename them into place.  The
+ * write back of all files is started before waiting for any of them, so
+ * the disk sees the whole batch at once.  Directories are synced once,
+ * after all renames.
+ *
+ */
+int
+ods_file_batchcommit(void)
+{
+    struct ods_filebatch* batch;
+    int* fds;
+    char* dirname;
+    char* lastdirname = NULL;
+    int i, fd, nfailed = 0;
+    pthread_once(&filebatchonce, ods_file_batchinit);
+    batch = pthread_getspecific(filebatchkey);
+    if (!batch) {
+        return 0;
+    }
+    pthread_setspecific(filebatchkey, NULL);
+    CHECKALLOC(fds = malloc(sizeof(int) * (batch->count ? batch->count : 1)));
+    for (i=0; i<batch->count; i++) {
+        fds[i] = open(batch->tmpnames[i], O_RDONLY);
+#ifdef HAVE_SYNC_FILE_RANGE
+        if (fds[i] >= 0) {
+            (void) sync_file_range(fds[i], 0, 0, SYNC_FILE_RANGE_WRITE);
+        }
+#endif
+    }
+    for (i=0; i<batch->count; i++) {
+        if (fds[i] >= 0) {
+#ifdef HAVE_FDATASYNC
+            if (fdatasync(fds[i]) != 0) {
+#else
+            if (fsync(fds[i]) != 0) {
+#endif
+                ods_log_warning("[%s] unable to sync %s: %s", file_str,
+                    batch->tmpnames[i], strerror(errno));
+            }
+            close(fds[i]);
+        }
+        if (rename(batch->tmpnames[i], batch->filenames[i]) != 0) {
+            ods_log_error("[%s] unable to rename %s to %s: %s", file_str,
+                batch->tmpnames[i], batch->filenames[i], strerror(errno));
+            unlink(batch->tmpnames[i]);
+            ++nfailed;
+        }
+    }
+    for (i=0; i<batch->count; i++) {
+        dirname = ods_dir_name(batch->filenames[i]);
+        if (!lastdirname || strcmp(lastdirname, (dirname ? dirname : "."))) {
+            if ((fd = open((dirname ? dirname : "."), O_RDONLY)) >= 0) {
+                (void) fsync(fd);
+                close(fd);
+            }
+            free(lastdirname);
+            lastdirname = strdup(dirname ? dirname : ".");
+        }
+        free(dirname);
+        free(batch->tmpnames[i]);
+        free(batch->filenames[i]);
+    }
+    free(lastdirname);
+    free(fds);
+    free(batch->tmpnames);
+    free(batch->filenames);
+    free(batch);
+    return nfailed;
+}
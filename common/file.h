@@ -201,4 +201,31 @@ void ods_chown(const char* file, uid_t uid, gid_t gid, int getdir);
  */
 void ods_str_list_add(char*** list, char* str);
 
+/**
+ * Replace a file by a newly written temporary file.  If the calling thread
+ * has a file batch open, the rename is deferred until the batch is
+ * committed, otherwise the file is renamed right away.
+ * \param[in] tmpname the newly written file
+ * \param[in] filename the file to replace
+ * \return ods_status ODS_STATUS_RENAME_ERR if the file could not be renamed
+ *
+ */
+ods_status ods_file_replace(const char* tmpname, const char* filename);
+
+/**
+ * Open a file batch on the calling thread.  Files replaced while the batch
+ * is open are only renamed when the batch is committed, after all of them
+ * have been flushed to disk together.
+ *
+ */
+void ods_file_batchopen(void);
+
+/**
+ * Flush all files of the batch of the calling thread to disk, rename them
+ * into place and close the batch.
+ * \return int the number of files that could not be replaced
+ *
+ */
+int ods_file_batchcommit(void);
+
 #endif /* SHARED_FILE_H */
@@ -67,48 +67,72 @@ fifoq_wipe(fifoq_type* q)
         q->blob[i] = NULL;
         q->owner[i] = NULL;
     }
+    q->head = 0;
     q->count = 0;
 }
 
 
 /**
- * Pop item from queue.
+ * Pop a batch of items from queue.
  *
  */
-void*
-fifoq_pop(fifoq_type* q, void** context)
+size_t
+fifoq_popbatch(fifoq_type* q, void** items, void** owners, size_t max)
 {
-    void* pop = NULL;
     size_t i = 0;
     if (!q || q->count <= 0) {
-        return NULL;
+        return 0;
+    }
+    if (max > q->count) {
+        max = q->count;
     }
-    pop = q->blob[0];
-    *context = q->owner[0];
-    for (i = 0; i < q->count-1; i++) {
-        q->blob[i] = q->blob[i+1];
-        q->owner[i] = q->owner[i+1];
+    for (i = 0; i < max; i++) {
+        items[i] = q->blob[q->head];
+        owners[i] = q->owner[q->head];
+        q->blob[q->head] = NULL;
+        q->owner[q->head] = NULL;
+        q->head = (q->head + 1) % FIFOQ_MAX_COUNT;
     }
-    q->count -= 1;
-    if (q->count <= (size_t) FIFOQ_MAX_COUNT * 0.1) {
+    q->count -= max;
+    if (q->count <= (size_t) FIFOQ_MAX_COUNT / 2 &&
+        q->count + max > (size_t) FIFOQ_MAX_COUNT / 2) {
         /**
-         * Notify waiting workers that they can start queuing again
+         * Notify waiting workers that they can start queuing again, while
+         * the drudgers still have plenty of work left.
          * If no workers are waiting, this call has no effect.
          */
         pthread_cond_broadcast(&q->q_nonfull);
     }
+    return max;
+}
+
+
+/**
+ * Pop item from queue.
+ *
+ */
+void*
+fifoq_pop(fifoq_type* q, void** context)
+{
+    void* pop = NULL;
+    if (fifoq_popbatch(q, &pop, context, 1) == 0) {
+        return NULL;
+    }
     return pop;
 }
 
 
 /**
- * Push item to queue.
+ * Push a batch of items to queue.
  *
  */
 ods_status
-fifoq_push(fifoq_type* q, void* item, void* context, int* tries)
+fifoq_pushbatch(fifoq_type* q, void** items, size_t count, void* context, size_t* pushed, int* tries)
 {
-    if (!q || !item) {
+    size_t i = 0;
+    size_t tail = 0;
+    *pushed = 0;
+    if (!q || !items) {
         return ODS_STATUS_ASSERT_ERR;
     }
     if (q->count >= FIFOQ_MAX_COUNT) {
@@ -125,26 +149,60 @@ fifoq_push(fifoq_type* q, void* item, void* context, int* tries)
         }
         return ODS_STATUS_UNCHANGED;
     }
-    q->blob[q->count] = item;
-    q->owner[q->count] = context;
-    q->count += 1;
-    if (q->count == 1) {
-        ods_log_deeebug("[%s] threshold %lu reached, notify drudgers",
-            fifoq_str, (unsigned long) q->count);
-        /* If no drudgers are waiting, this call has no effect. */
+    for (i = 0; i < count; i++) {
+        if (!items[i]) {
+            return ODS_STATUS_ASSERT_ERR;
+        }
+    }
+    for (i = 0; i < count && q->count < FIFOQ_MAX_COUNT; i++) {
+        tail = (q->head + q->count) % FIFOQ_MAX_COUNT;
+        q->blob[tail] = items[i];
+        q->owner[tail] = context;
+        q->count += 1;
+        *pushed += 1;
+    }
+    ods_log_deeebug("[%s] queued %lu, notify drudgers", fifoq_str,
+        (unsigned long) *pushed);
+    /**
+     * Wake as many drudgers as there is work for, once per batch rather
+     * than once per item.  If no drudgers are waiting, this call has no
+     * effect.
+     */
+    if (*pushed > 1) {
         pthread_cond_broadcast(&q->q_threshold);
+    } else if (*pushed == 1) {
+        pthread_cond_signal(&q->q_threshold);
+    }
+    return (*pushed < count ? ODS_STATUS_UNCHANGED : ODS_STATUS_OK);
+}
+
+
+/**
+ * Push item to queue.
+ *
+ */
+ods_status
+fifoq_push(fifoq_type* q, void* item, void* context, int* tries)
+{
+    size_t pushed;
+    if (!q || !item) {
+        return ODS_STATUS_ASSERT_ERR;
     }
-    return ODS_STATUS_OK;
+    return fifoq_pushbatch(q, &item, 1, context, &pushed, tries);
 }
 
 void
 fifoq_report(fifoq_type* q, worker_type* superior, ods_status subtaskstatus)
+{
+    fifoq_reportbatch(q, superior, 1, (subtaskstatus != ODS_STATUS_OK ? 1 : 0));
+}
+
+void
+fifoq_reportbatch(fifoq_type* q, worker_type* superior, long nsubtasks, long nsubtasksfailed)
 {
     pthread_mutex_lock(&q->q_lock);
-    if (subtaskstatus != ODS_STATUS_OK) {
-        superior->tasksFailed += 1;
-    }
-    superior->tasksOutstanding -= 1;
+    superior->tasksFailed += nsubtasksfailed;
+    superior->tasksOutstanding -= nsubtasks;
     if (superior->tasksOutstanding == 0) {
         pthread_cond_signal(&superior->tasksBlocker);
     }
@@ -50,15 +50,22 @@ typedef struct fifoq_struct fifoq_type;
 #include "locks.h"
 #include "status.h"
 
-#define FIFOQ_MAX_COUNT 1000
+#define FIFOQ_MAX_COUNT 4096
 #define FIFOQ_TRIES_COUNT 10
+#define FIFOQ_BATCH_COUNT 64 /* items queued per lock acquisition */
+#define FIFOQ_POP_COUNT 8 /* items handed out per lock acquisition */
 
 /**
  * FIFO Queue.
+ *
+ * The items are kept in a ring buffer, starting at index head.  Items can be
+ * pushed and popped in batches, to limit the number of lock handoffs between
+ * the workers queueing work and the drudgers performing it.
  */
 struct fifoq_struct {
     void* blob[FIFOQ_MAX_COUNT];
     void* owner[FIFOQ_MAX_COUNT];
+    size_t head;
     size_t count;
     pthread_mutex_t q_lock;
     pthread_cond_t q_threshold;
@@ -100,6 +107,32 @@ void* fifoq_pop(fifoq_type* q, void** worker);
  */
 ods_status fifoq_push(fifoq_type* q, void* item, void* worker, int* tries);
 
+/**
+ * Pop a batch of items from queue.  Like fifoq_pop() the queue lock must be
+ * held by the caller.
+ * \param[in] q queue
+ * \param[out] items popped items
+ * \param[out] owners the owners of the popped items
+ * \param[in] max maximum number of items to pop
+ * \return size_t number of items popped
+ *
+ */
+size_t fifoq_popbatch(fifoq_type* q, void** items, void** owners, size_t max);
+
+/**
+ * Push a batch of items to queue, all with the same owner.  Like fifoq_push()
+ * the queue lock must be held by the caller.
+ * \param[in] q queue
+ * \param[in] items items
+ * \param[in] count number of items
+ * \param[in] worker owner of items
+ * \param[out] pushed number of items pushed, less than count if full
+ * \param[out] tries number of tries
+ * \return ods_status status, ODS_STATUS_UNCHANGED if not all items pushed
+ *
+ */
+ods_status fifoq_pushbatch(fifoq_type* q, void** items, size_t count, void* worker, size_t* pushed, int* tries);
+
 /**
  * Clean up queue.
  * \param[in] q queue to be cleaned up
@@ -108,6 +141,7 @@ ods_status fifoq_push(fifoq_type* q, void* item, void* worker, int* tries);
 void fifoq_cleanup(fifoq_type* q);
 
 void fifoq_report(fifoq_type* q, worker_type* superior, ods_status subtaskstatus);
+void fifoq_reportbatch(fifoq_type* q, worker_type* superior, long nsubtasks, long nsubtasksfailed);
 void fifoq_waitfor(fifoq_type* q, worker_type* worker, long nsubtasks, long* nsubtasksfailed);
 void fifoq_notifyall(fifoq_type* q);
 
@@ -40,6 +40,7 @@
 #include <ldns/ldns.h>
 #include <pthread.h>
 #include <signal.h>
+#include <string.h>
 
 #include "scheduler/schedule.h"
 #include "scheduler/task.h"
@@ -66,6 +67,22 @@ task2node(task_type* task)
     return node;
 }
 
+/**
+ * Account a value in a histogram. Caller must hold
+ * schedule->schedule_lock.
+ */
+static void
+histogram_add(struct schedule_histogram* histogram, unsigned long value)
+{
+    int bucket = 0;
+    while (value > 0 && bucket < SCHEDULE_HISTOGRAM_SIZE - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    histogram->buckets[bucket]++;
+    histogram->count++;
+}
+
 /**
  * Get the first scheduled task. As long as return value is used
  * caller should hold schedule->schedule_lock.
@@ -199,6 +216,10 @@ schedule_create()
     schedule->num_waiting = 0;
     schedule->handlers = NULL;
     schedule->nhandlers = 0;
+    memset(&schedule->depth_histogram, 0, sizeof(struct schedule_histogram));
+    memset(&schedule->wait_histogram, 0, sizeof(struct schedule_histogram));
+    memset(&schedule->run_histogram, 0, sizeof(struct schedule_histogram));
+    schedule->num_skipped = 0;
     
     CHECKALLOC(schedule->signq = fifoq_create());
 
@@ -358,6 +379,7 @@ schedule_task(schedule_type* schedule, task_type* task, int replace, int log)
             task->lock = ((task_type*)node1->key)->lock;
         }
         /* not is schedule yet */
+        task->queued = time_now();
         node1 = task2node(task);
         node2 = task2node(task);
         if (!node1 || !node2) {
@@ -444,20 +466,46 @@ schedule_unschedule(schedule_type* schedule, task_type* task)
 task_type*
 schedule_pop_task(schedule_type* schedule)
 {
-    time_t timeout, now = time_now();
-    task_type* task;
+    time_t timeout, since, now = time_now();
+    ldns_rbnode_t* node;
+    task_type* task = NULL;
+    int skipped = 0;
 
     pthread_mutex_lock(&schedule->schedule_lock);
-    task = schedule_get_first_task(schedule);
-    if (task && (task->due_date <= now)) {
+    /* Rather than handing out the first task due and have the worker
+     * block on its lock when another task for the same resource is
+     * being performed, pass over such tasks to the next one due. */
+    node = ldns_rbtree_first(schedule->tasks);
+    while (node && node != LDNS_RBTREE_NULL) {
+        task = (task_type*) node->data;
+        if (task->due_date > now) {
+            break;
+        }
+        if (!task->lock || !pthread_mutex_trylock(task->lock)) {
+            break;
+        }
+        skipped++;
+        node = ldns_rbtree_next(node);
+    }
+    schedule->num_skipped += skipped;
+    if (node && node != LDNS_RBTREE_NULL && task->due_date <= now) {
         ods_log_debug("[%s] pop task for zone %s", schedule_str, task->owner);
+        histogram_add(&schedule->depth_histogram, schedule->tasks->count);
+        since = (task->due_date > task->queued ? task->due_date : task->queued);
+        histogram_add(&schedule->wait_histogram, (now > since ? now - since : 0));
         task = unschedule_task(schedule, task);
+        task->locked = (task->lock != NULL);
     } else {
         /* nothing to do now, sleep and wait for signal */
+        task = schedule_get_first_task(schedule);
         schedule->num_waiting += 1;
         timeout = clamp((task ? (task->due_date - now) : 0),
                         ((task && !strcmp(task->class, TASK_CLASS_ENFORCER)) ? 0 : 60),
                         ODS_SE_MAX_BACKOFF);
+        /* When all due tasks wait for a resource, we are signalled
+         * when a task is finished, but the resource may also be held
+         * elsewhere. */
+        if (skipped) timeout = 1;
         if (time_leaped()) timeout = -1;
         ods_thread_wait(&schedule->schedule_cond, &schedule->schedule_lock, timeout);
         schedule->num_waiting -= 1;
@@ -542,6 +590,31 @@ schedule_info(schedule_type* schedule, time_t* firstFireTime, int* idleWorkers,
     return 0;
 }
 
+void
+schedule_statistics(schedule_type* schedule, struct schedule_histogram* depth, struct schedule_histogram* wait, struct schedule_histogram* run, unsigned long* skipped)
+{
+    pthread_mutex_lock(&schedule->schedule_lock);
+    if (depth)
+        *depth = schedule->depth_histogram;
+    if (wait)
+        *wait = schedule->wait_histogram;
+    if (run)
+        *run = schedule->run_histogram;
+    if (skipped)
+        *skipped = schedule->num_skipped;
+    pthread_mutex_unlock(&schedule->schedule_lock);
+}
+
+void
+schedule_task_finished(schedule_type* schedule, long runtime)
+{
+    pthread_mutex_lock(&schedule->schedule_lock);
+    histogram_add(&schedule->run_histogram, (runtime > 0 ? runtime : 0));
+    /* a resource was released, a worker may be waiting for it */
+    pthread_cond_signal(&schedule->schedule_cond);
+    pthread_mutex_unlock(&schedule->schedule_lock);
+}
+
 void
 schedule_release_all(schedule_type* schedule)
 {
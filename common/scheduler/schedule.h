@@ -55,6 +55,16 @@ typedef struct schedule_struct schedule_type;
 #define SCHEDULE_ADD     0 /* ADD will fail of already present */
 #define SCHEDULE_REPLACE 1
 
+/* Histogram with logarithmic buckets, bucket 0 counts the value 0 and
+ * bucket i > 0 the values from 2^(i-1) up to 2^i, the last bucket also
+ * counts all larger values. */
+#define SCHEDULE_HISTOGRAM_SIZE 20
+
+struct schedule_histogram {
+    unsigned long count;
+    unsigned long buckets[SCHEDULE_HISTOGRAM_SIZE];
+};
+
 struct schedule_handler {
     task_id type;
     task_id class;
@@ -77,6 +87,15 @@ struct schedule_struct {
     int num_waiting;
     struct schedule_handler* handlers;
     int nhandlers;
+    /* Statistics: number of tasks in the queue when handing out a task,
+     * the time in seconds tasks were due before being handed out, and
+     * the time in milliseconds they took to perform. */
+    struct schedule_histogram depth_histogram;
+    struct schedule_histogram wait_histogram;
+    struct schedule_histogram run_histogram;
+    /* Number of times a due task was passed over because its lock was
+     * held by a task already being performed. */
+    unsigned long num_skipped;
 };
 
 /**
@@ -136,6 +155,9 @@ void schedule_unscheduletask(schedule_type* schedule, task_id task, const char*
  * Pop the first scheduled task that is due. If an item is directly
  * available it will be returned. Else the call will block and return
  * NULL when the caller is awoken. 
+ * Tasks of which the lock is held, because another task for the same
+ * resource is being performed, are passed over. The lock of the task
+ * returned is already acquired.
  *
  * \param[in] schedule schedule
  * \return task_type* popped task, or NULL when no task available or
@@ -157,6 +179,18 @@ void schedule_flush(schedule_type* schedule);
 
 int schedule_info(schedule_type* schedule, time_t* firstFireTime, int* idleWorkers, int* taskCount);
 
+/**
+ * Get a copy of the statistics of the schedule.  Any of the output
+ * arguments may be NULL.
+ */
+void schedule_statistics(schedule_type* schedule, struct schedule_histogram* depth, struct schedule_histogram* wait, struct schedule_histogram* run, unsigned long* skipped);
+
+/**
+ * Called by task_perform() when a task has been performed, with the time
+ * in milliseconds it took.
+ */
+void schedule_task_finished(schedule_type* schedule, long runtime);
+
 /**
  * Wake up all threads waiting for tasks. Useful to on program teardown.
  */
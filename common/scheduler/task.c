@@ -33,6 +33,7 @@
 
 #include <string.h>
 #include <pthread.h>
+#include <time.h>
 
 #include "scheduler/task.h"
 #include "scheduler/schedule.h"
@@ -83,6 +84,8 @@ task_create(const char *owner, char const *class, char const *type,
     task->freedata = freedata;
     task->due_date = due_date;
     task->lock = NULL;
+    task->locked = 0;
+    task->queued = 0;
 
     task->backoff = 0;
 
@@ -104,13 +107,17 @@ task_perform(schedule_type* scheduler, task_type* task, void* context)
 {
     time_t rescheduleTime;
     ods_status status;
+    struct timespec start, end;
 
+    clock_gettime(CLOCK_MONOTONIC, &start);
     if (task->callback) {
         if (task->lock) {
-            pthread_mutex_lock(task->lock);
+            if (!task->locked)
+                pthread_mutex_lock(task->lock);
             ods_log_debug("START TASK: %s %s", task->owner, task->type);
             rescheduleTime = task->callback(task, task->owner, task->userdata, context);
             ods_log_debug("END TASK: %s %s", task->owner, task->type);
+            task->locked = 0;
             pthread_mutex_unlock(task->lock);
         } else {
             ods_log_debug("START TASK WITHOUT LOCK");
@@ -118,8 +125,14 @@ task_perform(schedule_type* scheduler, task_type* task, void* context)
         }
     } else {
         /* We'll allow a task without callback, just don't reschedule. */
+        if (task->locked) {
+            task->locked = 0;
+            pthread_mutex_unlock(task->lock);
+        }
         rescheduleTime = schedule_SUCCESS;
     }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    schedule_task_finished(scheduler, (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000);
     if (rescheduleTime == schedule_PROMPTLY) {
         rescheduleTime = time_now();
     } else if (rescheduleTime == schedule_IMMEDIATELY) {
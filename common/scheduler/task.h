@@ -86,6 +86,13 @@ struct task_struct {
      * get the same lock. */
     pthread_mutex_t *lock;
 
+    /* Set when the scheduler already acquired the lock when handing out
+     * the task, task_perform() then does not lock it again. */
+    int locked;
+
+    /* Time the task was put in the queue, to measure waiting times. */
+    time_t queued;
+
     time_t backoff;
 };
 
@@ -65,6 +65,7 @@ enum ods_enum_status {
     ODS_STATUS_SOCK_GETADDRINFO,
     ODS_STATUS_SOCK_LISTEN,
     ODS_STATUS_SOCK_SETSOCKOPT_V6ONLY,
+    ODS_STATUS_SOCK_SETSOCKOPT_REUSEPORT,
     ODS_STATUS_SOCK_SOCKET_UDP,
     ODS_STATUS_SOCK_SOCKET_TCP,
 
@@ -60,11 +60,31 @@ help(int sockfd)
 {
 	client_printf(sockfd,
 		"queue shows all scheduled tasks with their time of earliest executions,\n"
-		"as well as all tasks currently being processed."
+		"as well as all tasks currently being processed.\n"
+		"It also shows histograms of the number of tasks queued and the time\n"
+		"tasks waited and took to run."
 		"\n\n"
 	);
 }
 
+static void
+printhistogram(int sockfd, const char* title, const char* unit, struct schedule_histogram* histogram)
+{
+	int i;
+	unsigned long low, high;
+	client_printf(sockfd, "%s (%lu samples):\n", title, histogram->count);
+	for (i = 0; i < SCHEDULE_HISTOGRAM_SIZE; i++) {
+		if (histogram->buckets[i] == 0)
+			continue;
+		low = (i == 0 ? 0 : 1UL << (i - 1));
+		high = (i == 0 ? 0 : (1UL << i) - 1);
+		if (i == SCHEDULE_HISTOGRAM_SIZE - 1)
+			client_printf(sockfd, "  %8lu %-12s %lu\n", low, "or more", histogram->buckets[i]);
+		else
+			client_printf(sockfd, "  %8lu - %-8lu %-2s %lu\n", low, high, unit, histogram->buckets[i]);
+	}
+}
+
 static int
 run(int sockfd, cmdhandler_ctx_type* context, char *cmd)
 {
@@ -75,6 +95,8 @@ run(int sockfd, cmdhandler_ctx_type* context, char *cmd)
         int count;
 	time_t now;
 	time_t nextFireTime;
+	struct schedule_histogram hdepth, hwait, hrun;
+	unsigned long skipped;
 	ldns_rbnode_t* node = LDNS_RBTREE_NULL;
 	task_type* task = NULL;
 	int num_waiting;
@@ -118,6 +140,13 @@ run(int sockfd, cmdhandler_ctx_type* context, char *cmd)
 			node = ldns_rbtree_next(node);
 		}
 	pthread_mutex_unlock(&engine->taskq->schedule_lock);
+
+	/* statistics */
+	schedule_statistics(engine->taskq, &hdepth, &hwait, &hrun, &skipped);
+	printhistogram(sockfd, "Tasks queued when dispatching a task", "", &hdepth);
+	printhistogram(sockfd, "Time tasks waited after being due", "s", &hwait);
+	printhistogram(sockfd, "Time tasks took to run", "ms", &hrun);
+	client_printf(sockfd, "Tasks passed over because their zone was busy: %lu\n", skipped);
 	return 0;
 }
 
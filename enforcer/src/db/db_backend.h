@@ -269,6 +269,27 @@ int db_backend_handle_delete(const db_backend_handle_t* backend_handle, const db
  */
 int db_backend_handle_count(const db_backend_handle_t* backend_handle, const db_object_t* object, const db_join_list_t* join_list, const db_clause_list_t* clause_list, size_t* count);
 
+/**
+ * Begin a transaction on the database.
+ * \param[in] backend_handle a db_backend_handle_t pointer.
+ * \return DB_ERROR_* on failure, otherwise DB_OK.
+ */
+int db_backend_handle_transaction_begin(const db_backend_handle_t* backend_handle);
+
+/**
+ * Commit the current transaction on the database.
+ * \param[in] backend_handle a db_backend_handle_t pointer.
+ * \return DB_ERROR_* on failure, otherwise DB_OK.
+ */
+int db_backend_handle_transaction_commit(const db_backend_handle_t* backend_handle);
+
+/**
+ * Roll back the current transaction on the database.
+ * \param[in] backend_handle a db_backend_handle_t pointer.
+ * \return DB_ERROR_* on failure, otherwise DB_OK.
+ */
+int db_backend_handle_transaction_rollback(const db_backend_handle_t* backend_handle);
+
 /**
  * Set the initialize function of a database backend handle.
  * \param[in] backend_handle a db_backend_handle_t pointer.
@@ -501,6 +522,27 @@ int db_backend_delete(const db_backend_t* backend, const db_object_t* object, co
  */
 int db_backend_count(const db_backend_t* backend, const db_object_t* object, const db_join_list_t* join_list, const db_clause_list_t* clause_list, size_t* count);
 
+/**
+ * Begin a transaction on the database.
+ * \param[in] backend a db_backend_t pointer.
+ * \return DB_ERROR_* on failure, otherwise DB_OK.
+ */
+int db_backend_transaction_begin(const db_backend_t* backend);
+
+/**
+ * Commit the current transaction on the database.
+ * \param[in] backend a db_backend_t pointer.
+ * \return DB_ERROR_* on failure, otherwise DB_OK.
+ */
+int db_backend_transaction_commit(const db_backend_t* backend);
+
+/**
+ * Roll back the current transaction on the database.
+ * \param[in] backend a db_backend_t pointer.
+ * \return DB_ERROR_* on failure, otherwise DB_OK.
+ */
+int db_backend_transaction_rollback(const db_backend_t* backend);
+
 /**
  * Get a new database backend by the name supplied in `name`.
  * \param[in] name a character pointer.
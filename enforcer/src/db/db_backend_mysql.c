@@ -51,10 +51,13 @@ static int __mysql_initialized = 0;
 /**
  * The MySQL database backend specific data.
  */
+typedef struct db_backend_mysql_statement db_backend_mysql_statement_t;
 typedef struct db_backend_mysql {
     MYSQL* db;
     int transaction;
     unsigned int timeout;
+    db_backend_mysql_statement_t* cache;
+    size_t cached;
 } db_backend_mysql_t;
 
 
@@ -75,8 +78,18 @@ struct db_backend_mysql_bind {
 
 /**
  * The MySQL database backend specific data for statements.
+ *
+ * Prepared statements are kept in the statement cache of the connection, keyed
+ * by their SQL which identifies the object, the operation and the shape of the
+ * clauses since all values are bound. A cached statement is marked as used
+ * while it is handed out.
  */
-typedef struct db_backend_mysql_statement {
+struct db_backend_mysql_statement {
+    db_backend_mysql_statement_t* next;
+    char* sql;
+    unsigned int hash;
+    int cached;
+    int used;
     db_backend_mysql_t* backend_mysql;
     MYSQL_STMT* statement;
     MYSQL_BIND* mysql_bind_input;
@@ -88,16 +101,16 @@ typedef struct db_backend_mysql_statement {
     db_object_field_list_t* object_field_list;
     int fields;
     int bound;
-} db_backend_mysql_statement_t;
+};
 
 
 
 /**
- * MySQL finish function.
+ * MySQL free function.
  *
  * Frees all data related to a db_backend_mysql_statement_t.
  */
-static inline void __db_backend_mysql_finish(db_backend_mysql_statement_t* statement) {
+static inline void __db_backend_mysql_free(db_backend_mysql_statement_t* statement) {
     db_backend_mysql_bind_t* bind;
 
     if (!statement) {
@@ -129,17 +142,73 @@ static inline void __db_backend_mysql_finish(db_backend_mysql_statement_t* state
     if (statement->object_field_list) {
         db_object_field_list_free(statement->object_field_list);
     }
+    free(statement->sql);
 
     free(statement);
 }
 
+/**
+ * MySQL finish function.
+ *
+ * Returns a statement from the statement cache to the cache, any pending
+ * result is discarded and the output is bound again on the next fetch. Other
+ * statements are freed.
+ */
+static inline void __db_backend_mysql_finish(db_backend_mysql_statement_t* statement) {
+    if (!statement) {
+        return;
+    }
+
+    if (statement->cached) {
+        mysql_stmt_free_result(statement->statement);
+        statement->bound = 0;
+        statement->used = 0;
+        return;
+    }
+    __db_backend_mysql_free(statement);
+}
+
+/**
+ * Empty the statement cache. Statements that are still in use are only
+ * removed from the cache and will be freed when they are finished.
+ */
+static void __db_backend_mysql_cache_clear(db_backend_mysql_t* backend_mysql) {
+    db_backend_mysql_statement_t* statement;
+
+    while ((statement = backend_mysql->cache)) {
+        backend_mysql->cache = statement->next;
+        statement->next = NULL;
+        statement->cached = 0;
+        if (!statement->used) {
+            __db_backend_mysql_free(statement);
+        }
+    }
+    backend_mysql->cached = 0;
+}
+
+/**
+ * Hash the SQL of a statement for the statement cache.
+ */
+static inline unsigned int __db_backend_mysql_hash(const char* sql) {
+    unsigned int hash = 5381;
+
+    while (*sql) {
+        hash = hash * 33 + (unsigned char)*sql++;
+    }
+    return hash;
+}
+
 /**
  * MySQL prepare function.
  *
  * Creates a db_backend_mysql_statement_t based on a SQL string and an object
- * field list.
+ * field list, or takes it from the statement cache if one with the same SQL is
+ * not in use. New statements are added to the cache as long as there is room
+ * left.
  */
 static inline int __db_backend_mysql_prepare(db_backend_mysql_t* backend_mysql, db_backend_mysql_statement_t** statement, const char* sql, size_t size, const db_object_field_list_t* object_field_list) {
+    db_backend_mysql_statement_t* cached;
+    unsigned int hash;
     unsigned long i, params;
     db_backend_mysql_bind_t* bind;
     const db_object_field_t* object_field;
@@ -163,10 +232,22 @@ static inline int __db_backend_mysql_prepare(db_backend_mysql_t* backend_mysql,
         return DB_ERROR_UNKNOWN;
     }
 
+    ods_log_debug("%s", sql);
+    hash = __db_backend_mysql_hash(sql);
+    for (cached = backend_mysql->cache; cached; cached = cached->next) {
+        if (!cached->used
+            && cached->hash == hash
+            && !strcmp(cached->sql, sql))
+        {
+            cached->used = 1;
+            *statement = cached;
+            return DB_OK;
+        }
+    }
+
     /*
      * Prepare the statement.
      */
-    ods_log_debug("%s", sql);
     if (!(*statement = calloc(1, sizeof(db_backend_mysql_statement_t)))
         || !((*statement)->statement = mysql_stmt_init(backend_mysql->db))
         || mysql_stmt_prepare((*statement)->statement, sql, size))
@@ -500,6 +581,17 @@ static inline int __db_backend_mysql_prepare(db_backend_mysql_t* backend_mysql,
         mysql_free_result(result_metadata);
     }
 
+    if (backend_mysql->cached < DB_BACKEND_MYSQL_STATEMENT_CACHE_SIZE
+        && ((*statement)->sql = strdup(sql)))
+    {
+        (*statement)->hash = hash;
+        (*statement)->cached = 1;
+        (*statement)->used = 1;
+        (*statement)->next = backend_mysql->cache;
+        backend_mysql->cache = *statement;
+        backend_mysql->cached++;
+    }
+
     return DB_OK;
 }
 
@@ -740,6 +832,7 @@ static int db_backend_mysql_disconnect(void* data) {
     if (backend_mysql->transaction) {
         db_backend_mysql_transaction_rollback(backend_mysql);
     }
+    __db_backend_mysql_cache_clear(backend_mysql);
 
     mysql_close(backend_mysql->db);
     backend_mysql->db = NULL;
@@ -2130,8 +2223,6 @@ static void db_backend_mysql_free(void* data) {
 
 static int db_backend_mysql_transaction_begin(void* data) {
     db_backend_mysql_t* backend_mysql = (db_backend_mysql_t*)data;
-    static const char* sql = "BEGIN TRANSACTION";
-    db_backend_mysql_statement_t* statement = NULL;
 
     if (!__mysql_initialized) {
         return DB_ERROR_UNKNOWN;
@@ -2139,19 +2230,18 @@ static int db_backend_mysql_transaction_begin(void* data) {
     if (!backend_mysql) {
         return DB_ERROR_UNKNOWN;
     }
-    if (backend_mysql->transaction) {
+    if (!backend_mysql->db) {
         return DB_ERROR_UNKNOWN;
     }
-
-    if (__db_backend_mysql_prepare(backend_mysql, &statement, sql, strlen(sql), NULL)) {
+    if (backend_mysql->transaction) {
         return DB_ERROR_UNKNOWN;
     }
 
-    if (__db_backend_mysql_execute(statement)) {
-        __db_backend_mysql_finish(statement);
+    ods_log_debug("START TRANSACTION");
+    if (mysql_autocommit(backend_mysql->db, 0)) {
+        ods_log_info("DB transaction Err %d: %s", mysql_errno(backend_mysql->db), mysql_error(backend_mysql->db));
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_mysql_finish(statement);
 
     backend_mysql->transaction = 1;
     return DB_OK;
@@ -2159,8 +2249,6 @@ static int db_backend_mysql_transaction_begin(void* data) {
 
 static int db_backend_mysql_transaction_commit(void* data) {
     db_backend_mysql_t* backend_mysql = (db_backend_mysql_t*)data;
-    static const char* sql = "COMMIT TRANSACTION";
-    db_backend_mysql_statement_t* statement = NULL;
 
     if (!__mysql_initialized) {
         return DB_ERROR_UNKNOWN;
@@ -2168,19 +2256,20 @@ static int db_backend_mysql_transaction_commit(void* data) {
     if (!backend_mysql) {
         return DB_ERROR_UNKNOWN;
     }
-    if (!backend_mysql->transaction) {
+    if (!backend_mysql->db) {
         return DB_ERROR_UNKNOWN;
     }
-
-    if (__db_backend_mysql_prepare(backend_mysql, &statement, sql, strlen(sql), NULL)) {
+    if (!backend_mysql->transaction) {
         return DB_ERROR_UNKNOWN;
     }
 
-    if (__db_backend_mysql_execute(statement)) {
-        __db_backend_mysql_finish(statement);
+    ods_log_debug("COMMIT");
+    if (mysql_commit(backend_mysql->db)
+        || mysql_autocommit(backend_mysql->db, 1))
+    {
+        ods_log_info("DB transaction Err %d: %s", mysql_errno(backend_mysql->db), mysql_error(backend_mysql->db));
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_mysql_finish(statement);
 
     backend_mysql->transaction = 0;
     return DB_OK;
@@ -2188,8 +2277,6 @@ static int db_backend_mysql_transaction_commit(void* data) {
 
 static int db_backend_mysql_transaction_rollback(void* data) {
     db_backend_mysql_t* backend_mysql = (db_backend_mysql_t*)data;
-    static const char* sql = "ROLLBACK TRANSACTION";
-    db_backend_mysql_statement_t* statement = NULL;
 
     if (!__mysql_initialized) {
         return DB_ERROR_UNKNOWN;
@@ -2197,19 +2284,20 @@ static int db_backend_mysql_transaction_rollback(void* data) {
     if (!backend_mysql) {
         return DB_ERROR_UNKNOWN;
     }
-    if (!backend_mysql->transaction) {
+    if (!backend_mysql->db) {
         return DB_ERROR_UNKNOWN;
     }
-
-    if (__db_backend_mysql_prepare(backend_mysql, &statement, sql, strlen(sql), NULL)) {
+    if (!backend_mysql->transaction) {
         return DB_ERROR_UNKNOWN;
     }
 
-    if (__db_backend_mysql_execute(statement)) {
-        __db_backend_mysql_finish(statement);
+    ods_log_debug("ROLLBACK");
+    if (mysql_rollback(backend_mysql->db)
+        || mysql_autocommit(backend_mysql->db, 1))
+    {
+        ods_log_info("DB transaction Err %d: %s", mysql_errno(backend_mysql->db), mysql_error(backend_mysql->db));
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_mysql_finish(statement);
 
     backend_mysql->transaction = 0;
     return DB_OK;
@@ -35,6 +35,7 @@
 #define DB_BACKEND_MYSQL_DEFAULT_TIMEOUT 30
 #define DB_BACKEND_MYSQL_STRING_MIN_SIZE 64
 #define DB_BACKEND_MYSQL_STRING_MAX_SIZE 4096
+#define DB_BACKEND_MYSQL_STATEMENT_CACHE_SIZE 64
 
 /**
  * Create a new database backend handle for SQLite.
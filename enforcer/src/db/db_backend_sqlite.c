@@ -63,16 +63,37 @@ static pthread_cond_t __sqlite_cond = PTHREAD_COND_INITIALIZER;
 /**
  * The SQLite database backend specific data.
  */
+typedef struct db_backend_sqlite_cached db_backend_sqlite_cached_t;
 typedef struct db_backend_sqlite {
     sqlite3* db;
     int transaction;
     int timeout;
     int time;
     long usleep;
+    db_backend_sqlite_cached_t* cache;
+    size_t cached;
 } db_backend_sqlite_t;
 
 
 
+/**
+ * A prepared SQLite statement kept in the statement cache of a connection.
+ *
+ * All values are bound to the statements so the SQL identifies the object,
+ * the operation and the shape of the clauses, it is used as the key. A
+ * statement is marked as used while it is handed out, reading the same SQL
+ * twice at the same time prepares a second statement.
+ */
+struct db_backend_sqlite_cached {
+    db_backend_sqlite_cached_t* next;
+    sqlite3_stmt* statement;
+    char* sql;
+    unsigned int hash;
+    int used;
+};
+
+
+
 /**
  * The SQLite database backend specific data for walking a result.
  */
@@ -136,10 +157,28 @@ static int __db_backend_sqlite_busy_handler(void *data, int retry) {
     return 1;
 }
 
+/**
+ * Hash the SQL of a statement for the statement cache.
+ */
+static inline unsigned int __db_backend_sqlite_hash(const char* sql) {
+    unsigned int hash = 5381;
+
+    while (*sql) {
+        hash = hash * 33 + (unsigned char)*sql++;
+    }
+    return hash;
+}
+
 /**
  * SQLite prepare function.
+ *
+ * Statements are taken from the statement cache of the connection if one with
+ * the same SQL is not in use, otherwise a new statement is prepared and added
+ * to the cache as long as there is room left.
  */
 static inline int __db_backend_sqlite_prepare(db_backend_sqlite_t* backend_sqlite, sqlite3_stmt** statement, const char* sql, size_t size) {
+    db_backend_sqlite_cached_t* cached;
+    unsigned int hash;
     int ret;
 
     if (!backend_sqlite) {
@@ -160,6 +199,19 @@ static inline int __db_backend_sqlite_prepare(db_backend_sqlite_t* backend_sqlit
 
     ods_log_debug("%s", sql);
     backend_sqlite->time = time(NULL);
+
+    hash = __db_backend_sqlite_hash(sql);
+    for (cached = backend_sqlite->cache; cached; cached = cached->next) {
+        if (!cached->used
+            && cached->hash == hash
+            && !strcmp(cached->sql, sql))
+        {
+            cached->used = 1;
+            *statement = cached->statement;
+            return DB_OK;
+        }
+    }
+
     ret = sqlite3_prepare_v2(backend_sqlite->db,
         sql,
         size,
@@ -175,6 +227,21 @@ static inline int __db_backend_sqlite_prepare(db_backend_sqlite_t* backend_sqlit
         return DB_ERROR_UNKNOWN;
     }
 
+    if (backend_sqlite->cached < DB_BACKEND_SQLITE_STATEMENT_CACHE_SIZE
+        && (cached = calloc(1, sizeof(db_backend_sqlite_cached_t))))
+    {
+        if (!(cached->sql = strdup(sql))) {
+            free(cached);
+            return DB_OK;
+        }
+        cached->statement = *statement;
+        cached->hash = hash;
+        cached->used = 1;
+        cached->next = backend_sqlite->cache;
+        backend_sqlite->cache = cached;
+        backend_sqlite->cached++;
+    }
+
     return DB_OK;
 }
 
@@ -239,17 +306,50 @@ static inline int __db_backend_sqlite_step(db_backend_sqlite_t* backend_sqlite,
 /**
  * SQLite finalize function.
  *
- * This will also signal the pthread cond that is used for busy handler.
+ * Statements from the statement cache are reset and returned to the cache,
+ * others are finalized. This will also signal the pthread cond that is used
+ * for busy handler.
  */
-static inline int __db_backend_sqlite_finalize(sqlite3_stmt* statement) {
+static inline int __db_backend_sqlite_finalize(db_backend_sqlite_t* backend_sqlite, sqlite3_stmt* statement) {
+    db_backend_sqlite_cached_t* cached;
     int ret;
 
-    ret = sqlite3_finalize(statement);
+    for (cached = backend_sqlite->cache; cached; cached = cached->next) {
+        if (cached->statement == statement) {
+            break;
+        }
+    }
+    if (cached) {
+        ret = sqlite3_reset(statement);
+        sqlite3_clear_bindings(statement);
+        cached->used = 0;
+    }
+    else {
+        ret = sqlite3_finalize(statement);
+    }
     pthread_cond_broadcast(&__sqlite_cond);
 
     return ret;
 }
 
+/**
+ * Empty the statement cache. Statements that are still in use are only
+ * removed from the cache and will be finalized when they are done with.
+ */
+static void __db_backend_sqlite_cache_clear(db_backend_sqlite_t* backend_sqlite) {
+    db_backend_sqlite_cached_t* cached;
+
+    while ((cached = backend_sqlite->cache)) {
+        backend_sqlite->cache = cached->next;
+        if (!cached->used) {
+            sqlite3_finalize(cached->statement);
+        }
+        free(cached->sql);
+        free(cached);
+    }
+    backend_sqlite->cached = 0;
+}
+
 static int db_backend_sqlite_initialize(void* data) {
     db_backend_sqlite_t* backend_sqlite = (db_backend_sqlite_t*)data;
 
@@ -365,6 +465,7 @@ static int db_backend_sqlite_disconnect(void* data) {
     if (backend_sqlite->transaction) {
         db_backend_sqlite_transaction_rollback(backend_sqlite);
     }
+    __db_backend_sqlite_cache_clear(backend_sqlite);
     ret = sqlite3_close(backend_sqlite->db);
     if (ret != SQLITE_OK) {
         return DB_ERROR_UNKNOWN;
@@ -679,7 +780,7 @@ static db_result_t* db_backend_sqlite_next(void* data, int finish) {
     }
 
     if (finish) {
-        __db_backend_sqlite_finalize(statement->statement);
+        __db_backend_sqlite_finalize(statement->backend_sqlite, statement->statement);
         free(statement);
         return NULL;
     }
@@ -833,16 +934,16 @@ db_backend_sqlite_last_id(void* data, int *last_id)
     }
     int ret = __db_backend_sqlite_step(backend_sqlite, statement);
     if (ret != SQLITE_DONE && ret != SQLITE_ROW) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
     *last_id = sqlite3_column_int(statement, 0);
     ret = sqlite3_errcode(backend_sqlite->db);
     if ((ret != SQLITE_OK && ret != SQLITE_ROW && ret != SQLITE_DONE)) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
     return DB_OK;
 }
 
@@ -1028,59 +1129,59 @@ static int db_backend_sqlite_create(void* data, const db_object_t* object, const
     bind = 1;
     for (value_pos = 0; value_pos < db_value_set_size(value_set); value_pos++) {
         if (!(value = db_value_set_at(value_set, value_pos))) {
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
 
         switch (db_value_type(value)) {
         case DB_TYPE_INT32:
             if (db_value_to_int32(value, &int32)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int = int32;
             ret = sqlite3_bind_int(statement, bind++, to_int);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_UINT32:
             if (db_value_to_uint32(value, &uint32)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int = uint32;
             ret = sqlite3_bind_int(statement, bind++, to_int);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_INT64:
             if (db_value_to_int64(value, &int64)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int64 = int64;
             ret = sqlite3_bind_int64(statement, bind++, to_int64);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_UINT64:
             if (db_value_to_uint64(value, &uint64)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int64 = uint64;
             ret = sqlite3_bind_int64(statement, bind++, to_int64);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
@@ -1088,25 +1189,25 @@ static int db_backend_sqlite_create(void* data, const db_object_t* object, const
         case DB_TYPE_TEXT:
             ret = sqlite3_bind_text(statement, bind++, db_value_text(value), -1, SQLITE_TRANSIENT);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_ENUM:
             if (db_value_enum_value(value, &to_int)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             ret = sqlite3_bind_int(statement, bind++, to_int);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         default:
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
     }
@@ -1117,7 +1218,7 @@ static int db_backend_sqlite_create(void* data, const db_object_t* object, const
     if (revision_field) {
         ret = sqlite3_bind_int(statement, bind++, 1);
         if (ret != SQLITE_OK) {
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
     }
@@ -1126,10 +1227,10 @@ static int db_backend_sqlite_create(void* data, const db_object_t* object, const
      * Execute the SQL.
      */
     if (__db_backend_sqlite_step(backend_sqlite, statement) != SQLITE_DONE) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
 
     return DB_OK;
 }
@@ -1240,7 +1341,7 @@ static db_result_list_t* db_backend_sqlite_read(void* data, const db_object_t* o
     if (clause_list) {
         bind = 1;
         if (__db_backend_sqlite_bind_clause(statement->statement, clause_list, &bind)) {
-            __db_backend_sqlite_finalize(statement->statement);
+            __db_backend_sqlite_finalize(statement->backend_sqlite, statement->statement);
             free(statement);
             return NULL;
         }
@@ -1250,7 +1351,7 @@ static db_result_list_t* db_backend_sqlite_read(void* data, const db_object_t* o
         || db_result_list_set_next(result_list, db_backend_sqlite_next, statement, 0))
     {
         db_result_list_free(result_list);
-        __db_backend_sqlite_finalize(statement->statement);
+        __db_backend_sqlite_finalize(statement->backend_sqlite, statement->statement);
         free(statement);
         return NULL;
     }
@@ -1441,59 +1542,59 @@ static int db_backend_sqlite_update(void* data, const db_object_t* object, const
     bind = 1;
     for (value_pos = 0; value_pos < db_value_set_size(value_set); value_pos++) {
         if (!(value = db_value_set_at(value_set, value_pos))) {
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
 
         switch (db_value_type(value)) {
         case DB_TYPE_INT32:
             if (db_value_to_int32(value, &int32)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int = int32;
             ret = sqlite3_bind_int(statement, bind++, to_int);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_UINT32:
             if (db_value_to_uint32(value, &uint32)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int = uint32;
             ret = sqlite3_bind_int(statement, bind++, to_int);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_INT64:
             if (db_value_to_int64(value, &int64)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int64 = int64;
             ret = sqlite3_bind_int64(statement, bind++, to_int64);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_UINT64:
             if (db_value_to_uint64(value, &uint64)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int64 = uint64;
             ret = sqlite3_bind_int64(statement, bind++, to_int64);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
@@ -1501,25 +1602,25 @@ static int db_backend_sqlite_update(void* data, const db_object_t* object, const
         case DB_TYPE_TEXT:
             ret = sqlite3_bind_text(statement, bind++, db_value_text(value), -1, SQLITE_TRANSIENT);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_ENUM:
             if (db_value_enum_value(value, &to_int)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             ret = sqlite3_bind_int(statement, bind++, to_int);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         default:
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
     }
@@ -1530,7 +1631,7 @@ static int db_backend_sqlite_update(void* data, const db_object_t* object, const
     if (revision_field) {
         ret = sqlite3_bind_int64(statement, bind++, revision_number + 1);
         if (ret != SQLITE_OK) {
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
     }
@@ -1540,7 +1641,7 @@ static int db_backend_sqlite_update(void* data, const db_object_t* object, const
      */
     if (clause_list) {
         if (__db_backend_sqlite_bind_clause(statement, clause_list, &bind)) {
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
     }
@@ -1549,10 +1650,10 @@ static int db_backend_sqlite_update(void* data, const db_object_t* object, const
      * Execute the SQL.
      */
     if (__db_backend_sqlite_step(backend_sqlite, statement) != SQLITE_DONE) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
 
     /*
      * If we are using revision we have to have a positive number of changes
@@ -1651,16 +1752,16 @@ static int db_backend_sqlite_delete(void* data, const db_object_t* object, const
     if (clause_list) {
         bind = 1;
         if (__db_backend_sqlite_bind_clause(statement, clause_list, &bind)) {
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
     }
 
     if (__db_backend_sqlite_step(backend_sqlite, statement) != SQLITE_DONE) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
 
     /*
      * If we are using revision we have to have a positive number of changes
@@ -1751,26 +1852,26 @@ static int db_backend_sqlite_count(void* data, const db_object_t* object, const
     if (clause_list) {
         bind = 1;
         if (__db_backend_sqlite_bind_clause(statement, clause_list, &bind)) {
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
     }
 
     ret = __db_backend_sqlite_step(backend_sqlite, statement);
     if (ret != SQLITE_DONE && ret != SQLITE_ROW) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
 
     sqlite_count = sqlite3_column_int(statement, 0);
     ret = sqlite3_errcode(backend_sqlite->db);
     if ((ret != SQLITE_OK && ret != SQLITE_ROW && ret != SQLITE_DONE)) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
 
     *count = sqlite_count;
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
     return DB_OK;
 }
 
@@ -1805,10 +1906,10 @@ static int db_backend_sqlite_transaction_begin(void* data) {
     }
 
     if (__db_backend_sqlite_step(backend_sqlite, statement) != SQLITE_DONE) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
 
     backend_sqlite->transaction = 1;
     return DB_OK;
@@ -1834,10 +1935,10 @@ static int db_backend_sqlite_transaction_commit(void* data) {
     }
 
     if (__db_backend_sqlite_step(backend_sqlite, statement) != SQLITE_DONE) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
 
     backend_sqlite->transaction = 0;
     return DB_OK;
@@ -1863,10 +1964,10 @@ static int db_backend_sqlite_transaction_rollback(void* data) {
     }
 
     if (__db_backend_sqlite_step(backend_sqlite, statement) != SQLITE_DONE) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
 
     backend_sqlite->transaction = 0;
     return DB_OK;
@@ -194,3 +194,36 @@ int db_connection_count(const db_connection_t* connection, const db_object_t* ob
 
     return db_backend_count(connection->backend, object, join_list, clause_list, count);
 }
+
+int db_connection_transaction_begin(const db_connection_t* connection) {
+    if (!connection) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (!connection->backend) {
+        return DB_ERROR_UNKNOWN;
+    }
+
+    return db_backend_transaction_begin(connection->backend);
+}
+
+int db_connection_transaction_commit(const db_connection_t* connection) {
+    if (!connection) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (!connection->backend) {
+        return DB_ERROR_UNKNOWN;
+    }
+
+    return db_backend_transaction_commit(connection->backend);
+}
+
+int db_connection_transaction_rollback(const db_connection_t* connection) {
+    if (!connection) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (!connection->backend) {
+        return DB_ERROR_UNKNOWN;
+    }
+
+    return db_backend_transaction_rollback(connection->backend);
+}
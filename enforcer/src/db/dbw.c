@@ -12,6 +12,9 @@
 
 static pthread_rwlock_t db_lock = PTHREAD_RWLOCK_INITIALIZER;
 
+/* Number of rows of which the revision is verified with a single query. */
+#define DBW_REVISION_BATCH 64
+
 const char *
 dbw_enum2txt(const char *c[], int n)
 {
@@ -135,76 +138,6 @@ dbxvalue2int(struct db_value const *val)
     }
 }
 
-static int dbw_policy_revision(const db_connection_t *dbconn, struct db_value *id)
-{
-    policy_t *dbx_obj = policy_new(dbconn);
-    int rev = -1;
-    if (dbx_obj && !policy_get_by_id(dbx_obj, id))
-        rev = dbxvalue2int(&dbx_obj->rev);
-    policy_free(dbx_obj);
-    return rev;
-}
-
-static int dbw_policykey_revision(const db_connection_t *dbconn, struct db_value *id)
-{
-    policy_key_t *dbx_obj = policy_key_new(dbconn);
-    int rev = -1;
-    if (dbx_obj && !policy_key_get_by_id(dbx_obj, id))
-        rev = dbxvalue2int(&dbx_obj->rev);
-    policy_key_free(dbx_obj);
-    return rev;
-}
-
-static int dbw_zone_revision(const db_connection_t *dbconn, struct db_value *id)
-{
-    zone_db_t *dbx_obj = zone_db_new(dbconn);
-    int rev = -1;
-    if (dbx_obj && !zone_db_get_by_id(dbx_obj, id))
-        rev = dbxvalue2int(&dbx_obj->rev);
-    zone_db_free(dbx_obj);
-    return rev;
-}
-
-static int dbw_key_revision(const db_connection_t *dbconn, struct db_value *id)
-{
-    key_data_t *dbx_obj = key_data_new(dbconn);
-    int rev = -1;
-    if (dbx_obj && !key_data_get_by_id(dbx_obj, id))
-        rev = dbxvalue2int(&dbx_obj->rev);
-    key_data_free(dbx_obj);
-    return rev;
-}
-
-static int dbw_keystate_revision(const db_connection_t *dbconn, struct db_value *id)
-{
-    key_state_t *dbx_obj = key_state_new(dbconn);
-    int rev = -1;
-    if (dbx_obj && !key_state_get_by_id(dbx_obj, id))
-        rev = dbxvalue2int(&dbx_obj->rev);
-    key_state_free(dbx_obj);
-    return rev;
-}
-
-static int dbw_keydependency_revision(const db_connection_t *dbconn, struct db_value *id)
-{
-    key_dependency_t *dbx_obj = key_dependency_new(dbconn);
-    int rev = -1;
-    if (dbx_obj && !key_dependency_get_by_id(dbx_obj, id))
-        rev = dbxvalue2int(&dbx_obj->rev);
-    key_dependency_free(dbx_obj);
-    return rev;
-}
-
-static int dbw_hsmkey_revision(const db_connection_t *dbconn, struct db_value *id)
-{
-    hsm_key_t *dbx_obj = hsm_key_new(dbconn);
-    int rev = -1;
-    if (dbx_obj && !hsm_key_get_by_id(dbx_obj, id))
-        rev = dbxvalue2int(&dbx_obj->rev);
-    hsm_key_free(dbx_obj);
-    return rev;
-}
-
 static int
 dbw_policy_update(const db_connection_t *dbconn, struct dbrow *row)
 {
@@ -994,7 +927,7 @@ dbw_zones(db_connection_t *dbconn, int fetch)
     }
     list->free = dbw_zone_free;
     list->update = dbw_zone_update;
-    list->revision = dbw_zone_revision;
+    list->table = "zone";
     if (fetch) {
         list->set = calloc(n, sizeof (struct dbw_zone *));
         if (!list->set) {
@@ -1034,7 +967,7 @@ dbw_keys(db_connection_t *dbconn, int fetch)
     }
     list->free = dbw_key_free;
     list->update = dbw_key_update;
-    list->revision = dbw_key_revision;
+    list->table = "keyData";
     if (fetch) {
         list->set = calloc(n, sizeof (struct dbw_key *));
         if (!list->set) {
@@ -1074,7 +1007,7 @@ dbw_keystates(db_connection_t *dbconn, int fetch)
     }
     list->free = dbw_keystate_free;
     list->update = dbw_keystate_update;
-    list->revision = dbw_keystate_revision;
+    list->table = "keyState";
     if (fetch) {
         list->set = calloc(n, sizeof (struct dbw_keystate *));
         if (!list->set) {
@@ -1114,7 +1047,7 @@ dbw_keydependencies(db_connection_t *dbconn, int fetch)
     }
     list->free = dbw_keydependency_free;
     list->update = dbw_keydependency_update;
-    list->revision = dbw_keydependency_revision;
+    list->table = "keyDependency";
     if (fetch) {
     list->set = calloc(n, sizeof (struct dbw_keydependency *));
         if (!list->set) {
@@ -1154,7 +1087,7 @@ dbw_hsmkeys(db_connection_t *dbconn, int fetch)
     }
     list->free = dbw_hsmkey_free;
     list->update = dbw_hsmkey_update;
-    list->revision = dbw_hsmkey_revision;
+    list->table = "hsmKey";
     if (fetch) {
         list->set = calloc(n, sizeof (struct dbw_hsmkey *));
         if (!list->set) {
@@ -1195,7 +1128,7 @@ dbw_policies(db_connection_t *dbconn, int fetch)
     }
     list->free = dbw_policy_free;
     list->update = dbw_policy_update;
-    list->revision = dbw_policy_revision;
+    list->table = "policy";
     if (fetch) {
         list->set = calloc(n, sizeof (struct dbw_policy *));
         if (!list->set) {
@@ -1235,7 +1168,7 @@ dbw_policykeys(db_connection_t *dbconn, int fetch)
     }
     list->free = dbw_policykey_free;
     list->update = dbw_policykey_update;
-    list->revision = dbw_policykey_revision;
+    list->table = "policyKey";
     if (fetch) {
         list->set = calloc(n, sizeof (struct dbw_policykey *));
         if (!list->set) {
@@ -1320,6 +1253,334 @@ dbw_fetch(db_connection_t *conn)
     return dbw_fetch_filtered(conn, DBW_F_ALL);
 }
 
+/**
+ *  ZONE SCOPED FETCHES
+ *
+ *  These append the rows of a single zone (and what it references) to
+ *  otherwise empty lists, so the merge functions can be reused unchanged.
+ */
+
+static int list_add(struct dbw_list *list, struct dbrow *row);
+
+static int
+list_contains(struct dbw_list *list, int id)
+{
+    for (size_t i = 0; i < list->n; i++) {
+        if (list->set[i]->id == id) return 1;
+    }
+    return 0;
+}
+
+static int
+scoped_add_policy(struct dbw_db *db, db_connection_t *conn, int policy_id)
+{
+    struct db_value id;
+    policy_t *dbx_obj;
+    struct dbrow *row;
+
+    if (list_contains(db->policies, policy_id)) return 0;
+    memset(&id, 0, sizeof (id));
+    if (!(dbx_obj = policy_new(conn))) return 1;
+    if (db_value_from_int32(&id, policy_id) || policy_get_by_id(dbx_obj, &id)) {
+        policy_free(dbx_obj);
+        return 1;
+    }
+    row = (struct dbrow *)policy_dbx_to_dbw(dbx_obj);
+    policy_free(dbx_obj);
+    if (!row) return 1;
+    if (list_add(db->policies, row)) {
+        dbw_policy_free(row);
+        return 1;
+    }
+    return 0;
+}
+
+static int
+scoped_add_policykeys(struct dbw_db *db, db_connection_t *conn, int policy_id)
+{
+    struct db_value id;
+    policy_key_list_t *dbx_list;
+    const policy_key_t *dbx_item;
+    struct dbrow *row;
+
+    memset(&id, 0, sizeof (id));
+    if (db_value_from_int32(&id, policy_id)) return 1;
+    if (!(dbx_list = policy_key_list_new_get_by_policy_id(conn, &id))) return 1;
+    while ((dbx_item = policy_key_list_next(dbx_list)) != NULL) {
+        if (!(row = (struct dbrow *)policykey_dbx_to_dbw(dbx_item))
+            || list_add(db->policykeys, row))
+        {
+            dbw_policykey_free(row);
+            policy_key_list_free(dbx_list);
+            return 1;
+        }
+    }
+    policy_key_list_free(dbx_list);
+    return 0;
+}
+
+static int
+scoped_add_keys(struct dbw_db *db, db_connection_t *conn, int zone_id)
+{
+    struct db_value id;
+    key_data_list_t *dbx_list;
+    const key_data_t *dbx_item;
+    struct dbrow *row;
+
+    memset(&id, 0, sizeof (id));
+    if (db_value_from_int32(&id, zone_id)) return 1;
+    if (!(dbx_list = key_data_list_new_get_by_zone_id(conn, &id))) return 1;
+    while ((dbx_item = key_data_list_next(dbx_list)) != NULL) {
+        if (!(row = (struct dbrow *)key_dbx_to_dbw(dbx_item))
+            || list_add(db->keys, row))
+        {
+            dbw_key_free(row);
+            key_data_list_free(dbx_list);
+            return 1;
+        }
+    }
+    key_data_list_free(dbx_list);
+    return 0;
+}
+
+static int
+scoped_add_keystates(struct dbw_db *db, db_connection_t *conn, int key_id)
+{
+    struct db_value id;
+    key_state_list_t *dbx_list;
+    const key_state_t *dbx_item;
+    struct dbrow *row;
+
+    memset(&id, 0, sizeof (id));
+    if (db_value_from_int32(&id, key_id)) return 1;
+    if (!(dbx_list = key_state_list_new_get_by_key_data_id(conn, &id))) return 1;
+    while ((dbx_item = key_state_list_next(dbx_list)) != NULL) {
+        if (!(row = (struct dbrow *)keystate_dbx_to_dbw(dbx_item))
+            || list_add(db->keystates, row))
+        {
+            dbw_keystate_free(row);
+            key_state_list_free(dbx_list);
+            return 1;
+        }
+    }
+    key_state_list_free(dbx_list);
+    return 0;
+}
+
+static int
+scoped_add_keydependencies(struct dbw_db *db, db_connection_t *conn, int zone_id)
+{
+    struct db_value id;
+    key_dependency_list_t *dbx_list;
+    const key_dependency_t *dbx_item;
+    struct dbrow *row;
+
+    memset(&id, 0, sizeof (id));
+    if (db_value_from_int32(&id, zone_id)) return 1;
+    if (!(dbx_list = key_dependency_list_new_get_by_zone_id(conn, &id))) return 1;
+    while ((dbx_item = key_dependency_list_next(dbx_list)) != NULL) {
+        if (!(row = (struct dbrow *)keydependency_dbx_to_dbw(dbx_item))
+            || list_add(db->keydependencies, row))
+        {
+            dbw_keydependency_free(row);
+            key_dependency_list_free(dbx_list);
+            return 1;
+        }
+    }
+    key_dependency_list_free(dbx_list);
+    return 0;
+}
+
+/**
+ * Add a single hsmkey by id. The number of keys of *other* zones using this
+ * hsmkey is recorded in foreign_key_count, since those keys are not fetched.
+ */
+static int
+scoped_add_hsmkey(struct dbw_db *db, db_connection_t *conn, int hsmkey_id)
+{
+    struct db_value id;
+    hsm_key_t *dbx_obj;
+    key_data_t *dbx_key;
+    db_clause_list_t *clause_list;
+    struct dbw_hsmkey *hsmkey;
+    size_t count = 0, local = 0;
+
+    if (list_contains(db->hsmkeys, hsmkey_id)) return 0;
+    memset(&id, 0, sizeof (id));
+    if (!(dbx_obj = hsm_key_new(conn))) return 1;
+    if (db_value_from_int32(&id, hsmkey_id) || hsm_key_get_by_id(dbx_obj, &id)) {
+        hsm_key_free(dbx_obj);
+        return 1;
+    }
+    hsmkey = hsmkey_dbx_to_dbw(dbx_obj);
+    hsm_key_free(dbx_obj);
+    if (!hsmkey) return 1;
+
+    if (!(dbx_key = key_data_new(conn)) || !(clause_list = db_clause_list_new())) {
+        key_data_free(dbx_key);
+        dbw_hsmkey_free((struct dbrow *)hsmkey);
+        return 1;
+    }
+    if (!key_data_hsm_key_id_clause(clause_list, &id)
+        || key_data_count(dbx_key, clause_list, &count))
+    {
+        db_clause_list_free(clause_list);
+        key_data_free(dbx_key);
+        dbw_hsmkey_free((struct dbrow *)hsmkey);
+        return 1;
+    }
+    db_clause_list_free(clause_list);
+    key_data_free(dbx_key);
+    for (size_t k = 0; k < db->keys->n; k++) {
+        if (((struct dbw_key *)db->keys->set[k])->hsmkey_id == hsmkey_id) local++;
+    }
+    hsmkey->foreign_key_count = count > local ? count - local : 0;
+
+    if (list_add(db->hsmkeys, (struct dbrow *)hsmkey)) {
+        dbw_hsmkey_free((struct dbrow *)hsmkey);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Add all hsmkeys of a policy in the given state. Used for the pool of
+ * unused keys and, for shared policies, the keys that may be reused.
+ */
+static int
+scoped_add_hsmkeys_by_state(struct dbw_db *db, db_connection_t *conn,
+    int policy_id, hsm_key_state_t state)
+{
+    struct db_value id;
+    db_clause_list_t *clause_list;
+    hsm_key_list_t *dbx_list;
+    const hsm_key_t *dbx_item;
+    struct dbrow *row;
+
+    memset(&id, 0, sizeof (id));
+    if (db_value_from_int32(&id, policy_id)) return 1;
+    if (!(clause_list = db_clause_list_new())) return 1;
+    if (!hsm_key_policy_id_clause(clause_list, &id)
+        || !hsm_key_state_clause(clause_list, state)
+        || !(dbx_list = hsm_key_list_new_get_by_clauses(conn, clause_list)))
+    {
+        db_clause_list_free(clause_list);
+        return 1;
+    }
+    db_clause_list_free(clause_list);
+    while ((dbx_item = hsm_key_list_next(dbx_list)) != NULL) {
+        if (list_contains(db->hsmkeys, dbxvalue2int(&dbx_item->id))) continue;
+        if (!(row = (struct dbrow *)hsmkey_dbx_to_dbw(dbx_item))
+            || list_add(db->hsmkeys, row))
+        {
+            dbw_hsmkey_free(row);
+            hsm_key_list_free(dbx_list);
+            return 1;
+        }
+    }
+    hsm_key_list_free(dbx_list);
+    return 0;
+}
+
+static int
+dbw_fetch_zone_rows(struct dbw_db *db, db_connection_t *conn,
+    char const *zonename)
+{
+    zone_db_t *dbx_zone;
+    struct dbrow *zone;
+    struct dbw_policy *policy;
+    size_t k;
+
+    if (!(dbx_zone = zone_db_new_get_by_name(conn, zonename))) return 1;
+    zone = (struct dbrow *)zone_dbx_to_dbw(dbx_zone);
+    zone_db_free(dbx_zone);
+    if (!zone) return 1;
+    if (list_add(db->zones, zone)) {
+        dbw_zone_free(zone);
+        return 1;
+    }
+    if (scoped_add_policy(db, conn, ((struct dbw_zone *)zone)->policy_id)
+        || scoped_add_policykeys(db, conn, ((struct dbw_zone *)zone)->policy_id)
+        || scoped_add_keys(db, conn, zone->id)
+        || scoped_add_keydependencies(db, conn, zone->id))
+    {
+        return 1;
+    }
+    for (k = 0; k < db->keys->n; k++) {
+        struct dbw_key *key = (struct dbw_key *)db->keys->set[k];
+        if (scoped_add_keystates(db, conn, key->id)
+            || scoped_add_hsmkey(db, conn, key->hsmkey_id))
+        {
+            return 1;
+        }
+    }
+    /* hsmkeys can outlive a policy change of the zone, make sure every
+     * parent is present so merge() finds it. */
+    for (k = 0; k < db->hsmkeys->n; k++) {
+        struct dbw_hsmkey *hsmkey = (struct dbw_hsmkey *)db->hsmkeys->set[k];
+        if (scoped_add_policy(db, conn, hsmkey->policy_id)) return 1;
+    }
+    policy = (struct dbw_policy *)db->policies->set[0];
+    if (scoped_add_hsmkeys_by_state(db, conn, policy->id, HSM_KEY_STATE_UNUSED))
+        return 1;
+    if (policy->keys_shared &&
+        scoped_add_hsmkeys_by_state(db, conn, policy->id, HSM_KEY_STATE_SHARED))
+    {
+        return 1;
+    }
+    return 0;
+}
+
+struct dbw_db *
+dbw_fetch_zone(db_connection_t *conn, char const *zonename)
+{
+    struct dbw_db *db = calloc(1, sizeof(struct dbw_db));
+    if (!db) {
+        ods_log_error("[dbw_fetch_zone] Memory allocation failure.");
+        return NULL;
+    }
+    db->conn            = conn;
+    db->policies        = dbw_policies(conn, 0);
+    db->zones           = dbw_zones(conn, 0);
+    db->keys            = dbw_keys(conn, 0);
+    db->keystates       = dbw_keystates(conn, 0);
+    db->hsmkeys         = dbw_hsmkeys(conn, 0);
+    db->policykeys      = dbw_policykeys(conn, 0);
+    db->keydependencies = dbw_keydependencies(conn, 0);
+    if (!db->policies || !db->zones || !db->keys || !db->keystates ||
+            !db->hsmkeys || !db->policykeys || !db->keydependencies)
+    {
+        dbw_free(db);
+        ods_log_error("[dbw_fetch_zone] Memory allocation failure.");
+        return NULL;
+    }
+
+    if (pthread_rwlock_rdlock(&db_lock)) {
+        ods_log_error("[dbw_fetch_zone] Unable to obtain database read lock.");
+        dbw_free(db);
+        return NULL;
+    }
+    if (dbw_fetch_zone_rows(db, conn, zonename)) {
+        (void)pthread_rwlock_unlock(&db_lock);
+        dbw_free(db);
+        ods_log_error("[dbw_fetch_zone] Failed to read zone %s from database.",
+            zonename);
+        return NULL;
+    }
+    (void)pthread_rwlock_unlock(&db_lock);
+
+    merge_pl_pk(db->policies, db->policykeys);
+    merge_pl_hk(db->policies, db->hsmkeys);
+    merge_pl_zn(db->policies, db->zones);
+    merge_zn_kd(db->zones,    db->keys);
+    merge_kd_ks(db->keys,     db->keystates);
+    merge_hk_kd(db->hsmkeys,  db->keys);
+    merge_zn_dp(db->zones,    db->keydependencies);
+    merge_kt_dp(db->keys,     db->keydependencies);
+    merge_kf_dp(db->keys,     db->keydependencies);
+    return db;
+}
+
 static int
 dbw_commit_list(const db_connection_t *conn, struct dbw_list *list)
 {
@@ -1328,10 +1589,132 @@ dbw_commit_list(const db_connection_t *conn, struct dbw_list *list)
         if (!row->dirty) continue;
         int r = list->update(conn, row);
         if (r) return r;
+    }
+    return 0;
+}
+
+/**
+ * Mark the rows of a list clean, once the transaction writing them is
+ * committed.
+ */
+static void
+dbw_clean_list(struct dbw_list *list)
+{
+    for (size_t i = 0; i < list->n; i++) {
         /* TODO: if successful, DELETED rows will be clean and dbw_db
          * structure will not be safe to reuse. We should remove these items
          * completely (see lookahead_cmd.c) */
-        row->dirty = DBW_CLEAN;
+        list->set[i]->dirty = DBW_CLEAN;
+    }
+}
+
+/**
+ * Create an object with only the id and revision of a table, to read the
+ * revisions of many rows at once.
+ */
+static db_object_t *
+dbw_revision_object(const db_connection_t *conn, char const *table)
+{
+    db_object_t *object;
+    db_object_field_list_t *field_list;
+    db_object_field_t *field;
+
+    if (!(object = db_object_new())
+        || db_object_set_connection(object, conn)
+        || db_object_set_table(object, table)
+        || db_object_set_primary_key_name(object, "id")
+        || !(field_list = db_object_field_list_new()))
+    {
+        db_object_free(object);
+        return NULL;
+    }
+    if (!(field = db_object_field_new())
+        || db_object_field_set_name(field, "id")
+        || db_object_field_set_type(field, DB_TYPE_PRIMARY_KEY)
+        || db_object_field_list_add(field_list, field))
+    {
+        db_object_field_free(field);
+        db_object_field_list_free(field_list);
+        db_object_free(object);
+        return NULL;
+    }
+    if (!(field = db_object_field_new())
+        || db_object_field_set_name(field, "rev")
+        || db_object_field_set_type(field, DB_TYPE_REVISION)
+        || db_object_field_list_add(field_list, field))
+    {
+        db_object_field_free(field);
+        db_object_field_list_free(field_list);
+        db_object_free(object);
+        return NULL;
+    }
+    if (db_object_set_object_field_list(object, field_list)) {
+        db_object_field_list_free(field_list);
+        db_object_free(object);
+        return NULL;
+    }
+    return object;
+}
+
+/**
+ * Verify the revisions of up to DBW_REVISION_BATCH rows with one query. The
+ * clauses are padded with the last id so every batch has the same shape and
+ * reuses the prepared statement of the connection.
+ */
+static int
+dbw_verify_batch_revisions(const db_object_t *object, struct dbrow **rows,
+    size_t n)
+{
+    db_clause_list_t *clause_list;
+    db_clause_t *clause;
+    db_result_list_t *result_list;
+    const db_result_t *result;
+    const db_value_set_t *value_set;
+    size_t i, found = 0;
+    int id;
+
+    if (!(clause_list = db_clause_list_new())) return 1;
+    for (i = 0; i < DBW_REVISION_BATCH; i++) {
+        if (!(clause = db_clause_new())
+            || db_clause_set_field(clause, "id")
+            || db_clause_set_type(clause, DB_CLAUSE_EQUAL)
+            || db_clause_set_operator(clause, DB_CLAUSE_OPERATOR_OR)
+            || db_value_from_int32(db_clause_get_value(clause),
+                rows[i < n ? i : n - 1]->id)
+            || db_clause_list_add(clause_list, clause))
+        {
+            db_clause_free(clause);
+            db_clause_list_free(clause_list);
+            return 1;
+        }
+    }
+    result_list = db_object_read(object, NULL, clause_list);
+    db_clause_list_free(clause_list);
+    if (!result_list) return 1;
+
+    while ((result = db_result_list_next(result_list))) {
+        if (!(value_set = db_result_value_set(result))
+            || db_value_set_size(value_set) != 2)
+        {
+            db_result_list_free(result_list);
+            return 1;
+        }
+        id = dbxvalue2int(db_value_set_at(value_set, 0));
+        for (i = 0; i < n; i++) {
+            if (rows[i]->id != id) continue;
+            if (dbxvalue2int(db_value_set_at(value_set, 1)) != rows[i]->revision) {
+                ods_log_debug("[dbw_verify_revisions] collision detected on id %d", id);
+                db_result_list_free(result_list);
+                return 1;
+            }
+            found++;
+            break;
+        }
+    }
+    db_result_list_free(result_list);
+    if (found != n) {
+        ods_log_debug("[dbw_verify_revisions] %zu rows deleted meanwhile", n - found);
+        return 1;
     }
     return 0;
 }
@@ -1339,22 +1722,32 @@ dbw_commit_list(const db_connection_t *conn, struct dbw_list *list)
 static int
 dbw_verify_list_revisions(const db_connection_t *conn, struct dbw_list *list)
 {
-    struct db_value id;
-    memset(&id, 0, sizeof(struct db_value));
-    id.type = DB_TYPE_INT64;
-    for (size_t i = 0; i < list->n; i++) {
+    struct dbrow *rows[DBW_REVISION_BATCH];
+    db_object_t *object = NULL;
+    size_t n = 0;
+    int r = 0;
+
+    for (size_t i = 0; i < list->n && !r; i++) {
         struct dbrow *row = list->set[i];
         if (row->dirty != DBW_UPDATE) continue;
-        id.int64 = row->id;
-        if (list->revision(conn, &id) != row->revision) {
-            ods_log_debug("[dbw_verify_revisions] collision detected on id %d", row->id);
+        rows[n++] = row;
+        if (n < DBW_REVISION_BATCH && i + 1 < list->n) continue;
+        if (!object && !(object = dbw_revision_object(conn, list->table))) {
             return 1;
         }
+        r = dbw_verify_batch_revisions(object, rows, n);
+        n = 0;
     }
-    return 0;
+    if (!r && n) {
+        if (!object && !(object = dbw_revision_object(conn, list->table))) {
+            return 1;
+        }
+        r = dbw_verify_batch_revisions(object, rows, n);
+    }
+    db_object_free(object);
+    return r;
 }
 
-
 static int
 dbw_verify_revisions(struct dbw_db *db)
 {
@@ -1379,6 +1772,10 @@ dbw_verify_revisions(struct dbw_db *db)
 int
 dbw_commit(struct dbw_db *db)
 {
+    if (db->invalid) {
+        ods_log_error("[dbw_commit] Changes were rolled back before, can't commit to database.");
+        return 1;
+    }
     if (pthread_rwlock_wrlock(&db_lock)) {
         ods_log_error("[dbw_commit] Unable to obtain database write lock.");
         return 1;
@@ -1388,6 +1785,13 @@ dbw_commit(struct dbw_db *db)
         (void)pthread_rwlock_unlock(&db_lock);
         return 1;
     }
+    /* All rows are written in one transaction, this saves a journal sync
+     * per row and leaves the database untouched when a row fails. */
+    if (db_connection_transaction_begin(db->conn)) {
+        ods_log_error("[dbw_commit] Unable to begin transaction.");
+        (void)pthread_rwlock_unlock(&db_lock);
+        return 1;
+    }
     int r = 0;
     r |= dbw_commit_list(db->conn, db->policies);
     r |= dbw_commit_list(db->conn, db->policykeys);
@@ -1396,6 +1800,25 @@ dbw_commit(struct dbw_db *db)
     r |= dbw_commit_list(db->conn, db->keys);
     r |= dbw_commit_list(db->conn, db->keystates);
     r |= dbw_commit_list(db->conn, db->keydependencies);
+    if (!r && db_connection_transaction_commit(db->conn)) {
+        ods_log_error("[dbw_commit] Unable to commit transaction.");
+        r = 1;
+    }
+    if (r) {
+        /* Rows written before the failure got new ids and the changes of
+         * the caller are gone from the database, the rows no longer match
+         * it. */
+        (void)db_connection_transaction_rollback(db->conn);
+        db->invalid = 1;
+    } else {
+        dbw_clean_list(db->policies);
+        dbw_clean_list(db->policykeys);
+        dbw_clean_list(db->zones);
+        dbw_clean_list(db->hsmkeys);
+        dbw_clean_list(db->keys);
+        dbw_clean_list(db->keystates);
+        dbw_clean_list(db->keydependencies);
+    }
     (void)pthread_rwlock_unlock(&db_lock);
     return r;
 }
@@ -1404,6 +1827,7 @@ struct dbw_zone *
 dbw_get_zone(struct dbw_db *db, char const *zonename)
 {
     struct dbw_list *list = db->zones;
+    if (db->invalid) return NULL;
     for (size_t n = 0; n < list->n; n++) {
         struct dbw_zone *zone = (struct dbw_zone *)list->set[n];
         if (!strcmp(zone->name, zonename)) return zone;
@@ -1415,6 +1839,7 @@ struct dbw_policy *
 dbw_get_policy(struct dbw_db *db, char const *policyname)
 {
     struct dbw_list *list = db->policies;
+    if (db->invalid) return NULL;
     for (size_t n = 0; n < list->n; n++) {
         struct dbw_policy *policy = (struct dbw_policy *)list->set[n];
         if (!strcmp(policy->name, policyname)) return policy;
@@ -1426,6 +1851,7 @@ struct dbw_policykey *
 dbw_get_policykey(struct dbw_db *db, int id)
 {
     struct dbw_list *list = db->policykeys;
+    if (db->invalid) return NULL;
     for (size_t n = 0; n < list->n; n++) {
         struct dbw_policykey *policykey = (struct dbw_policykey *)list->set[n];
         if (id == policykey->id) return policykey;
@@ -1448,6 +1874,7 @@ struct dbw_hsmkey *
 dbw_get_hsmkey(struct dbw_db *db, char const *locator)
 {
     struct dbw_list *list = db->hsmkeys;
+    if (db->invalid) return NULL;
     for (size_t n = 0; n < list->n; n++) {
         struct dbw_hsmkey *hsmkey = (struct dbw_hsmkey *)list->set[n];
         if (!strcmp(locator, hsmkey->locator)) return hsmkey;
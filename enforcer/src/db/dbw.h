@@ -307,6 +307,9 @@ struct dbw_hsmkey {
     unsigned int is_revoked;
     unsigned int key_type;
     unsigned int backup;
+    /** Keys of other zones using this hsmkey that were not fetched. Only
+     * non-zero after dbw_fetch_zone() */
+    unsigned int foreign_key_count;
 };
 
 struct dbw_zone {
@@ -347,7 +350,7 @@ struct dbw_list {
     size_t n;
     void (*free)(struct dbrow *);
     int (*update)(const db_connection_t *, struct dbrow *);
-    int (*revision)(const db_connection_t *, struct db_value *);
+    char const *table; /* database table, for batched revision checks */
 };
 
 struct dbw_db {
@@ -359,6 +362,7 @@ struct dbw_db {
     struct dbw_list *hsmkeys;
     struct dbw_list *keystates;
     struct dbw_list *keydependencies;
+    int invalid; /* a commit was rolled back, rows don't match the database */
 };
 
 /* DB operations */
@@ -390,9 +394,26 @@ struct dbw_db *dbw_fetch(db_connection_t *conn);
  */
 struct dbw_db *dbw_fetch_filtered(db_connection_t *conn, int mask);
 
+/**
+ * Fetch only the rows needed to enforce a single zone: the zone, its
+ * policy and policy keys, its keys, keystates and keydependencies, the
+ * hsmkeys referenced by those keys and the hsmkeys of the policy that are
+ * available for allocation (unused, or shared when the policy shares keys).
+ * The result has the same layout as dbw_fetch() and can be committed with
+ * dbw_commit(), which will then only touch these rows.
+ *
+ * return NULL on failure or when the zone does not exist
+ */
+struct dbw_db *dbw_fetch_zone(db_connection_t *conn, char const *zonename);
+
 /**
  * Commit changes to the database. Guarded by a R/W lock. Only records marked
- * as dirty will be considered for writing.
+ * as dirty will be considered for writing. Records stay dirty until all of
+ * them are written.
+ *
+ * If writing fails the transaction is rolled back and db is marked invalid:
+ * the lookup functions return NULL and further commits fail. The caller must
+ * free it and fetch the database again.
  *
  * return 0 on success. 1 otherwise.
  */
@@ -413,7 +434,7 @@ void dbw_mark_dirty(struct dbrow *row);
  * convenience functions to get a specific zone or policy from a fetched
  * database.
  *
- * Return NULL if no such object exists
+ * Return NULL if no such object exists or db is invalid
  */
 struct dbw_zone * dbw_get_zone(struct dbw_db *db, char const *zonename);
 struct dbw_policy * dbw_get_policy(struct dbw_db *db, char const *policyname);
@@ -105,6 +105,7 @@ int main(void) {
         || !CU_add_test(pSuite, "test of read object 1 (#3)", test_database_operations_read_object1)
         || !CU_add_test(pSuite, "test of delete object 2", test_database_operations_delete_object2)
         || !CU_add_test(pSuite, "test of read object 1 (#4)", test_database_operations_read_object1)
+        || !CU_add_test(pSuite, "test of transaction", test_database_operations_transaction)
 
         || !CU_add_test(pSuite, "test of read object 1 (REV)", test_database_operations_read_object1_2)
         || !CU_add_test(pSuite, "test of create object 2 (REV)", test_database_operations_create_object2_2)
@@ -141,6 +142,7 @@ int main(void) {
         || !CU_add_test(pSuite, "test of read object 1 (#3)", test_database_operations_read_object1)
         || !CU_add_test(pSuite, "test of delete object 2", test_database_operations_delete_object2)
         || !CU_add_test(pSuite, "test of read object 1 (#4)", test_database_operations_read_object1)
+        || !CU_add_test(pSuite, "test of transaction", test_database_operations_transaction)
 
         || !CU_add_test(pSuite, "test of read object 1 (REV)", test_database_operations_read_object1_2)
         || !CU_add_test(pSuite, "test of create object 2 (REV)", test_database_operations_create_object2_2)
@@ -1166,6 +1166,36 @@ void test_database_operations_delete_object3(void) {
     CU_PASS("test_free");
 }
 
+void test_database_operations_transaction(void) {
+    CU_ASSERT_FATAL(!db_connection_transaction_begin(connection));
+    CU_ASSERT_PTR_NOT_NULL_FATAL((test = test_new(connection)));
+    CU_ASSERT_FATAL(!test_set_name(test, "name 4"));
+    CU_ASSERT_FATAL(!test_create(test));
+    test_free(test);
+    test = NULL;
+    CU_ASSERT_FATAL(!db_connection_transaction_rollback(connection));
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL((test = test_new(connection)));
+    CU_ASSERT(test_get_by_name(test, "name 4"));
+    test_free(test);
+    test = NULL;
+
+    CU_ASSERT_FATAL(!db_connection_transaction_begin(connection));
+    CU_ASSERT_PTR_NOT_NULL_FATAL((test = test_new(connection)));
+    CU_ASSERT_FATAL(!test_set_name(test, "name 4"));
+    CU_ASSERT_FATAL(!test_create(test));
+    test_free(test);
+    test = NULL;
+    CU_ASSERT_FATAL(!db_connection_transaction_commit(connection));
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL((test = test_new(connection)));
+    CU_ASSERT_FATAL(!test_get_by_name(test, "name 4"));
+    CU_ASSERT_FATAL(!test_delete(test));
+    test_free(test);
+    test = NULL;
+    CU_PASS("test_free");
+}
+
 void test_database_operations_read_all(void) {
     const test_t* local_test;
     int count = 0;
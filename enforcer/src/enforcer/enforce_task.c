@@ -86,7 +86,7 @@ static time_t
 perform_enforce(int sockfd, engine_type *engine, char const *zonename,
     db_connection_t *dbconn)
 {
-    struct dbw_db *db = dbw_fetch(dbconn);
+    struct dbw_db *db = dbw_fetch_zone(dbconn, zonename);
     if (!db) {
         ods_log_error("[%s] Error reading database", module_str);
         return -1;
@@ -165,7 +165,7 @@ enforce_task_flush_policy(engine_type *engine, struct dbw_policy *policy)
 void
 enforce_task_flush_all(engine_type *engine, db_connection_t *dbconn)
 {
-    struct dbw_db *db = dbw_fetch(dbconn);
+    struct dbw_db *db = dbw_fetch_filtered(dbconn, DBW_F_POLICY|DBW_F_ZONE);
     if (!db) ods_fatal_exit("[%s] failed to list zones from DB", module_str);
     for (size_t z = 0; z < db->zones->n; z++) {
         struct dbw_zone *zone = (struct dbw_zone *)db->zones->set[z];
@@ -358,16 +358,19 @@ generate_cb(task_type* task, char const *owner, void *userdata,
             }
         }
     }
-    (void)dbw_commit(db);
-    for (size_t p = 0; p < db->policies->n; p++) {
-        struct dbw_policy *policy = (struct dbw_policy *)db->policies->set[p];
-        if (policy->scratch)
-            enforce_task_flush_policy(engine, policy);
-    }
-    for (size_t z = 0; z < db->zones->n; z++) {
-        struct dbw_zone *zone = (struct dbw_zone *)db->zones->set[z];
-        if (zone->scratch && !zone->policy->scratch) {
-            enforce_task_flush_zone(engine, zone->name);
+    if (dbw_commit(db)) {
+        ods_log_error("[hsm_key_factory_generate] Unable to commit generated keys to database.");
+    } else {
+        for (size_t p = 0; p < db->policies->n; p++) {
+            struct dbw_policy *policy = (struct dbw_policy *)db->policies->set[p];
+            if (policy->scratch)
+                enforce_task_flush_policy(engine, policy);
+        }
+        for (size_t z = 0; z < db->zones->n; z++) {
+            struct dbw_zone *zone = (struct dbw_zone *)db->zones->set[z];
+            if (zone->scratch && !zone->policy->scratch) {
+                enforce_task_flush_zone(engine, zone->name);
+            }
         }
     }
     dbw_free(db);
@@ -470,8 +473,8 @@ hsm_key_factory_get_key(engine_type *engine, struct dbw_db *db,
 void
 hsm_key_factory_release_key_mockup(struct dbw_hsmkey *hsmkey, struct dbw_key *key, int mockup)
 {
-    int c = hsmkey->key_count;
-    if (c == 1 && hsmkey->key[0] == key) c--;
+    int c = hsmkey->key_count + hsmkey->foreign_key_count;
+    if (c == 1 && hsmkey->key_count == 1 && hsmkey->key[0] == key) c--;
     if (c > 0) {
         ods_log_debug("[hsm_key_factory_release_key] unable to release hsm_key, in use");
     } else {
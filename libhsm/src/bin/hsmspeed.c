@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sys/time.h>
 
 #include "libhsm.h"
 #include <libhsmdns.h>
@@ -50,6 +51,7 @@ typedef struct {
     hsm_ctx_t *ctx;
     libhsm_key_t *key;
     unsigned int iterations;
+    unsigned int batchsize;
 } sign_arg_t;
 
 static void
@@ -57,7 +59,7 @@ usage ()
 {
     fprintf(stderr,
         "usage: %s "
-        "[-c config] -r repository [-i iterations] [-s keysize] [-t threads]\n",
+        "[-c config] -r repository [-i iterations] [-s keysize] [-t threads] [-b batchsize]\n",
         progname);
 }
 
@@ -67,10 +69,14 @@ sign (void *arg)
     hsm_ctx_t *ctx = NULL;
     libhsm_key_t *key = NULL;
 
-    size_t i;
+    size_t i, j;
     unsigned int iterations = 0;
+    unsigned int batchsize;
 
     ldns_rr_list *rrset;
+    ldns_rr_list **rrsets;
+    ldns_rr **sigs;
+    unsigned int n;
     ldns_rr *rr, *sig, *dnskey_rr;
     ldns_status status;
     hsm_sign_params_t *sign_params;
@@ -80,6 +86,7 @@ sign (void *arg)
     ctx = sign_arg->ctx;
     key = sign_arg->key;
     iterations = sign_arg->iterations;
+    batchsize = sign_arg->batchsize;
 
     fprintf(stderr, "Signer thread #%d started...\n", sign_arg->id);
 
@@ -96,24 +103,47 @@ sign (void *arg)
     sign_params->keytag = ldns_calc_keytag(dnskey_rr);
 
     /* Do some signing */
-    for (i=0; i<iterations; i++) {
-        sig = hsm_sign_rrset(ctx, rrset, key, sign_params);
-        if (! sig) {
-            fprintf(stderr,
-                    "hsm_sign_rrset() returned error: %s in %s\n",
-                    ctx->error_message,
-                    ctx->error_action
-            );
-            break;
+    if (batchsize > 1) {
+        rrsets = malloc(sizeof(ldns_rr_list*) * batchsize);
+        sigs = malloc(sizeof(ldns_rr*) * batchsize);
+        for (j=0; j<batchsize; j++) {
+            rrsets[j] = rrset;
+        }
+        for (i=0; i<iterations; i+=batchsize) {
+            n = (iterations - i < batchsize ? iterations - i : batchsize);
+            if (hsm_sign_rrset_batch(ctx, n, rrsets, key, sign_params, sigs) != (int)n) {
+                fprintf(stderr,
+                        "hsm_sign_rrset_batch() returned error: %s in %s\n",
+                        ctx->error_message,
+                        ctx->error_action
+                );
+                break;
+            }
+            for (j=0; j<n; j++) {
+                ldns_rr_free(sigs[j]);
+            }
+        }
+        free(sigs);
+        free(rrsets);
+    } else {
+        for (i=0; i<iterations; i++) {
+            sig = hsm_sign_rrset(ctx, rrset, key, sign_params);
+            if (! sig) {
+                fprintf(stderr,
+                        "hsm_sign_rrset() returned error: %s in %s\n",
+                        ctx->error_message,
+                        ctx->error_action
+                );
+                break;
+            }
+            ldns_rr_free(sig);
         }
-        ldns_rr_free(sig);
     }
 
     /* Clean up */
     ldns_rr_list_deep_free(rrset);
     hsm_sign_params_free(sign_params);
     ldns_rr_free(dnskey_rr);
-    hsm_destroy_context(ctx);
 
     fprintf(stderr, "Signer thread #%d done.\n", sign_arg->id);
 
@@ -122,6 +152,92 @@ sign (void *arg)
 }
 
 
+static int
+run(libhsm_key_t *key, unsigned int threads, unsigned int iterations,
+    unsigned int batchsize, double *elapsed)
+{
+    sign_arg_t sign_arg_array[HSMSPEED_THREADS_MAX];
+    pthread_t thread_array[HSMSPEED_THREADS_MAX];
+    pthread_attr_t thread_attr;
+    void *thread_status;
+    struct timeval start, end;
+    unsigned int n, nstarted;
+    int result, failed = 0;
+
+    /* Prepare threads */
+    pthread_attr_init(&thread_attr);
+    pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
+
+    for (n=0; n<threads; n++) {
+        sign_arg_array[n].id = n;
+        sign_arg_array[n].ctx = hsm_create_context();
+        if (! sign_arg_array[n].ctx) {
+            fprintf(stderr, "hsm_create_context() returned error\n");
+            while (n > 0) {
+                hsm_destroy_context(sign_arg_array[--n].ctx);
+            }
+            pthread_attr_destroy(&thread_attr);
+            return -1;
+        }
+        sign_arg_array[n].key = key;
+        sign_arg_array[n].iterations = iterations;
+        sign_arg_array[n].batchsize = batchsize;
+    }
+
+    fprintf(stderr, "Signing %d RRsets with %s using %d %s in batches of %d...\n",
+        iterations, algoname, threads, (threads > 1 ? "threads" : "thread"),
+        batchsize);
+    gettimeofday(&start, NULL);
+
+    /* Create threads for signing */
+    for (nstarted=0; nstarted<threads; nstarted++) {
+        result = pthread_create(&thread_array[nstarted], &thread_attr,
+            sign, (void *) &sign_arg_array[nstarted]);
+        if (result) {
+            fprintf(stderr, "pthread_create() returned %d\n", result);
+            failed = 1;
+            break;
+        }
+    }
+
+    /* Wait for threads to finish */
+    for (n=0; n<nstarted; n++) {
+        result = pthread_join(thread_array[n], &thread_status);
+        if (result) {
+            fprintf(stderr, "pthread_join() returned %d\n", result);
+            failed = 1;
+        }
+    }
+
+    gettimeofday(&end, NULL);
+    pthread_attr_destroy(&thread_attr);
+    for (n=0; n<threads; n++) {
+        hsm_destroy_context(sign_arg_array[n].ctx);
+    }
+    if (failed) {
+        return -1;
+    }
+    fprintf(stderr, "Signing done.\n");
+
+    end.tv_sec -= start.tv_sec;
+    end.tv_usec-= start.tv_usec;
+    *elapsed =(double)(end.tv_sec)+(double)(end.tv_usec)*.000001;
+    return 0;
+}
+
+static void
+report(const char *path, unsigned int threads, unsigned int iterations,
+    unsigned int batchsize, double elapsed, unsigned int keysize)
+{
+    double speed;
+
+    speed = iterations / elapsed * threads;
+    printf("%d %s, %d signatures per thread, batches of %d, %.2f sig/s (RSA %d bits, %s)\n",
+        threads, (threads > 1 ? "threads" : "thread"), iterations,
+        batchsize, speed, keysize, path);
+}
+
+
 int
 main (int argc, char *argv[])
 {
@@ -132,26 +248,21 @@ main (int argc, char *argv[])
     unsigned int keysize = 1024;
     unsigned int iterations = 1;
     unsigned int threads = 1;
-
-    static struct timeval start,end;
+    unsigned int batchsize = 1;
 
     char *config = NULL;
     const char *repository = NULL;
 
-    sign_arg_t sign_arg_array[HSMSPEED_THREADS_MAX];
-
-    pthread_t      thread_array[HSMSPEED_THREADS_MAX];
-    pthread_attr_t thread_attr;
-    void          *thread_status;
-
     int ch;
-    unsigned int n;
-    double elapsed, speed;
+    double elapsed;
 
     progname = argv[0];
 
-    while ((ch = getopt(argc, argv, "c:i:r:s:t:")) != -1) {
+    while ((ch = getopt(argc, argv, "b:c:i:r:s:t:")) != -1) {
         switch (ch) {
+        case 'b':
+            batchsize = atoi(optarg);
+            break;
         case 'c':
             config = strdup(optarg);
             break;
@@ -221,56 +332,24 @@ main (int argc, char *argv[])
         exit(-1);
     }
 
-    /* Prepare threads */
-    pthread_attr_init(&thread_attr);
-    pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
-
-    for (n=0; n<threads; n++) {
-        sign_arg_array[n].id = n;
-        sign_arg_array[n].ctx = hsm_create_context();
-        if (! sign_arg_array[n].ctx) {
-            fprintf(stderr, "hsm_create_context() returned error\n");
-            exit(-1);
-        }
-        sign_arg_array[n].key = key;
-        sign_arg_array[n].iterations = iterations;
+    /* Sign through PKCS#11 first, then in-process if the key allows */
+    hsm_softkey_unload(key);
+    if (run(key, threads, iterations, batchsize, &elapsed)) {
+        exit(EXIT_FAILURE);
     }
-
-    fprintf(stderr, "Signing %d RRsets with %s using %d %s...\n",
-        iterations, algoname, threads, (threads > 1 ? "threads" : "thread"));
-    gettimeofday(&start, NULL);
-
-    /* Create threads for signing */
-    for (n=0; n<threads; n++) {
-        result = pthread_create(&thread_array[n], &thread_attr,
-            sign, (void *) &sign_arg_array[n]);
-        if (result) {
-            fprintf(stderr, "pthread_create() returned %d\n", result);
-            exit(EXIT_FAILURE);
-        }
-    }
-
-    /* Wait for threads to finish */
-    for (n=0; n<threads; n++) {
-        result = pthread_join(thread_array[n], &thread_status);
-        if (result) {
-            fprintf(stderr, "pthread_join() returned %d\n", result);
+    report("PKCS#11", threads, iterations, batchsize, elapsed, keysize);
+    if (hsm_softkey_load(ctx, key) == HSM_OK) {
+        if (run(key, threads, iterations, batchsize, &elapsed)) {
             exit(EXIT_FAILURE);
         }
+        report("in-process", threads, iterations, batchsize, elapsed, keysize);
+    } else {
+        char* error = hsm_get_error(ctx);
+        fprintf(stderr, "Skipping in-process signing: %s\n",
+            (error ? error : "key not extractable"));
+        free(error);
     }
 
-    gettimeofday(&end, NULL);
-    fprintf(stderr, "Signing done.\n");
-
-    /* Report results */
-    end.tv_sec -= start.tv_sec;
-    end.tv_usec-= start.tv_usec;
-    elapsed =(double)(end.tv_sec)+(double)(end.tv_usec)*.000001;
-    speed = iterations / elapsed * threads;
-    printf("%d %s, %d signatures per thread, %.2f sig/s (RSA %d bits)\n",
-        threads, (threads > 1 ? "threads" : "thread"), iterations,
-        speed, keysize);
-
     /* Delete temporary key */
     fprintf(stderr, "Deleting temporary key...\n");
     result = hsm_remove_key(ctx, key);
@@ -51,6 +51,20 @@
 #include <pkcs11.h>
 #include <pthread.h>
 
+/* In-process signing needs the OpenSSL 1.1 API */
+#if defined HAVE_SSL && defined HAVE_SSL_NEW_HMAC
+#define HSM_SOFTSIGN
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+#include <openssl/ecdsa.h>
+#include <openssl/x509.h>
+#endif
+
+#ifndef CKM_AES_KEY_WRAP_PAD
+#define CKM_AES_KEY_WRAP_PAD (0x210a)
+#endif
+
 /*! Fixed length from PKCS#11 specification */
 #define HSM_TOKEN_LABEL_LENGTH 32
 
@@ -58,6 +72,9 @@
 hsm_ctx_t *_hsm_ctx;
 pthread_mutex_t _hsm_ctx_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*! Serializes extracting and releasing in-process private keys */
+static pthread_mutex_t _hsm_softkey_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /*! General PKCS11 helper functions */
 static char const *
 ldns_pkcs11_rv_str(CK_RV rv)
@@ -495,6 +512,7 @@ hsm_config_default(hsm_config_t *config)
 {
     config->use_pubkey = 1;
     config->allow_extract = 0;
+    config->software_sign = 0;
 }
 
 /* creates a session_t structure, and automatically adds and initializes
@@ -632,6 +650,7 @@ hsm_ctx_new()
     memset(ctx->session, 0, HSM_MAX_SESSIONS * sizeof(hsm_ctx_t*));
     ctx->session_count = 0;
     ctx->error = 0;
+    ctx->keycache = NULL;
     return ctx;
 }
 
@@ -743,7 +762,6 @@ hsm_ctx_clone(hsm_ctx_t *ctx)
             hsm_ctx_add_session(new_ctx, new_session);
         }
         new_ctx->keycache = ctx->keycache;
-        new_ctx->keycache_lock = ctx->keycache_lock;
     }
     return new_ctx;
 }
@@ -756,6 +774,8 @@ libhsm_key_new()
     key->modulename = NULL;
     key->private_key = 0;
     key->public_key = 0;
+    key->softkey = NULL;
+    key->softkeystate = 0;
     return key;
 }
 
@@ -1703,80 +1723,76 @@ hsm_get_key_rdata(hsm_ctx_t *ctx, hsm_session_t *session,
     }
 }
 
-/* this function allocates memory for the mechanism ID and enough room
- * to leave the upcoming digest data. It fills in the mechanism id
- * use with care. The returned data must be free'd by the caller.
- * Only used by RSA PKCS. */
-static CK_BYTE *
-hsm_create_prefix(CK_ULONG digest_len,
-                  ldns_algorithm algorithm,
-                  CK_ULONG *data_size)
+/* Return the DigestInfo prefix of the digest for the algorithm.  CKM_RSA_PKCS
+ * does the padding, but cannot know the identifier prefix, so we need to add
+ * that ourselves.  The other algorithms sign the plain digest.
+ * Returns the length of the digest, or 0 for unsupported algorithms.
+ */
+static CK_ULONG
+hsm_digest_prefix(ldns_algorithm algorithm,
+                  const CK_BYTE **prefix,
+                  CK_ULONG *prefix_len)
 {
-    CK_BYTE *data;
-    const CK_BYTE RSA_MD5_ID[] = { 0x30, 0x20, 0x30, 0x0C, 0x06, 0x08, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x02, 0x05, 0x05, 0x00, 0x04, 0x10 };
-    const CK_BYTE RSA_SHA1_ID[] = { 0x30, 0x21, 0x30, 0x09, 0x06, 0x05, 0x2B, 0x0E, 0x03, 0x02, 0x1A, 0x05, 0x00, 0x04, 0x14 };
-    const CK_BYTE RSA_SHA256_ID[] = { 0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20 };
-    const CK_BYTE RSA_SHA512_ID[] = { 0x30, 0x51, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x03, 0x05, 0x00, 0x04, 0x40 };
+    static const CK_BYTE RSA_MD5_ID[] = { 0x30, 0x20, 0x30, 0x0C, 0x06, 0x08, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x02, 0x05, 0x05, 0x00, 0x04, 0x10 };
+    static const CK_BYTE RSA_SHA1_ID[] = { 0x30, 0x21, 0x30, 0x09, 0x06, 0x05, 0x2B, 0x0E, 0x03, 0x02, 0x1A, 0x05, 0x00, 0x04, 0x14 };
+    static const CK_BYTE RSA_SHA256_ID[] = { 0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20 };
+    static const CK_BYTE RSA_SHA512_ID[] = { 0x30, 0x51, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x03, 0x05, 0x00, 0x04, 0x40 };
 
+    *prefix = NULL;
+    *prefix_len = 0;
     switch((ldns_signing_algorithm)algorithm) {
         case LDNS_SIGN_RSAMD5:
-            *data_size = sizeof(RSA_MD5_ID) + digest_len;
-            CHECKALLOC(data = malloc(*data_size));
-            memcpy(data, RSA_MD5_ID, sizeof(RSA_MD5_ID));
-            break;
+            *prefix = RSA_MD5_ID;
+            *prefix_len = sizeof(RSA_MD5_ID);
+            return 16;
         case LDNS_SIGN_RSASHA1:
         case LDNS_SIGN_RSASHA1_NSEC3:
-            *data_size = sizeof(RSA_SHA1_ID) + digest_len;
-            CHECKALLOC(data = malloc(*data_size));
-            memcpy(data, RSA_SHA1_ID, sizeof(RSA_SHA1_ID));
-            break;
-	case LDNS_SIGN_RSASHA256:
-            *data_size = sizeof(RSA_SHA256_ID) + digest_len;
-            CHECKALLOC(data = malloc(*data_size));
-            memcpy(data, RSA_SHA256_ID, sizeof(RSA_SHA256_ID));
-            break;
-	case LDNS_SIGN_RSASHA512:
-            *data_size = sizeof(RSA_SHA512_ID) + digest_len;
-            CHECKALLOC(data = malloc(*data_size));
-            memcpy(data, RSA_SHA512_ID, sizeof(RSA_SHA512_ID));
-            break;
+            *prefix = RSA_SHA1_ID;
+            *prefix_len = sizeof(RSA_SHA1_ID);
+            return LDNS_SHA1_DIGEST_LENGTH;
+        case LDNS_SIGN_RSASHA256:
+            *prefix = RSA_SHA256_ID;
+            *prefix_len = sizeof(RSA_SHA256_ID);
+            return LDNS_SHA256_DIGEST_LENGTH;
+        case LDNS_SIGN_RSASHA512:
+            *prefix = RSA_SHA512_ID;
+            *prefix_len = sizeof(RSA_SHA512_ID);
+            return LDNS_SHA512_DIGEST_LENGTH;
         case LDNS_SIGN_DSA:
         case LDNS_SIGN_DSA_NSEC3:
+            return LDNS_SHA1_DIGEST_LENGTH;
         case LDNS_SIGN_ECC_GOST:
+            return 32;
 /* TODO: We can remove the directive if we require LDNS >= 1.6.13 */
 #if !defined LDNS_BUILD_CONFIG_USE_ECDSA || LDNS_BUILD_CONFIG_USE_ECDSA
         case LDNS_SIGN_ECDSAP256SHA256:
+            return LDNS_SHA256_DIGEST_LENGTH;
         case LDNS_SIGN_ECDSAP384SHA384:
+            return LDNS_SHA384_DIGEST_LENGTH;
 #endif
-            *data_size = digest_len;
-            CHECKALLOC(data = malloc(*data_size));
-            break;
         default:
-            return NULL;
+            return 0;
     }
-    return data;
 }
 
-static CK_BYTE *
+static int
 hsm_digest_through_hsm(hsm_ctx_t *ctx,
                        hsm_session_t *session,
                        CK_MECHANISM_TYPE mechanism_type,
+                       CK_BYTE *digest,
                        CK_ULONG digest_len,
                        ldns_buffer *sign_buf)
 {
     CK_MECHANISM digest_mechanism;
-    CK_BYTE *digest;
     CK_RV rv;
 
     digest_mechanism.pParameter = NULL;
     digest_mechanism.ulParameterLen = 0;
     digest_mechanism.mechanism = mechanism_type;
-    CHECKALLOC(digest = malloc(digest_len));
     rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_DigestInit(session->session,
                                                  &digest_mechanism);
     if (hsm_pkcs11_check_error(ctx, rv, "HSM digest init")) {
-        free(digest);
-        return NULL;
+        return -1;
     }
 
     rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_Digest(session->session,
@@ -1785,145 +1801,363 @@ hsm_digest_through_hsm(hsm_ctx_t *ctx,
                                         digest,
                                         &digest_len);
     if (hsm_pkcs11_check_error(ctx, rv, "HSM digest")) {
-        free(digest);
-        return NULL;
+        return -1;
     }
-    return digest;
+    return 0;
 }
 
-static ldns_rdf *
-hsm_sign_buffer(hsm_ctx_t *ctx,
-                ldns_buffer *sign_buf,
-                const libhsm_key_t *key,
-                ldns_algorithm algorithm)
-{
-    CK_RV rv;
-    CK_ULONG signatureLen = HSM_MAX_SIGNATURE_LENGTH;
-    CK_BYTE signature[HSM_MAX_SIGNATURE_LENGTH];
-    CK_MECHANISM sign_mechanism;
-
-    ldns_rdf *sig_rdf;
-    CK_BYTE *digest = NULL;
+/* Compute the data to be signed over the content of the sign buffer into
+ * data, which must be able to hold HSM_MAX_DIGESTINFO_LENGTH bytes.
+ * Returns the length of the data, or 0 on failure.
+ */
+static CK_ULONG
+hsm_create_digestinfo(hsm_ctx_t *ctx,
+                      hsm_session_t *session,
+                      ldns_buffer *sign_buf,
+                      ldns_algorithm algorithm,
+                      CK_BYTE *data)
+{
+    const CK_BYTE *prefix;
+    CK_ULONG prefix_len;
     CK_ULONG digest_len;
+    CK_BYTE *digest;
 
-    CK_BYTE *data = NULL;
-    CK_ULONG data_len = 0;
-
-    hsm_session_t *session;
-
-    session = hsm_find_key_session(ctx, key);
-    if (!session) return NULL;
+    digest_len = hsm_digest_prefix(algorithm, &prefix, &prefix_len);
+    if (digest_len == 0) {
+        /* log error? or should we not even get here for
+         * unsupported algorithms? */
+        return 0;
+    }
+    if (prefix_len > 0) {
+        memcpy(data, prefix, prefix_len);
+    }
+    digest = &data[prefix_len];
 
     /* some HSMs don't really handle CKM_SHA1_RSA_PKCS well, so
      * we'll do the hashing manually */
-    /* When adding algorithms, remember there is another switch below */
+    /* When adding algorithms, remember there are other switches */
     switch ((ldns_signing_algorithm)algorithm) {
         case LDNS_SIGN_RSAMD5:
-            digest_len = 16;
-            digest = hsm_digest_through_hsm(ctx, session,
-                                            CKM_MD5, digest_len,
-                                            sign_buf);
+            if (hsm_digest_through_hsm(ctx, session, CKM_MD5, digest,
+                                       digest_len, sign_buf)) {
+                return 0;
+            }
             break;
         case LDNS_SIGN_RSASHA1:
         case LDNS_SIGN_RSASHA1_NSEC3:
         case LDNS_SIGN_DSA:
         case LDNS_SIGN_DSA_NSEC3:
-            digest_len = LDNS_SHA1_DIGEST_LENGTH;
-            CHECKALLOC(digest = malloc(digest_len));
-            digest = ldns_sha1(ldns_buffer_begin(sign_buf),
-                               ldns_buffer_position(sign_buf),
-                               digest);
+            ldns_sha1(ldns_buffer_begin(sign_buf),
+                      ldns_buffer_position(sign_buf),
+                      digest);
             break;
-
         case LDNS_SIGN_RSASHA256:
 /* TODO: We can remove the directive if we require LDNS >= 1.6.13 */
 #if !defined LDNS_BUILD_CONFIG_USE_ECDSA || LDNS_BUILD_CONFIG_USE_ECDSA
         case LDNS_SIGN_ECDSAP256SHA256:
 #endif
-            digest_len = LDNS_SHA256_DIGEST_LENGTH;
-            CHECKALLOC(digest = malloc(digest_len));
-            digest = ldns_sha256(ldns_buffer_begin(sign_buf),
-                                 ldns_buffer_position(sign_buf),
-                                 digest);
+            ldns_sha256(ldns_buffer_begin(sign_buf),
+                        ldns_buffer_position(sign_buf),
+                        digest);
             break;
 /* TODO: We can remove the directive if we require LDNS >= 1.6.13 */
 #if !defined LDNS_BUILD_CONFIG_USE_ECDSA || LDNS_BUILD_CONFIG_USE_ECDSA
         case LDNS_SIGN_ECDSAP384SHA384:
-            digest_len = LDNS_SHA384_DIGEST_LENGTH;
-            CHECKALLOC(digest = malloc(digest_len));
-            digest = ldns_sha384(ldns_buffer_begin(sign_buf),
-                                 ldns_buffer_position(sign_buf),
-                                 digest);
+            ldns_sha384(ldns_buffer_begin(sign_buf),
+                        ldns_buffer_position(sign_buf),
+                        digest);
             break;
 #endif
         case LDNS_SIGN_RSASHA512:
-            digest_len = LDNS_SHA512_DIGEST_LENGTH;
-            CHECKALLOC(digest = malloc(digest_len));
-            digest = ldns_sha512(ldns_buffer_begin(sign_buf),
-                                 ldns_buffer_position(sign_buf),
-                                 digest);
+            ldns_sha512(ldns_buffer_begin(sign_buf),
+                        ldns_buffer_position(sign_buf),
+                        digest);
             break;
         case LDNS_SIGN_ECC_GOST:
-            digest_len = 32;
-            digest = hsm_digest_through_hsm(ctx, session,
-                                            CKM_GOSTR3411, digest_len,
-                                            sign_buf);
+            if (hsm_digest_through_hsm(ctx, session, CKM_GOSTR3411, digest,
+                                       digest_len, sign_buf)) {
+                return 0;
+            }
             break;
         default:
-            /* log error? or should we not even get here for
-             * unsupported algorithms? */
-            return NULL;
-    }
-
-    if (!digest) {
-        return NULL;
+            return 0;
     }
+    return prefix_len + digest_len;
+}
 
-    /* CKM_RSA_PKCS does the padding, but cannot know the identifier
-     * prefix, so we need to add that ourselves.
-     * The other algorithms will just get the digest buffer returned. */
-    data = hsm_create_prefix(digest_len, algorithm, &data_len);
-    memcpy(data + data_len - digest_len, digest, digest_len);
-
-    sign_mechanism.pParameter = NULL;
-    sign_mechanism.ulParameterLen = 0;
+static int
+hsm_sign_mechanism(ldns_algorithm algorithm, CK_MECHANISM *sign_mechanism)
+{
+    sign_mechanism->pParameter = NULL;
+    sign_mechanism->ulParameterLen = 0;
     switch((ldns_signing_algorithm)algorithm) {
         case LDNS_SIGN_RSAMD5:
         case LDNS_SIGN_RSASHA1:
         case LDNS_SIGN_RSASHA1_NSEC3:
         case LDNS_SIGN_RSASHA256:
         case LDNS_SIGN_RSASHA512:
-            sign_mechanism.mechanism = CKM_RSA_PKCS;
+            sign_mechanism->mechanism = CKM_RSA_PKCS;
             break;
         case LDNS_SIGN_DSA:
         case LDNS_SIGN_DSA_NSEC3:
-            sign_mechanism.mechanism = CKM_DSA;
+            sign_mechanism->mechanism = CKM_DSA;
             break;
         case LDNS_SIGN_ECC_GOST:
-            sign_mechanism.mechanism = CKM_GOSTR3410;
+            sign_mechanism->mechanism = CKM_GOSTR3410;
             break;
 /* TODO: We can remove the directive if we require LDNS >= 1.6.13 */
 #if !defined LDNS_BUILD_CONFIG_USE_ECDSA || LDNS_BUILD_CONFIG_USE_ECDSA
         case LDNS_SIGN_ECDSAP256SHA256:
         case LDNS_SIGN_ECDSAP384SHA384:
-            sign_mechanism.mechanism = CKM_ECDSA;
+            sign_mechanism->mechanism = CKM_ECDSA;
             break;
 #endif
         default:
             /* log error? or should we not even get here for
              * unsupported algorithms? */
-            free(data);
-            free(digest);
+            return -1;
+    }
+    return 0;
+}
+
+#ifdef HSM_SOFTSIGN
+/* Extract the private key of a key pair by having the HSM wrap it with an
+ * ephemeral AES key, and unwrapping it in-process.  Errors are reported in
+ * the context, if one is given.
+ */
+static EVP_PKEY *
+hsm_softkey_extract(hsm_ctx_t *ctx, hsm_session_t *session,
+                    const libhsm_key_t *key)
+{
+    CK_RV rv;
+    CK_OBJECT_CLASS keyclass = CKO_SECRET_KEY;
+    CK_KEY_TYPE keytype = CKK_AES;
+    CK_BBOOL ctrue = CK_TRUE;
+    CK_BBOOL cfalse = CK_FALSE;
+    CK_BYTE kek[32];
+    CK_ATTRIBUTE kekTemplate[] = {
+        { CKA_CLASS,    &keyclass, sizeof(keyclass) },
+        { CKA_KEY_TYPE, &keytype,  sizeof(keytype)  },
+        { CKA_TOKEN,    &cfalse,   sizeof(cfalse)   },
+        { CKA_WRAP,     &ctrue,    sizeof(ctrue)    },
+        { CKA_VALUE,    kek,       sizeof(kek)      }
+    };
+    CK_MECHANISM mechanism = { CKM_AES_KEY_WRAP_PAD, NULL_PTR, 0 };
+    CK_OBJECT_HANDLE wrappingKey;
+    CK_BYTE_PTR wrapped = NULL;
+    CK_ULONG wrappedLen = 0;
+    unsigned char *plain;
+    const unsigned char *p;
+    int plainLen = 0, finalLen = 0;
+    EVP_CIPHER_CTX *cipher;
+    PKCS8_PRIV_KEY_INFO *p8;
+    EVP_PKEY *pkey = NULL;
+
+    if (RAND_bytes(kek, sizeof(kek)) != 1) {
+        hsm_ctx_set_error(ctx, HSM_ERROR, "hsm_softkey_load()",
+            "unable to create wrapping key");
+        return NULL;
+    }
+    rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_CreateObject(session->session,
+                                      kekTemplate, 5, &wrappingKey);
+    if (hsm_pkcs11_check_error(ctx, rv, "create wrapping key")) {
+        OPENSSL_cleanse(kek, sizeof(kek));
+        return NULL;
+    }
+    rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_WrapKey(session->session,
+                                      &mechanism, wrappingKey, key->private_key,
+                                      NULL_PTR, &wrappedLen);
+    if (rv == CKR_OK) {
+        CHECKALLOC(wrapped = malloc(wrappedLen));
+        rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_WrapKey(session->session,
+                                          &mechanism, wrappingKey, key->private_key,
+                                          wrapped, &wrappedLen);
+    }
+    (void) ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_DestroyObject(session->session,
+                                      wrappingKey);
+    if (hsm_pkcs11_check_error(ctx, rv, "wrap private key")) {
+        OPENSSL_cleanse(kek, sizeof(kek));
+        free(wrapped);
+        return NULL;
+    }
+
+    /* the unwrapped key is a PKCS#8 PrivateKeyInfo, never longer than the
+     * wrapped key */
+    CHECKALLOC(plain = malloc(wrappedLen));
+    CHECKALLOC(cipher = EVP_CIPHER_CTX_new());
+    EVP_CIPHER_CTX_set_flags(cipher, EVP_CIPHER_CTX_FLAG_WRAP_ALLOW);
+    if (EVP_DecryptInit_ex(cipher, EVP_aes_256_wrap_pad(), NULL, kek, NULL) == 1 &&
+        EVP_DecryptUpdate(cipher, plain, &plainLen, wrapped, wrappedLen) == 1 &&
+        EVP_DecryptFinal_ex(cipher, plain + plainLen, &finalLen) == 1) {
+        p = plain;
+        if ((p8 = d2i_PKCS8_PRIV_KEY_INFO(NULL, &p, plainLen + finalLen))) {
+            pkey = EVP_PKCS82PKEY(p8);
+            PKCS8_PRIV_KEY_INFO_free(p8);
+        }
+    }
+    EVP_CIPHER_CTX_free(cipher);
+    OPENSSL_cleanse(plain, wrappedLen);
+    OPENSSL_cleanse(kek, sizeof(kek));
+    free(plain);
+    free(wrapped);
+
+    if (pkey && EVP_PKEY_base_id(pkey) != EVP_PKEY_RSA &&
+        EVP_PKEY_base_id(pkey) != EVP_PKEY_EC) {
+        /* only RSA and ECDSA are signed in-process */
+        EVP_PKEY_free(pkey);
+        pkey = NULL;
+    }
+    if (!pkey) {
+        hsm_ctx_set_error(ctx, HSM_ERROR, "hsm_softkey_load()",
+            "unable to unwrap private key");
+    }
+    return pkey;
+}
+
+/* Get a reference to the in-process private key of a key pair, extracting
+ * it on first use if the repository is configured for software signing.
+ * Returns NULL if the key is to be used through PKCS#11.
+ */
+static EVP_PKEY *
+hsm_softkey_acquire(hsm_session_t *session, const libhsm_key_t *key)
+{
+    libhsm_key_t *mutablekey = (libhsm_key_t *) key;
+    EVP_PKEY *pkey = NULL;
+
+    /* keys signed through PKCS#11 skip the lock, the state is checked
+     * again under the lock otherwise */
+    if (__sync_fetch_and_add(&mutablekey->softkeystate, 0) < 0) {
+        return NULL;
+    }
+    pthread_mutex_lock(&_hsm_softkey_mutex);
+    if (key->softkeystate == 0) {
+        if (session->module->config && session->module->config->software_sign) {
+            mutablekey->softkey = hsm_softkey_extract(NULL, session, key);
+        }
+        mutablekey->softkeystate = (key->softkey ? 1 : -1);
+    }
+    if (key->softkey) {
+        pkey = key->softkey;
+        EVP_PKEY_up_ref(pkey);
+    }
+    pthread_mutex_unlock(&_hsm_softkey_mutex);
+    return pkey;
+}
+
+/* Sign the DigestInfo or digest in-process, producing the same signature
+ * as CKM_RSA_PKCS or CKM_ECDSA would.
+ */
+static ldns_rdf *
+hsm_softkey_sign(hsm_ctx_t *ctx, EVP_PKEY *pkey, CK_BYTE *data,
+                 CK_ULONG data_len)
+{
+    EVP_PKEY_CTX *pctx;
+    unsigned char signature[HSM_MAX_SIGNATURE_LENGTH];
+    unsigned char rs[HSM_MAX_SIGNATURE_LENGTH];
+    size_t signatureLen = sizeof(signature);
+    const unsigned char *p;
+    ECDSA_SIG *ecdsasig;
+    const BIGNUM *r, *s;
+    int len;
+
+    if (!(pctx = EVP_PKEY_CTX_new(pkey, NULL)) ||
+        EVP_PKEY_sign_init(pctx) != 1 ||
+        (EVP_PKEY_base_id(pkey) == EVP_PKEY_RSA &&
+         EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PADDING) != 1) ||
+        EVP_PKEY_sign(pctx, signature, &signatureLen, data, data_len) != 1) {
+        EVP_PKEY_CTX_free(pctx);
+        hsm_ctx_set_error(ctx, HSM_ERROR, "hsm_sign_buffer()",
+            "in-process signing failed");
+        return NULL;
+    }
+    EVP_PKEY_CTX_free(pctx);
+    if (EVP_PKEY_base_id(pkey) == EVP_PKEY_EC) {
+        /* OpenSSL DER encodes the signature, DNSSEC takes r and s at the
+         * size of the curve */
+        len = (EVP_PKEY_bits(pkey) + 7) / 8;
+        p = signature;
+        if (!(ecdsasig = d2i_ECDSA_SIG(NULL, &p, signatureLen))) {
+            hsm_ctx_set_error(ctx, HSM_ERROR, "hsm_sign_buffer()",
+                "in-process signing failed");
             return NULL;
+        }
+        ECDSA_SIG_get0(ecdsasig, &r, &s);
+        BN_bn2binpad(r, rs, len);
+        BN_bn2binpad(s, rs + len, len);
+        ECDSA_SIG_free(ecdsasig);
+        return ldns_rdf_new_frm_data(LDNS_RDF_TYPE_B64, 2 * len, rs);
+    }
+    return ldns_rdf_new_frm_data(LDNS_RDF_TYPE_B64, signatureLen, signature);
+}
+#endif
+
+int
+hsm_softkey_load(hsm_ctx_t *ctx, libhsm_key_t *key)
+{
+#ifdef HSM_SOFTSIGN
+    hsm_session_t *session;
+    EVP_PKEY *pkey;
+
+    session = hsm_find_key_session(ctx, key);
+    if (!session) return HSM_ERROR;
+    pthread_mutex_lock(&_hsm_softkey_mutex);
+    if (!key->softkey) {
+        if ((pkey = hsm_softkey_extract(ctx, session, key))) {
+            key->softkey = pkey;
+        }
     }
+    key->softkeystate = (key->softkey ? 1 : -1);
+    pthread_mutex_unlock(&_hsm_softkey_mutex);
+    return (key->softkeystate > 0 ? HSM_OK : HSM_ERROR);
+#else
+    (void) key;
+    hsm_ctx_set_error(ctx, HSM_ERROR, "hsm_softkey_load()",
+        "in-process signing is not supported");
+    return HSM_ERROR;
+#endif
+}
+
+void
+hsm_softkey_unload(libhsm_key_t *key)
+{
+    pthread_mutex_lock(&_hsm_softkey_mutex);
+#ifdef HSM_SOFTSIGN
+    if (key->softkey) {
+        EVP_PKEY_free(key->softkey);
+    }
+#endif
+    key->softkey = NULL;
+    key->softkeystate = -1;
+    pthread_mutex_unlock(&_hsm_softkey_mutex);
+}
+
+static ldns_rdf *
+hsm_sign_digestinfo(hsm_ctx_t *ctx,
+                    hsm_session_t *session,
+                    const libhsm_key_t *key,
+                    CK_MECHANISM *sign_mechanism,
+                    CK_BYTE *data,
+                    CK_ULONG data_len)
+{
+    CK_RV rv;
+    CK_ULONG signatureLen = HSM_MAX_SIGNATURE_LENGTH;
+    CK_BYTE signature[HSM_MAX_SIGNATURE_LENGTH];
+#ifdef HSM_SOFTSIGN
+    EVP_PKEY *pkey;
+    ldns_rdf *result;
+
+    if ((pkey = hsm_softkey_acquire(session, key)) != NULL) {
+        result = hsm_softkey_sign(ctx, pkey, data, data_len);
+        EVP_PKEY_free(pkey);
+        return result;
+    }
+#endif
 
     rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_SignInit(
                                       session->session,
-                                      &sign_mechanism,
+                                      sign_mechanism,
                                       key->private_key);
     if (hsm_pkcs11_check_error(ctx, rv, "sign init")) {
-        free(data);
-        free(digest);
         return NULL;
     }
 
@@ -1931,20 +2165,36 @@ hsm_sign_buffer(hsm_ctx_t *ctx,
                                       signature,
                                       &signatureLen);
     if (hsm_pkcs11_check_error(ctx, rv, "sign final")) {
-        free(data);
-        free(digest);
         return NULL;
     }
 
-    sig_rdf = ldns_rdf_new_frm_data(LDNS_RDF_TYPE_B64,
-                                    signatureLen,
-                                    signature);
+    return ldns_rdf_new_frm_data(LDNS_RDF_TYPE_B64,
+                                 signatureLen,
+                                 signature);
+}
 
-    free(data);
-    free(digest);
+static ldns_rdf *
+hsm_sign_buffer(hsm_ctx_t *ctx,
+                ldns_buffer *sign_buf,
+                const libhsm_key_t *key,
+                ldns_algorithm algorithm)
+{
+    CK_MECHANISM sign_mechanism;
+    CK_BYTE data[HSM_MAX_DIGESTINFO_LENGTH];
+    CK_ULONG data_len;
+    hsm_session_t *session;
 
-    return sig_rdf;
+    session = hsm_find_key_session(ctx, key);
+    if (!session) return NULL;
 
+    if (hsm_sign_mechanism(algorithm, &sign_mechanism)) {
+        return NULL;
+    }
+    data_len = hsm_create_digestinfo(ctx, session, sign_buf, algorithm, data);
+    if (data_len == 0) {
+        return NULL;
+    }
+    return hsm_sign_digestinfo(ctx, session, key, &sign_mechanism, data, data_len);
 }
 
 static int
@@ -2087,6 +2337,7 @@ hsm_open2(struct engineconfig_repository* rlist,
         hsm_config_default(&module_config);
         module_config.use_pubkey = repo->use_pubkey;
         module_config.allow_extract = repo->allow_extract;
+        module_config.software_sign = repo->software_sign;
         if (repo->name && repo->tokenlabel) {
             if (repo->pin) {
                 result = hsm_attach(repo->name, repo->tokenlabel,
@@ -2151,6 +2402,16 @@ hsm_create_context()
     return newctx;
 }
 
+hsm_ctx_t *
+hsm_clone_context(hsm_ctx_t *ctx)
+{
+    hsm_ctx_t* newctx;
+    pthread_mutex_lock(&_hsm_ctx_mutex);
+    newctx = hsm_ctx_clone(ctx);
+    pthread_mutex_unlock(&_hsm_ctx_mutex);
+    return newctx;
+}
+
 int
 hsm_check_context()
 {
@@ -2241,6 +2502,11 @@ hsm_sign_params_free(hsm_sign_params_t *params)
 void
 libhsm_key_free(libhsm_key_t *key)
 {
+#ifdef HSM_SOFTSIGN
+    if (key->softkey) {
+        EVP_PKEY_free(key->softkey);
+    }
+#endif
     free(key->modulename);
     free(key);
 }
@@ -2879,6 +3145,81 @@ hsm_sign_rrset(hsm_ctx_t *ctx,
     return signature;
 }
 
+int
+hsm_sign_rrset_batch(hsm_ctx_t *ctx,
+                     int count,
+                     ldns_rr_list** rrsets,
+                     const libhsm_key_t *key,
+                     const hsm_sign_params_t *sign_params,
+                     ldns_rr** signatures)
+{
+    hsm_session_t *session;
+    CK_MECHANISM sign_mechanism;
+    CK_BYTE (*data)[HSM_MAX_DIGESTINFO_LENGTH];
+    CK_ULONG *data_len;
+    ldns_buffer *sign_buf;
+    ldns_rdf *b64_rdf;
+    int i, nsigned = 0;
+    size_t j;
+
+    for (i = 0; i < count; i++) {
+        signatures[i] = NULL;
+    }
+    if (!key) return 0;
+    if (!sign_params) return 0;
+    if (count <= 0) return 0;
+
+    session = hsm_find_key_session(ctx, key);
+    if (!session) return 0;
+    if (hsm_sign_mechanism(sign_params->algorithm, &sign_mechanism)) {
+        return 0;
+    }
+
+    /* First create all the digests, so the HSM is then kept busy with the
+     * sign operations back to back, using a single sign buffer. */
+    CHECKALLOC(data = malloc(sizeof(*data) * count));
+    CHECKALLOC(data_len = malloc(sizeof(CK_ULONG) * count));
+    sign_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+    for (i = 0; i < count; i++) {
+        data_len[i] = 0;
+        signatures[i] = hsm_create_empty_rrsig(rrsets[i], sign_params);
+        ldns_buffer_clear(sign_buf);
+        if (ldns_rrsig2buffer_wire(sign_buf, signatures[i])
+            != LDNS_STATUS_OK) {
+            continue;
+        }
+        for (j = 0; j < ldns_rr_list_rr_count(rrsets[i]); j++) {
+            ldns_rr2canonical(ldns_rr_list_rr(rrsets[i], j));
+        }
+        if (ldns_rr_list2buffer_wire(sign_buf, rrsets[i])
+            != LDNS_STATUS_OK) {
+            continue;
+        }
+        data_len[i] = hsm_create_digestinfo(ctx, session, sign_buf,
+                                            sign_params->algorithm, data[i]);
+    }
+    ldns_buffer_free(sign_buf);
+
+    for (i = 0; i < count; i++) {
+        b64_rdf = NULL;
+        if (data_len[i] > 0) {
+            b64_rdf = hsm_sign_digestinfo(ctx, session, key, &sign_mechanism,
+                                          data[i], data_len[i]);
+        }
+        if (b64_rdf) {
+            ldns_rr_rrsig_set_sig(signatures[i], b64_rdf);
+            ++nsigned;
+        } else {
+            /* signing went wrong */
+            ldns_rr_free(signatures[i]);
+            signatures[i] = NULL;
+        }
+    }
+    free(data_len);
+    free(data);
+    return nsigned;
+}
+
 int
 hsm_keytag(const char* loc, int alg, int ksk, uint16_t* keytag)
 {
@@ -3213,66 +3554,130 @@ hsm_print_tokeninfo(hsm_ctx_t *ctx)
     }
 }
 
-static int
-keycache_cmpfunc(const void* a, const void* b)
+#define KEYCACHE_SHARDS 16
+#define KEYCACHE_BUCKETS 64
+
+struct keycache_entry {
+    struct keycache_entry* next;
+    unsigned int hash;
+    char* locator;
+    libhsm_key_t* key;
+};
+
+struct keycache_shard {
+    pthread_rwlock_t lock;
+    struct keycache_entry* buckets[KEYCACHE_BUCKETS];
+};
+
+struct keycache_struct {
+    unsigned int generation;
+    struct keycache_shard shards[KEYCACHE_SHARDS];
+};
+
+/* only changed by keycache_create(), under _hsm_ctx_mutex */
+static unsigned int keycache_generations = 0;
+
+static unsigned int
+keycache_hash(const char* locator)
 {
-    const char* x = (const char*)a;
-    const char* y = (const char*)b;
-    return strcmp(x, y);
+    /* FNV-1a */
+    unsigned int hash = 2166136261U;
+    while (*locator) {
+        hash ^= (unsigned char) *locator++;
+        hash *= 16777619U;
+    }
+    return hash;
 }
 
-static void
-keycache_delfunc(ldns_rbnode_t* node, void* cargo)
+static struct keycache_entry*
+keycache_search(struct keycache_entry* entry, const char* locator, unsigned int hash)
 {
-    (void)cargo;
-    free((void*)node->key);
-    free(((libhsm_key_t*)node->data)->modulename);
-    free((void*)node->data);
-    free((void*)node);
+    while (entry) {
+        if (entry->hash == hash && !strcmp(entry->locator, locator))
+            break;
+        entry = entry->next;
+    }
+    return entry;
 }
 
 void
 keycache_create(hsm_ctx_t* ctx)
 {
-    ctx->keycache = ldns_rbtree_create(keycache_cmpfunc);
-    CHECKALLOC(_hsm_ctx->keycache_lock = malloc(sizeof (pthread_mutex_t)));
-    pthread_mutex_init(_hsm_ctx->keycache_lock, NULL);
+    int i, j;
+    CHECKALLOC(ctx->keycache = malloc(sizeof(struct keycache_struct)));
+    ctx->keycache->generation = ++keycache_generations;
+    for (i = 0; i < KEYCACHE_SHARDS; i++) {
+        pthread_rwlock_init(&ctx->keycache->shards[i].lock, NULL);
+        for (j = 0; j < KEYCACHE_BUCKETS; j++)
+            ctx->keycache->shards[i].buckets[j] = NULL;
+    }
 }
 
 void
 keycache_destroy(hsm_ctx_t* ctx)
 {
-    ldns_traverse_postorder(ctx->keycache, keycache_delfunc, NULL);
-    ldns_rbtree_free(ctx->keycache);
-    pthread_mutex_destroy(ctx->keycache_lock);
-    free(ctx->keycache_lock);
-    ctx->keycache_lock = NULL;
+    int i, j;
+    struct keycache_entry* entry;
+    struct keycache_entry* next;
+    if (!ctx->keycache)
+        return;
+    for (i = 0; i < KEYCACHE_SHARDS; i++) {
+        for (j = 0; j < KEYCACHE_BUCKETS; j++) {
+            for (entry = ctx->keycache->shards[i].buckets[j]; entry; entry = next) {
+                next = entry->next;
+                free(entry->locator);
+                libhsm_key_free(entry->key);
+                free(entry);
+            }
+        }
+        pthread_rwlock_destroy(&ctx->keycache->shards[i].lock);
+    }
+    free(ctx->keycache);
+    ctx->keycache = NULL;
+}
+
+unsigned int
+keycache_generation(hsm_ctx_t* ctx)
+{
+    return (ctx && ctx->keycache ? ctx->keycache->generation : 0);
 }
 
 const libhsm_key_t*
 keycache_lookup(hsm_ctx_t* ctx, const char* locator)
 {
-    ldns_rbnode_t* node;
-
-    pthread_mutex_lock(ctx->keycache_lock);
-        node = ldns_rbtree_search(ctx->keycache, locator);
-    pthread_mutex_unlock(ctx->keycache_lock);
-    if (node == LDNS_RBTREE_NULL || node == NULL) {
-        libhsm_key_t* key;
-        if ((key = hsm_find_key_by_id(ctx, locator)) == NULL) {
-            node = NULL;
-        } else {
-            CHECKALLOC(node = malloc(sizeof(ldns_rbnode_t)));
-            node->key = strdup(locator);
-            node->data = key;
-            pthread_mutex_lock(ctx->keycache_lock);
-                node = ldns_rbtree_insert(ctx->keycache, node);
-            pthread_mutex_unlock(ctx->keycache_lock);
-        }
-    }  
-
-    if (node == LDNS_RBTREE_NULL || node == NULL)
+    unsigned int hash;
+    struct keycache_shard* shard;
+    struct keycache_entry** bucket;
+    struct keycache_entry* entry;
+    libhsm_key_t* key;
+
+    hash = keycache_hash(locator);
+    shard = &ctx->keycache->shards[hash % KEYCACHE_SHARDS];
+    bucket = &shard->buckets[(hash / KEYCACHE_SHARDS) % KEYCACHE_BUCKETS];
+    pthread_rwlock_rdlock(&shard->lock);
+        entry = keycache_search(*bucket, locator, hash);
+    pthread_rwlock_unlock(&shard->lock);
+    if (entry)
+        return entry->key;
+
+    /* not cached, look it up in the HSM without holding the lock */
+    if ((key = hsm_find_key_by_id(ctx, locator)) == NULL)
         return NULL;
-    else
-        return node->data;
+    pthread_rwlock_wrlock(&shard->lock);
+        entry = keycache_search(*bucket, locator, hash);
+        if (entry == NULL) {
+            CHECKALLOC(entry = malloc(sizeof(struct keycache_entry)));
+            entry->hash = hash;
+            entry->locator = strdup(locator);
+            entry->key = key;
+            entry->next = *bucket;
+            *bucket = entry;
+            key = NULL;
+        }
+    pthread_rwlock_unlock(&shard->lock);
+    if (key) {
+        /* another thread inserted the key in the mean time */
+        libhsm_key_free(key);
+    }
+    return entry->key;
 }
@@ -53,6 +53,9 @@
  * maximum? */
 #define HSM_MAX_SIGNATURE_LENGTH 512
 
+/* DigestInfo prefix plus the largest digest (SHA-512) */
+#define HSM_MAX_DIGESTINFO_LENGTH 96
+
 /* Note that this constant also determines the size of the shared PIN memory.
  * Increasing this size requires any existing memory to be removed and should
  * be part of a migration script.
@@ -81,6 +84,7 @@
 typedef struct {
     unsigned int use_pubkey;     /*!< Maintain public keys in HSM */
     unsigned int allow_extract;  /*!< Generate CKA_EXTRACTABLE private keys */
+    unsigned int software_sign;  /*!< Sign in-process with extracted keys */
 } hsm_config_t;
 
 /*! Data type to describe an HSM */
@@ -105,6 +109,8 @@ typedef struct {
     char *modulename;   /*!< name of the module, as in hsm_session_t.module.name */
     unsigned long      private_key;  /*!< private key within module */
     unsigned long      public_key;   /*!< public key within module */
+    void              *softkey;      /*!< in-process private key, if extracted */
+    int                softkeystate; /*!< 0 untried, 1 extracted, -1 unavailable */
 } libhsm_key_t;
 
 /*! HSM Key Pair Information */
@@ -130,8 +136,7 @@ typedef struct {
     /*!< static string describing the first error */
     char error_message[HSM_ERROR_MSGSIZE];
     
-    ldns_rbtree_t* keycache;
-    pthread_mutex_t *keycache_lock;
+    struct keycache_struct* keycache;
 } hsm_ctx_t;
 
 
@@ -231,6 +236,19 @@ hsm_ctx_t *
 hsm_create_context(void);
 
 
+/*! Clone HSM context
+
+\param ctx HSM context to clone
+\return new context, or NULL on error
+
+Opens a new session on the token of each session in the context. The
+clone shares the key cache of the context, and can be freed with
+hsm_destroy_context()
+*/
+hsm_ctx_t *
+hsm_clone_context(hsm_ctx_t *ctx);
+
+
 /*! Check HSM context
 
 Check if the associated sessions are still alive.
@@ -511,11 +529,15 @@ void hsm_print_key(hsm_ctx_t *ctx, libhsm_key_t *key);
 void hsm_print_error(hsm_ctx_t *ctx);
 void hsm_print_tokeninfo(hsm_ctx_t *ctx);
 
-/* implementation of a key cache per context, needs changing see
- * OPENDNSSEC-799.
+/* implementation of a key cache shared by all contexts cloned from the
+ * global context.  Lookups only take a read lock on one of a number of
+ * shards, keys once found remain valid until the cache is destroyed.  The
+ * generation number changes each time the cache is recreated, callers that
+ * hold on to a key can use it to detect their key is no longer valid.
  */
 extern void keycache_create(hsm_ctx_t* ctx);
 extern void keycache_destroy(hsm_ctx_t* ctx);
 extern const libhsm_key_t* keycache_lookup(hsm_ctx_t* ctx, const char* locator);
+extern unsigned int keycache_generation(hsm_ctx_t* ctx);
 
 #endif /* HSM_H */
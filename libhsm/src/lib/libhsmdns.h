@@ -81,6 +81,57 @@ hsm_sign_rrset(hsm_ctx_t *ctx,
                const hsm_sign_params_t *sign_params);
 
 
+/*! Sign a number of RRsets using the same key and signing parameters
+
+The digests of all RRsets are computed first, after which the signature
+operations are issued back to back on the session of the key.  The returned
+ldns_rr structures can be freed with ldns_rr_free()
+
+\param context HSM context
+\param count Number of RRsets
+\param rrsets RRsets to sign
+\param key Key pair used to sign
+\param sign_params the signing parameters, shared by all RRsets
+\param signatures Array of count entries receiving the signatures, or NULL
+       for the RRsets that could not be signed
+\return int The number of RRsets signed
+*/
+int
+hsm_sign_rrset_batch(hsm_ctx_t *ctx,
+                     int count,
+                     ldns_rr_list** rrsets,
+                     const libhsm_key_t *key,
+                     const hsm_sign_params_t *sign_params,
+                     ldns_rr** signatures);
+
+
+/*! Extract the private key of a key pair for in-process signing
+
+The private key is wrapped by the HSM and unwrapped in-process, which only
+succeeds for keys generated as extractable (AllowExtraction).  Once
+extracted, signatures made with the key are computed in-process instead of
+through PKCS#11.  Without SoftwareSigning configured for the repository,
+this is only done on explicit request.
+
+\param context HSM context
+\param key Key pair
+\return int HSM_OK if the private key is available in-process
+*/
+int
+hsm_softkey_load(hsm_ctx_t *ctx, libhsm_key_t *key);
+
+
+/*! Release the in-process private key of a key pair
+
+Signatures made with the key go through PKCS#11 afterwards.
+
+\param key Key pair
+*/
+void
+hsm_softkey_unload(libhsm_key_t *key);
+
+
+
 /*! Get DNSKEY RR
 
 The returned ldns_rr structure can be freed with ldns_rr_free()
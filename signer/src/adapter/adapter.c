@@ -144,7 +144,7 @@ adapter_load_config(adapter_type* adapter)
  *
  */
 ods_status
-adapter_read(zone_type* zone, names_view_type view)
+adapter_read(zone_type* zone, names_view_type view, int nthreads)
 {
     if (!zone || !zone->adinbound) {
         ods_log_error("[%s] unable to read zone: no input adapter",
@@ -156,7 +156,7 @@ adapter_read(zone_type* zone, names_view_type view)
         case ADAPTER_FILE:
             ods_log_verbose("[%s] read zone %s from file input adapter %s",
                 adapter_str, zone->name, zone->adinbound->configstr);
-            return adfile_read(zone, view);
+            return adfile_read(zone, view, nthreads);
         case ADAPTER_DNS:
             ods_log_verbose("[%s] read zone %s from dns input adapter %s",
                 adapter_str, zone->name, zone->adinbound->configstr);
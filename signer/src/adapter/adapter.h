@@ -93,10 +93,12 @@ int adapter_compare(adapter_type* a1, adapter_type* a2);
 /**
  * Read zone from input adapter.
  * \param[in] zone zone
+ * \param[in] view view to read the zone into
+ * \param[in] nthreads number of threads a zone file may be parsed with
  * \return ods_status status
  *
  */
-ods_status adapter_read(zone_type* zone, names_view_type view);
+ods_status adapter_read(zone_type* zone, names_view_type view, int nthreads);
 
 /**
  * Write zone to output adapter.
@@ -50,7 +50,8 @@
 #include <stdlib.h>
 
 static const char* adapter_str = "adapter";
-static ods_status addns_read_pkt(FILE* fd, zone_type* zone, names_view_type view);
+static ods_status addns_read_pkt(FILE* fd, zone_type* zone, names_view_type view,
+    uint8_t* wire);
 static ods_status addns_read_file(FILE* fd, zone_type* zone, names_view_type view);
 
 
@@ -130,12 +131,79 @@ addns_read_line:
 }
 
 
+/**
+ * Read the next record from the xfrd spool.
+ *
+ */
+static int
+addns_read_spool_record(FILE* fd, uint8_t* kind, uint8_t* data,
+    uint16_t* len)
+{
+    uint8_t header[3];
+    if (fread(header, sizeof(header), 1, fd) != 1) {
+        return 1;
+    }
+    *kind = header[0];
+    *len = (uint16_t) ((header[1] << 8) | header[2]);
+    if (*len && fread(data, *len, 1, fd) != 1) {
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Read the next RR from the xfrd spool. Sets complete at the end of the
+ * transfer, returns NULL without setting it if the transfer is incomplete.
+ *
+ */
+static ldns_rr*
+addns_read_spool_rr(FILE* fd, uint8_t* wire, unsigned* complete,
+    ldns_status* status, unsigned int* l)
+{
+    ldns_rr* rr = NULL;
+    uint8_t kind = 0;
+    uint16_t len = 0;
+    size_t pos = 0;
+
+    *status = LDNS_STATUS_OK;
+    if (addns_read_spool_record(fd, &kind, wire, &len)) {
+        /* EOF */
+        return NULL;
+    }
+    (*l)++;
+    switch (kind) {
+        case XFRD_SPOOL_RR:
+            *status = ldns_wire2rr(&rr, wire, len, &pos, LDNS_SECTION_ANSWER);
+            if (*status != LDNS_STATUS_OK) {
+                ods_log_error("[%s] error parsing RR at record %u (%s)",
+                    adapter_str, *l, ldns_get_errorstr_by_id(*status));
+                ldns_rr_free(rr);
+                return NULL;
+            }
+            return rr;
+        case XFRD_SPOOL_END:
+            /* end of pkt */
+            *complete = 1;
+            return NULL;
+        case XFRD_SPOOL_BEGIN:
+            /* begin packet but previous not ended, rollback */
+            return NULL;
+        default:
+            ods_log_error("[%s] bogus xfrd record %u of kind %u", adapter_str,
+                *l, (unsigned) kind);
+            *status = LDNS_STATUS_ERR;
+            return NULL;
+    }
+}
+
+
 /**
  * Read pkt from file.
  *
  */
 static ods_status
-addns_read_pkt(FILE* fd, zone_type* zone, names_view_type view)
+addns_read_pkt(FILE* fd, zone_type* zone, names_view_type view, uint8_t* wire)
 {
     ldns_rr* rr = NULL;
     long startpos = 0;
@@ -158,6 +226,9 @@ addns_read_pkt(FILE* fd, zone_type* zone, names_view_type view)
     unsigned line_update_interval = 100000;
     unsigned line_update = line_update_interval;
     unsigned l = 0;
+    unsigned complete = 0;
+    uint8_t kind = 0;
+    uint16_t spoollen = 0;
     char* xfrd;
     char* fin;
     char* fout;
@@ -168,16 +239,31 @@ addns_read_pkt(FILE* fd, zone_type* zone, names_view_type view)
 
 
     fpos = ftell(fd);
-    len = adutil_readline_frm_file(fd, line, &l, 1);
-    if (len < 0) {
-        /* -1 EOF */
-        return ODS_STATUS_EOF;
-    }
-    adutil_rtrim_line(line, &len);
-    if (ods_strcmp(";;BEGINPACKET", line) != 0) {
-        ods_log_error("[%s] bogus xfrd file zone %s, missing ;;BEGINPACKET (was %s)",
-            adapter_str, zone->name, line);
-        return ODS_STATUS_ERR;
+    if (wire) {
+        line[0] = '\0';
+        if (addns_read_spool_record(fd, &kind, wire, &spoollen)) {
+            /* EOF */
+            return ODS_STATUS_EOF;
+        }
+        if (kind != XFRD_SPOOL_BEGIN
+            || spoollen != strlen(XFRD_SPOOL_MAGIC)
+            || memcmp(wire, XFRD_SPOOL_MAGIC, spoollen) != 0) {
+            ods_log_error("[%s] bogus xfrd file zone %s, missing begin of "
+                "transfer", adapter_str, zone->name);
+            return ODS_STATUS_ERR;
+        }
+    } else {
+        len = adutil_readline_frm_file(fd, line, &l, 1);
+        if (len < 0) {
+            /* -1 EOF */
+            return ODS_STATUS_EOF;
+        }
+        adutil_rtrim_line(line, &len);
+        if (ods_strcmp(";;BEGINPACKET", line) != 0) {
+            ods_log_error("[%s] bogus xfrd file zone %s, missing ;;BEGINPACKET (was %s)",
+                adapter_str, zone->name, line);
+            return ODS_STATUS_ERR;
+        }
     }
     startpos = fpos;
     fpos = ftell(fd);
@@ -203,8 +289,8 @@ addns_read_pkt(FILE* fd, zone_type* zone, names_view_type view)
     ttl = adapi_get_ttl(zone);
 
     /* read RRs */
-    while ((rr = addns_read_rr(fd, line, &orig, &prev, &ttl, &status, &l))
-        != NULL) {
+    while ((rr = wire ? addns_read_spool_rr(fd, wire, &complete, &status, &l)
+        : addns_read_rr(fd, line, &orig, &prev, &ttl, &status, &l)) != NULL) {
         /* update file position */
         fpos = ftell(fd);
         /* check status */
@@ -378,7 +464,10 @@ addns_read_pkt(FILE* fd, zone_type* zone, names_view_type view)
         prev = NULL;
     }
     /* check again */
-    if (ods_strcmp(";;ENDPACKET", line) == 0) {
+    if (!wire && ods_strcmp(";;ENDPACKET", line) == 0) {
+        complete = 1;
+    }
+    if (complete) {
         ods_log_verbose("[%s] xfr zone %s on disk complete, commit to db",
             adapter_str, zone->name);
             startpos = 0;
@@ -429,6 +518,7 @@ addns_read_pkt(FILE* fd, zone_type* zone, names_view_type view)
                 adapter_str, zone->name, ods_status2str(result));
         } else {
             pthread_mutex_lock(&zone->xfrd->rw_lock);
+            xfrd_spool_close(zone->xfrd);
             if (ods_file_lastmodified(xfrd)) {
                 result = ods_file_copy(xfrd, fout, 0, 1);
                 if (result != ODS_STATUS_OK) {
@@ -464,9 +554,18 @@ static ods_status
 addns_read_file(FILE* fd, zone_type* zone, names_view_type view)
 {
     ods_status status = ODS_STATUS_OK;
+    uint8_t* wire = NULL;
+    int c;
 
+    CHECKALLOC(wire = (uint8_t*) malloc(LDNS_MAX_PACKETLEN));
     while (status == ODS_STATUS_OK) {
-        status = addns_read_pkt(fd, zone, view);
+        /* transfers spooled by an older version are in text format */
+        if ((c = getc(fd)) == EOF) {
+            status = ODS_STATUS_EOF;
+            break;
+        }
+        ungetc(c, fd);
+        status = addns_read_pkt(fd, zone, view, c == ';' ? NULL : wire);
         if (status == ODS_STATUS_OK) {
             pthread_mutex_lock(&zone->xfrd->serial_lock);
             zone->xfrd->serial_xfr = *(zone->inboundserial);
@@ -474,6 +573,7 @@ addns_read_file(FILE* fd, zone_type* zone, names_view_type view)
             pthread_mutex_unlock(&zone->xfrd->serial_lock);
         }
     }
+    free(wire);
     if (status == ODS_STATUS_EOF) {
         status = ODS_STATUS_OK;
     }
@@ -704,6 +804,7 @@ addns_read(zone_type* z, names_view_type v)
         ods_log_error("[%s] unable to build paths to xfrd files", adapter_str);
         return ODS_STATUS_MALLOC_ERR;
     }
+    xfrd_spool_close(z->xfrd);
     if (rename(xfrfile, file) != 0) {
         pthread_mutex_unlock(&z->xfrd->serial_lock);
         pthread_mutex_unlock(&z->xfrd->rw_lock);
@@ -751,6 +852,11 @@ addns_write(zone_type* z, names_view_type view)
     ods_log_assert(z->adoutbound);
     ods_log_assert(z->adoutbound->type == ADAPTER_DNS);
 
+    /* pre-render the zone for outgoing zone transfers */
+    if (putxfr(z, view, ".axfr")) {
+        ods_log_warning("[%s] unable to write transfer image for zone %s, "
+            "transfers will be rendered on request", adapter_str, z->name);
+    }
     dnsout_send_notify(z, view);
     return ODS_STATUS_OK;
 }
@@ -40,20 +40,117 @@
 #include "status.h"
 #include "util.h"
 #include "signer/zone.h"
+#include "janitor.h"
+#include "locks.h"
 
 #include <ldns/ldns.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 
 static const char* adapter_str = "adapter";
-static ods_status adfile_read_file(FILE* fd, zone_type* zone, names_view_type view);
+
+/* Zone files are parsed in chunks of about this size */
+#define ADFILE_CHUNKSIZE (4*1024*1024)
+
+size_t adfile_chunksize = ADFILE_CHUNKSIZE;
+
+/* Identifies an RR by its owner name, type and rdata in canonical wire
+ * format, without its TTL and class.
+ */
+struct adfile_fingerprint {
+    unsigned char digest[16];
+};
+
+/* Fingerprints of all RRs read from a zone file */
+struct adfile_fingerprints {
+    struct adfile_fingerprint* items;
+    size_t count;
+    size_t size;
+};
+
+static ods_status adfile_read_file(FILE* fd, zone_type* zone, names_view_type view, struct adfile_fingerprints* seen);
+
+
+/**
+ * Compute the fingerprint of an RR.
+ *
+ */
+static void
+adfile_fingerprint(ldns_buffer* buffer, ldns_rr* rr, struct adfile_fingerprint* fingerprint)
+{
+    unsigned char digest[LDNS_SHA1_DIGEST_LENGTH];
+    size_t i;
+    ldns_buffer_clear(buffer);
+    (void) ldns_rdf2buffer_wire_canonical(buffer, ldns_rr_owner(rr));
+    ldns_buffer_write_u16(buffer, ldns_rr_get_type(rr));
+    for (i = 0; i < ldns_rr_rd_count(rr); i++) {
+        (void) ldns_rdf2buffer_wire_canonical(buffer, ldns_rr_rdf(rr, i));
+    }
+    ldns_sha1(ldns_buffer_begin(buffer), ldns_buffer_position(buffer), digest);
+    memcpy(fingerprint->digest, digest, sizeof(fingerprint->digest));
+}
+
+static int
+adfile_fingerprint_compare(const void* a, const void* b)
+{
+    return memcmp(((const struct adfile_fingerprint*)a)->digest,
+        ((const struct adfile_fingerprint*)b)->digest,
+        sizeof(((const struct adfile_fingerprint*)a)->digest));
+}
+
+static void
+adfile_fingerprint_add(struct adfile_fingerprints* seen, struct adfile_fingerprint* items, size_t count)
+{
+    if (seen->count + count > seen->size) {
+        seen->size = (seen->size ? seen->size * 2 : 1024);
+        if (seen->size < seen->count + count) {
+            seen->size = seen->count + count;
+        }
+        CHECKALLOC(seen->items = realloc(seen->items, seen->size * sizeof(struct adfile_fingerprint)));
+    }
+    memcpy(&seen->items[seen->count], items, count * sizeof(struct adfile_fingerprint));
+    seen->count += count;
+}
+
+
+/**
+ * Add an RR read from the zone file to the zone.
+ *
+ */
+static ods_status
+adfile_add_rr(zone_type* zone, names_view_type view, ldns_rr* rr,
+    unsigned int l, const char* line, uint32_t* serial)
+{
+    ods_status result;
+    /* SOA? */
+    if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA) {
+        *serial =
+          ldns_rdf2native_int32(ldns_rr_rdf(rr, SE_SOA_RDATA_SERIAL));
+    }
+    /* add to the database */
+    result = adapi_add_rr(zone, view, rr, 0);
+    if (result == ODS_STATUS_UNCHANGED) {
+        ods_log_debug("[%s] skipping RR at line %i (duplicate): %s",
+            adapter_str, l, (line ? line : ""));
+        result = ODS_STATUS_OK;
+    } else if (result != ODS_STATUS_OK) {
+        ods_log_error("[%s] error adding RR at line %i: %s",
+            adapter_str, l, (line ? line : ""));
+    }
+    return result;
+}
 
 /**
  * Read the next RR from zone file.
  *
  */
 static ldns_rr*
-adfile_read_rr(FILE* fd, zone_type* zone, names_view_type view, char* line, ldns_rdf** orig,
+adfile_read_rr(FILE* fd, zone_type* zone, names_view_type view,
+    struct adfile_fingerprints* seen, char* line, ldns_rdf** orig,
     ldns_rdf** prev, uint32_t* ttl, ldns_status* status, unsigned int* l)
 {
     ldns_rr* rr = NULL;
@@ -118,7 +215,7 @@ adfile_read_line:
                     }
                     fd_include = ods_fopen(line + offset, NULL, "r");
                     if (fd_include) {
-                        s = adfile_read_file(fd_include, zone, view);
+                        s = adfile_read_file(fd_include, zone, view, seen);
                         ods_fclose(fd_include);
                     } else {
                         ods_log_error("[%s] unable to open include file %s",
@@ -191,7 +288,8 @@ adfile_read_rr:
  *
  */
 static ods_status
-adfile_read_file(FILE* fd, zone_type* zone, names_view_type view)
+adfile_read_file(FILE* fd, zone_type* zone, names_view_type view,
+    struct adfile_fingerprints* seen)
 {
     ods_status result = ODS_STATUS_OK;
     ldns_rr* rr = NULL;
@@ -205,6 +303,8 @@ adfile_read_file(FILE* fd, zone_type* zone, names_view_type view)
     unsigned int line_update_interval = 100000;
     unsigned int line_update = line_update_interval;
     unsigned int l = 0;
+    ldns_buffer* buffer;
+    struct adfile_fingerprint fingerprint;
 
     ods_log_assert(fd);
     ods_log_assert(zone);
@@ -224,8 +324,9 @@ adfile_read_file(FILE* fd, zone_type* zone, names_view_type view)
     }
     /* $TTL <default ttl> */
     ttl = adapi_get_ttl(zone);
+    buffer = ldns_buffer_new(LDNS_MAX_PACKETLEN);
     /* read RRs */
-    while ((rr = adfile_read_rr(fd, zone, view, line, &orig, &prev, &ttl,
+    while ((rr = adfile_read_rr(fd, zone, view, seen, line, &orig, &prev, &ttl,
         &status, &l)) != NULL) {
         /* check status */
         if (status != LDNS_STATUS_OK) {
@@ -239,32 +340,19 @@ adfile_read_file(FILE* fd, zone_type* zone, names_view_type view)
             ods_log_debug("[%s] ...at line %i: %s", adapter_str, l, line);
             line_update += line_update_interval;
         }
-        /* SOA? */
-        if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA) {
-            new_serial =
-              ldns_rdf2native_int32(ldns_rr_rdf(rr, SE_SOA_RDATA_SERIAL));
+        if (seen) {
+            adfile_fingerprint(buffer, rr, &fingerprint);
+            adfile_fingerprint_add(seen, &fingerprint, 1);
         }
-        /* add to the database */
-        result = adapi_add_rr(zone, view, rr, 0);
-        if (result == ODS_STATUS_UNCHANGED) {
-            ods_log_debug("[%s] skipping RR at line %i (duplicate): %s",
-                adapter_str, l, line);
-            ldns_rr_free(rr);
-            rr = NULL;
-            result = ODS_STATUS_OK;
-            continue;
-        } else if (result != ODS_STATUS_OK) {
-            ods_log_error("[%s] error adding RR at line %i: %s",
-                adapter_str, l, line);
-            ldns_rr_free(rr);
-            rr = NULL;
+        result = adfile_add_rr(zone, view, rr, l, line, &new_serial);
+        ldns_rr_free(rr);
+        rr = NULL;
+        if (result != ODS_STATUS_OK) {
             break;
         }
-        if(rr) {
-            ldns_rr_free(rr);
-        }
     }
     /* and done */
+    ldns_buffer_free(buffer);
     if (orig) {
         ldns_rdf_deep_free(orig);
         orig = NULL;
@@ -288,15 +376,440 @@ adfile_read_file(FILE* fd, zone_type* zone, names_view_type view)
 }
 
 
+/* A piece of the zone file that starts at a line with an owner name, and
+ * the directives in effect at that point.
+ */
+struct adfile_chunk {
+    const char* data;
+    size_t size;
+    unsigned int line;
+    const char* origin;
+    size_t originlen;
+    const char* ttl;
+    size_t ttllen;
+    int parsed;
+    ods_status status;
+    int count;
+    int capacity;
+    ldns_rr** rrs;
+    unsigned int* lines;
+    struct adfile_fingerprint* fingerprints;
+};
+
+struct adfile_parser {
+    zone_type* zone;
+    ldns_rdf* origin;
+    uint32_t ttl;
+    struct adfile_chunk* chunks;
+    int nchunks;
+    int nextchunk;
+    int applied;
+    int window;
+    int abort;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+
+/**
+ * Take the value of a directive, up to a comment or the end of the line.
+ *
+ */
+static const char*
+adfile_directive(const char* data, size_t size, size_t offset, size_t* len)
+{
+    size_t end;
+    while (offset < size && (data[offset] == ' ' || data[offset] == '\t')) {
+        offset++;
+    }
+    for (end = offset; end < size && data[end] != '\n' && data[end] != ';'; end++)
+        ;
+    while (end > offset && isspace((int)data[end-1])) {
+        end--;
+    }
+    *len = end - offset;
+    return &data[offset];
+}
+
+
 /**
- * Read zone from zonefile.
+ * Split the zone file in chunks, at lines that start with an owner name
+ * outside of parentheses.  This scan follows the quoting, comment and
+ * bracket rules of adutil_readline_frm_file(), and keeps track of the
+ * $ORIGIN and $TTL directives so each chunk can be parsed on its own.
+ * \return int number of chunks, or -1 if the file has $INCLUDE directives
+ *
+ */
+static int
+adfile_split(const char* data, size_t size, struct adfile_chunk** chunksptr)
+{
+    struct adfile_chunk* chunks = NULL;
+    int nchunks = 0, maxchunks = 0;
+    const char* origin = NULL;
+    const char* ttl = NULL;
+    size_t originlen = 0, ttllen = 0;
+    size_t p, nextcut = 0;
+    unsigned int line = 0;
+    int linestart = 1, depth = 0, in_string = 0, comment = 0;
+    char c, lc = 0;
+
+    for (p = 0; p < size; p++) {
+        c = data[p];
+        if (linestart) {
+            linestart = 0;
+            if (c == '$') {
+                if (size - p > 8 && strncmp(&data[p], "$INCLUDE", 8) == 0 && isspace((int)data[p+8])) {
+                    free(chunks);
+                    return -1;
+                } else if (size - p > 7 && strncmp(&data[p], "$ORIGIN", 7) == 0 && isspace((int)data[p+7])) {
+                    origin = adfile_directive(data, size, p + 8, &originlen);
+                } else if (size - p > 4 && strncmp(&data[p], "$TTL", 4) == 0 && isspace((int)data[p+4])) {
+                    ttl = adfile_directive(data, size, p + 5, &ttllen);
+                }
+            } else if (p >= nextcut && !isspace((int)c) && c != ';') {
+                if (nchunks == maxchunks) {
+                    maxchunks = (maxchunks ? maxchunks * 2 : 16);
+                    CHECKALLOC(chunks = realloc(chunks, maxchunks * sizeof(struct adfile_chunk)));
+                }
+                if (nchunks > 0) {
+                    chunks[nchunks-1].size = &data[p] - chunks[nchunks-1].data;
+                }
+                memset(&chunks[nchunks], 0, sizeof(struct adfile_chunk));
+                chunks[nchunks].data = (nchunks > 0 ? &data[p] : data);
+                chunks[nchunks].line = (nchunks > 0 ? line : 0);
+                chunks[nchunks].origin = origin;
+                chunks[nchunks].originlen = originlen;
+                chunks[nchunks].ttl = ttl;
+                chunks[nchunks].ttllen = ttllen;
+                nchunks++;
+                nextcut = p + adfile_chunksize;
+            }
+        }
+        if (comment) {
+            if (c == '\n') {
+                comment = 0;
+            }
+        } else if (c == '"' && lc != '\\') {
+            in_string = 1 - in_string;
+        } else if (!in_string && lc != '\\') {
+            if (c == '(') {
+                depth++;
+            } else if (c == ')' && depth > 0) {
+                depth--;
+            } else if (c == ';') {
+                comment = 1;
+            }
+        }
+        if (c == '\n') {
+            line++;
+            if (depth == 0) {
+                linestart = 1;
+            }
+        }
+        lc = c;
+    }
+    if (nchunks > 0) {
+        chunks[nchunks-1].size = &data[size] - chunks[nchunks-1].data;
+        /* the first chunk starts with whatever precedes the first owner */
+        chunks[0].origin = NULL;
+        chunks[0].ttl = NULL;
+    }
+    *chunksptr = chunks;
+    return nchunks;
+}
+
+
+/**
+ * Parse a chunk of the zone file into RRs and their fingerprints.
+ *
+ */
+static void
+adfile_parse_chunk(struct adfile_parser* parser, struct adfile_chunk* chunk)
+{
+    FILE* fd;
+    char* line;
+    char* value;
+    const char* endptr;
+    ldns_rr* rr;
+    ldns_rdf* orig = NULL;
+    ldns_rdf* prev = NULL;
+    ldns_buffer* buffer;
+    ldns_status status = LDNS_STATUS_OK;
+    uint32_t ttl = parser->ttl;
+    unsigned int l = chunk->line;
+
+    chunk->status = ODS_STATUS_OK;
+    if (chunk->origin) {
+        CHECKALLOC(value = strndup(chunk->origin, chunk->originlen));
+        orig = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, value);
+        free(value);
+    } else {
+        orig = ldns_rdf_clone(parser->origin);
+    }
+    if (chunk->ttl) {
+        CHECKALLOC(value = strndup(chunk->ttl, chunk->ttllen));
+        ttl = ldns_str2period(value, &endptr);
+        free(value);
+    }
+    fd = fmemopen((void*)chunk->data, chunk->size, "r");
+    if (!orig || !fd) {
+        ods_log_error("[%s] unable to parse zone file at line %i", adapter_str, chunk->line);
+        chunk->status = ODS_STATUS_ERR;
+        if (orig) {
+            ldns_rdf_deep_free(orig);
+        }
+        if (fd) {
+            fclose(fd);
+        }
+        return;
+    }
+    CHECKALLOC(line = malloc(SE_ADFILE_MAXLINE));
+    buffer = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+    while ((rr = adfile_read_rr(fd, parser->zone, NULL, NULL, line, &orig, &prev,
+        &ttl, &status, &l)) != NULL) {
+        if (chunk->count == chunk->capacity) {
+            chunk->capacity = (chunk->capacity ? chunk->capacity * 2 : 1024);
+            CHECKALLOC(chunk->rrs = realloc(chunk->rrs, chunk->capacity * sizeof(ldns_rr*)));
+            CHECKALLOC(chunk->lines = realloc(chunk->lines, chunk->capacity * sizeof(unsigned int)));
+            CHECKALLOC(chunk->fingerprints = realloc(chunk->fingerprints, chunk->capacity * sizeof(struct adfile_fingerprint)));
+        }
+        chunk->rrs[chunk->count] = rr;
+        chunk->lines[chunk->count] = l;
+        adfile_fingerprint(buffer, rr, &chunk->fingerprints[chunk->count]);
+        chunk->count++;
+    }
+    if (status != LDNS_STATUS_OK) {
+        ods_log_error("[%s] error reading RR at line %i (%s)",
+            adapter_str, l, ldns_get_errorstr_by_id(status));
+        chunk->status = ODS_STATUS_ERR;
+    }
+    ldns_buffer_free(buffer);
+    free(line);
+    fclose(fd);
+    ldns_rdf_deep_free(orig);
+    if (prev) {
+        ldns_rdf_deep_free(prev);
+    }
+}
+
+
+static void
+adfile_release_chunk(struct adfile_chunk* chunk)
+{
+    int i;
+    for (i = 0; i < chunk->count; i++) {
+        ldns_rr_free(chunk->rrs[i]);
+    }
+    free(chunk->rrs);
+    free(chunk->lines);
+    free(chunk->fingerprints);
+    chunk->rrs = NULL;
+    chunk->lines = NULL;
+    chunk->fingerprints = NULL;
+    chunk->count = 0;
+}
+
+
+/**
+ * Parse chunks, keeping no more than a window of parsed chunks ahead of
+ * the chunks applied to the zone.
+ *
+ */
+static void
+adfile_parse_run(struct adfile_parser* parser)
+{
+    int i;
+    pthread_mutex_lock(&parser->lock);
+    for (;;) {
+        while (!parser->abort && parser->nextchunk < parser->nchunks &&
+            parser->nextchunk >= parser->applied + parser->window) {
+            pthread_cond_wait(&parser->cond, &parser->lock);
+        }
+        if (parser->abort || parser->nextchunk >= parser->nchunks) {
+            break;
+        }
+        i = parser->nextchunk++;
+        pthread_mutex_unlock(&parser->lock);
+        adfile_parse_chunk(parser, &parser->chunks[i]);
+        pthread_mutex_lock(&parser->lock);
+        parser->chunks[i].parsed = 1;
+        pthread_cond_broadcast(&parser->cond);
+    }
+    pthread_mutex_unlock(&parser->lock);
+}
+
+
+/**
+ * Read a zone file that is mapped in memory, parsing it with a number of
+ * threads while the RRs are added to the zone in file order.
+ *
+ */
+static ods_status
+adfile_read_chunks(zone_type* zone, names_view_type view, struct adfile_chunk* chunks,
+    int nchunks, int nthreads, struct adfile_fingerprints* seen, size_t* nrrs)
+{
+    struct adfile_parser parser;
+    janitor_thread_t* threads = NULL;
+    ods_status result = ODS_STATUS_OK;
+    uint32_t new_serial = 0;
+    int i, j;
+
+    parser.zone = zone;
+    parser.origin = adapi_get_origin(zone);
+    parser.ttl = adapi_get_ttl(zone);
+    parser.chunks = chunks;
+    parser.nchunks = nchunks;
+    parser.nextchunk = 0;
+    parser.applied = 0;
+    parser.window = nthreads * 2;
+    parser.abort = 0;
+    if (!parser.origin) {
+        ods_log_error("[%s] error getting default value for $ORIGIN",
+            adapter_str);
+        return ODS_STATUS_ERR;
+    }
+    pthread_mutex_init(&parser.lock, NULL);
+    pthread_cond_init(&parser.cond, NULL);
+    if (nthreads > nchunks) {
+        nthreads = nchunks;
+    }
+    if (nthreads > 1) {
+        CHECKALLOC(threads = malloc(nthreads * sizeof(janitor_thread_t)));
+        for (i = 0; i < nthreads; i++) {
+            janitor_thread_create(&threads[i], workerthreadclass, (janitor_runfn_t)adfile_parse_run, &parser);
+        }
+    }
+    for (i = 0; i < nchunks && result == ODS_STATUS_OK; i++) {
+        pthread_mutex_lock(&parser.lock);
+        while (!chunks[i].parsed) {
+            if (parser.nextchunk == i) {
+                /* no thread picked it up, parse it ourselves */
+                parser.nextchunk++;
+                pthread_mutex_unlock(&parser.lock);
+                adfile_parse_chunk(&parser, &chunks[i]);
+                pthread_mutex_lock(&parser.lock);
+                chunks[i].parsed = 1;
+            } else {
+                pthread_cond_wait(&parser.cond, &parser.lock);
+            }
+        }
+        pthread_mutex_unlock(&parser.lock);
+        result = chunks[i].status;
+        for (j = 0; j < chunks[i].count && result == ODS_STATUS_OK; j++) {
+            result = adfile_add_rr(zone, view, chunks[i].rrs[j], chunks[i].lines[j], NULL, &new_serial);
+        }
+        *nrrs += chunks[i].count;
+        adfile_fingerprint_add(seen, chunks[i].fingerprints, chunks[i].count);
+        adfile_release_chunk(&chunks[i]);
+        pthread_mutex_lock(&parser.lock);
+        parser.applied = i + 1;
+        if (result != ODS_STATUS_OK) {
+            parser.abort = 1;
+        }
+        pthread_cond_broadcast(&parser.cond);
+        pthread_mutex_unlock(&parser.lock);
+    }
+    if (threads) {
+        for (i = 0; i < nthreads; i++) {
+            janitor_thread_join(threads[i]);
+        }
+        free(threads);
+    }
+    for (i = 0; i < nchunks; i++) {
+        adfile_release_chunk(&chunks[i]);
+    }
+    pthread_cond_destroy(&parser.cond);
+    pthread_mutex_destroy(&parser.lock);
+    /* input zone ok, set inbound serial */
+    if (result == ODS_STATUS_OK) {
+        free(zone->inboundserial);
+        zone->inboundserial = malloc(sizeof(uint32_t));
+        *zone->inboundserial = new_serial;
+    }
+    return result;
+}
+
+
+/**
+ * Remove the RRs from the zone that were not read from the zone file.  The
+ * SOA, which is replaced rather than added, and the RRs maintained by the
+ * signer itself are left alone.
+ *
+ */
+static void
+adfile_remove_absent(zone_type* zone, names_view_type view, struct adfile_fingerprints* seen)
+{
+    names_iterator domainiter;
+    names_iterator rrsetiter;
+    names_iterator rriter;
+    recordset_type record;
+    ldns_rr_type recordtype;
+    ldns_rr* rr;
+    ldns_rr_list* absent;
+    ldns_buffer* buffer;
+    struct adfile_fingerprint fingerprint;
+    size_t i;
+
+    qsort(seen->items, seen->count, sizeof(struct adfile_fingerprint), adfile_fingerprint_compare);
+    absent = ldns_rr_list_new();
+    buffer = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+    for (domainiter = names_viewiterator(view, NULL); names_iterate(&domainiter, &record); names_advance(&domainiter, NULL)) {
+        for (rrsetiter = names_recordalltypes(record); names_iterate(&rrsetiter, &recordtype); names_advance(&rrsetiter, NULL)) {
+            switch (recordtype) {
+                case LDNS_RR_TYPE_SOA:
+                case LDNS_RR_TYPE_DNSKEY:
+                case LDNS_RR_TYPE_NSEC3PARAMS:
+                case LDNS_RR_TYPE_RRSIG:
+                case LDNS_RR_TYPE_NSEC:
+                case LDNS_RR_TYPE_NSEC3:
+                    continue;
+                default:
+                    break;
+            }
+            for (rriter = names_recordallvalues(record, recordtype); names_iterate(&rriter, &rr); names_advance(&rriter, NULL)) {
+                if (ldns_rr_get_type(rr) != recordtype) {
+                    continue;
+                }
+                adfile_fingerprint(buffer, rr, &fingerprint);
+                if (!bsearch(&fingerprint, seen->items, seen->count, sizeof(struct adfile_fingerprint), adfile_fingerprint_compare)) {
+                    ldns_rr_list_push_rr(absent, ldns_rr_clone(rr));
+                }
+            }
+        }
+    }
+    if (ldns_rr_list_rr_count(absent) > 0) {
+        ods_log_verbose("[%s] zone %s: removing %lu RRs no longer in zone file",
+            adapter_str, zone->name, (unsigned long) ldns_rr_list_rr_count(absent));
+    }
+    for (i = 0; i < ldns_rr_list_rr_count(absent); i++) {
+        (void) zone_del_rr(zone, view, ldns_rr_list_rr(absent, i));
+    }
+    ldns_rr_list_deep_free(absent);
+    ldns_buffer_free(buffer);
+}
+
+
+/**
+ * Read zone from zonefile.  The file is split in chunks that are parsed
+ * in parallel.  Zone files with $INCLUDE directives, or that cannot be
+ * mapped in memory, are read sequentially, as are all zone files if the
+ * chunk size is 0.  RRs that are in the zone but
+ * no longer in the file are removed afterwards.
  *
  */
 ods_status
-adfile_read(zone_type* adzone, names_view_type view)
+adfile_read(zone_type* adzone, names_view_type view, int nthreads)
 {
     FILE* fd = NULL;
     ods_status status = ODS_STATUS_OK;
+    struct adfile_fingerprints seen = { NULL, 0, 0 };
+    struct adfile_chunk* chunks = NULL;
+    struct timespec start, end;
+    struct stat statbuf;
+    double elapsed;
+    void* data = MAP_FAILED;
+    size_t nrrs = 0;
+    int nchunks = -1;
     if (!adzone || !adzone->adinbound || !adzone->adinbound->configstr) {
         ods_log_error("[%s] unable to read file: no input adapter",
             adapter_str);
@@ -306,8 +819,39 @@ adfile_read(zone_type* adzone, names_view_type view)
     if (!fd) {
         return ODS_STATUS_FOPEN_ERR;
     }
-    status = adfile_read_file(fd, adzone, view);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (fstat(fileno(fd), &statbuf) != 0) {
+        statbuf.st_size = 0;
+    } else if (statbuf.st_size > 0) {
+        data = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fileno(fd), 0);
+    }
+    if (data != MAP_FAILED && adfile_chunksize > 0) {
+        (void) madvise(data, statbuf.st_size, MADV_SEQUENTIAL);
+        nchunks = adfile_split(data, statbuf.st_size, &chunks);
+    }
+    if (nchunks > 0) {
+        status = adfile_read_chunks(adzone, view, chunks, nchunks,
+            (nthreads > 0 ? nthreads : 1), &seen, &nrrs);
+        free(chunks);
+    } else {
+        status = adfile_read_file(fd, adzone, view, &seen);
+        nrrs = seen.count;
+    }
+    if (data != MAP_FAILED) {
+        munmap(data, statbuf.st_size);
+    }
     ods_fclose(fd);
+    if (status == ODS_STATUS_OK) {
+        adfile_remove_absent(adzone, view, &seen);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+        if (elapsed > 0.0) {
+            ods_log_verbose("[%s] read zone %s: %lu RRs in %.3fs, %.1f MB/s, %.0f RRs/s",
+                adapter_str, adzone->name, (unsigned long) nrrs, elapsed,
+                statbuf.st_size / elapsed / 1000000.0, nrrs / elapsed);
+        }
+    }
+    free(seen.items);
     return status;
 }
 
@@ -341,7 +885,7 @@ adfile_write(zone_type* adzone, names_view_type view, const char* filename)
     if (!tmpname) {
         return ODS_STATUS_MALLOC_ERR;
     }
-    if(writezone(view, tmpname)) {
+    if(writezone(view, tmpname, 1)) {
         if (adzone->adoutbound->error) {
             ods_log_error("[%s] unable to write zone %s file %s", adapter_str, adzone->name, filename);
             adzone->adoutbound->error = 0;
@@ -350,11 +894,7 @@ adfile_write(zone_type* adzone, names_view_type view, const char* filename)
     }
 
     if (status == ODS_STATUS_OK) {
-        if (rename((const char*) tmpname, filename) != 0) {
-            ods_log_error("[%s] unable to write file: failed to rename %s "
-                "to %s (%s)", adapter_str, tmpname, filename, strerror(errno));
-            status = ODS_STATUS_RENAME_ERR;
-        }
+        status = ods_file_replace(tmpname, filename);
     }
     free(tmpname);
     /* [end] write zone */
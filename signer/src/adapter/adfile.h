@@ -45,13 +45,22 @@
  */
 /** NULL */
 
+/**
+ * Size of the chunks zone files are split in to be parsed in parallel.
+ * Zone files are read sequentially if it is 0.
+ *
+ */
+extern size_t adfile_chunksize;
+
 /**
  * Read zone from input file adapter.
  * \param[in] zone zone reference
+ * \param[in] view view to read the zone into
+ * \param[in] nthreads number of threads parsing the zone file
  * \return ods_status status
  *
  */
-ods_status adfile_read(zone_type* zone, names_view_type view);
+ods_status adfile_read(zone_type* zone, names_view_type view, int nthreads);
 
 /**
  * Write zone to output file adapter.
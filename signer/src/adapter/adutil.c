@@ -194,63 +194,154 @@ adutil_whitespace_line(char* line, int line_len)
     return 1;
 }
 
+/**
+ * Build the filename of a transfer file of a zone.
+ *
+ */
+char*
+xfrfile(zone_type* zone, const char* suffix)
+{
+    return ods_build_path(zone->name, suffix, 0, 1);
+}
+
 FILE*
 getxfr(zone_type* zone, const char* suffix, time_t* serial)
 {
     names_view_type view;
     char *filename;
     names_iterator iter;
-    char* soa1;
-    char* soa2;
+    ldns_rr* soa1;
+    ldns_rr* soa2;
     char*apex;
     recordset_type record;
     ldns_rr* rr;
+    ldns_buffer* wire;
+    char* basename;
     FILE* fp;
     int fd;
-    asprintf(&filename, "%s%s", zone->name, suffix);
-    fd = open(filename, O_RDWR|O_CREAT|O_EXCL, 0666);
+    /* concurrent transfers of the same zone each get their own file */
+    basename = xfrfile(zone, suffix);
+    filename = (basename ? ods_build_path(basename, ".XXXXXX", 0, 0) : NULL);
+    free(basename);
+    if (!filename) {
+        ods_log_error("[%s] unable to build transfer file name for zone %s",
+            adapter_str, zone->name);
+        return NULL;
+    }
+    fd = mkstemp(filename);
+    if (fd == -1) {
+        ods_log_error("[%s] unable to create transfer file %s for zone %s: "
+            "%s", adapter_str, filename, zone->name, strerror(errno));
+        free(filename);
+        return NULL;
+    }
     fp = fdopen(fd, "w+");
+    if (!fp) {
+        ods_log_error("[%s] unable to open transfer file %s for zone %s: "
+            "%s", adapter_str, filename, zone->name, strerror(errno));
+        close(fd);
+        unlink(filename);
+        free(filename);
+        return NULL;
+    }
+    /* the file is only reached through fp from here on */
+    unlink(filename);
+    free(filename);
     if(!serial) {
         view = zonelist_obtainresource(NULL, zone, NULL, offsetof(zone_type,outputview));
         names_viewreset(view);
-        writezoneapex(view, fp);
-        writezonecontent(view, fp);
-        writezoneapex(view, fp);
+        writezonewire(view, fp);
         zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type,outputview), view);
     } else {
+        wire = ldns_buffer_new(LDNS_MAX_PACKETLEN);
         view = zonelist_obtainresource(NULL, zone, NULL, offsetof(zone_type,changesview));
         names_viewreset(view);
         apex = ldns_rdf2str(zone->apex);
         iter = names_viewiterator(view,names_iteratorchanges,apex,(int)*serial);
         if(names_iterate(&iter,&record)) {
             names_recordlookupone(record, LDNS_RR_TYPE_SOA, NULL, &rr);
-            soa1 = ldns_rr2str(rr);
+            soa1 = ldns_rr_clone(rr);
         } else
             soa1 = NULL;
         soa2 = NULL;
         while(names_advance(&iter,&record)) {
             names_recordlookupone(record, LDNS_RR_TYPE_SOA, NULL, &rr);
-            soa2 = ldns_rr2str(rr);
+            ldns_rr_free(soa2);
+            soa2 = ldns_rr_clone(rr);
         }
         names_end(&iter);
         free(apex);
         assert(soa1);
         assert(soa2);
-        fprintf(fp, "%s", soa2);
-        fprintf(fp, "%s", soa1);
+        writerrwire(soa2, wire, fp);
+        writerrwire(soa1, wire, fp);
         for(iter=names_viewiterator(view,names_iteratorchangedeletes,(int)*serial); names_iterate(&iter,&record); names_advance(&iter,NULL)) {
-            writerecordcontent(record, fp);
+            writerecordwire(record, wire, fp);
         }
-        fprintf(fp, "%s", soa2);
+        writerrwire(soa2, wire, fp);
         for(iter=names_viewiterator(view,names_iteratorchangeinserts,(int)*serial); names_iterate(&iter,&record); names_advance(&iter,NULL)) {
-            writerecordcontent(record, fp);
+            writerecordwire(record, wire, fp);
         }
-        fprintf(fp, "%s", soa2);
+        writerrwire(soa2, wire, fp);
         zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type,changesview), view);
+        ldns_rr_free(soa1);
+        ldns_rr_free(soa2);
+        ldns_buffer_free(wire);
+    }
+    if (fflush(fp) != 0 || ferror(fp)) {
+        ods_log_error("[%s] unable to write transfer file for zone %s: %s",
+            adapter_str, zone->name, strerror(errno));
+        fclose(fp);
+        return NULL;
     }
-    lseek(fd, SEEK_SET, 0);
     rewind(fp);
-    unlink(filename);
-    free(filename);
     return fp;
 }
+
+int
+putxfr(zone_type* zone, names_view_type view, const char* suffix)
+{
+    char* filename;
+    char* tmpfilename;
+    FILE* fp;
+    int status = 0;
+    filename = xfrfile(zone, suffix);
+    tmpfilename = ods_build_path(filename, ".tmp", 0, 0);
+    if(filename == NULL || tmpfilename == NULL) {
+        free(tmpfilename);
+        free(filename);
+        return 1;
+    }
+    fp = fopen(tmpfilename, "w");
+    if(fp == NULL) {
+        ods_log_error("[%s] unable to write transfer image %s for zone %s",
+            adapter_str, tmpfilename, zone->name);
+        status = 1;
+    } else {
+        writezonewire(view, fp);
+        if(fclose(fp) != 0 || ods_file_replace(tmpfilename, filename) != ODS_STATUS_OK) {
+            ods_log_error("[%s] unable to write transfer image %s for zone %s: %s",
+                adapter_str, filename, zone->name, strerror(errno));
+            unlink(tmpfilename);
+            status = 1;
+        }
+    }
+    free(tmpfilename);
+    free(filename);
+    return status;
+}
+
+void
+dropxfr(zone_type* zone, const char* suffix)
+{
+    char* filename;
+    filename = xfrfile(zone, suffix);
+    if(filename == NULL) {
+        return;
+    }
+    if(unlink(filename) == 0) {
+        ods_log_debug("[%s] removed transfer image %s for zone %s",
+            adapter_str, filename, zone->name);
+    }
+    free(filename);
+}
@@ -68,9 +68,19 @@ void adutil_rtrim_line(char* line, int* line_len);
  */
 int adutil_whitespace_line(char* line, int line_len);
 
+/**
+ * Build the filename of a transfer file of a zone, all transfer files are
+ * named this way so that the writer and readers agree on the name.
+ * \param[in] zone Zone for which to name the file
+ * \param[in] suffix The suffix to append to the zone name
+ * \return char* allocated filename, or NULL on failure
+ */
+char* xfrfile(zone_type* zone, const char* suffix);
+
 /**
  * Produce an AXFR or IXFR file, the file is immediately deleted, but an
- * open file handler is returned so its content can be read.
+ * open file handler is returned so its content can be read.  The records
+ * are stored as in the transfer image, see putxfr().
  * \param[in] zone Zone for which to produce an zone file
  * \param[in] suffix Zhe suffix to use for the file, the base directory if the
  *                   working directory for the signer and the filename is
@@ -84,4 +94,25 @@ int adutil_whitespace_line(char* line, int line_len);
  */
 FILE* getxfr(zone_type* zone, const char* suffix, time_t* serial);
 
+/**
+ * Write the pre-rendered transfer image of the zone, which allows zone
+ * transfers to be served without rendering or parsing the zone.  Each record
+ * is stored in uncompressed wire format, prefixed by its length in two bytes
+ * network order.  The image starts and ends with the SOA record.  The file is
+ * replaced atomically.
+ * \param[in] zone Zone for which to produce the transfer image
+ * \param[in] view The view on the zone to write, normally the output view
+ * \param[in] suffix The suffix to append to the zone name for the filename
+ * \return int 0 on success, 1 on failure
+ */
+int putxfr(zone_type* zone, names_view_type view, const char* suffix);
+
+/**
+ * Remove the pre-rendered transfer image of the zone, so that a stale image
+ * is not served when the zone is no longer output through DNS.
+ * \param[in] zone Zone for which to remove the transfer image
+ * \param[in] suffix The suffix to append to the zone name for the filename
+ */
+void dropxfr(zone_type* zone, const char* suffix);
+
 #endif /* ADAPTER_ADUTIL_H */
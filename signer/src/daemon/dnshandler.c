@@ -45,32 +45,74 @@ static const char* dnsh_str = "dnshandler";
  *
  */
 dnshandler_type*
-dnshandler_create(listener_type* interfaces)
+dnshandler_create(listener_type* interfaces, int nlisteners)
 {
     dnshandler_type* dnsh = NULL;
+    int i, j;
     if (!interfaces || interfaces->count <= 0) {
         return NULL;
     }
+    if (nlisteners < 1) {
+        nlisteners = 1;
+    }
+#ifndef SO_REUSEPORT
+    if (nlisteners > 1) {
+        ods_log_warning("[%s] no support for SO_REUSEPORT, using a single "
+            "listener thread", dnsh_str);
+        nlisteners = 1;
+    }
+#endif
     CHECKALLOC(dnsh = (dnshandler_type*) malloc(sizeof(dnshandler_type)));
     dnsh->need_to_exit = 0;
     dnsh->engine = NULL;
     dnsh->interfaces = interfaces;
-    dnsh->socklist = NULL;
-    dnsh->netio = NULL;
-    dnsh->query = NULL;
     dnsh->started = 0;
-    dnsh->tcp_accept_handlers = NULL;
     /* setup */
-    CHECKALLOC(dnsh->socklist = (socklist_type*) malloc(sizeof(socklist_type)));
-    dnsh->netio = netio_create();
-    dnsh->query = query_create();
+    dnsh->nlisteners = nlisteners;
+    CHECKALLOC(dnsh->listeners = (dnslistener_type*) malloc(nlisteners * sizeof(dnslistener_type)));
+    for (i=0; i < nlisteners; i++) {
+        dnsh->listeners[i].thread_id = NULL;
+        dnsh->listeners[i].dnshandler = dnsh;
+        dnsh->listeners[i].tcp_accept_handlers = NULL;
+        CHECKALLOC(dnsh->listeners[i].socklist = (socklist_type*) malloc(sizeof(socklist_type)));
+        for (j=0; j < MAX_INTERFACES; j++) {
+            dnsh->listeners[i].socklist->udp[j].s = -1;
+            dnsh->listeners[i].socklist->tcp[j].s = -1;
+        }
+        dnsh->listeners[i].netio = netio_create();
+        dnsh->listeners[i].query = query_create();
+    }
     dnsh->xfrhandler.fd = -1;
     dnsh->xfrhandler.user_data = (void*) dnsh;
     dnsh->xfrhandler.timeout = 0;
+    dnsh->xfrhandler.entry = NULL;
     return dnsh;
 }
 
 
+/**
+ * Close the sockets of a listener.
+ *
+ */
+static void
+dnshandler_close(dnshandler_type* dnshandler, dnslistener_type* listener)
+{
+    size_t i = 0;
+    for (i = 0; i < dnshandler->interfaces->count; i++) {
+        if (listener->socklist->udp[i].s != -1) {
+            close(listener->socklist->udp[i].s);
+            freeaddrinfo((void*)listener->socklist->udp[i].addr);
+            listener->socklist->udp[i].s = -1;
+        }
+        if (listener->socklist->tcp[i].s != -1) {
+            close(listener->socklist->tcp[i].s);
+            freeaddrinfo((void*)listener->socklist->tcp[i].addr);
+            listener->socklist->tcp[i].s = -1;
+        }
+    }
+}
+
+
 /**
  * Start dns handler listener.
  *
@@ -79,12 +121,32 @@ ods_status
 dnshandler_listen(dnshandler_type* dnshandler)
 {
     ods_status status = ODS_STATUS_OK;
+    int i, j;
     ods_log_assert(dnshandler);
-    status = sock_listen(dnshandler->socklist, dnshandler->interfaces);
-    if (status != ODS_STATUS_OK) {
-        ods_log_error("[%s] unable to start: sock_listen() "
-            "failed (%s)", dnsh_str, ods_status2str(status));
-        dnshandler->thread_id = 0;
+    for (i=0; i < dnshandler->nlisteners; i++) {
+        status = sock_listen(dnshandler->listeners[i].socklist,
+            dnshandler->interfaces, dnshandler->nlisteners > 1);
+        if (status == ODS_STATUS_SOCK_SETSOCKOPT_REUSEPORT) {
+            /* the sockets cannot be shared, serve them from one thread */
+            ods_log_warning("[%s] unable to share sockets, using a single "
+                "listener thread", dnsh_str);
+            for (j=0; j <= i; j++) {
+                dnshandler_close(dnshandler, &dnshandler->listeners[j]);
+            }
+            for (j=1; j < dnshandler->nlisteners; j++) {
+                netio_cleanup(dnshandler->listeners[j].netio);
+                query_cleanup(dnshandler->listeners[j].query);
+                free(dnshandler->listeners[j].socklist);
+            }
+            dnshandler->nlisteners = 1;
+            status = sock_listen(dnshandler->listeners[0].socklist,
+                dnshandler->interfaces, 0);
+        }
+        if (status != ODS_STATUS_OK) {
+            ods_log_error("[%s] unable to start: sock_listen() "
+                "failed (%s)", dnsh_str, ods_status2str(status));
+            break;
+        }
     }
     return status;
 }
@@ -95,11 +157,13 @@ dnshandler_listen(dnshandler_type* dnshandler)
  *
  */
 void
-dnshandler_start(dnshandler_type* dnshandler)
+dnshandler_start(dnslistener_type* listener)
 {
+    dnshandler_type* dnshandler;
     size_t i = 0;
 
-    ods_log_assert(dnshandler);
+    ods_log_assert(listener);
+    dnshandler = listener->dnshandler;
     ods_log_debug("[%s] start", dnsh_str);
 
     /* udp */
@@ -107,45 +171,47 @@ dnshandler_start(dnshandler_type* dnshandler)
         struct udp_data* data = NULL;
         netio_handler_type* handler = NULL;
         CHECKALLOC(data = (struct udp_data*) malloc(sizeof(struct udp_data)));
-        data->query = dnshandler->query;
+        data->query = listener->query;
         data->engine = dnshandler->engine;
-        data->socket = &dnshandler->socklist->udp[i];
+        data->socket = &listener->socklist->udp[i];
         CHECKALLOC(handler = (netio_handler_type*) malloc(sizeof(netio_handler_type)));
-        handler->fd = dnshandler->socklist->udp[i].s;
+        handler->fd = listener->socklist->udp[i].s;
         handler->timeout = NULL;
         handler->user_data = data;
         handler->event_types = NETIO_EVENT_READ;
         handler->event_handler = sock_handle_udp;
         handler->free_handler = 1;
+        handler->entry = NULL;
         ods_log_debug("[%s] add udp network handler fd %u", dnsh_str,
             (unsigned) handler->fd);
-        netio_add_handler(dnshandler->netio, handler);
+        netio_add_handler(listener->netio, handler);
     }
     /* tcp */
-    CHECKALLOC(dnshandler->tcp_accept_handlers = (netio_handler_type*) malloc(dnshandler->interfaces->count * sizeof(netio_handler_type)));
+    CHECKALLOC(listener->tcp_accept_handlers = (netio_handler_type*) malloc(dnshandler->interfaces->count * sizeof(netio_handler_type)));
     for (i=0; i < dnshandler->interfaces->count; i++) {
         struct tcp_accept_data* data = NULL;
         netio_handler_type* handler = NULL;
         CHECKALLOC(data = (struct tcp_accept_data*) malloc(sizeof(struct tcp_accept_data)));
         data->engine = dnshandler->engine;
-        data->socket = &dnshandler->socklist->udp[i];
+        data->socket = &listener->socklist->udp[i];
         data->tcp_accept_handler_count = dnshandler->interfaces->count;
-        data->tcp_accept_handlers = dnshandler->tcp_accept_handlers;
-        handler = &dnshandler->tcp_accept_handlers[i];
-        handler->fd = dnshandler->socklist->tcp[i].s;
+        data->tcp_accept_handlers = listener->tcp_accept_handlers;
+        handler = &listener->tcp_accept_handlers[i];
+        handler->fd = listener->socklist->tcp[i].s;
         handler->timeout = NULL;
         handler->user_data = data;
         handler->event_types = NETIO_EVENT_READ;
         handler->event_handler = sock_handle_tcp_accept;
         handler->free_handler = 0;
+        handler->entry = NULL;
         ods_log_debug("[%s] add tcp network handler fd %u", dnsh_str,
             (unsigned) handler->fd);
-        netio_add_handler(dnshandler->netio, handler);
+        netio_add_handler(listener->netio, handler);
     }
     /* service */
     while (dnshandler->need_to_exit == 0) {
         ods_log_deeebug("[%s] netio dispatch", dnsh_str);
-        if (netio_dispatch(dnshandler->netio, NULL, NULL) == -1) {
+        if (netio_dispatch(listener->netio, NULL, NULL) == -1) {
             if (errno != EINTR) {
                 ods_log_error("[%s] unable to dispatch netio: %s", dnsh_str,
                     strerror(errno));
@@ -165,8 +231,13 @@ dnshandler_start(dnshandler_type* dnshandler)
 void
 dnshandler_signal(dnshandler_type* dnshandler)
 {
-    if (dnshandler && dnshandler->thread_id && dnshandler->started) {
-        janitor_thread_signal(dnshandler->thread_id);
+    int i;
+    if (dnshandler && dnshandler->started) {
+        for (i=0; i < dnshandler->nlisteners; i++) {
+            if (dnshandler->listeners[i].thread_id) {
+                janitor_thread_signal(dnshandler->listeners[i].thread_id);
+            }
+        }
     }
 }
 
@@ -198,28 +269,25 @@ dnshandler_fwd_notify(dnshandler_type* dnshandler, uint8_t* pkt, size_t len)
 void
 dnshandler_cleanup(dnshandler_type* dnshandler)
 {
+    dnslistener_type* listener;
     size_t i = 0;
+    int l;
     if (!dnshandler) {
         return;
     }
-    netio_cleanup(dnshandler->netio);
-    query_cleanup(dnshandler->query);
-
-
-    for (i = 0; i < dnshandler->interfaces->count; i++) {
-        if (dnshandler->tcp_accept_handlers)
-            free(dnshandler->tcp_accept_handlers[i].user_data);
-        if (dnshandler->socklist->udp[i].s != -1) {
-            close(dnshandler->socklist->udp[i].s);
-            freeaddrinfo((void*)dnshandler->socklist->udp[i].addr);
+    for (l = 0; l < dnshandler->nlisteners; l++) {
+        listener = &dnshandler->listeners[l];
+        netio_cleanup(listener->netio);
+        query_cleanup(listener->query);
+        for (i = 0; i < dnshandler->interfaces->count; i++) {
+            if (listener->tcp_accept_handlers)
+                free(listener->tcp_accept_handlers[i].user_data);
         }
-        if (dnshandler->socklist->tcp[i].s != -1) {
-            close(dnshandler->socklist->tcp[i].s);
-            freeaddrinfo((void*)dnshandler->socklist->tcp[i].addr);
-        }  
+        dnshandler_close(dnshandler, listener);
+        free(listener->tcp_accept_handlers);
+        free(listener->socklist);
     }
-    free(dnshandler->tcp_accept_handlers);
-    free(dnshandler->socklist);
+    free(dnshandler->listeners);
     listener_cleanup(dnshandler->interfaces);
     free(dnshandler);
 }
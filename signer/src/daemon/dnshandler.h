@@ -48,27 +48,42 @@ typedef struct dnshandler_struct dnshandler_type;
 #define ODS_SE_NOTIFY_CMD "NOTIFY"
 #define ODS_SE_MAX_HANDLERS 5
 
-struct dnshandler_struct {
+typedef struct dnslistener_struct dnslistener_type;
+
+/**
+ * A thread serving its own sockets on the dns handler interfaces.  With
+ * more than one listener, the sockets are bound with SO_REUSEPORT so
+ * that the kernel spreads the requests over the listeners.  If the
+ * sockets cannot be shared, a single listener serves them.
+ *
+ */
+struct dnslistener_struct {
     janitor_thread_t thread_id;
-    engine_type* engine;
-    listener_type* interfaces;
+    dnshandler_type* dnshandler;
     socklist_type* socklist;
     netio_type* netio;
     query_type* query;
+    netio_handler_type *tcp_accept_handlers;
+};
+
+struct dnshandler_struct {
+    engine_type* engine;
+    listener_type* interfaces;
+    dnslistener_type* listeners;
+    int nlisteners;
     netio_handler_type xfrhandler;
     unsigned need_to_exit;
     unsigned started;
-    netio_handler_type *tcp_accept_handlers;
 };
 
 /**
  * Create dns handler.
- * \param[in] allocator memory allocator
  * \param[in] interfaces list of interfaces
+ * \param[in] nlisteners number of listener threads
  * \return dnshandler_type* created dns handler
  *
  */
-dnshandler_type* dnshandler_create(listener_type* interfaces);
+dnshandler_type* dnshandler_create(listener_type* interfaces, int nlisteners);
 
 /**
  * Start dns handler listener.
@@ -79,11 +94,11 @@ dnshandler_type* dnshandler_create(listener_type* interfaces);
 ods_status dnshandler_listen(dnshandler_type* dnshandler);
 
 /**
- * Start dns handler.
- * \param[in] dnshandler_type* dns handler
+ * Run a dns handler listener, until the dns handler needs to exit.
+ * \param[in] dnslistener_type* dns handler listener
  *
  */
-void dnshandler_start(dnshandler_type* dnshandler);
+void dnshandler_start(dnslistener_type* listener);
 
 /**
  * Signal dns handler.
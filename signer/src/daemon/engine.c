@@ -42,10 +42,12 @@
 #include "status.h"
 #include "util.h"
 #include "signer/zonelist.h"
+#include "adapter/adutil.h"
 #include "wire/tsig.h"
 #include "libhsm.h"
 #include "signertasks.h"
 #include "signercommands.h"
+#include "outputstage.h"
 #include "confparser.h"
 #include "views/httpd.h"
 
@@ -78,6 +80,8 @@ engine_create(void)
     engine->cmdhandler = NULL;
     engine->dnshandler = NULL;
     engine->xfrhandler = NULL;
+    engine->signpipeline = NULL;
+    engine->outputstage = NULL;
     engine->taskq = NULL;
     engine->pid = -1;
     engine->uid = -1;
@@ -129,17 +133,21 @@ engine_start_cmdhandler(engine_type* engine)
 static void
 engine_start_dnshandler(engine_type* engine)
 {
+    int i;
     if (!engine || !engine->dnshandler) {
         return;
     }
     ods_log_debug("[%s] start dnshandler", engine_str);
     engine->dnshandler->engine = engine;
     engine->dnshandler->started = 1;
-    janitor_thread_create(&engine->dnshandler->thread_id, handlerthreadclass, (janitor_runfn_t)dnshandler_start, engine->dnshandler);
+    for (i=0; i < engine->dnshandler->nlisteners; i++) {
+        janitor_thread_create(&engine->dnshandler->listeners[i].thread_id, handlerthreadclass, (janitor_runfn_t)dnshandler_start, &engine->dnshandler->listeners[i]);
+    }
 }
 static void
 engine_stop_dnshandler(engine_type* engine)
 {
+    int i;
     if (!engine || !engine->dnshandler || !engine->dnshandler->started) {
         return;
     }
@@ -147,7 +155,10 @@ engine_stop_dnshandler(engine_type* engine)
     engine->dnshandler->need_to_exit = 1;
     dnshandler_signal(engine->dnshandler);
     ods_log_debug("[%s] join dnshandler", engine_str);
-    janitor_thread_join(engine->dnshandler->thread_id);
+    for (i=0; i < engine->dnshandler->nlisteners; i++) {
+        janitor_thread_join(engine->dnshandler->listeners[i].thread_id);
+        engine->dnshandler->listeners[i].thread_id = NULL;
+    }
     engine->dnshandler->engine = NULL;
 }
 
@@ -264,6 +275,12 @@ engine_start_workers(engine_type* engine)
         engine->workers[threadCount]->context = context;
         janitor_thread_create(&engine->workers[threadCount]->thread_id, workerthreadclass, (janitor_runfn_t)worker_start, engine->workers[threadCount]);
     }
+    if (engine->config->num_signing_sessions > 0) {
+        engine->signpipeline = lhsm_pipeline_create(engine, engine->config->num_signing_sessions);
+    }
+    if (engine->config->num_output_threads > 0) {
+        engine->outputstage = outputstage_create(engine, engine->config->num_output_threads);
+    }
     for (i=0; i < engine->config->num_signer_threads; i++,threadCount++) {
         engine->workers[threadCount]->need_to_exit = 0;
         janitor_thread_create(&engine->workers[threadCount]->thread_id, workerthreadclass, (janitor_runfn_t)drudge, engine->workers[threadCount]);
@@ -290,6 +307,16 @@ engine_stop_threads(engine_type* engine)
         janitor_thread_join(engine->workers[i]->thread_id);
         free(engine->workers[i]->context);
     }
+    if (engine->signpipeline) {
+        ods_log_debug("[%s] stop signing sessions", engine_str);
+        lhsm_pipeline_cleanup(engine->signpipeline);
+        engine->signpipeline = NULL;
+    }
+    if (engine->outputstage) {
+        ods_log_debug("[%s] stop output threads", engine_str);
+        outputstage_cleanup(engine->outputstage);
+        engine->outputstage = NULL;
+    }
 }
 
 
@@ -336,7 +363,8 @@ engine_setup_initialize(engine_type* engine, int* fdptr)
         ods_log_error("Failed to setup command handler");
         return ODS_STATUS_CMDHANDLER_ERR;
     }
-    engine->dnshandler = dnshandler_create(create_listener(engine->config->interfaces));
+    engine->dnshandler = dnshandler_create(create_listener(engine->config->interfaces),
+        engine->config->num_listener_threads);
     engine->xfrhandler = xfrhandler_create();
     if (!engine->xfrhandler) {
         ods_log_error("Failed to setup transfer handler");
@@ -616,11 +644,15 @@ dnsconfig_zone(engine_type* engine, zone_type* zone)
                 &zone->notify->handler);
         }
         numdns++;
-    } else if (zone->notify) {
-        netio_remove_handler(engine->xfrhandler->netio,
-            &zone->notify->handler);
-        notify_cleanup(zone->notify);
-        zone->notify = NULL;
+    } else {
+        if (zone->notify) {
+            netio_remove_handler(engine->xfrhandler->netio,
+                &zone->notify->handler);
+            notify_cleanup(zone->notify);
+            zone->notify = NULL;
+        }
+        /* no longer served, do not leave an image that would go stale */
+        dropxfr(zone, ".axfr");
     }
     return numdns;
 }
@@ -659,6 +691,7 @@ engine_update_zones(engine_type* engine, ods_status zl_changed)
                 &zone->xfrd->handler);
             netio_remove_handler(engine->xfrhandler->netio,
                 &zone->notify->handler);
+            outputstage_cancel(engine->outputstage, zone);
             zone_cleanup(zone);
             zone = NULL;
             continue;
@@ -69,6 +69,8 @@ struct engine_struct {
     zonelist_type* zonelist;
     dnshandler_type* dnshandler;
     xfrhandler_type* xfrhandler;
+    struct lhsm_pipeline_struct* signpipeline;
+    struct outputstage_struct* outputstage;
     edns_data_type edns;
 };
 
@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2026 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Output stage.  Signed zones are handed over by the workers and written
+ * out by a small set of output threads, so that the signing workers do
+ * not wait for the disk.  A zone that is handed over again while it is
+ * still waiting is written once, and the files written for a batch of
+ * zones are flushed to disk together.
+ *
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include "daemon/outputstage.h"
+#include "daemon/signertasks.h"
+#include "signer/tools.h"
+#include "clientpipe.h"
+#include "file.h"
+#include "locks.h"
+#include "log.h"
+#include "status.h"
+
+static const char* outputstage_str = "output";
+
+/* maximum number of zones written and flushed together */
+#define OUTPUTSTAGE_BATCH 8
+
+static void
+outputstage_push(outputstage_type* stage, zone_type* zone)
+{
+    zone_type** queue;
+    int i;
+    if (stage->queuecount == stage->queuesize) {
+        CHECKALLOC(queue = (zone_type**) malloc(stage->queuesize * 2 * sizeof(zone_type*)));
+        for (i=0; i<stage->queuecount; i++) {
+            queue[i] = stage->queue[(stage->queuehead + i) % stage->queuesize];
+        }
+        free(stage->queue);
+        stage->queue = queue;
+        stage->queuehead = 0;
+        stage->queuesize *= 2;
+    }
+    stage->queue[(stage->queuehead + stage->queuecount) % stage->queuesize] = zone;
+    stage->queuecount++;
+    if (stage->queuecount > stage->peakqueued) {
+        stage->peakqueued = stage->queuecount;
+    }
+    zone->outputstate = OUTPUTSTAGE_QUEUED;
+    pthread_cond_signal(&stage->work);
+}
+
+/**
+ * Run an output thread.  The thread takes a batch of zones from the
+ * queue, writes them with a file batch open, and only notifies once the
+ * files of the whole batch are in place.
+ *
+ */
+static void
+outputstage_run(outputstage_type* stage)
+{
+    zone_type* zones[OUTPUTSTAGE_BATCH];
+    int outputs[OUTPUTSTAGE_BATCH];
+    ods_status statuses[OUTPUTSTAGE_BATCH];
+    int i, count, nfailed;
+
+    pthread_mutex_lock(&stage->lock);
+    for (;;) {
+        while (stage->queuecount == 0 && !stage->need_to_exit) {
+            pthread_cond_wait(&stage->work, &stage->lock);
+        }
+        if (stage->queuecount == 0) {
+            break;
+        }
+        for (count=0; count<OUTPUTSTAGE_BATCH && stage->queuecount > 0; count++) {
+            zones[count] = stage->queue[stage->queuehead];
+            stage->queuehead = (stage->queuehead + 1) % stage->queuesize;
+            stage->queuecount--;
+            outputs[count] = zones[count]->outputflags;
+            zones[count]->outputflags = 0;
+            zones[count]->outputstate = OUTPUTSTAGE_WRITING;
+        }
+        pthread_cond_broadcast(&stage->space);
+        pthread_mutex_unlock(&stage->lock);
+
+        ods_file_batchopen();
+        for (i=0; i<count; i++) {
+            pthread_mutex_lock(&zones[i]->zone_lock);
+            statuses[i] = do_outputzone(zones[i], stage->engine, outputs[i]);
+            pthread_mutex_unlock(&zones[i]->zone_lock);
+        }
+        nfailed = ods_file_batchcommit();
+        for (i=0; i<count; i++) {
+            if (statuses[i] == ODS_STATUS_OK) {
+                pthread_mutex_lock(&zones[i]->zone_lock);
+                tools_notify(zones[i], stage->engine);
+                pthread_mutex_unlock(&zones[i]->zone_lock);
+            } else {
+                nfailed++;
+            }
+        }
+
+        pthread_mutex_lock(&stage->lock);
+        for (i=0; i<count; i++) {
+            if (zones[i]->outputstate == OUTPUTSTAGE_REWRITE) {
+                outputstage_push(stage, zones[i]);
+            } else {
+                zones[i]->outputstate = OUTPUTSTAGE_IDLE;
+            }
+        }
+        stage->nwritten += count;
+        stage->nfailed += nfailed;
+        stage->nbatches++;
+        pthread_cond_broadcast(&stage->done);
+    }
+    pthread_mutex_unlock(&stage->lock);
+}
+
+/**
+ * Create the output stage.
+ *
+ */
+outputstage_type*
+outputstage_create(engine_type* engine, int nthreads)
+{
+    outputstage_type* stage;
+    int i;
+    if (nthreads <= 0) {
+        return NULL;
+    }
+    CHECKALLOC(stage = (outputstage_type*) calloc(1, sizeof(outputstage_type)));
+    stage->engine = engine;
+    stage->nthreads = nthreads;
+    stage->queuebound = nthreads * OUTPUTSTAGE_BATCH * 2;
+    stage->queuesize = stage->queuebound;
+    CHECKALLOC(stage->queue = (zone_type**) malloc(stage->queuesize * sizeof(zone_type*)));
+    pthread_mutex_init(&stage->lock, NULL);
+    pthread_cond_init(&stage->work, NULL);
+    pthread_cond_init(&stage->space, NULL);
+    pthread_cond_init(&stage->done, NULL);
+    stage->created = time(NULL);
+    CHECKALLOC(stage->threads = (janitor_thread_t*) malloc(nthreads * sizeof(janitor_thread_t)));
+    for (i=0; i<nthreads; i++) {
+        janitor_thread_create(&stage->threads[i], workerthreadclass, (janitor_runfn_t)outputstage_run, stage);
+    }
+    ods_log_verbose("[%s] output stage started with %d threads", outputstage_str, nthreads);
+    return stage;
+}
+
+/**
+ * Submit a zone to be written.
+ *
+ */
+void
+outputstage_submit(outputstage_type* stage, zone_type* zone, int outputs)
+{
+    int submitted = 0;
+    pthread_mutex_lock(&stage->lock);
+    stage->nsubmitted++;
+    while (!submitted) {
+        submitted = 1;
+        switch (zone->outputstate) {
+            case OUTPUTSTAGE_QUEUED:
+            case OUTPUTSTAGE_REWRITE:
+                zone->outputflags |= outputs;
+                stage->ncoalesced++;
+                break;
+            case OUTPUTSTAGE_WRITING:
+                /* the running write may have missed the latest changes */
+                zone->outputflags |= outputs;
+                zone->outputstate = OUTPUTSTAGE_REWRITE;
+                break;
+            default:
+                if (stage->queuecount >= stage->queuebound && !stage->need_to_exit) {
+                    /* the zone may be submitted by another thread meanwhile */
+                    pthread_cond_wait(&stage->space, &stage->lock);
+                    submitted = 0;
+                    break;
+                }
+                zone->outputflags = outputs;
+                outputstage_push(stage, zone);
+                break;
+        }
+    }
+    pthread_mutex_unlock(&stage->lock);
+}
+
+/**
+ * Withdraw a zone from the output stage.
+ *
+ */
+void
+outputstage_cancel(outputstage_type* stage, zone_type* zone)
+{
+    int i, j;
+    if (!stage) {
+        return;
+    }
+    pthread_mutex_lock(&stage->lock);
+    while (zone->outputstate == OUTPUTSTAGE_WRITING ||
+           zone->outputstate == OUTPUTSTAGE_REWRITE) {
+        zone->outputstate = OUTPUTSTAGE_WRITING;
+        pthread_cond_wait(&stage->done, &stage->lock);
+    }
+    if (zone->outputstate == OUTPUTSTAGE_QUEUED) {
+        for (i=0, j=0; i<stage->queuecount; i++) {
+            if (stage->queue[(stage->queuehead + i) % stage->queuesize] != zone) {
+                stage->queue[(stage->queuehead + j) % stage->queuesize] =
+                    stage->queue[(stage->queuehead + i) % stage->queuesize];
+                j++;
+            }
+        }
+        stage->queuecount = j;
+        pthread_cond_broadcast(&stage->space);
+    }
+    zone->outputstate = OUTPUTSTAGE_IDLE;
+    zone->outputflags = 0;
+    pthread_mutex_unlock(&stage->lock);
+}
+
+/**
+ * Report the output stage counters.
+ *
+ */
+void
+outputstage_report(outputstage_type* stage, int fd)
+{
+    long nsubmitted, ncoalesced, nwritten, nfailed, nbatches;
+    int queued, peakqueued;
+    time_t elapsed;
+
+    if (!stage) {
+        return;
+    }
+    pthread_mutex_lock(&stage->lock);
+    nsubmitted = stage->nsubmitted;
+    ncoalesced = stage->ncoalesced;
+    nwritten = stage->nwritten;
+    nfailed = stage->nfailed;
+    nbatches = stage->nbatches;
+    queued = stage->queuecount;
+    peakqueued = stage->peakqueued;
+    elapsed = time(NULL) - stage->created;
+    pthread_mutex_unlock(&stage->lock);
+    if (fd >= 0) {
+        client_printf(fd, "\nOutput stage of %d threads: %d zones queued (peak %d).\n",
+            stage->nthreads, queued, peakqueued);
+        client_printf(fd, "%ld zones submitted, %ld coalesced, %ld written in %ld batches, %ld failed, in %ld seconds.\n",
+            nsubmitted, ncoalesced, nwritten, nbatches, nfailed, (long) elapsed);
+    } else {
+        ods_log_info("[%s] output stage of %d threads: %ld zones submitted, %ld coalesced, "
+            "%ld written in %ld batches, %ld failed, peak %d queued",
+            outputstage_str, stage->nthreads, nsubmitted, ncoalesced, nwritten,
+            nbatches, nfailed, peakqueued);
+    }
+}
+
+/**
+ * Stop the threads and clean up the output stage.
+ *
+ */
+void
+outputstage_cleanup(outputstage_type* stage)
+{
+    int i;
+    if (!stage) {
+        return;
+    }
+    pthread_mutex_lock(&stage->lock);
+    stage->need_to_exit = 1;
+    pthread_cond_broadcast(&stage->work);
+    pthread_cond_broadcast(&stage->space);
+    pthread_mutex_unlock(&stage->lock);
+    for (i=0; i<stage->nthreads; i++) {
+        janitor_thread_join(stage->threads[i]);
+    }
+    outputstage_report(stage, -1);
+    pthread_cond_destroy(&stage->done);
+    pthread_cond_destroy(&stage->space);
+    pthread_cond_destroy(&stage->work);
+    pthread_mutex_destroy(&stage->lock);
+    free(stage->threads);
+    free(stage->queue);
+    free(stage);
+}
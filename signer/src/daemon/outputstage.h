@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2026 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OUTPUTSTAGE_H
+#define OUTPUTSTAGE_H
+
+#include "config.h"
+#include <time.h>
+#include "janitor.h"
+#include "daemon/engine.h"
+#include "signer/zone.h"
+
+/* state of a zone in the output stage, kept in zone->outputstate */
+enum outputstage_state {
+    OUTPUTSTAGE_IDLE = 0, /* not known to the output stage */
+    OUTPUTSTAGE_QUEUED,   /* waiting in the queue */
+    OUTPUTSTAGE_WRITING,  /* being written */
+    OUTPUTSTAGE_REWRITE   /* being written, and to be written again after */
+};
+
+typedef struct outputstage_struct outputstage_type;
+struct outputstage_struct {
+    engine_type* engine;
+    int nthreads;
+    janitor_thread_t* threads;
+    int need_to_exit;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t space;
+    pthread_cond_t done;
+    /* circular queue of zones waiting to be written */
+    zone_type** queue;
+    int queuehead;
+    int queuecount;
+    int queuesize;
+    int queuebound;
+    /* counters */
+    time_t created;
+    long nsubmitted;
+    long ncoalesced;
+    long nwritten;
+    long nfailed;
+    long nbatches;
+    int peakqueued;
+};
+
+/**
+ * Create the output stage and start its threads.
+ * \param[in] engine signer engine
+ * \param[in] nthreads number of output threads
+ * \return outputstage_type* the output stage
+ *
+ */
+outputstage_type* outputstage_create(engine_type* engine, int nthreads);
+
+/**
+ * Submit a zone to be written.  If the zone is already waiting to be
+ * written, the outputs are merged into the waiting request.  Blocks while
+ * the queue is full.  Must be called with the zone locked.
+ * \param[in] stage the output stage
+ * \param[in] zone zone
+ * \param[in] outputs optional outputs to write, see do_outputzone()
+ *
+ */
+void outputstage_submit(outputstage_type* stage, zone_type* zone, int outputs);
+
+/**
+ * Withdraw a zone from the output stage, waiting for it to be written if
+ * that is in progress.  Must be called without the zone locked.
+ * \param[in] stage the output stage
+ * \param[in] zone zone
+ *
+ */
+void outputstage_cancel(outputstage_type* stage, zone_type* zone);
+
+/**
+ * Report the output stage counters.
+ * \param[in] stage the output stage
+ * \param[in] fd file descriptor to report to, or -1 to log them
+ *
+ */
+void outputstage_report(outputstage_type* stage, int fd);
+
+/**
+ * Write out the zones still waiting, stop the threads and clean up the
+ * output stage.
+ * \param[in] stage the output stage
+ *
+ */
+void outputstage_cleanup(outputstage_type* stage);
+
+#endif /* OUTPUTSTAGE_H */
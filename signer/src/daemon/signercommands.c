@@ -35,6 +35,7 @@
 #include "daemon/engine.h"
 #include "cmdhandler.h"
 #include "signercommands.h"
+#include "outputstage.h"
 #include "clientpipe.h"
 
 static char const * cmdh_str = "cmdhandler";
@@ -446,6 +447,14 @@ cmdhandler_handle_cmd_queue(int sockfd, cmdhandler_ctx_type* context, char *cmd)
         node = ldns_rbtree_next(node);
     }
     pthread_mutex_unlock(&engine->taskq->schedule_lock);
+    /* signing pipeline */
+    lhsm_pipeline_report(engine->signpipeline, sockfd);
+    /* output stage */
+    outputstage_report(engine->outputstage, sockfd);
+    /* outbound notifies */
+    if (engine->xfrhandler) {
+        notifyq_report(engine->xfrhandler->notifyq, sockfd);
+    }
     return 0;
 }
 
@@ -58,23 +58,24 @@ rrset_getliteralrr(ldns_rr** dnskey, const char *resourcerecord, uint32_t ttl, l
 }
 
 /**
- * Calculate the signature validation period.
+ * Calculate the signature validation period.  The random jitter is drawn
+ * once and then reused, such that all RRsets of a domain get the same
+ * validity and can be signed together.
  *
  */
 static void
 rrset_sigvalid_period(signconf_type* sc, ldns_rr_type rrtype, time_t signtime,
-    time_t* inception, time_t* expiration)
+    time_t* random_jitter, time_t* inception, time_t* expiration)
 {
     time_t jitter = 0;
     time_t offset = 0;
     time_t validity = 0;
-    time_t random_jitter = 0;
     if (!sc || !rrtype || !signtime) {
         return;
     }
     jitter = duration2time(sc->sig_jitter);
-    if (jitter) {
-        random_jitter = ods_rand(jitter*2);
+    if (*random_jitter < 0) {
+        *random_jitter = (jitter ? ods_rand(jitter*2) : 0);
     }
     offset = duration2time(sc->sig_inception_offset);
     switch (rrtype) {
@@ -93,7 +94,7 @@ rrset_sigvalid_period(signconf_type* sc, ldns_rr_type rrtype, time_t signtime,
             validity = duration2time(sc->sig_validity_default);
     }
     *inception = signtime - offset;
-    *expiration = (signtime + validity + random_jitter) - jitter;
+    *expiration = (signtime + validity + *random_jitter) - jitter;
 }
 
 ldns_rr_type
@@ -110,31 +111,41 @@ domain_is_delegpt(names_view_type view, recordset_type record)
     return LDNS_RR_TYPE_SOA;
 }
 
+/* The status of a name follows from its nearest ancestor in the view,
+ * whose own status is cached in the record.  The cached status remains
+ * valid until a SOA, NS or DNAME RRset appears or disappears in the view,
+ * so rather than walking up to the apex for every RRset, normally only
+ * the parent needs to be looked up once per name.
+ */
 ldns_rr_type
 domain_is_occluded(names_view_type view, recordset_type record)
 {
-    names_iterator iter;
-    recordset_type parent = NULL;
+    long stamp;
+    ldns_rr_type status;
+    recordset_type parent;
     if(names_recordhasdata(record, LDNS_RR_TYPE_SOA, NULL, 0))
         return LDNS_RR_TYPE_SOA;
-    for(iter=names_viewiterator(view,names_iteratorancestors,names_recordgetname(record)); names_iterate(&iter,&parent); names_advance(&iter,NULL)) {
-        if (names_recordhasdata(parent, LDNS_RR_TYPE_SOA, NULL, 0)) {
-            names_end(&iter);
-            return LDNS_RR_TYPE_SOA;
-        }
-        if (names_recordhasdata(parent, LDNS_RR_TYPE_NS, NULL, 0)) {
-            /* Glue / Empty non-terminal to Glue */
-            names_end(&iter);
-            return LDNS_RR_TYPE_A;
-        }
-        if (names_recordhasdata(parent, LDNS_RR_TYPE_DNAME, NULL, 0)) {
-            /* Occluded data / Empty non-terminal to Occluded data */
-            names_end(&iter);
-            return LDNS_RR_TYPE_DNAME;
-        }
+    stamp = names_viewcutstamp(view);
+    status = names_recordgetauthority(record, stamp);
+    if(status != LDNS_RR_TYPE_FIRST)
+        return status;
+    parent = names_viewparent(view, record);
+    if (parent == NULL) {
+        /* Authoritative or delegation */
+        status = LDNS_RR_TYPE_SOA;
+    } else if (names_recordhasdata(parent, LDNS_RR_TYPE_SOA, NULL, 0)) {
+        status = LDNS_RR_TYPE_SOA;
+    } else if (names_recordhasdata(parent, LDNS_RR_TYPE_NS, NULL, 0)) {
+        /* Glue / Empty non-terminal to Glue */
+        status = LDNS_RR_TYPE_A;
+    } else if (names_recordhasdata(parent, LDNS_RR_TYPE_DNAME, NULL, 0)) {
+        /* Occluded data / Empty non-terminal to Occluded data */
+        status = LDNS_RR_TYPE_DNAME;
+    } else {
+        status = domain_is_occluded(view, parent);
     }
-    /* Authoritative or delegation */
-    return LDNS_RR_TYPE_SOA;
+    names_recordsetauthority(record, stamp, status);
+    return status;
 }
 
 struct rrsigkeymatching {
@@ -142,6 +153,105 @@ struct rrsigkeymatching {
     key_type* key;
 };
 
+/* Signatures to be made for the RRsets of a single domain.  The RRsets
+ * are collected first, such that all RRsets to be signed by the same key
+ * are handed to the HSM in one go.  The jobs are kept apart from their
+ * RR types, so they can be handed to the HSM as is.
+ */
+struct rrset_signbatch {
+    time_t jitter;
+    int njobs;
+    int maxjobs;
+    lhsm_signjob_type* jobs;
+    ldns_rr_type* rrtypes;
+    int nrrsets;
+    int maxrrsets;
+    ldns_rr_list** rrsets;
+};
+
+static void
+rrset_signbatchinit(struct rrset_signbatch* batch)
+{
+    batch->jitter = -1;
+    batch->njobs = batch->maxjobs = 0;
+    batch->jobs = NULL;
+    batch->rrtypes = NULL;
+    batch->nrrsets = batch->maxrrsets = 0;
+    batch->rrsets = NULL;
+}
+
+static void
+rrset_signbatchclear(struct rrset_signbatch* batch)
+{
+    for (int i=0; i<batch->njobs; i++)
+        if (batch->jobs[i].rrsig)
+            ldns_rr_free(batch->jobs[i].rrsig);
+    for (int i=0; i<batch->nrrsets; i++)
+        ldns_rr_list_free(batch->rrsets[i]);
+    free(batch->rrsets);
+    free(batch->rrtypes);
+    free(batch->jobs);
+    rrset_signbatchinit(batch);
+}
+
+static void
+rrset_signbatchadd(struct rrset_signbatch* batch, ldns_rr_type rrtype, ldns_rr_list* rrset, key_type* key, time_t inception, time_t expiration)
+{
+    if (batch->njobs == batch->maxjobs) {
+        batch->maxjobs = (batch->maxjobs ? batch->maxjobs * 2 : 8);
+        CHECKALLOC(batch->jobs = realloc(batch->jobs, sizeof(lhsm_signjob_type) * batch->maxjobs));
+        CHECKALLOC(batch->rrtypes = realloc(batch->rrtypes, sizeof(ldns_rr_type) * batch->maxjobs));
+    }
+    batch->rrtypes[batch->njobs] = rrtype;
+    batch->jobs[batch->njobs].rrset = rrset;
+    batch->jobs[batch->njobs].key = key;
+    batch->jobs[batch->njobs].inception = inception;
+    batch->jobs[batch->njobs].expiration = expiration;
+    batch->jobs[batch->njobs].rrsig = NULL;
+    batch->njobs++;
+}
+
+/* Transfer the ownership of an RRset to the batch */
+static void
+rrset_signbatchkeep(struct rrset_signbatch* batch, ldns_rr_list* rrset)
+{
+    if (batch->nrrsets == batch->maxrrsets) {
+        batch->maxrrsets = (batch->maxrrsets ? batch->maxrrsets * 2 : 8);
+        CHECKALLOC(batch->rrsets = realloc(batch->rrsets, sizeof(ldns_rr_list*) * batch->maxrrsets));
+    }
+    batch->rrsets[batch->nrrsets++] = rrset;
+}
+
+/* Add the signatures made to the domain, the batch is cleared afterwards */
+static ods_status
+rrset_signdeliver(struct rrset_signbatch* batch, recordset_type record)
+{
+    ods_status status = ODS_STATUS_OK;
+    int i, nfailed = 0;
+    for (i=0; i<batch->njobs; i++) {
+        if (batch->jobs[i].rrsig) {
+            names_recordaddsignature(record, batch->rrtypes[i], batch->jobs[i].rrsig, strdup(batch->jobs[i].key->locator), batch->jobs[i].key->flags);
+            batch->jobs[i].rrsig = NULL;
+        } else if (batch->jobs[i].key) {
+            ++nfailed;
+        }
+    }
+    if (nfailed > 0) {
+        ods_log_crit("unable to sign %d RRsets of %s: lhsm_sign_batch() failed", nfailed, names_recordgetname(record));
+        status = ODS_STATUS_HSM_ERR;
+    }
+    rrset_signbatchclear(batch);
+    return status;
+}
+
+/* Sign all collected RRsets, grouped per key and validity period */
+static ods_status
+rrset_signflush(struct rrset_signbatch* batch, recordset_type record, hsm_ctx_t* ctx)
+{
+    (void) lhsm_sign_jobs(ctx, batch->njobs, batch->jobs);
+    return rrset_signdeliver(batch, record);
+}
+
 static int
 rrsigkeyismatching(struct signature_struct* signature, key_type* key)
 {
@@ -184,14 +294,15 @@ rrsigkeymatching(signconf_type* signconf, struct signature_struct** rrsigs, stru
 }
 
 /**
- * Sign RRset.
+ * Determine the signatures to be made for an RRset and add them to the batch.
  *
  */
-ods_status
-rrset_sign(signconf_type* signconf, names_view_type view, recordset_type record, ldns_rr_type rrtype, hsm_ctx_t* ctx, time_t signtime)
+static ods_status
+rrset_collect(signconf_type* signconf, names_view_type view, recordset_type record, ldns_rr_type rrtype, struct rrset_signbatch* batch, time_t signtime)
 {
     ods_status status;
     uint32_t newsigs;
+    int firstjob = batch->njobs;
     ldns_rr* rrsig;
     time_t inception;
     time_t expiration;
@@ -313,21 +424,13 @@ rrset_sign(signconf_type* signconf, names_view_type view, recordset_type record,
         }
     }
     /* Calculate signature validity for new signatures */
-    rrset_sigvalid_period(signconf, rrtype, signtime, &inception, &expiration);
+    rrset_sigvalid_period(signconf, rrtype, signtime, &batch->jitter, &inception, &expiration);
     /* for each missing signature (no signature, but with key in the tuplie list) produce a signature */
     for (int i = 0; i < nmatchedsignatures; i++) {
         if (!matchedsignatures[i].signature && matchedsignatures[i].key) {
             /* Sign the RRset with this key */
             logger_message(&cls,logger_noctx,logger_TRACE, "sign %s with key %s inception=%ld expiration=%ld delegation=%s occluded=%s\n",names_recordgetname(record),matchedsignatures[i].key->locator,(long)inception,(long)expiration,(delegpt!=LDNS_RR_TYPE_SOA?"yes":"no"),(dstatus!=LDNS_RR_TYPE_SOA?"yes":"no"));
-            rrsig = lhsm_sign(ctx, rrset, matchedsignatures[i].key, inception, expiration);
-            if (rrsig == NULL) {
-                ods_log_crit("unable to sign RRset[%i]: lhsm_sign() failed", rrtype);
-                if(rrset) ldns_rr_list_free(rrset);
-                free(matchedsignatures);
-                return ODS_STATUS_HSM_ERR;
-            }
-            /* Add signature */
-            names_recordaddsignature(record, rrtype, rrsig, strdup(matchedsignatures[i].key->locator), matchedsignatures[i].key->flags);
+            rrset_signbatchadd(batch, rrtype, rrset, matchedsignatures[i].key, inception, expiration);
             newsigs++;
         }
         /* Add signatures for DNSKEY if have been configured to be added explicitjy */
@@ -353,12 +456,115 @@ rrset_sign(signconf_type* signconf, names_view_type view, recordset_type record,
         }
     }
 
-    /* RRset signing completed */
-    if(rrset) ldns_rr_list_free(rrset);
+    /* RRset signing collected, the batch now owns the RRset if it needs signing */
+    if (batch->njobs > firstjob) {
+        rrset_signbatchkeep(batch, rrset);
+    } else if(rrset) {
+        ldns_rr_list_free(rrset);
+    }
     free(matchedsignatures);
     return 0;
 }
 
+/**
+ * Sign RRset.
+ *
+ */
+ods_status
+rrset_sign(signconf_type* signconf, names_view_type view, recordset_type record, ldns_rr_type rrtype, hsm_ctx_t* ctx, time_t signtime)
+{
+    ods_status status;
+    struct rrset_signbatch batch;
+    rrset_signbatchinit(&batch);
+    if ((status = rrset_collect(signconf, view, record, rrtype, &batch, signtime)) != ODS_STATUS_OK) {
+        rrset_signbatchclear(&batch);
+        return status;
+    }
+    return rrset_signflush(&batch, record, ctx);
+}
+
+/* Collect all RRsets of a domain that need to be signed, including its denial of existence */
+static ods_status
+rrset_collectall(signconf_type* signconf, names_view_type view, recordset_type record, struct rrset_signbatch* batch, time_t signtime)
+{
+    ods_status status;
+    names_iterator iter;
+    ldns_rr_type rrtype;
+    for (iter=names_recordalltypes(record); names_iterate(&iter,&rrtype); names_advance(&iter,NULL)) {
+        if ((status = rrset_collect(signconf, view, record, rrtype, batch, signtime)) != ODS_STATUS_OK) {
+            names_end(&iter);
+            rrset_signbatchclear(batch);
+            return status;
+        }
+    }
+    if(names_recordgetdenial(record)) {
+        if ((status = rrset_collect(signconf, view, record, LDNS_RR_TYPE_NSEC, batch, signtime)) != ODS_STATUS_OK) {
+            rrset_signbatchclear(batch);
+            return status;
+        }
+    }
+    return ODS_STATUS_OK;
+}
+
+/**
+ * Sign all RRsets of a domain, including its denial of existence.  The
+ * RRsets that are to be signed by the same key are signed in one batch.
+ *
+ */
+ods_status
+rrset_signall(signconf_type* signconf, names_view_type view, recordset_type record, hsm_ctx_t* ctx, time_t signtime)
+{
+    ods_status status;
+    struct rrset_signbatch batch;
+    rrset_signbatchinit(&batch);
+    if ((status = rrset_collectall(signconf, view, record, &batch, signtime)) != ODS_STATUS_OK)
+        return status;
+    return rrset_signflush(&batch, record, ctx);
+}
+
+/**
+ * Collect the signatures to be made for all RRsets of a domain, to be
+ * signed by the signing pipeline.
+ *
+ */
+struct rrset_signbatch*
+rrset_signprepare(signconf_type* signconf, names_view_type view, recordset_type record, time_t signtime, ods_status* status)
+{
+    struct rrset_signbatch* batch;
+    CHECKALLOC(batch = malloc(sizeof(struct rrset_signbatch)));
+    rrset_signbatchinit(batch);
+    if ((*status = rrset_collectall(signconf, view, record, batch, signtime)) != ODS_STATUS_OK) {
+        free(batch);
+        return NULL;
+    }
+    return batch;
+}
+
+/**
+ * The signatures to be made for a domain.
+ *
+ */
+int
+rrset_signjobs(struct rrset_signbatch* batch, lhsm_signjob_type** jobs)
+{
+    *jobs = batch->jobs;
+    return batch->njobs;
+}
+
+/**
+ * Add the signatures made by the signing pipeline to the domain, and
+ * release the batch.
+ *
+ */
+ods_status
+rrset_signfinish(struct rrset_signbatch* batch, recordset_type record)
+{
+    ods_status status;
+    status = rrset_signdeliver(batch, record);
+    free(batch);
+    return status;
+}
+
 static void
 denial_create_bitmap(names_view_type view, recordset_type record, ldns_rr_type nsectype, ldns_rr_type** types, size_t* types_count)
 {
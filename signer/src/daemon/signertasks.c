@@ -31,6 +31,7 @@
 #include <unistd.h>
 
 #include "daemon/engine.h"
+#include "daemon/outputstage.h"
 #include "scheduler/worker.h"
 #include "scheduler/schedule.h"
 #include "signertasks.h"
@@ -50,19 +51,23 @@
 static logger_cls_type names_logsigning = LOGGER_INITIALIZE("signing");
 
 /**
- * Queue RRset for signing.
+ * Queue RRsets for signing.
  *
  */
 static void
-worker_queue_domain(struct worker_context* context, fifoq_type* q, void* item, long* nsubtasks)
+worker_queue_domains(struct worker_context* context, fifoq_type* q, void** items, size_t count, long* nsubtasks)
 {
     ods_status status = ODS_STATUS_UNCHANGED;
     int tries = 0;
+    size_t pushed = 0;
     ods_log_assert(q);
 
         pthread_mutex_lock(&q->q_lock);
-        status = fifoq_push(q, item, context, &tries);
+        status = fifoq_pushbatch(q, items, count, context, &pushed, &tries);
+        *nsubtasks += pushed;
         while (status == ODS_STATUS_UNCHANGED) {
+            items += pushed;
+            count -= pushed;
             tries++;
             if (context->worker->need_to_exit) {
                 pthread_mutex_unlock(&q->q_lock);
@@ -72,15 +77,15 @@ worker_queue_domain(struct worker_context* context, fifoq_type* q, void* item, l
              * Apparently the queue is full. Lets take a small break to not hog CPU.
              * The worker will release the signq lock while sleeping and will
              * automatically grab the lock when the queue is nonfull.
-             * Queue is nonfull at 10% of the queue size.
+             * Queue is nonfull at 50% of the queue size.
              */
             ods_thread_wait(&q->q_nonfull, &q->q_lock, 5);
-            status = fifoq_push(q, item, context, &tries);
+            status = fifoq_pushbatch(q, items, count, context, &pushed, &tries);
+            *nsubtasks += pushed;
         }
         pthread_mutex_unlock(&q->q_lock);
 
         ods_log_assert(status == ODS_STATUS_OK);
-        *nsubtasks += 1;
 }
 
 
@@ -93,10 +98,19 @@ worker_queue_zone(struct worker_context* context, fifoq_type* q, names_view_type
 {
     names_iterator iter;
     recordset_type record;
+    void* batch[FIFOQ_BATCH_COUNT];
+    size_t count = 0;
     time_t refreshtime = context->clock_in + duration2time(context->zone->signconf->sig_refresh_interval);
     for(iter=names_viewiterator(view,names_iteratorexpiring,refreshtime); names_iterate(&iter,&record); names_advance(&iter,NULL)) {
         names_amend(view, record);
-        worker_queue_domain(context, q, record, nsubtasks);
+        batch[count++] = record;
+        if (count == FIFOQ_BATCH_COUNT) {
+            worker_queue_domains(context, q, batch, count, nsubtasks);
+            count = 0;
+        }
+    }
+    if (count > 0) {
+        worker_queue_domains(context, q, batch, count, nsubtasks);
     }
 }
 
@@ -123,25 +137,14 @@ worker_check_jobs(worker_type* worker, task_type* task, int ntasks, long ntasksf
 }
 
 static ods_status
-signdomain(struct worker_context* superior, hsm_ctx_t* ctx, recordset_type record)
+signdomainexpiry(recordset_type record)
 {
-    ods_status status;
-    names_iterator iter;
-    ldns_rr_type rrtype;
     time_t expiration = INT_MAX;
     time_t rrsigexpirationtime;
     ldns_rr* rrsig;
     struct signature_struct** rrsigs;
     ldns_rdf* rrsigexpiration;
 
-    for (iter=names_recordalltypes(record); names_iterate(&iter,&rrtype); names_advance(&iter,NULL)) {
-        if ((status = rrset_sign(superior->zone->signconf, superior->view, record, rrtype, ctx, superior->clock_in)) != ODS_STATUS_OK)
-            return status;
-    }
-    if(names_recordgetdenial(record)) {
-        if((status = rrset_sign(superior->zone->signconf, superior->view, record, LDNS_RR_TYPE_NSEC, ctx, superior->clock_in)) != ODS_STATUS_OK)
-            return status;
-    }
 
     names_recordlookupall(record, LDNS_RR_TYPE_RRSIG, NULL, NULL, &rrsigs);
     for(int i=0; rrsigs[i]; i++) {
@@ -157,13 +160,63 @@ signdomain(struct worker_context* superior, hsm_ctx_t* ctx, recordset_type recor
     return ODS_STATUS_OK;
 }
 
+static ods_status
+signdomain(struct worker_context* superior, hsm_ctx_t* ctx, recordset_type record)
+{
+    ods_status status;
+    if ((status = rrset_signall(superior->zone->signconf, superior->view, record, ctx, superior->clock_in)) != ODS_STATUS_OK)
+        return status;
+    return signdomainexpiry(record);
+}
+
+/**
+ * Sign the domains popped from the sign queue through the signing
+ * pipeline.  The signatures of all domains are submitted as one round,
+ * such that the HSM sessions are kept busy while the drudger waits.
+ *
+ */
+static void
+signdomains(lhsm_pipeline_type* pipeline, void** records, void** superiors, size_t count, ods_status* statuses)
+{
+    struct rrset_signbatch* batches[FIFOQ_POP_COUNT];
+    struct worker_context* superior;
+    lhsm_signround_type round;
+    lhsm_signjob_type* jobs;
+    size_t i;
+    int njobs;
+
+    lhsm_pipeline_round(&round);
+    for (i=0; i < count; i++) {
+        superior = superiors[i];
+        batches[i] = rrset_signprepare(superior->zone->signconf, superior->view, (recordset_type) records[i], superior->clock_in, &statuses[i]);
+        if (batches[i]) {
+            njobs = rrset_signjobs(batches[i], &jobs);
+            lhsm_pipeline_submit(pipeline, &round, njobs, jobs);
+        }
+    }
+    (void) lhsm_pipeline_wait(pipeline, &round);
+    for (i=0; i < count; i++) {
+        if (batches[i]) {
+            statuses[i] = rrset_signfinish(batches[i], (recordset_type) records[i]);
+            if (statuses[i] == ODS_STATUS_OK) {
+                statuses[i] = signdomainexpiry((recordset_type) records[i]);
+            }
+        }
+    }
+}
+
 void
 drudge(worker_type* worker)
 {
-    recordset_type record;
+    void* records[FIFOQ_POP_COUNT];
+    void* superiors[FIFOQ_POP_COUNT];
+    ods_status statuses[FIFOQ_POP_COUNT];
+    size_t i, j, count;
+    long nfailed;
     ods_status status;
     struct worker_context* superior;
     hsm_ctx_t* ctx = NULL;
+    lhsm_pipeline_type* pipeline;
     engine_type* engine;
     fifoq_type* signq = worker->taskq->signq;
 
@@ -174,41 +227,57 @@ drudge(worker_type* worker)
             pthread_mutex_unlock(&signq->q_lock);
             break;
         }
-        superior = NULL;
-        record = (recordset_type) fifoq_pop(signq, (void**)&superior);
-        if (!record) {
+        count = fifoq_popbatch(signq, records, superiors, FIFOQ_POP_COUNT);
+        if (count == 0) {
             ods_log_deeebug("[%s] nothing to do, wait", worker->name);
             /**
              * Apparently the queue is empty. Wait until new work is queued.
              * The drudger will release the signq lock while sleeping and
-             * will automatically grab the lock when the threshold is reached.
-             * Threshold is at 1 and MAX (after a number of tries).
+             * will automatically grab the lock when work is queued.
              */
             pthread_cond_wait(&signq->q_threshold, &signq->q_lock);
             if(worker->need_to_exit == 0)
-                record = (recordset_type) fifoq_pop(signq, (void**)&superior);
+                count = fifoq_popbatch(signq, records, superiors, FIFOQ_POP_COUNT);
         }
         pthread_mutex_unlock(&signq->q_lock);
         /* do some work */
-        if (record) {
+        pipeline = (count > 0 ? ((struct worker_context*)superiors[0])->engine->signpipeline : NULL);
+        if (pipeline) {
+            signdomains(pipeline, records, superiors, count, statuses);
+        }
+        nfailed = 0;
+        for (i=0, j=0; i < count; i++) {
+            superior = superiors[i];
             ods_log_assert(superior);
-            if (!ctx) {
-                ods_log_debug("[%s] create hsm context", worker->name);
-                ctx = hsm_create_context();
-            }
-            if (!ctx) {
-                engine = superior->engine;
-                ods_log_crit("[%s] error creating libhsm context", worker->name);
-                engine->need_to_reload = 1;
-                pthread_mutex_lock(&engine->signal_lock);
-                pthread_cond_signal(&engine->signal_cond);
-                pthread_mutex_unlock(&engine->signal_lock);
-                ods_log_error("signer instructed to reload due to hsm reset while signing");
-                status = ODS_STATUS_HSM_ERR;
+            if (pipeline) {
+                status = statuses[i];
             } else {
-                status = signdomain(superior, ctx, record);
+                if (!ctx) {
+                    ods_log_debug("[%s] create hsm context", worker->name);
+                    ctx = hsm_create_context();
+                }
+                if (!ctx) {
+                    engine = superior->engine;
+                    ods_log_crit("[%s] error creating libhsm context", worker->name);
+                    engine->need_to_reload = 1;
+                    pthread_mutex_lock(&engine->signal_lock);
+                    pthread_cond_signal(&engine->signal_cond);
+                    pthread_mutex_unlock(&engine->signal_lock);
+                    ods_log_error("signer instructed to reload due to hsm reset while signing");
+                    status = ODS_STATUS_HSM_ERR;
+                } else {
+                    status = signdomain(superior, ctx, (recordset_type) records[i]);
+                }
+            }
+            if (status != ODS_STATUS_OK) {
+                nfailed += 1;
+            }
+            /* report once for each run of records of the same superior */
+            if (i + 1 == count || superiors[i+1] != superior) {
+                fifoq_reportbatch(signq, superior->worker, i + 1 - j, nfailed);
+                nfailed = 0;
+                j = i + 1;
             }
-            fifoq_report(signq, superior->worker, status);
         }
         /* done work */
     }
@@ -277,29 +346,73 @@ do_forcereadsignconf(task_type* task, const char* zonename, void* zonearg, void
     }
 }
 
+/* Only the names changed since the previous pass are examined, unless a
+ * changed name is a delegation or DNAME, which may occlude names below it
+ * that did not change themselves.  Names that are no longer occluded after
+ * a cut was removed are put back into the denial chain.
+ */
 void
 processoccluded(names_view_type view)
 {
+    int count;
+    int cut = 0;
     struct dual change;
     names_iterator iter;
+    recordset_type record;
+    for (iter=names_viewexcludedrecords(view); iter && names_iterate(&iter,&record); names_advance(&iter,NULL)) {
+        if(domain_is_occluded(view, record) == LDNS_RR_TYPE_SOA) {
+            names_update(view, &record);
+            names_viewannotate(view, &record, 1);
+        }
+    }
     /* for any occluded domain names, clear the annotation, since we should not be genereating NSECs for them */
+    iter = names_viewdirtyrecords(view, &count);
+    if(iter != NULL) {
+        for (; names_iterate(&iter,&record); names_advance(&iter,NULL)) {
+            if(names_recordgetdenial(record) && domain_is_occluded(view, record) != LDNS_RR_TYPE_SOA) {
+                names_update(view, &record);
+                names_recordannotate(record, NULL);
+            }
+            if(!names_recordhasdata(record, LDNS_RR_TYPE_SOA, NULL, 0) &&
+               (names_recordhasdata(record, LDNS_RR_TYPE_NS, NULL, 0) || names_recordhasdata(record, LDNS_RR_TYPE_DNAME, NULL, 0))) {
+                cut = 1;
+            }
+        }
+        if(!cut)
+            return;
+    }
     for (iter=names_viewiterator(view,names_iteratordenialchainupdates); names_iterate(&iter,&change); names_advance(&iter,NULL)) {
         if(domain_is_occluded(view, change.src) != LDNS_RR_TYPE_SOA) {
-            recordset_type record = change.src;
+            record = change.src;
             names_update(view, &record);
             names_recordannotate(record, NULL);
         }
     }
 }
 
-static void
-processneighbours(names_view_type view, signconf_type* signconf, int newserial)
+/* Only the part of the denial chain around the names changed since the
+ * previous pass is examined, unless the entire chain needs to be revisited
+ * for instance because the signer configuration changed, in which case
+ * full is set.  Returns the number of denial records updated.
+ */
+static uint32_t
+processneighbours(names_view_type view, signconf_type* signconf, int newserial, int* full, uint32_t* changecount)
 {
+    int count;
+    uint32_t nsecs = 0;
     struct dual change;
     names_iterator iter;
     const char* nextnamestr;
     ldns_rdf* nextnamerdf;
-    for (iter=names_viewiterator(view,names_iteratordenialchainupdates); names_iterate(&iter,&change); names_advance(&iter,NULL)) {
+    iter = names_viewdirtydenialchain(view, &count);
+    *changecount = count;
+    if(iter == NULL || *full) {
+        if(iter != NULL)
+            names_end(&iter);
+        iter = names_viewiterator(view,names_iteratordenialchainupdates);
+        *full = 1;
+    }
+    for (; names_iterate(&iter,&change); names_advance(&iter,NULL)) {
         if(signconf->nsec3params)
             nextnamestr = names_recordgetdenial(change.dst);
         else
@@ -317,9 +430,11 @@ processneighbours(names_view_type view, signconf_type* signconf, int newserial)
                 names_amend(view, record);
             }
             names_recordsetdenial(record, nsec);
+            ++nsecs;
         }
         ldns_rdf_deep_free(nextnamerdf);
     }
+    return nsecs;
 }
 
 static void
@@ -379,6 +494,11 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
     struct dual change;
     names_iterator iter;
     time_t returnscheduletime = schedule_SUCCESS;
+    int fullpass;
+    uint32_t nsecs;
+    uint32_t changes = 0;
+    long expiring = 0;
+    time_t nsecstart;
 
     context->clock_in = time_now();
     context->zone = zone;
@@ -419,7 +539,10 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
     signview = zonelist_obtainresource(NULL, zone, NULL, offsetof(zone_type, signview));
     context->view = signview;
     names_viewreset(signview);
-    processneighbours(signview, zone->signconf, newserial);
+    nsecstart = time(NULL);
+    fullpass = zone->denialrefresh;
+    nsecs = processneighbours(signview, zone->signconf, newserial, &fullpass, &changes);
+    zone->denialrefresh = 0;
     conflict = names_viewcommit(signview);
     assert(!conflict);
 
@@ -434,6 +557,10 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
         zone->stats->sig_soa_count = 0;
         zone->stats->sig_reuse = 0;
         zone->stats->sig_time = 0;
+        zone->stats->nsec_count = nsecs;
+        zone->stats->nsec_time = start - nsecstart;
+        zone->stats->change_count = changes;
+        zone->stats->full_pass = fullpass;
         pthread_mutex_unlock(&zone->stats->stats_lock);
     }
     /* check the HSM connection before queuing sign operations */
@@ -458,6 +585,7 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
                     "signing zone %s", worker->name, task->owner);
             /* sleep until work is done */
             fifoq_waitfor(context->signq, worker, nsubtasks, &nsubtasksfailed);
+            expiring = nsubtasks;
         } else {
             names_iterator iter;
             hsm_ctx_t* ctx;
@@ -467,6 +595,7 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
             for(iter=names_viewiterator(signview,names_iteratorexpiring,refreshtime); names_iterate(&iter,&record); names_advance(&iter,NULL)) {
                 names_amend(signview, record);
                 signdomain(context, ctx, record);
+                ++expiring;
             }
             hsm_destroy_context(ctx);
         }
@@ -485,6 +614,7 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
       if (zone->stats) {
         pthread_mutex_lock(&zone->stats->stats_lock);
         zone->stats->sig_time = (end - start);
+        zone->stats->expire_count = expiring;
         if (zone->stats->sort_done == 0 &&
             (zone->stats->sig_count <= zone->stats->sig_soa_count)) {
             ods_log_verbose("skip write zone %s serial %u (zone not "
@@ -521,7 +651,7 @@ do_readzone(task_type* task, const char* zonename, void* zonearg, void *contexta
         status = ODS_STATUS_ERR;
     }
     if (status == ODS_STATUS_OK) {
-        status = tools_input(zone);
+        status = tools_input(zone, engine->config->num_signer_threads);
         if (status == ODS_STATUS_UNCHANGED) {
             ods_log_verbose("zone %s unsigned data not changed, continue", task->owner);
             status = ODS_STATUS_OK;
@@ -566,7 +696,7 @@ do_forcereadzone(task_type* task, const char* zonename, void* zonearg, void *con
         status = ODS_STATUS_ERR;
     }
     if (status == ODS_STATUS_OK) {
-        status = tools_input(zone);
+        status = tools_input(zone, engine->config->num_signer_threads);
         if (status == ODS_STATUS_UNCHANGED) {
             ods_log_verbose("zone %s unsigned data not changed, continue", task->owner);
             status = ODS_STATUS_OK;
@@ -597,27 +727,23 @@ static const long default_zonefile_freq = 1;
 static const long default_ixfr_history = 30;
 
 void
-do_outputzonefile(zone_type* zone)
+do_outputzonefile(zone_type* zone, int nthreads)
 {
     names_view_type outputview;
-    char* filename;
     char* tmpname;
 
     /* Write the zone as it currently stands */
     outputview = zonelist_obtainresource(NULL, zone, NULL, offsetof(zone_type,outputview));
     names_viewreset(outputview);
     tmpname = ods_build_path(zone->adoutbound->configstr, ".tmp", 0, 0);
-    if(writezone(outputview, tmpname)) {
+    if(writezone(outputview, tmpname, nthreads)) {
         if (zone->adoutbound->error) {
-            ods_log_error("unable to write zone %s file %s", zone->name, filename);
+            ods_log_error("unable to write zone %s file %s", zone->name, zone->adoutbound->configstr);
             zone->adoutbound->error = 0;
             // status = ODS_STATUS_FWRITE_ERR;
         }
     } else {
-        if (rename((const char*) tmpname, zone->adoutbound->configstr) != 0) {
-            ods_log_error("unable to write file: failed to rename %s to %s (%s)", tmpname, filename, strerror(errno));
-            // status = ODS_STATUS_RENAME_ERR;
-        }
+        (void) ods_file_replace(tmpname, zone->adoutbound->configstr);
     }
     free(tmpname);
     zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type,outputview), outputview);
@@ -668,6 +794,28 @@ do_outputstatefile(zone_type* zone)
     free(filename);
 }
 
+/**
+ * Write the outputs of a zone.  Files replaced here are only moved into
+ * place once the file batch of the calling thread is committed, if one
+ * is open.
+ *
+ */
+ods_status
+do_outputzone(zone_type* zone, engine_type* engine, int outputs)
+{
+    if (outputs & OUTPUT_STATEFILE) {
+        do_purgezone(zone);
+        do_outputstatefile(zone);
+    }
+    if (tools_output(zone, engine) != ODS_STATUS_OK) {
+        return ODS_STATUS_ERR;
+    }
+    if (outputs & OUTPUT_ZONEFILE) {
+        do_outputzonefile(zone, engine->config->num_signer_threads);
+    }
+    return ODS_STATUS_OK;
+}
+
 time_t
 do_writezone(task_type* task, const char* zonename, void* zonearg, void *contextarg)
 {
@@ -676,6 +824,7 @@ do_writezone(task_type* task, const char* zonename, void* zonearg, void *context
     worker_type* worker = context->worker;
     zone_type* zone = zonearg;
     time_t resign;
+    int outputs = 0;
     context->clock_in = time_now(); /* TODO this means something different */
     /* perform write to output adapter task */
 
@@ -693,20 +842,23 @@ do_writezone(task_type* task, const char* zonename, void* zonearg, void *context
     if(zone->operatingconf->statefile_freq > 0) {
         if(--(zone->operatingconf->statefile_timer) <= 0) {
             zone->operatingconf->statefile_timer = zone->operatingconf->statefile_freq;
-            do_purgezone(zone);
-            do_outputstatefile(zone);
+            outputs |= OUTPUT_STATEFILE;
         }
     }
-
-    tools_output(zone, engine);
-
     if(zone->operatingconf->zonefile_freq > 0) {
         if(--(zone->operatingconf->zonefile_timer) <= 0) {
             zone->operatingconf->zonefile_timer = zone->operatingconf->zonefile_freq;
-            do_outputzonefile(zone);
+            outputs |= OUTPUT_ZONEFILE;
         }
     }
 
+    /* hand the zone to the output stage, or write it ourselves */
+    if (engine->outputstage) {
+        outputstage_submit(engine->outputstage, zone, outputs);
+    } else if (do_outputzone(zone, engine, outputs) == ODS_STATUS_OK) {
+        tools_notify(zone, engine);
+    }
+
     if (zone->signconf &&
             duration2time(zone->signconf->sig_resign_interval)) {
         resign = context->clock_in +
@@ -35,6 +35,10 @@
 #include "status.h"
 #include "locks.h"
 
+/* optional outputs written along with the output adapter */
+#define OUTPUT_STATEFILE 0x01
+#define OUTPUT_ZONEFILE  0x02
+
 struct worker_context {
     engine_type* engine;
     worker_type* worker;
@@ -52,6 +56,7 @@ time_t do_signzone(task_type* task, const char* zonename, void* zonearg, void *c
 time_t do_readzone(task_type* task, const char* zonename, void* zonearg, void *contextarg);
 time_t do_forcereadzone(task_type* task, const char* zonename, void* zonearg, void *contextarg);
 void do_purgezone(zone_type* zone);
+ods_status do_outputzone(zone_type* zone, engine_type* engine, int outputs);
 time_t do_writezone(task_type* task, const char* zonename, void* zonearg, void *contextarg);
 
 #endif /* SIGNERTASKS_H */
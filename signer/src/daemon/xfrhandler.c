@@ -70,16 +70,19 @@ xfrhandler_create()
     xfrh->notify_waiting_first = NULL;
     xfrh->notify_waiting_last = NULL;
     xfrh->notify_udp_num = 0;
+    xfrh->notifyq = NULL;
     /* setup */
     xfrh->netio = netio_create();
     xfrh->packet = buffer_create(PACKET_BUFFER_SIZE);
     xfrh->tcp_set = tcp_set_create();
+    xfrh->notifyq = notifyq_create(xfrh);
     xfrh->dnshandler.fd = -1;
     xfrh->dnshandler.user_data = (void*) xfrh;
     xfrh->dnshandler.timeout = 0;
     xfrh->dnshandler.event_types = NETIO_EVENT_READ;
     xfrh->dnshandler.event_handler = xfrhandler_handle_dns;
     xfrh->dnshandler.free_handler = 0;
+    xfrh->dnshandler.entry = NULL;
     return xfrh;
 }
 
@@ -182,6 +185,7 @@ xfrhandler_cleanup(xfrhandler_type* xfrhandler)
     if (!xfrhandler) {
         return;
     }
+    notifyq_cleanup(xfrhandler->notifyq);
     netio_cleanup_shallow(xfrhandler->netio);
     buffer_cleanup(xfrhandler->packet);
     tcp_set_cleanup(xfrhandler->tcp_set);
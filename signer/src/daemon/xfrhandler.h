@@ -41,6 +41,7 @@ typedef struct xfrhandler_struct xfrhandler_type;
 #include "wire/buffer.h"
 #include "wire/netio.h"
 #include "wire/notify.h"
+#include "wire/notifyq.h"
 #include "wire/tcpset.h"
 #include "wire/xfrd.h"
 #include "engine.h"
@@ -67,6 +68,7 @@ struct xfrhandler_struct {
     notify_type* notify_waiting_first;
     notify_type* notify_waiting_last;
     int notify_udp_num;
+    notifyq_type* notifyq;
     netio_handler_type dnshandler;
     unsigned got_time : 1;
     unsigned need_to_exit : 1;
@@ -32,6 +32,8 @@
 #include "daemon/engine.h"
 #include "hsm.h"
 #include "log.h"
+#include "locks.h"
+#include "clientpipe.h"
 #include "cryptoki_compat/pkcs11.h"
 
 static const char* hsm_str = "hsm";
@@ -54,6 +56,7 @@ lhsm_clear_key_cache(key_type* key)
         hsm_sign_params_free(key->params);
         key->params = NULL;
     }
+    key->hsmkey = NULL;
 }
 
 static const libhsm_key_t*
@@ -73,6 +76,42 @@ keylookup(hsm_ctx_t* ctx, const char* locator)
     return key;
 }
 
+/**
+ * Resolve the HSM key of a signer key.  The key is held on to by the signer
+ * key, for as long as the key cache it came from is valid.  This is only
+ * done while the keys of a zone are prepared, before any signing work is
+ * queued, so the signing threads only ever read the resolved key.
+ *
+ */
+static const libhsm_key_t*
+keyresolve(hsm_ctx_t* ctx, key_type* key_id)
+{
+    const libhsm_key_t* key = key_id->hsmkey;
+    unsigned int generation = keycache_generation(ctx);
+    if (key == NULL || key_id->hsmkeygeneration != generation) {
+        key = keylookup(ctx, key_id->locator);
+        key_id->hsmkey = key;
+        key_id->hsmkeygeneration = generation;
+    }
+    return key;
+}
+
+/**
+ * Get the resolved HSM key of a signer key, for signing.
+ *
+ */
+static const libhsm_key_t*
+keyresolved(hsm_ctx_t* ctx, key_type* key_id)
+{
+    if (key_id->hsmkey == NULL ||
+        key_id->hsmkeygeneration != keycache_generation(ctx)) {
+        ods_log_error("[%s] unable to sign: key %s not prepared", hsm_str,
+            key_id->locator?key_id->locator:"(null)");
+        return NULL;
+    }
+    return key_id->hsmkey;
+}
+
 /**
  * Get key from one of the HSMs.
  *
@@ -107,9 +146,15 @@ llibhsm_key_start:
     }
     if (skip_hsm_access) return ODS_STATUS_OK;
 
+    /* resolve key, also when the dnskey is known already */
+    if (!keyresolve(ctx, key_id)) {
+        ods_log_error("[%s] unable to get key: hsm failed to find key %s",
+            hsm_str, key_id->locator?key_id->locator:"(null)");
+        return ODS_STATUS_ERR;
+    }
     /* get dnskey */
     if (!key_id->dnskey) {
-        key_id->dnskey = hsm_get_dnskey(ctx, keylookup(ctx, key_id->locator), key_id->params);
+        key_id->dnskey = hsm_get_dnskey(ctx, key_id->hsmkey, key_id->params);
     }
     if (!key_id->dnskey) {
         error = hsm_get_error(ctx);
@@ -157,7 +202,7 @@ lhsm_sign(hsm_ctx_t* ctx, ldns_rr_list* rrset, key_type* key_id,
     params->inception = inception;
     params->expiration = expiration;
     params->keytag = key_id->params->keytag;
-    result = hsm_sign_rrset(ctx, rrset, keylookup(ctx, key_id->locator), params);
+    result = hsm_sign_rrset(ctx, rrset, keyresolved(ctx, key_id), params);
     hsm_sign_params_free(params);
     if (!result) {
         error = hsm_get_error(ctx);
@@ -169,3 +214,363 @@ lhsm_sign(hsm_ctx_t* ctx, ldns_rr_list* rrset, key_type* key_id,
     }
     return result;
 }
+
+
+/**
+ * Get RRSIGs for a number of RRsets from one of the HSMs.
+ *
+ */
+ods_status
+lhsm_sign_batch(hsm_ctx_t* ctx, int count, ldns_rr_list** rrsets,
+    key_type* key_id, time_t inception, time_t expiration, ldns_rr** rrsigs)
+{
+    char* error = NULL;
+    hsm_sign_params_t* params = NULL;
+    int i, nsigned;
+
+    if (!key_id || !rrsets || !inception || !expiration) {
+        ods_log_error("[%s] unable to sign: missing required elements",
+            hsm_str);
+        return ODS_STATUS_ERR;
+    }
+    ods_log_assert(key_id->dnskey);
+    ods_log_assert(key_id->params);
+    /* adjust parameters */
+    params = hsm_sign_params_new();
+    params->owner = ldns_rdf_clone(key_id->params->owner);
+    params->algorithm = key_id->algorithm;
+    params->flags = key_id->flags;
+    params->inception = inception;
+    params->expiration = expiration;
+    params->keytag = key_id->params->keytag;
+    nsigned = hsm_sign_rrset_batch(ctx, count, rrsets, keyresolved(ctx, key_id), params, rrsigs);
+    hsm_sign_params_free(params);
+    if (nsigned != count) {
+        error = hsm_get_error(ctx);
+        if (error) {
+            ods_log_error("[%s] %s", hsm_str, error);
+            free((void*)error);
+        }
+        ods_log_crit("[%s] error signing %d of %d rrsets with libhsm",
+            hsm_str, count - nsigned, count);
+        for (i=0; i<count; i++) {
+            if (rrsigs[i])
+                ldns_rr_free(rrsigs[i]);
+            rrsigs[i] = NULL;
+        }
+        return ODS_STATUS_HSM_ERR;
+    }
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Sign a number of jobs, batched per key and signature validity.
+ *
+ */
+ods_status
+lhsm_sign_jobs(hsm_ctx_t* ctx, int count, lhsm_signjob_type* jobs)
+{
+    ods_status status = ODS_STATUS_OK;
+    ldns_rr_list** rrsets;
+    ldns_rr** rrsigs;
+    int* members;
+    char* grouped;
+    key_type* key;
+    int i, j, n;
+
+    if (count <= 0) {
+        return ODS_STATUS_OK;
+    }
+    CHECKALLOC(rrsets = malloc(sizeof(ldns_rr_list*) * count));
+    CHECKALLOC(rrsigs = malloc(sizeof(ldns_rr*) * count));
+    CHECKALLOC(members = malloc(sizeof(int) * count));
+    CHECKALLOC(grouped = calloc(count, sizeof(char)));
+    for (i=0; i<count && status == ODS_STATUS_OK; i++) {
+        if (grouped[i] || (key = jobs[i].key) == NULL)
+            continue;
+        for (j=i, n=0; j<count; j++) {
+            if (!grouped[j] && jobs[j].key == key && jobs[j].inception == jobs[i].inception && jobs[j].expiration == jobs[i].expiration) {
+                members[n] = j;
+                rrsets[n] = jobs[j].rrset;
+                grouped[j] = 1;
+                ++n;
+            }
+        }
+        status = lhsm_sign_batch(ctx, n, rrsets, key, jobs[i].inception, jobs[i].expiration, rrsigs);
+        if (status != ODS_STATUS_OK) {
+            break;
+        }
+        for (j=0; j<n; j++) {
+            jobs[members[j]].rrsig = rrsigs[j];
+        }
+    }
+    free(grouped);
+    free(members);
+    free(rrsigs);
+    free(rrsets);
+    return status;
+}
+
+
+static double
+lhsm_pipeline_elapsed(struct timespec* from, struct timespec* to)
+{
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1000000000.0;
+}
+
+/**
+ * Run a session of the signing pipeline.  The session takes requests from
+ * the queue and signs them with its own HSM context, a clone of the context
+ * of the pipeline.
+ *
+ */
+static void
+lhsm_pipeline_run(lhsm_pipeline_type* pipeline)
+{
+    hsm_ctx_t* ctx = NULL;
+    lhsm_signrequest_type request;
+    struct timespec started, finished;
+    long nsigned, nfailed;
+    int i;
+
+    pthread_mutex_lock(&pipeline->lock);
+    for (;;) {
+        while (pipeline->queuecount == 0 && !pipeline->need_to_exit) {
+            pthread_cond_wait(&pipeline->work, &pipeline->lock);
+        }
+        if (pipeline->queuecount == 0) {
+            break;
+        }
+        request = pipeline->queue[pipeline->queuehead];
+        pipeline->queuehead = (pipeline->queuehead + 1) % pipeline->queuesize;
+        pipeline->queuecount--;
+        pipeline->inflight += request.njobs;
+        if (pipeline->inflight > pipeline->peakinflight) {
+            pipeline->peakinflight = pipeline->inflight;
+        }
+        pthread_mutex_unlock(&pipeline->lock);
+
+        clock_gettime(CLOCK_MONOTONIC, &started);
+        if (!ctx) {
+            ods_log_debug("[%s] clone hsm context for signing session", hsm_str);
+            ctx = (pipeline->ctx ? hsm_clone_context(pipeline->ctx) : NULL);
+            if (!ctx) {
+                ods_log_crit("[%s] error cloning libhsm context for signing session", hsm_str);
+                if (pipeline->engine) {
+                    pipeline->engine->need_to_reload = 1;
+                    pthread_mutex_lock(&pipeline->engine->signal_lock);
+                    pthread_cond_signal(&pipeline->engine->signal_cond);
+                    pthread_mutex_unlock(&pipeline->engine->signal_lock);
+                    ods_log_error("signer instructed to reload due to hsm reset while signing");
+                }
+            }
+        }
+        if (ctx) {
+            (void) lhsm_sign_jobs(ctx, request.njobs, request.jobs);
+        }
+        nsigned = nfailed = 0;
+        for (i=0; i<request.njobs; i++) {
+            if (request.jobs[i].rrsig) {
+                nsigned++;
+            } else if (request.jobs[i].key) {
+                nfailed++;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &finished);
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->inflight -= request.njobs;
+        pipeline->nrequests++;
+        pipeline->nsigned += nsigned;
+        pipeline->nfailed += nfailed;
+        pipeline->busytotal += lhsm_pipeline_elapsed(&started, &finished);
+        pipeline->latencytotal += lhsm_pipeline_elapsed(&request.submitted, &finished);
+        if (lhsm_pipeline_elapsed(&request.submitted, &finished) > pipeline->latencymax) {
+            pipeline->latencymax = lhsm_pipeline_elapsed(&request.submitted, &finished);
+        }
+        request.round->nfailed += nfailed;
+        if (--request.round->pending == 0) {
+            pthread_cond_broadcast(&pipeline->done);
+        }
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    /* cleanup open HSM sessions */
+    if (ctx) {
+        hsm_destroy_context(ctx);
+    }
+}
+
+/**
+ * Create a signing pipeline.
+ *
+ */
+lhsm_pipeline_type*
+lhsm_pipeline_create(engine_type* engine, int window)
+{
+    lhsm_pipeline_type* pipeline;
+    int i;
+    if (window <= 0) {
+        return NULL;
+    }
+    CHECKALLOC(pipeline = (lhsm_pipeline_type*) calloc(1, sizeof(lhsm_pipeline_type)));
+    pipeline->engine = engine;
+    pipeline->window = window;
+    pipeline->ctx = hsm_create_context();
+    if (!pipeline->ctx) {
+        ods_log_error("[%s] unable to create libhsm context for signing "
+            "pipeline", hsm_str);
+    }
+    pipeline->queuesize = window * 4;
+    CHECKALLOC(pipeline->queue = (lhsm_signrequest_type*) malloc(pipeline->queuesize * sizeof(lhsm_signrequest_type)));
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->work, NULL);
+    pthread_cond_init(&pipeline->done, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &pipeline->created);
+    CHECKALLOC(pipeline->sessions = (janitor_thread_t*) malloc(window * sizeof(janitor_thread_t)));
+    for (i=0; i<window; i++) {
+        janitor_thread_create(&pipeline->sessions[i], workerthreadclass, (janitor_runfn_t)lhsm_pipeline_run, pipeline);
+    }
+    ods_log_verbose("[%s] signing pipeline started with %d sessions", hsm_str, window);
+    return pipeline;
+}
+
+/**
+ * Initialize a round of requests.
+ *
+ */
+void
+lhsm_pipeline_round(lhsm_signround_type* round)
+{
+    round->pending = 0;
+    round->nfailed = 0;
+}
+
+/**
+ * Submit a request of jobs to the pipeline.
+ *
+ */
+void
+lhsm_pipeline_submit(lhsm_pipeline_type* pipeline,
+    lhsm_signround_type* round, int count, lhsm_signjob_type* jobs)
+{
+    lhsm_signrequest_type* queue;
+    int i;
+    if (count <= 0) {
+        return;
+    }
+    pthread_mutex_lock(&pipeline->lock);
+    if (pipeline->queuecount == pipeline->queuesize) {
+        CHECKALLOC(queue = (lhsm_signrequest_type*) malloc(pipeline->queuesize * 2 * sizeof(lhsm_signrequest_type)));
+        for (i=0; i<pipeline->queuecount; i++) {
+            queue[i] = pipeline->queue[(pipeline->queuehead + i) % pipeline->queuesize];
+        }
+        free(pipeline->queue);
+        pipeline->queue = queue;
+        pipeline->queuehead = 0;
+        pipeline->queuesize *= 2;
+    }
+    i = (pipeline->queuehead + pipeline->queuecount) % pipeline->queuesize;
+    pipeline->queue[i].jobs = jobs;
+    pipeline->queue[i].njobs = count;
+    pipeline->queue[i].round = round;
+    clock_gettime(CLOCK_MONOTONIC, &pipeline->queue[i].submitted);
+    pipeline->queuecount++;
+    if (pipeline->queuecount > pipeline->peakqueued) {
+        pipeline->peakqueued = pipeline->queuecount;
+    }
+    round->pending++;
+    pthread_cond_signal(&pipeline->work);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+/**
+ * Wait until all requests of a round have been handled.
+ *
+ */
+long
+lhsm_pipeline_wait(lhsm_pipeline_type* pipeline, lhsm_signround_type* round)
+{
+    long nfailed;
+    pthread_mutex_lock(&pipeline->lock);
+    while (round->pending > 0) {
+        pthread_cond_wait(&pipeline->done, &pipeline->lock);
+    }
+    nfailed = round->nfailed;
+    pthread_mutex_unlock(&pipeline->lock);
+    return nfailed;
+}
+
+/**
+ * Report the pipeline counters.
+ *
+ */
+void
+lhsm_pipeline_report(lhsm_pipeline_type* pipeline, int fd)
+{
+    struct timespec now;
+    double elapsed, latency, throughput, utilization;
+    long nrequests, nsigned, nfailed;
+    int inflight, peakinflight, peakqueued, queued;
+    double latencymax;
+
+    if (!pipeline) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&pipeline->lock);
+    nrequests = pipeline->nrequests;
+    nsigned = pipeline->nsigned;
+    nfailed = pipeline->nfailed;
+    inflight = pipeline->inflight;
+    queued = pipeline->queuecount;
+    peakinflight = pipeline->peakinflight;
+    peakqueued = pipeline->peakqueued;
+    latency = (nrequests ? pipeline->latencytotal / nrequests : 0.0);
+    latencymax = pipeline->latencymax;
+    elapsed = lhsm_pipeline_elapsed(&pipeline->created, &now);
+    utilization = (elapsed > 0.0 ? pipeline->busytotal / (elapsed * pipeline->window) : 0.0);
+    pthread_mutex_unlock(&pipeline->lock);
+    throughput = (elapsed > 0.0 ? nsigned / elapsed : 0.0);
+    if (fd >= 0) {
+        client_printf(fd, "\nSigning pipeline of %d sessions: %d signatures in flight (peak %d), %d requests queued (peak %d).\n",
+            pipeline->window, inflight, peakinflight, queued, peakqueued);
+        client_printf(fd, "%ld signatures made, %ld failed, %.1f signatures/s, request latency %.3f ms (max %.3f ms), sessions %.0f%% busy.\n",
+            nsigned, nfailed, throughput, latency * 1000.0, latencymax * 1000.0, utilization * 100.0);
+    } else {
+        ods_log_info("[%s] signing pipeline of %d sessions: %ld signatures made, %ld failed, %.1f signatures/s, "
+            "request latency %.3f ms (max %.3f ms), peak %d in flight, peak %d queued, sessions %.0f%% busy",
+            hsm_str, pipeline->window, nsigned, nfailed, throughput, latency * 1000.0, latencymax * 1000.0,
+            peakinflight, peakqueued, utilization * 100.0);
+    }
+}
+
+/**
+ * Stop the sessions and clean up the pipeline.
+ *
+ */
+void
+lhsm_pipeline_cleanup(lhsm_pipeline_type* pipeline)
+{
+    int i;
+    if (!pipeline) {
+        return;
+    }
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->need_to_exit = 1;
+    pthread_cond_broadcast(&pipeline->work);
+    pthread_mutex_unlock(&pipeline->lock);
+    for (i=0; i<pipeline->window; i++) {
+        janitor_thread_join(pipeline->sessions[i]);
+    }
+    lhsm_pipeline_report(pipeline, -1);
+    if (pipeline->ctx) {
+        hsm_destroy_context(pipeline->ctx);
+    }
+    pthread_cond_destroy(&pipeline->done);
+    pthread_cond_destroy(&pipeline->work);
+    pthread_mutex_destroy(&pipeline->lock);
+    free(pipeline->sessions);
+    free(pipeline->queue);
+    free(pipeline);
+}
@@ -36,9 +36,11 @@
 #include "status.h"
 #include "signer/keys.h"
 #include "libhsm.h"
+#include "janitor.h"
 
 #include <ctype.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include <ldns/ldns.h>
 #include <libhsmdns.h>
@@ -67,4 +69,153 @@ ods_status lhsm_get_key(hsm_ctx_t* ctx, ldns_rdf* owner, key_type* key_id, int s
 ldns_rr* lhsm_sign(hsm_ctx_t* ctx, ldns_rr_list* rrset, key_type* key_id,
     time_t inception, time_t expiration);
 
+/**
+ * Get RRSIGs for a number of RRsets from one of the HSMs, all using the
+ * same key and signature validity.
+ * \param[in] ctx HSM context
+ * \param[in] count number of RRsets
+ * \param[in] rrsets RRsets to be signed
+ * \param[in] key_id key credentials
+ * \param[in] inception signature inception
+ * \param[in] expiration signature expiration
+ * \param[out] rrsigs the count RRSIG records
+ * \return ods_status status, on failure no RRSIG records are returned
+ *
+ */
+ods_status lhsm_sign_batch(hsm_ctx_t* ctx, int count, ldns_rr_list** rrsets,
+    key_type* key_id, time_t inception, time_t expiration, ldns_rr** rrsigs);
+
+/**
+ * A single signature to be made: an RRset, the key to sign it with and the
+ * validity period.  The resulting RRSIG record, if any, is left in rrsig.
+ *
+ */
+typedef struct lhsm_signjob_struct lhsm_signjob_type;
+struct lhsm_signjob_struct {
+    ldns_rr_list* rrset;
+    key_type* key;
+    time_t inception;
+    time_t expiration;
+    ldns_rr* rrsig;
+};
+
+/**
+ * Sign a number of jobs, in batches of jobs that share the same key and
+ * signature validity.  Signing stops at the first failing batch, the jobs
+ * not signed are left without RRSIG record.
+ * \param[in] ctx HSM context
+ * \param[in] count number of jobs
+ * \param[in] jobs jobs to be signed
+ * \return ods_status status
+ *
+ */
+ods_status lhsm_sign_jobs(hsm_ctx_t* ctx, int count, lhsm_signjob_type* jobs);
+
+/**
+ * Signing pipeline.  A number of sessions, each running in its own thread
+ * with its own cloned HSM context, keep sign operations in flight on the
+ * HSMs on behalf of the drudgers.  Work is handed to the pipeline in
+ * requests of jobs, typically all the signatures of one domain, which are
+ * signed in one go by a single session.  A drudger submits the requests
+ * for all its domains in a round and then waits for the round to complete.
+ *
+ */
+typedef struct lhsm_signrequest_struct lhsm_signrequest_type;
+struct lhsm_signrequest_struct {
+    lhsm_signjob_type* jobs;
+    int njobs;
+    struct timespec submitted;
+    struct lhsm_signround_struct* round;
+};
+
+typedef struct lhsm_signround_struct lhsm_signround_type;
+struct lhsm_signround_struct {
+    int pending;
+    long nfailed;
+};
+
+typedef struct lhsm_pipeline_struct lhsm_pipeline_type;
+struct lhsm_pipeline_struct {
+    struct engine_struct* engine;
+    hsm_ctx_t* ctx; /* cloned by every session */
+    int window;
+    janitor_thread_t* sessions;
+    int need_to_exit;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    /* circular queue of requests waiting for a session */
+    lhsm_signrequest_type* queue;
+    int queuehead;
+    int queuecount;
+    int queuesize;
+    /* counters */
+    struct timespec created;
+    long nrequests;
+    long nsigned;
+    long nfailed;
+    int inflight;
+    int peakinflight;
+    int peakqueued;
+    double latencytotal;
+    double latencymax;
+    double busytotal;
+};
+
+/**
+ * Create a signing pipeline and start its sessions.  Every session signs
+ * on a clone of the HSM context of the pipeline.
+ * \param[in] engine engine to reload when an HSM context cannot be had
+ * \param[in] window number of sign operations kept in flight, which is
+ *            the number of HSM sessions used
+ * \return lhsm_pipeline_type* the pipeline
+ *
+ */
+lhsm_pipeline_type* lhsm_pipeline_create(struct engine_struct* engine,
+    int window);
+
+/**
+ * Initialize a round of requests.
+ * \param[in] round the round
+ *
+ */
+void lhsm_pipeline_round(lhsm_signround_type* round);
+
+/**
+ * Submit a request of jobs to the pipeline, without waiting for them to
+ * be signed.  The jobs must stay in place until the round completes.
+ * \param[in] pipeline the pipeline
+ * \param[in] round the round the request is part of
+ * \param[in] count number of jobs
+ * \param[in] jobs jobs to be signed
+ *
+ */
+void lhsm_pipeline_submit(lhsm_pipeline_type* pipeline,
+    lhsm_signround_type* round, int count, lhsm_signjob_type* jobs);
+
+/**
+ * Wait until all requests of a round have been handled.
+ * \param[in] pipeline the pipeline
+ * \param[in] round the round
+ * \return long the number of jobs of the round that failed
+ *
+ */
+long lhsm_pipeline_wait(lhsm_pipeline_type* pipeline,
+    lhsm_signround_type* round);
+
+/**
+ * Report the pipeline counters.
+ * \param[in] pipeline the pipeline
+ * \param[in] fd file descriptor to report to, or -1 to log them
+ *
+ */
+void lhsm_pipeline_report(lhsm_pipeline_type* pipeline, int fd);
+
+/**
+ * Stop the sessions and clean up the pipeline.
+ * \param[in] pipeline the pipeline
+ *
+ */
+void lhsm_pipeline_cleanup(lhsm_pipeline_type* pipeline);
+
 #endif /* SHARED_HSM_H */
@@ -132,7 +132,7 @@ parse_addns_remote(const char* filename,
     if (doc) {
         xmlFreeDoc(doc);
     }
-    return acl;
+    return acl_compile(acl);
 }
 
 
@@ -221,7 +221,7 @@ parse_addns_acl(const char* filename,
     if (doc) {
         xmlFreeDoc(doc);
     }
-    return acl;
+    return acl_compile(acl);
 }
 
 
@@ -48,10 +48,8 @@ static const char* parser_str = "parser";
  *
  */
 keylist_type*
-parse_sc_keys(void* sc, const char* cfgfile)
+parse_sc_keys(void* sc, xmlXPathContextPtr xpathCtx)
 {
-    xmlDocPtr doc = NULL;
-    xmlXPathContextPtr xpathCtx = NULL;
     xmlXPathObjectPtr xpathObj = NULL;
     xmlNode* curNode = NULL;
     xmlChar* xexpr = NULL;
@@ -64,30 +62,13 @@ parse_sc_keys(void* sc, const char* cfgfile)
     int configerr;
     int ksk, zsk, publish, i;
 
-    if (!cfgfile || !sc) {
-        return NULL;
-    }
-    /* Load XML document */
-    doc = xmlParseFile(cfgfile);
-    if (doc == NULL) {
-        ods_log_error("[%s] unable to parse <Keys>: "
-            "xmlParseFile() failed", parser_str);
-        return NULL;
-    }
-    /* Create xpath evaluation context */
-    xpathCtx = xmlXPathNewContext(doc);
-    if(xpathCtx == NULL) {
-        xmlFreeDoc(doc);
-        ods_log_error("[%s] unable to parse <Keys>: "
-            "xmlXPathNewContext() failed", parser_str);
+    if (!xpathCtx || !sc) {
         return NULL;
     }
     /* Evaluate xpath expression */
     xexpr = (xmlChar*) "//SignerConfiguration/Zone/Keys/Key";
     xpathObj = xmlXPathEvalExpression(xexpr, xpathCtx);
     if(xpathObj == NULL) {
-        xmlXPathFreeContext(xpathCtx);
-        xmlFreeDoc(doc);
         ods_log_error("[%s] unable to parse <Keys>: "
             "xmlXPathEvalExpression() failed", parser_str);
         return NULL;
@@ -158,10 +139,6 @@ parse_sc_keys(void* sc, const char* cfgfile)
         }
     }
     xmlXPathFreeObject(xpathObj);
-    xmlXPathFreeContext(xpathCtx);
-    if (doc) {
-        xmlFreeDoc(doc);
-    }
     return kl;
 }
 
@@ -171,10 +148,10 @@ parse_sc_keys(void* sc, const char* cfgfile)
  *
  */
 duration_type*
-parse_sc_sig_resign_interval(const char* cfgfile)
+parse_sc_sig_resign_interval(xmlXPathContextPtr xpathCtx)
 {
     duration_type* duration = NULL;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Signatures/Resign",
         1);
     if (!str) {
@@ -187,10 +164,10 @@ parse_sc_sig_resign_interval(const char* cfgfile)
 
 
 duration_type*
-parse_sc_sig_refresh_interval(const char* cfgfile)
+parse_sc_sig_refresh_interval(xmlXPathContextPtr xpathCtx)
 {
     duration_type* duration = NULL;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Signatures/Refresh",
         1);
     if (!str) {
@@ -203,10 +180,10 @@ parse_sc_sig_refresh_interval(const char* cfgfile)
 
 
 duration_type*
-parse_sc_sig_validity_default(const char* cfgfile)
+parse_sc_sig_validity_default(xmlXPathContextPtr xpathCtx)
 {
     duration_type* duration = NULL;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Signatures/Validity/Default",
         1);
     if (!str) {
@@ -219,10 +196,10 @@ parse_sc_sig_validity_default(const char* cfgfile)
 
 
 duration_type*
-parse_sc_sig_validity_denial(const char* cfgfile)
+parse_sc_sig_validity_denial(xmlXPathContextPtr xpathCtx)
 {
     duration_type* duration = NULL;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Signatures/Validity/Denial",
         1);
     if (!str) {
@@ -235,10 +212,10 @@ parse_sc_sig_validity_denial(const char* cfgfile)
 
 
 duration_type*
-parse_sc_sig_validity_keyset(const char* cfgfile)
+parse_sc_sig_validity_keyset(xmlXPathContextPtr xpathCtx)
 {
     duration_type* duration = NULL;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Signatures/Validity/Keyset",
         0);
     /* Even if the value is 0 or NULL we want to write it in duration format. 
@@ -253,10 +230,10 @@ parse_sc_sig_validity_keyset(const char* cfgfile)
 
 
 duration_type*
-parse_sc_sig_jitter(const char* cfgfile)
+parse_sc_sig_jitter(xmlXPathContextPtr xpathCtx)
 {
     duration_type* duration = NULL;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Signatures/Jitter",
         1);
     if (!str) {
@@ -269,10 +246,10 @@ parse_sc_sig_jitter(const char* cfgfile)
 
 
 duration_type*
-parse_sc_sig_inception_offset(const char* cfgfile)
+parse_sc_sig_inception_offset(xmlXPathContextPtr xpathCtx)
 {
     duration_type* duration = NULL;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Signatures/InceptionOffset",
         1);
     if (!str) {
@@ -285,10 +262,10 @@ parse_sc_sig_inception_offset(const char* cfgfile)
 
 
 duration_type*
-parse_sc_dnskey_ttl(const char* cfgfile)
+parse_sc_dnskey_ttl(xmlXPathContextPtr xpathCtx)
 {
     duration_type* duration = NULL;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Keys/TTL",
         1);
     if (!str) {
@@ -301,40 +278,21 @@ parse_sc_dnskey_ttl(const char* cfgfile)
 
 
 const char**
-parse_sc_dnskey_sigrrs(const char* cfgfile)
+parse_sc_dnskey_sigrrs(xmlXPathContextPtr xpathCtx)
 {
-    xmlDocPtr doc = NULL;
-    xmlXPathContextPtr xpathCtx = NULL;
     xmlXPathObjectPtr xpathObj = NULL;
     xmlNode* curNode = NULL;
     xmlChar* xexpr = NULL;
     const char **signatureresourcerecords;
     int i;
 
-    if (!cfgfile) {
-        return NULL;
-    }
-    /* Load XML document */
-    doc = xmlParseFile(cfgfile);
-    if (doc == NULL) {
-        ods_log_error("[%s] unable to parse <Keys>: "
-            "xmlParseFile() failed", parser_str);
-        return NULL;
-    }
-    /* Create xpath evaluation context */
-    xpathCtx = xmlXPathNewContext(doc);
-    if(xpathCtx == NULL) {
-        xmlFreeDoc(doc);
-        ods_log_error("[%s] unable to parse <Keys>: "
-            "xmlXPathNewContext() failed", parser_str);
+    if (!xpathCtx) {
         return NULL;
     }
     /* Evaluate xpath expression */
     xexpr = (xmlChar*) "//SignerConfiguration/Zone/Keys/SignatureResourceRecord";
     xpathObj = xmlXPathEvalExpression(xexpr, xpathCtx);
     if(xpathObj == NULL) {
-        xmlXPathFreeContext(xpathCtx);
-        xmlFreeDoc(doc);
         ods_log_error("[%s] unable to parse <Keys>: "
             "xmlXPathEvalExpression() failed", parser_str);
         return NULL;
@@ -351,20 +309,16 @@ parse_sc_dnskey_sigrrs(const char* cfgfile)
         signatureresourcerecords = NULL;
     }
     xmlXPathFreeObject(xpathObj);
-    xmlXPathFreeContext(xpathCtx);
-    if (doc) {
-        xmlFreeDoc(doc);
-    }
     return signatureresourcerecords;
 }
 
 
 
 duration_type*
-parse_sc_nsec3param_ttl(const char* cfgfile)
+parse_sc_nsec3param_ttl(xmlXPathContextPtr xpathCtx)
 {
     duration_type* duration = NULL;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Denial/NSEC3/TTL",
         0);
     if (!str) {
@@ -377,10 +331,10 @@ parse_sc_nsec3param_ttl(const char* cfgfile)
 
 
 duration_type*
-parse_sc_soa_ttl(const char* cfgfile)
+parse_sc_soa_ttl(xmlXPathContextPtr xpathCtx)
 {
     duration_type* duration = NULL;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/SOA/TTL",
         1);
     if (!str) {
@@ -393,10 +347,10 @@ parse_sc_soa_ttl(const char* cfgfile)
 
 
 duration_type*
-parse_sc_soa_min(const char* cfgfile)
+parse_sc_soa_min(xmlXPathContextPtr xpathCtx)
 {
     duration_type* duration = NULL;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/SOA/Minimum",
         1);
     if (!str) {
@@ -409,10 +363,10 @@ parse_sc_soa_min(const char* cfgfile)
 
 
 duration_type*
-parse_sc_max_zone_ttl(const char* cfgfile)
+parse_sc_max_zone_ttl(xmlXPathContextPtr xpathCtx)
 {
     duration_type* duration = NULL;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Signatures/MaxZoneTTL",
         0);
     if (!str) {
@@ -429,16 +383,16 @@ parse_sc_max_zone_ttl(const char* cfgfile)
  *
  */
 ldns_rr_type
-parse_sc_nsec_type(const char* cfgfile)
+parse_sc_nsec_type(xmlXPathContextPtr xpathCtx)
 {
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Denial/NSEC3",
         0);
     if (str) {
         free((void*)str);
         return LDNS_RR_TYPE_NSEC3;
     }
-    str = parse_conf_string(cfgfile,
+    str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Denial/NSEC",
         0);
     if (str) {
@@ -454,10 +408,10 @@ parse_sc_nsec_type(const char* cfgfile)
  *
  */
 uint32_t
-parse_sc_nsec3_algorithm(const char* cfgfile)
+parse_sc_nsec3_algorithm(xmlXPathContextPtr xpathCtx)
 {
     int ret = 0;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Denial/NSEC3/Hash/Algorithm",
         1);
     if (str) {
@@ -471,10 +425,10 @@ parse_sc_nsec3_algorithm(const char* cfgfile)
 
 
 uint32_t
-parse_sc_nsec3_iterations(const char* cfgfile)
+parse_sc_nsec3_iterations(xmlXPathContextPtr xpathCtx)
 {
     int ret = 0;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Denial/NSEC3/Hash/Iterations",
         1);
     if (str) {
@@ -488,10 +442,10 @@ parse_sc_nsec3_iterations(const char* cfgfile)
 
 
 int
-parse_sc_nsec3_optout(const char* cfgfile)
+parse_sc_nsec3_optout(xmlXPathContextPtr xpathCtx)
 {
     int ret = 0;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Denial/NSEC3/OptOut",
         0);
     if (str) {
@@ -502,10 +456,10 @@ parse_sc_nsec3_optout(const char* cfgfile)
 }
 
 int
-parse_sc_passthrough(const char* cfgfile)
+parse_sc_passthrough(xmlXPathContextPtr xpathCtx)
 {
     int ret = 0;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_evaluate(xpathCtx,
         "//SignerConfiguration/Zone/Passthrough",
         0);
     if (str) {
@@ -527,11 +481,11 @@ parse_sc_passthrough(const char* cfgfile)
  *
  */
 const char*
-parse_sc_soa_serial(const char* cfgfile)
+parse_sc_soa_serial(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
-    const char* str = parse_conf_string(
-        cfgfile,
+    const char* str = parse_conf_evaluate(
+        xpathCtx,
         "//SignerConfiguration/Zone/SOA/Serial",
         1);
 
@@ -544,11 +498,11 @@ parse_sc_soa_serial(const char* cfgfile)
 
 
 const char*
-parse_sc_nsec3_salt(const char* cfgfile)
+parse_sc_nsec3_salt(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
-    const char* str = parse_conf_string(
-        cfgfile,
+    const char* str = parse_conf_evaluate(
+        xpathCtx,
         "//SignerConfiguration/Zone/Denial/NSEC3/Hash/Salt",
         1);
 
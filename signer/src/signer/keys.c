@@ -109,6 +109,8 @@ keylist_push(keylist_type* kl, const char* locator, const char* resourcerecord,
     kl->keys[kl->count -1].zsk = zsk;
     kl->keys[kl->count -1].dnskey = NULL;
     kl->keys[kl->count -1].params = NULL;
+    kl->keys[kl->count -1].hsmkey = NULL;
+    kl->keys[kl->count -1].hsmkeygeneration = 0;
     return &kl->keys[kl->count -1];
 }
 
@@ -50,6 +50,8 @@ typedef struct keylist_struct keylist_type;
 struct key_struct {
     ldns_rr* dnskey;
     hsm_sign_params_t* params;
+    const libhsm_key_t* hsmkey; /* resolved by lhsm_get_key(), valid for hsmkeygeneration */
+    unsigned int hsmkeygeneration;
     const char* locator;
     const char* resourcerecord;
     uint8_t algorithm;
@@ -59,6 +59,9 @@ stats_clear(stats_type* stats)
     stats->sort_done = 0;
     stats->nsec_count = 0;
     stats->nsec_time = 0;
+    stats->change_count = 0;
+    stats->expire_count = 0;
+    stats->full_pass = 0;
     stats->sig_count = 0;
     stats->sig_soa_count = 0;
     stats->sig_reuse = 0;
@@ -87,12 +90,15 @@ stats_log(stats_type* stats, const char* name, uint32_t serial,
     }
     ods_log_info("[STATS] %s %u RR[count=%u time=%lu(sec)] "
         "NSEC%s[count=%u time=%lu(sec)] "
+        "PASS[%s changed=%u expiring=%u] "
         "RRSIG[new=%u reused=%u time=%lu(sec) avg=%u(sig/sec)] "
         "TOTAL[time=%u(sec)] ",
         name?name:"(null)", (unsigned) serial,
         stats->sort_count, (unsigned long)stats->sort_time,
         nsec_type==LDNS_RR_TYPE_NSEC3?"3":"", stats->nsec_count,
-        (unsigned long)stats->nsec_time, stats->sig_count, stats->sig_reuse,
+        (unsigned long)stats->nsec_time,
+        stats->full_pass?"full":"incremental", stats->change_count,
+        stats->expire_count, stats->sig_count, stats->sig_reuse,
         (unsigned long)stats->sig_time, avsign,
         (uint32_t) (stats->end_time - stats->start_time));
 }
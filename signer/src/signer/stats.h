@@ -53,6 +53,9 @@ struct stats_struct {
     int         sort_done;
     uint32_t    nsec_count;
     time_t      nsec_time;
+    uint32_t    change_count;
+    uint32_t    expire_count;
+    int         full_pass;
     uint32_t    sig_count;
     uint32_t    sig_soa_count;
     uint32_t    sig_reuse;
@@ -42,6 +42,15 @@
 
 static const char* tools_str = "tools";
 
+/* minimum number of records for each thread annotating records */
+#define TOOLS_ANNOTATE_MINSLICE 4096
+
+struct tools_annotate_slice {
+    names_view_type view;
+    recordset_type* records;
+    int count;
+};
+
 
 /**
  * Load zone signconf.
@@ -72,6 +81,7 @@ tools_signconf(zone_type* zone)
         ods_log_debug("[%s] zone %s switch to new signconf", tools_str,
             zone->name);
         zone->signconf = new_signconf;
+        zone->denialrefresh = 1;
         signconf_log(zone->signconf, zone->name);
         zone->default_ttl = (uint32_t) duration2time(zone->signconf->soa_min);
     } else if (status != ODS_STATUS_UNCHANGED) {
@@ -82,12 +92,61 @@ tools_signconf(zone_type* zone)
 }
 
 
+static void
+tools_annotate_slice(void* arg)
+{
+    struct tools_annotate_slice* slice = arg;
+    names_viewannotate(slice->view, slice->records, slice->count);
+}
+
+
+/**
+ * Annotate the records read into the view before it is committed.  For
+ * NSEC3 zones this computes the hashed owner names, which on large zones
+ * is split among a number of threads.
+ *
+ */
+static void
+tools_annotate(names_view_type view, int nthreads)
+{
+    recordset_type* records;
+    struct tools_annotate_slice* slices;
+    janitor_thread_t* threads;
+    int i, count, slicesize;
+
+    count = names_viewpending(view, &records);
+    if (nthreads > count / TOOLS_ANNOTATE_MINSLICE)
+        nthreads = count / TOOLS_ANNOTATE_MINSLICE;
+    if (nthreads <= 1) {
+        names_viewannotate(view, records, count);
+        return;
+    }
+    CHECKALLOC(slices = malloc(sizeof(struct tools_annotate_slice) * nthreads));
+    CHECKALLOC(threads = malloc(sizeof(janitor_thread_t) * nthreads));
+    slicesize = (count + nthreads - 1) / nthreads;
+    for (i=0; i<nthreads; i++) {
+        slices[i].view = view;
+        slices[i].records = &records[i*slicesize];
+        slices[i].count = (i == nthreads-1 ? count - i*slicesize : slicesize);
+    }
+    for (i=1; i<nthreads; i++) {
+        janitor_thread_create(&threads[i], workerthreadclass, tools_annotate_slice, &slices[i]);
+    }
+    tools_annotate_slice(&slices[0]);
+    for (i=1; i<nthreads; i++) {
+        janitor_thread_join(threads[i]);
+    }
+    free(threads);
+    free(slices);
+}
+
+
 /**
  * Read zone from input adapter.
  *
  */
 ods_status
-tools_input(zone_type* zone)
+tools_input(zone_type* zone, int nthreads)
 {
     ods_status status = ODS_STATUS_OK;
     time_t start = 0;
@@ -126,7 +185,7 @@ tools_input(zone_type* zone)
     }
     /* Input Adapter */
     start = time(NULL);
-    status = adapter_read(zone, view);
+    status = adapter_read(zone, view, nthreads);
     if (status != ODS_STATUS_OK && status != ODS_STATUS_UNCHANGED) {
         if (status == ODS_STATUS_XFRINCOMPLETE) {
             ods_log_info("[%s] read zone %s: xfr in progress",
@@ -148,6 +207,7 @@ tools_input(zone_type* zone)
     }
     switch(status) {
         case ODS_STATUS_OK:
+            tools_annotate(view, nthreads);
             names_viewcommit(view);
             metastorageput(zone);
             break;
@@ -199,6 +259,21 @@ tools_output(zone_type* zone, engine_type* engine)
             tools_str, zone->name, ods_status2str(status));
         return status;
     }
+    return status;
+}
+
+
+/**
+ * Notify that the zone has been written.
+ *
+ */
+ods_status
+tools_notify(zone_type* zone, engine_type* engine)
+{
+    ods_status status = ODS_STATUS_OK;
+    ods_log_assert(engine);
+    ods_log_assert(zone);
+    ods_log_assert(zone->name);
     /* kick the nameserver */
     if (zone->notify_ns) {
 	int pid_status;
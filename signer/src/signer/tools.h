@@ -43,10 +43,11 @@ ods_status tools_signconf(zone_type* zone);
 /**
  * Read zone from input adapter.
  * \param[in] zone zone
+ * \param[in] nthreads number of threads to use for annotating the read records
  * \return ods_status status
  *
  */
-ods_status tools_input(zone_type* zone);
+ods_status tools_input(zone_type* zone, int nthreads);
 
 /**
  * Write zone to output adapter.
@@ -57,4 +58,15 @@ ods_status tools_input(zone_type* zone);
  */
 ods_status tools_output(zone_type* zone, engine_type* engine);
 
+/**
+ * Notify the nameserver and secondaries that the zone has been written,
+ * and log the zone statistics.  Called once the output of the zone is in
+ * place on disk.
+ * \param[in] zone zone
+ * \param[in] engine signer engine
+ * \return ods_status status
+ *
+ */
+ods_status tools_notify(zone_type* zone, engine_type* engine);
+
 #endif /* SIGNER_TOOLS_H */
@@ -99,6 +99,9 @@ zone_create(char* name, ldns_rr_class klass)
     zone->xfrd = NULL;
     zone->notify = NULL;
     zone->zoneconfigvalid = 0;
+    zone->denialrefresh = 1;
+    zone->outputstate = 0;
+    zone->outputflags = 0;
     zone->signconf = signconf_create();
     zone->operatingconf = NULL;
     if (!zone->signconf) {
@@ -109,6 +109,10 @@ struct zone_struct {
     pthread_mutex_t xfr_lock;
     /* backing store for rrsigs (both domain as denial) */
     int zoneconfigvalid; /* flag indicating whether the signconf has at least once been read */
+    int denialrefresh; /* flag indicating the next sign pass is to revisit the entire denial chain */
+    /* output stage, guarded by the lock of the output stage */
+    int outputstate; /* state of the zone in the output stage */
+    int outputflags; /* optional outputs to write, see do_outputzone() */
 };
 
 
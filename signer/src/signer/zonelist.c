@@ -44,6 +44,11 @@
 
 static const char* zl_str = "zonelist";
 
+struct zonelist_index_struct {
+    size_t count;
+    zone_type* zones[1];
+};
+
 
 /**
  * Compare two zones.
@@ -84,6 +89,8 @@ zonelist_create()
     }
     zlist->last_modified = 0;
     pthread_mutex_init(&zlist->zl_lock, NULL);
+    zlist->index = NULL;
+    pthread_rwlock_init(&zlist->index_lock, NULL);
     return zlist;
 }
 
@@ -328,6 +335,38 @@ zonelist_lookup_zone_by_name(zonelist_type* zonelist, const char* name,
 }
 
 
+/**
+ * Replace the lookup index with one of the current zones.  Zones that
+ * are about to be removed are left out.
+ *
+ */
+static void
+zonelist_reindex(zonelist_type* zl)
+{
+    struct zonelist_index_struct* index = NULL;
+    struct zonelist_index_struct* old = NULL;
+    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
+    zone_type* zone = NULL;
+
+    CHECKALLOC(index = (struct zonelist_index_struct*) malloc(
+        sizeof(struct zonelist_index_struct) +
+        zl->zones->count * sizeof(zone_type*)));
+    index->count = 0;
+    for (node = ldns_rbtree_first(zl->zones); node != LDNS_RBTREE_NULL;
+        node = ldns_rbtree_next(node)) {
+        zone = (zone_type*) node->data;
+        if (zone->zl_status != ZONE_ZL_REMOVED) {
+            index->zones[index->count++] = zone;
+        }
+    }
+    pthread_rwlock_wrlock(&zl->index_lock);
+    old = zl->index;
+    zl->index = index;
+    pthread_rwlock_unlock(&zl->index_lock);
+    free(old);
+}
+
+
 /**
  * Lookup zone by dname.
  *
@@ -336,12 +375,32 @@ zone_type*
 zonelist_lookup_zone_by_dname(zonelist_type* zonelist, ldns_rdf* dname,
     ldns_rr_class klass)
 {
-    char* name = NULL;
+    struct zonelist_index_struct* index = NULL;
     zone_type* result = NULL;
-    if (zonelist && zonelist->zones && dname && klass) {
-        name = ldns_rdf2str(dname);
-        result = zonelist_lookup_zone_by_name(zonelist, name, klass);
-        free((void*)name);
+    size_t lo, hi, mid;
+    int cmp;
+    if (zonelist && dname && klass) {
+        pthread_rwlock_rdlock(&zonelist->index_lock);
+        index = zonelist->index;
+        lo = 0;
+        hi = (index ? index->count : 0);
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (klass != index->zones[mid]->klass) {
+                cmp = (klass < index->zones[mid]->klass ? -1 : 1);
+            } else {
+                cmp = ldns_dname_compare(dname, index->zones[mid]->apex);
+            }
+            if (cmp == 0) {
+                result = index->zones[mid];
+                break;
+            } else if (cmp < 0) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        pthread_rwlock_unlock(&zonelist->index_lock);
     }
     return result;
 }
@@ -402,6 +461,10 @@ zonelist_del_zone(zonelist_type* zlist, zone_type* zone)
         goto zone_not_present;
     }
     free((void*) old_node);
+    /* removed zones were already left out of the index */
+    if (zone->zl_status != ZONE_ZL_REMOVED) {
+        zonelist_reindex(zlist);
+    }
     return;
 
 zone_not_present:
@@ -529,6 +592,7 @@ zonelist_update(zonelist_type* zl, const char* zlfile)
         zl->just_updated = 0;
         new_zlist->last_modified = st_mtime;
         zonelist_merge(zl, new_zlist);
+        zonelist_reindex(zl);
         (void)time_datestamp(zl->last_modified, "%Y-%m-%d %T", &datestamp);
         ods_log_error("[%s] file %s is modified since %s", zl_str, zlfile,
             datestamp?datestamp:"Unknown");
@@ -592,6 +656,8 @@ zonelist_cleanup(zonelist_type* zl)
         ldns_rbtree_free(zl->zones);
         zl->zones = NULL;
     }
+    free(zl->index);
+    pthread_rwlock_destroy(&zl->index_lock);
     pthread_mutex_destroy(&zl->zl_lock);
     free(zl);
 }
@@ -612,6 +678,8 @@ zonelist_free(zonelist_type* zl)
         ldns_rbtree_free(zl->zones);
         zl->zones = NULL;
     }
+    free(zl->index);
+    pthread_rwlock_destroy(&zl->index_lock);
     pthread_mutex_destroy(&zl->zl_lock);
     free(zl);
 }
@@ -50,6 +50,10 @@ struct zonelist_struct {
     int just_updated;
     int just_removed;
     pthread_mutex_t zl_lock;
+    /* sorted copy of the zones for lookups by the dns handler, which
+     * is replaced as a whole under index_lock instead of zl_lock */
+    struct zonelist_index_struct* index;
+    pthread_rwlock_t index_lock;
 };
 
 /**
@@ -72,7 +76,9 @@ zone_type* zonelist_lookup_zone_by_name(zonelist_type* zonelist,
     const char* name, ldns_rr_class klass);
 
 /**
- * Lookup zone by dname and class.
+ * Lookup zone by dname and class.  Does not need the zone list lock,
+ * it searches the index kept up to date by zonelist_update and
+ * zonelist_del_zone.
  * \param[in] zl zone list
  * \param[in] dname zone domain name
  * \param[in] klass zone class
@@ -30,6 +30,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <dlfcn.h>
@@ -39,6 +40,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <signal.h>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -51,9 +57,16 @@
 #include "daemon/signercommands.h"
 #include "utilities.h"
 #include "daemon/signertasks.h"
+#include "daemon/outputstage.h"
+#include "daemon/dnshandler.h"
 #include "daemon/metastorage.h"
 #include "views/httpd.h"
 #include "adapter/adutil.h"
+#include "adapter/adfile.h"
+#include "wire/netio.h"
+#include "wire/acl.h"
+#include "wire/notifyq.h"
+#include "wire/tsig.h"
 #include "settings.h"
 #include "cfg.h"
 
@@ -94,6 +107,21 @@ initialize(int argc, char* argv[])
     janitor_threadclass_setblockedsignals(debugthreadclass);
 }
 
+/* timing of the performance tests, finer than logger_mark_performance() */
+static void
+perfstart(struct timespec* start)
+{
+    clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+static double
+perfstop(const struct timespec* start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
 static void
 enginerunner(void* engine)
 {
@@ -435,7 +463,7 @@ testIterator(void)
     prev = NULL;
     ttl = 60;
     name = "example.com";
-    record = names_recordcreate((char**)&name);
+    record = names_recordcreate((char**)&name, NULL);
     origin = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, "example.com.");
     ldns_rr_new_frm_str(&rr, "example.com. 86400 IN SOA ns1.example.com. postmaster.example.com. 2009060301 10800 3600 604800 86400", ttl, origin, &prev);
     names_recordadddata(record, rr);
@@ -503,6 +531,41 @@ testAnnotateItem(const char* name, const char* expected)
 }
 
 
+static void
+testAnnotateNSEC3Item(const char* name, int iterations, const char* salt)
+{
+    signconf_type signconf;
+    signconf_type* signconfptr = &signconf;
+    struct names_view_zone zonedata = { NULL, "example.com.", &signconfptr };
+    recordset_type record;
+    ldns_rdf* dname;
+    ldns_rdf* apex;
+    ldns_rdf* hashed_label;
+    ldns_rdf* hashed_ownername;
+    char* expected;
+    memset(&signconf, 0, sizeof(signconf_type));
+    signconf.nsec3params = nsec3params_create(&signconf, LDNS_SHA1, 0, iterations, salt);
+    dname = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, name);
+    apex = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, "example.com.");
+    hashed_label = ldns_nsec3_hash_name(dname, signconf.nsec3params->algorithm, signconf.nsec3params->iterations, signconf.nsec3params->salt_len, signconf.nsec3params->salt_data);
+    hashed_ownername = ldns_dname_cat_clone(hashed_label, apex);
+    expected = ldns_rdf2str(hashed_ownername);
+    record = names_recordcreatetemp(name);
+    names_recordannotate(record, &zonedata);
+    CU_ASSERT_STRING_EQUAL(expected, names_recordgetdenial(record));
+    names_recordannotate(record, NULL);
+    names_recordannotatebatch(&record, 1, &zonedata);
+    CU_ASSERT_STRING_EQUAL(expected, names_recordgetdenial(record));
+    names_recorddispose(record);
+    free(expected);
+    ldns_rdf_deep_free(hashed_ownername);
+    ldns_rdf_deep_free(hashed_label);
+    ldns_rdf_deep_free(apex);
+    ldns_rdf_deep_free(dname);
+    nsec3params_cleanup(signconf.nsec3params);
+}
+
+
 void
 testAnnotate(void)
 {
@@ -510,6 +573,10 @@ testAnnotate(void)
     testAnnotateItem("www.example.com", "com~example~www");
     testAnnotateItem("example.com", "com~example");
     testAnnotateItem("com", "com");
+    testAnnotateNSEC3Item("example.com.", 12, "aabbccdd");
+    testAnnotateNSEC3Item("www.Example.COM.", 12, "aabbccdd");
+    testAnnotateNSEC3Item("a\\.b.example.com.", 0, "-");
+    testAnnotateNSEC3Item("\\065.example.com.", 1, "01");
 }
 
 
@@ -525,6 +592,7 @@ testMarshalling(void)
     ldns_rr* rrsig;
     ldns_rdf* rrprev = NULL;
     recordset_type record;
+    recordset_type copy;
     signconf_type* signconf = NULL;
     struct names_view_zone zone = { NULL, "example.com.", &signconf };
 
@@ -561,11 +629,746 @@ testMarshalling(void)
     // names_dumprecord(stderr,record); In case this test fails enable this to investigate
     marshallclose(h);
     close(fd);
-    
+
+    fd = open("test.dmp", O_WRONLY|O_TRUNC|O_CREAT,0666);
+    h = marshallcreate(marshall_BINARYOUTPUT, fd);
+    names_recordmarshall(&record,h);
+    names_recordmarshall(NULL,h);
+    marshallclose(h);
+
+    copy = record;
+    record = NULL;
+    fd = open("test.dmp", O_RDONLY, 0666);
+    h = marshallcreate(marshall_BINARYINPUT, fd);
+    names_recordmarshall(&record,h);
+    CU_ASSERT_PTR_NOT_NULL(record);
+    CU_ASSERT_STRING_EQUAL(names_recordgetname(record), names_recordgetname(copy));
+    CU_ASSERT(names_recordhasdata(record, LDNS_RR_TYPE_A, rr1, 1));
+    CU_ASSERT(names_recordhasdata(record, LDNS_RR_TYPE_A, rr2, 1));
+    CU_ASSERT(names_recordhasdata(record, LDNS_RR_TYPE_NS, rr3, 1));
+    CU_ASSERT_EQUAL(names_recordgetexpiry(record), 111);
+    CU_ASSERT_EQUAL(names_recordgetvalidupto(record), 333);
+    names_recordmarshall(&copy,h);
+    CU_ASSERT_PTR_NULL(copy);
+    marshallclose(h);
+
+    unlink("test.dmp");
+}
+
+
+static void
+testMarshallingPerformanceFile(enum marshall_method output, enum marshall_method input, recordset_type* records, int nrecords)
+{
+    int i, fd;
+    marshall_handle h;
+    recordset_type record;
+
+    fd = open("test.dmp", O_WRONLY|O_TRUNC|O_CREAT,0666);
+    h = marshallcreate(output, fd);
+    for(i=0; i<nrecords; i++)
+        names_recordmarshall(&records[i],h);
+    names_recordmarshall(NULL,h);
+    marshallclose(h);
+    logger_mark_performance("done writing");
+
+    fd = open("test.dmp", O_RDONLY, 0666);
+    h = marshallcreate(input, fd);
+    i = 0;
+    do {
+        names_recordmarshall(&record,h);
+        if(record) {
+            names_recorddispose(record);
+            ++i;
+        }
+    } while(record);
+    marshallclose(h);
+    CU_ASSERT_EQUAL(i, nrecords);
+    logger_mark_performance("done reading");
     unlink("test.dmp");
 }
 
 
+void
+testMarshallingPerformance(void)
+{
+    int i;
+    char name[64];
+    char data[128];
+    ldns_rr* rr;
+    ldns_rdf* origin;
+    ldns_rdf* rrprev = NULL;
+    const int nrecords = 200000;
+    recordset_type* records;
+    signconf_type* signconf = NULL;
+    struct names_view_zone zone = { NULL, "example.com.", &signconf };
+
+    logger_configurecls("performance", logger_INFO, logger_log_stdout);
+    origin = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, "example.com.");
+    records = malloc(sizeof(recordset_type) * nrecords);
+    for(i=0; i<nrecords; i++) {
+        snprintf(name, sizeof(name), "domain%d.example.com.", i);
+        records[i] = names_recordcreatetemp(name);
+        names_recordannotate(records[i], &zone);
+        snprintf(data, sizeof(data), "%s A 192.0.%d.%d", name, (i>>8)&0xff, i&0xff);
+        ldns_rr_new_frm_str(&rr, data, 60, origin, &rrprev);
+        names_recordadddata(records[i], rr);
+        snprintf(data, sizeof(data), "%s TXT \"record number %d\"", name, i);
+        ldns_rr_new_frm_str(&rr, data, 60, origin, &rrprev);
+        names_recordadddata(records[i], rr);
+        names_recordsetexpiry(records[i], i);
+    }
+    logger_mark_performance("done setup records");
+
+    testMarshallingPerformanceFile(marshall_OUTPUT, marshall_INPUT, records, nrecords);
+    logger_mark_performance("done textual format");
+    testMarshallingPerformanceFile(marshall_BINARYOUTPUT, marshall_BINARYINPUT, records, nrecords);
+    logger_mark_performance("done binary format");
+
+    for(i=0; i<nrecords; i++)
+        names_recorddispose(records[i]);
+    free(records);
+    ldns_rdf_deep_free(origin);
+}
+
+
+struct signqdrudger {
+    fifoq_type* q;
+    int need_to_exit;
+    long ndone;
+};
+
+static void
+signqdrudger(void* arg)
+{
+    struct signqdrudger* drudger = arg;
+    void* items[FIFOQ_POP_COUNT];
+    void* owners[FIFOQ_POP_COUNT];
+    volatile unsigned long work;
+    size_t i, count;
+    int j;
+    while (!drudger->need_to_exit) {
+        pthread_mutex_lock(&drudger->q->q_lock);
+        count = fifoq_popbatch(drudger->q, items, owners, FIFOQ_POP_COUNT);
+        if (count == 0 && !drudger->need_to_exit) {
+            pthread_cond_wait(&drudger->q->q_threshold, &drudger->q->q_lock);
+            count = fifoq_popbatch(drudger->q, items, owners, FIFOQ_POP_COUNT);
+        }
+        pthread_mutex_unlock(&drudger->q->q_lock);
+        for (i=0; i<count; i++) {
+            /* mimic the cost of signing a small RRset with a fast key */
+            for (work=0, j=0; j<2000; j++)
+                work += j * (unsigned long) items[i];
+        }
+        if (count > 0) {
+            fifoq_reportbatch(drudger->q, owners[0], count, 0);
+            drudger->ndone += count;
+        }
+    }
+}
+
+void
+testSignQueue(void)
+{
+    static const int nthreadsteps[] = { 1, 2, 4, 8, 16, 32, 0 };
+    const long nitems = 1000000;
+    struct signqdrudger* drudgers;
+    janitor_thread_t* threads;
+    worker_type worker;
+    void* batch[FIFOQ_BATCH_COUNT];
+    long i, nsubtasks, nfailed;
+    size_t count, pushed;
+    int tries, step, t;
+    struct timespec start;
+    double elapsed;
+    fifoq_type* q;
+
+    logger_configurecls("performance", logger_INFO, logger_log_stdout);
+    memset(&worker, 0, sizeof(worker));
+    worker.name = "producer";
+    pthread_cond_init(&worker.tasksBlocker, NULL);
+    for (step=0; nthreadsteps[step]; step++) {
+        q = fifoq_create();
+        drudgers = calloc(nthreadsteps[step], sizeof(struct signqdrudger));
+        threads = calloc(nthreadsteps[step], sizeof(janitor_thread_t));
+        for (t=0; t<nthreadsteps[step]; t++) {
+            drudgers[t].q = q;
+            janitor_thread_create(&threads[t], debugthreadclass, signqdrudger, &drudgers[t]);
+        }
+        perfstart(&start);
+        nsubtasks = 0;
+        for (i=1, count=0; i<=nitems; i++) {
+            batch[count++] = (void*) i;
+            if (count == FIFOQ_BATCH_COUNT || i == nitems) {
+                tries = 0;
+                pthread_mutex_lock(&q->q_lock);
+                while (fifoq_pushbatch(q, batch, count, &worker, &pushed, &tries) == ODS_STATUS_UNCHANGED) {
+                    memmove(batch, &batch[pushed], (count - pushed) * sizeof(void*));
+                    count -= pushed;
+                    nsubtasks += pushed;
+                    tries++;
+                    ods_thread_wait(&q->q_nonfull, &q->q_lock, 1);
+                }
+                pthread_mutex_unlock(&q->q_lock);
+                nsubtasks += pushed;
+                count = 0;
+            }
+        }
+        fifoq_waitfor(q, &worker, nsubtasks, &nfailed);
+        elapsed = perfstop(&start);
+        CU_ASSERT_EQUAL(nsubtasks, nitems);
+        CU_ASSERT_EQUAL(nfailed, 0);
+        for (t=0; t<nthreadsteps[step]; t++)
+            drudgers[t].need_to_exit = 1;
+        fifoq_notifyall(q);
+        for (t=0; t<nthreadsteps[step]; t++)
+            janitor_thread_join(threads[t]);
+        printf("sign queue with %2d drudgers: %ld items in %.3fs, %.0f items/s\n",
+               nthreadsteps[step], nitems, elapsed, nitems / elapsed);
+        free(threads);
+        free(drudgers);
+        fifoq_cleanup(q);
+    }
+    pthread_cond_destroy(&worker.tasksBlocker);
+}
+
+
+struct nsec3hashslice {
+    recordset_type* records;
+    int count;
+    struct names_view_zone* zone;
+};
+
+static void
+nsec3hashslice(void* arg)
+{
+    struct nsec3hashslice* slice = arg;
+    names_recordannotatebatch(slice->records, slice->count, slice->zone);
+}
+
+void
+testNSEC3Hashing(void)
+{
+    static const int nthreadsteps[] = { 1, 2, 4, 8, 0 };
+    const int nrecords = 1000000;
+    signconf_type signconf;
+    signconf_type* signconfptr = &signconf;
+    struct names_view_zone zone = { NULL, "example.com.", &signconfptr };
+    recordset_type* records;
+    struct nsec3hashslice* slices;
+    janitor_thread_t* threads;
+    ldns_rdf* dname;
+    ldns_rdf* apex;
+    ldns_rdf* hashed_label;
+    ldns_rdf* hashed_ownername;
+    char name[64];
+    char* hash;
+    int i, step, t, slicesize;
+    struct timespec start;
+    double elapsed;
+
+    memset(&signconf, 0, sizeof(signconf_type));
+    signconf.nsec3params = nsec3params_create(&signconf, LDNS_SHA1, 0, 10, "aabbccddeeff0011");
+    records = malloc(sizeof(recordset_type) * nrecords);
+    for (i=0; i<nrecords; i++) {
+        snprintf(name, sizeof(name), "domain%d.example.com.", i);
+        records[i] = names_recordcreatetemp(name);
+    }
+
+    /* the original approach, using ldns for every name */
+    apex = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, zone.apex);
+    perfstart(&start);
+    for (i=0; i<nrecords; i++) {
+        dname = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, names_recordgetname(records[i]));
+        hashed_label = ldns_nsec3_hash_name(dname, signconf.nsec3params->algorithm, signconf.nsec3params->iterations, signconf.nsec3params->salt_len, signconf.nsec3params->salt_data);
+        hashed_ownername = ldns_dname_cat_clone(hashed_label, apex);
+        hash = ldns_rdf2str(hashed_ownername);
+        free(hash);
+        ldns_rdf_deep_free(hashed_ownername);
+        ldns_rdf_deep_free(hashed_label);
+        ldns_rdf_deep_free(dname);
+    }
+    elapsed = perfstop(&start);
+    printf("nsec3 hashing using ldns:            %d names in %.3fs, %.0f names/s\n", nrecords, elapsed, nrecords / elapsed);
+    ldns_rdf_deep_free(apex);
+
+    for (step=0; nthreadsteps[step]; step++) {
+        for (i=0; i<nrecords; i++)
+            names_recordannotate(records[i], NULL);
+        slices = calloc(nthreadsteps[step], sizeof(struct nsec3hashslice));
+        threads = calloc(nthreadsteps[step], sizeof(janitor_thread_t));
+        slicesize = (nrecords + nthreadsteps[step] - 1) / nthreadsteps[step];
+        for (t=0; t<nthreadsteps[step]; t++) {
+            slices[t].records = &records[t*slicesize];
+            slices[t].count = (t == nthreadsteps[step]-1 ? nrecords - t*slicesize : slicesize);
+            slices[t].zone = &zone;
+        }
+        perfstart(&start);
+        for (t=0; t<nthreadsteps[step]; t++)
+            janitor_thread_create(&threads[t], debugthreadclass, nsec3hashslice, &slices[t]);
+        for (t=0; t<nthreadsteps[step]; t++)
+            janitor_thread_join(threads[t]);
+        elapsed = perfstop(&start);
+        for (i=0; i<nrecords; i++)
+            CU_ASSERT_PTR_NOT_NULL(names_recordgetdenial(records[i]));
+        printf("nsec3 hashing batched with %d threads: %d names in %.3fs, %.0f names/s\n",
+               nthreadsteps[step], nrecords, elapsed, nrecords / elapsed);
+        free(threads);
+        free(slices);
+    }
+
+    for (i=0; i<nrecords; i++)
+        names_recorddispose(records[i]);
+    free(records);
+    nsec3params_cleanup(signconf.nsec3params);
+}
+
+static void
+testArenaPerformanceRun(names_arena_type arena, recordset_type* records, int nrecords, ldns_rdf* origin)
+{
+    int i, count;
+    char name[64];
+    char data[128];
+    char* namestr;
+    ldns_rr* rr;
+    ldns_rr* value;
+    ldns_rdf* rrprev = NULL;
+    names_iterator iter;
+    size_t size, reserved, inuse;
+    struct timespec start;
+    double elapsed;
+    signconf_type* signconf = NULL;
+    struct names_view_zone zone = { NULL, "example.com.", &signconf };
+
+    perfstart(&start);
+    for(i=0; i<nrecords; i++) {
+        snprintf(name, sizeof(name), "domain%d.example.com.", i);
+        namestr = name;
+        records[i] = names_recordcreate(&namestr, arena);
+        names_recordannotate(records[i], &zone);
+        snprintf(data, sizeof(data), "%s A 192.0.%d.%d", name, (i>>8)&0xff, i&0xff);
+        ldns_rr_new_frm_str(&rr, data, 60, origin, &rrprev);
+        names_recordadddata(records[i], rr);
+        ldns_rr_free(rr);
+        snprintf(data, sizeof(data), "%s TXT \"record number %d\"", name, i);
+        ldns_rr_new_frm_str(&rr, data, 60, origin, &rrprev);
+        names_recordadddata(records[i], rr);
+        ldns_rr_free(rr);
+        names_recordsetvalidfrom(records[i], i);
+        names_recordsetexpiry(records[i], i);
+    }
+    elapsed = perfstop(&start);
+    printf("%s: created %d records in %.3fs\n", (arena ? "arena" : "malloc"), nrecords, elapsed);
+    if(rrprev)
+        ldns_rdf_deep_free(rrprev);
+
+    perfstart(&start);
+    for(count=0, i=0; i<nrecords; i++) {
+        for(iter=names_recordallvalues(records[i], LDNS_RR_TYPE_A); names_iterate(&iter, &value); names_advance(&iter, NULL))
+            ++count;
+        if(names_recordhasexpiry(records[i]) && names_recordgetdenial(records[i]))
+            ++count;
+    }
+    elapsed = perfstop(&start);
+    CU_ASSERT_EQUAL(count, 2 * nrecords);
+
+    for(size=0, i=0; i<nrecords; i++)
+        size += names_recordextend(records[i]);
+    if(arena) {
+        names_arenastatistics(arena, &reserved, &inuse);
+        printf("arena: iterated in %.3fs, %lu bytes in records, %lu bytes reserved, %lu in use\n", elapsed, (unsigned long)size, (unsigned long)reserved, (unsigned long)inuse);
+    } else {
+        printf("malloc: iterated in %.3fs, %lu bytes in records\n", elapsed, (unsigned long)size);
+    }
+
+    perfstart(&start);
+    for(i=0; i<nrecords; i++)
+        names_recorddispose(records[i]);
+    names_arenadestroy(arena);
+    elapsed = perfstop(&start);
+    printf("%s: disposed in %.3fs\n", (arena ? "arena" : "malloc"), elapsed);
+}
+
+void
+testArenaPerformance(void)
+{
+    const int nrecords = 1000000;
+    recordset_type* records;
+    ldns_rdf* origin;
+
+    origin = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, "example.com.");
+    records = malloc(sizeof(recordset_type) * nrecords);
+    testArenaPerformanceRun(NULL, records, nrecords, origin);
+    testArenaPerformanceRun(names_arenacreate(), records, nrecords, origin);
+    free(records);
+    ldns_rdf_deep_free(origin);
+}
+
+static void
+testViewSharingReport(const char* when, names_view_type* views, int nviews)
+{
+    int i;
+    long nodes, entries;
+    size_t nodesize;
+    names_indexstatistics(&nodes, &nodesize);
+    for(entries=0, i=0; i<nviews; i++)
+        entries += names_viewindexentries(views[i]);
+    printf("%s: %d views, %ld index entries, %ld index nodes in use, %lu bytes instead of %lu\n", when, nviews,
+           entries, nodes, (unsigned long)(nodes * nodesize), (unsigned long)(entries * nodesize));
+}
+
+void
+testViewSharing(void)
+{
+    const int nrecords = 500000;
+    const int nchanges = 1000;
+    const int nrounds = 10;
+    struct { const char** keynames; int count; } kinds[] = {
+        { names_view_INPUT, 5 }, { names_view_PREPARE, 1 }, { names_view_NEIGHB, 1 }, { names_view_SIGN, 1 },
+        { names_view_OUTPUT, 4 }, { names_view_CHANGES, 1 }, { NULL, 0 }
+    };
+    names_view_type views[16];
+    names_view_type base;
+    int i, k, round, nviews;
+    char name[64];
+    char data[128];
+    ldns_rr* rr;
+    ldns_rdf* origin;
+    ldns_rdf* rrprev = NULL;
+    recordset_type record;
+    struct timespec start;
+    double elapsed;
+
+    origin = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, "example.com.");
+    base = names_viewcreate(NULL, names_view_BASE[0], &names_view_BASE[1]);
+    views[0] = names_viewcreate(base, names_view_INPUT[0], &names_view_INPUT[1]);
+    for(i=0; i<nrecords; i++) {
+        snprintf(name, sizeof(name), "domain%d.example.com.", i);
+        snprintf(data, sizeof(data), "%s A 192.0.%d.%d", name, (i>>8)&0xff, i&0xff);
+        ldns_rr_new_frm_str(&rr, data, 60, origin, &rrprev);
+        record = names_place(views[0], name);
+        names_own(views[0], &record);
+        names_recordadddata(record, rr);
+        ldns_rr_free(rr);
+    }
+    names_viewcommit(views[0]);
+    names_viewreset(base);
+    names_viewdestroy(views[0]);
+    nviews = 0;
+    views[nviews++] = base;
+    testViewSharingReport("zone loaded", views, nviews);
+
+    perfstart(&start);
+    for(k=0; kinds[k].keynames; k++)
+        for(i=0; i<kinds[k].count; i++)
+            views[nviews++] = names_viewcreate(base, kinds[k].keynames[0], &kinds[k].keynames[1]);
+    elapsed = perfstop(&start);
+    printf("created views in %.3fs\n", elapsed);
+    testViewSharingReport("views created", views, nviews);
+
+    for(round=0; round<nrounds; round++) {
+        perfstart(&start);
+        for(i=0; i<nchanges; i++) {
+            snprintf(name, sizeof(name), "domain%d.example.com.", (round * nchanges + i) * 7 % nrecords);
+            snprintf(data, sizeof(data), "%s TXT \"round %d\"", name, round);
+            ldns_rr_new_frm_str(&rr, data, 60, origin, &rrprev);
+            record = names_place(views[1], name);
+            names_own(views[1], &record);
+            names_recordadddata(record, rr);
+            ldns_rr_free(rr);
+        }
+        names_viewcommit(views[1]);
+        for(i=0; i<nviews; i++)
+            if(i != 1)
+                names_viewreset(views[i]);
+        elapsed = perfstop(&start);
+        printf("committed %d changes to all views in %.3fs\n", nchanges, elapsed);
+    }
+    testViewSharingReport("changes committed", views, nviews);
+
+    for(i=nviews-1; i>=0; i--)
+        names_viewdestroy(views[i]);
+    if(rrprev)
+        ldns_rdf_deep_free(rrprev);
+    ldns_rdf_deep_free(origin);
+}
+
+
+static void
+netioloadhandler(netio_type* netio, netio_handler_type* handler, netio_events_type event_types)
+{
+    long* ndone = handler->user_data;
+    char c;
+    if (read(handler->fd, &c, 1) == 1)
+        (*ndone)++;
+}
+
+static void
+testNetioLoadRun(netio_type* netio, int (*pairs)[2], int nhandlers, int nwritten, int nrounds, long* ndone)
+{
+    struct timespec timeout = { 1, 0 };
+    struct timespec start;
+    double elapsed;
+    long nexpected;
+    int i, round;
+
+    perfstart(&start);
+    for(*ndone=0, nexpected=0, round=0; round<nrounds; round++) {
+        for(i=0; i<nwritten; i++)
+            if (write(pairs[(round * nwritten + i) % nhandlers][1], "x", 1) == 1)
+                nexpected++;
+        while (*ndone < nexpected)
+            if (netio_dispatch(netio, &timeout, NULL) <= 0)
+                break;
+    }
+    elapsed = perfstop(&start);
+    CU_ASSERT_EQUAL(*ndone, (long)nwritten * nrounds);
+    printf("netio with %d handlers, %d active per round: %ld events in %.3fs, %.0f events/s\n",
+           nhandlers, nwritten, *ndone, elapsed, *ndone / elapsed);
+}
+
+void
+testNetioLoad(void)
+{
+    int nhandlers = 10000;
+    struct rlimit limit;
+    netio_type* netio;
+    netio_handler_type* handlers;
+    int (*pairs)[2];
+    long ndone = 0;
+    int i;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur != RLIM_INFINITY && (rlim_t)nhandlers > (limit.rlim_cur - 64) / 2)
+            nhandlers = (limit.rlim_cur - 64) / 2;
+    }
+    netio = netio_create();
+    if (netio->epollfd == -1 && nhandlers > (FD_SETSIZE - 64) / 2)
+        nhandlers = (FD_SETSIZE - 64) / 2;
+    handlers = calloc(nhandlers, sizeof(netio_handler_type));
+    pairs = calloc(nhandlers, sizeof(int[2]));
+    for(i=0; i<nhandlers; i++) {
+        if (socketpair(AF_UNIX, SOCK_DGRAM, 0, pairs[i]) != 0) {
+            CU_FAIL("unable to create socket pair");
+            nhandlers = i;
+            break;
+        }
+        handlers[i].fd = pairs[i][0];
+        handlers[i].timeout = NULL;
+        handlers[i].user_data = &ndone;
+        handlers[i].event_types = NETIO_EVENT_READ;
+        handlers[i].event_handler = netioloadhandler;
+        handlers[i].free_handler = 0;
+        netio_add_handler(netio, &handlers[i]);
+    }
+
+    testNetioLoadRun(netio, pairs, nhandlers, nhandlers, 10, &ndone);
+    testNetioLoadRun(netio, pairs, nhandlers, 1, 10000, &ndone);
+
+    for(i=0; i<nhandlers; i++) {
+        netio_remove_handler(netio, &handlers[i]);
+        close(pairs[i][0]);
+        close(pairs[i][1]);
+    }
+    netio_cleanup(netio);
+    free(pairs);
+    free(handlers);
+}
+
+static void
+netiotimerhandler(netio_type* netio, netio_handler_type* handler, netio_events_type event_types)
+{
+    int* fired = handler->user_data;
+    CU_ASSERT(event_types & NETIO_EVENT_TIMEOUT);
+    fired[fired[0]++ + 1] = handler->timeout->tv_sec;
+    handler->timeout = NULL;
+}
+
+void
+testNetioTimers(void)
+{
+    int nhandlers = 100;
+    netio_type* netio;
+    netio_handler_type* handlers;
+    struct timespec* timeouts;
+    struct timespec timeout = { 0, 0 };
+    int* fired;
+    int i;
+
+    netio = netio_create();
+    handlers = calloc(nhandlers, sizeof(netio_handler_type));
+    timeouts = calloc(nhandlers, sizeof(struct timespec));
+    fired = calloc(nhandlers + 1, sizeof(int));
+    /* timeouts in the past fire one per dispatch, earliest first */
+    for(i=0; i<nhandlers; i++) {
+        timeouts[i].tv_sec = 1000 + ((i * 37) % nhandlers) * 10;
+        timeouts[i].tv_nsec = 0;
+        handlers[i].fd = -1;
+        handlers[i].timeout = &timeouts[i];
+        handlers[i].user_data = fired;
+        handlers[i].event_types = NETIO_EVENT_TIMEOUT;
+        handlers[i].event_handler = netiotimerhandler;
+        handlers[i].free_handler = 0;
+        netio_add_handler(netio, &handlers[i]);
+    }
+    /* a changed timeout is picked up, a removed handler never fires */
+    timeouts[nhandlers-1].tv_sec = 5;
+    netio_update_handler(netio, &handlers[nhandlers-1]);
+    netio_remove_handler(netio, &handlers[0]);
+    for(i=0; i<nhandlers; i++)
+        netio_dispatch(netio, &timeout, NULL);
+    CU_ASSERT_EQUAL(fired[0], nhandlers - 1);
+    CU_ASSERT_EQUAL(fired[1], 5);
+    for(i=2; i<fired[0]; i++)
+        CU_ASSERT(fired[i] < fired[i+1]);
+    CU_ASSERT_PTR_NULL(handlers[0].entry);
+    CU_ASSERT_PTR_NOT_NULL(handlers[0].timeout);
+    for(i=1; i<nhandlers; i++)
+        netio_remove_handler(netio, &handlers[i]);
+    netio_cleanup(netio);
+    free(fired);
+    free(timeouts);
+    free(handlers);
+}
+
+
+struct queryrateclient {
+    int port;
+    uint8_t* wire;
+    size_t size;
+    long nqueries;
+    long nanswers;
+};
+
+static void
+queryrateclient(void* arg)
+{
+    struct queryrateclient* client = arg;
+    struct sockaddr_in addr;
+    struct timeval timeout = { 1, 0 };
+    uint8_t buffer[4096];
+    long nsent = 0;
+    int outstanding = 0;
+    int s;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(client->port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    s = socket(AF_INET, SOCK_DGRAM, 0);
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(s, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+        close(s);
+        return;
+    }
+    /* keep a window of queries in flight */
+    while (nsent < client->nqueries || outstanding > 0) {
+        while (outstanding < 16 && nsent < client->nqueries) {
+            if (send(s, client->wire, client->size, 0) == (ssize_t) client->size)
+                outstanding++;
+            nsent++;
+        }
+        if (recv(s, buffer, sizeof(buffer), 0) > 0) {
+            client->nanswers++;
+            outstanding--;
+        } else {
+            /* consider the queries in flight lost */
+            outstanding = 0;
+        }
+    }
+    close(s);
+}
+
+static void
+queryratehangup(int sig)
+{
+    (void) sig;
+}
+
+void
+testQueryRate(void)
+{
+    static const int nlistenersteps[] = { 1, 2, 4, 0 };
+    const int nclients = 8;
+    const long nqueries = 50000;
+    struct queryrateclient* clients;
+    janitor_thread_t* threads;
+    struct sigaction action, oldaction;
+    struct timespec start;
+    double elapsed;
+    dnshandler_type* dnshandler;
+    listener_type* listener;
+    zone_type* zone;
+    ldns_pkt* pkt;
+    uint8_t* wire;
+    size_t size;
+    long nanswers;
+    int step, i;
+
+    usefile("example.com.state", NULL);
+    usefile("zones.xml", "zones.xml.example");
+    usefile("unsigned.zone", "unsigned.zone.example");
+    usefile("signconf.xml", "signconf.xml.nsec3");
+    zonelist_update(engine->zonelist, engine->config->zonelist_filename_signer);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, "example.com", LDNS_RR_CLASS_IN);
+    zone->zl_status = ZONE_ZL_OK;
+
+    pkt = ldns_pkt_query_new(ldns_dname_new_frm_str("example.com."), LDNS_RR_TYPE_SOA, LDNS_RR_CLASS_IN, 0);
+    ldns_pkt2wire(&wire, pkt, &size);
+    ldns_pkt_free(pkt);
+
+    /* the listener threads are woken up for exit with SIGHUP */
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = queryratehangup;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGHUP, &action, &oldaction);
+
+    for (step=0; nlistenersteps[step]; step++) {
+        listener = listener_create();
+        listener_push(listener, "127.0.0.1", AF_INET, "15355");
+        dnshandler = dnshandler_create(listener, nlistenersteps[step]);
+        CU_ASSERT_EQUAL_FATAL(dnshandler_listen(dnshandler), ODS_STATUS_OK);
+        dnshandler->engine = engine;
+        dnshandler->started = 1;
+        for (i=0; i<dnshandler->nlisteners; i++)
+            janitor_thread_create(&dnshandler->listeners[i].thread_id, handlerthreadclass, (janitor_runfn_t)dnshandler_start, &dnshandler->listeners[i]);
+
+        clients = calloc(nclients, sizeof(struct queryrateclient));
+        threads = calloc(nclients, sizeof(janitor_thread_t));
+        perfstart(&start);
+        for (i=0; i<nclients; i++) {
+            clients[i].port = 15355;
+            clients[i].wire = wire;
+            clients[i].size = size;
+            clients[i].nqueries = nqueries;
+            janitor_thread_create(&threads[i], debugthreadclass, queryrateclient, &clients[i]);
+        }
+        for (nanswers=0, i=0; i<nclients; i++) {
+            janitor_thread_join(threads[i]);
+            nanswers += clients[i].nanswers;
+        }
+        elapsed = perfstop(&start);
+        CU_ASSERT(nanswers > 0);
+        printf("dns handler with %d listeners: %ld of %ld queries answered in %.3fs, %.0f queries/s\n",
+               dnshandler->nlisteners, nanswers, nclients * nqueries, elapsed, nanswers / elapsed);
+
+        dnshandler->need_to_exit = 1;
+        dnshandler_signal(dnshandler);
+        for (i=0; i<dnshandler->nlisteners; i++)
+            janitor_thread_join(dnshandler->listeners[i].thread_id);
+        dnshandler_cleanup(dnshandler);
+        free(threads);
+        free(clients);
+    }
+
+    sigaction(SIGHUP, &oldaction, NULL);
+    free(wire);
+    disposezone(zone);
+}
+
+
 void
 testStatefile(void)
 {
@@ -635,7 +1438,10 @@ testTransferfile(void)
 {
     FILE* fp;
     int status;
-    char line[1024];
+    char line[65535];
+    size_t len, pos;
+    int count;
+    ldns_rr* rr;
     zone_type* zone;
     names_view_type view;
     usefile("example.com.xfr", NULL);
@@ -659,15 +1465,27 @@ testTransferfile(void)
 
     time_t serial = 2;
     fp = getxfr(zone, ".xfr", &serial);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
     CU_ASSERT_NOT_EQUAL(unlink("example.com.xfr"), 0);
     CU_ASSERT_EQUAL(errno, ENOENT);
+    /* a concurrent transfer of the same zone gets its own file */
+    FILE* fp2 = getxfr(zone, ".xfr", &serial);
+    CU_ASSERT_PTR_NOT_NULL(fp2);
+    if (fp2)
+        fclose(fp2);
 
-    while(!feof(fp)) {
-        if(fgets(line,sizeof(line)-2,fp)) {
-            line[sizeof(line)-1] = '\0';
-            printf("%s",line);
-        }
+    count = 0;
+    while(fread(line,2,1,fp) == 1) {
+        len = ldns_read_uint16(line);
+        CU_ASSERT_EQUAL(fread(line,len,1,fp), 1);
+        pos = 0;
+        CU_ASSERT_EQUAL(ldns_wire2rr(&rr, (uint8_t*)line, len, &pos, LDNS_SECTION_ANSWER), LDNS_STATUS_OK);
+        if(count++ == 0)
+            CU_ASSERT_EQUAL(ldns_rr_get_type(rr), LDNS_RR_TYPE_SOA);
+        ldns_rr_print(stdout, rr);
+        ldns_rr_free(rr);
     }
+    CU_ASSERT(count > 0);
 
     fclose(fp);
     disposezone(zone);
@@ -681,6 +1499,669 @@ testTransferfile(void)
     usefile("signconf.xml", NULL);
 }
 
+/* The zone file writer as it was before output got buffered, kept to check
+ * the output of the current writer against.
+ */
+static void
+writezonelegacy(names_view_type view, const char* filename)
+{
+    FILE* fp;
+    int defaultttl = 0;
+    ldns_rdf* origin = NULL;
+    char* apex;
+    fp = fopen(filename,"w");
+    names_viewgetapex(view, &origin);
+    if (origin) {
+        apex = ldns_rdf2str(origin);
+        fprintf(fp, "$ORIGIN %s\n", apex);
+        ldns_rdf_deep_free(origin);
+        free(apex);
+    }
+    if (names_viewgetdefaultttl(view, &defaultttl)) {
+        fprintf(fp, "$TTL %d\n",defaultttl);
+    }
+    writezoneapex(view, fp);
+    writezonecontent(view, fp);
+    writezoneapex(view, fp);
+    fclose(fp);
+}
+
+static int
+comparefiles(const char* fname1, const char* fname2)
+{
+    FILE* fp1;
+    FILE* fp2;
+    int c1, c2;
+    fp1 = fopen(fname1, "r");
+    fp2 = fopen(fname2, "r");
+    do {
+        c1 = fgetc(fp1);
+        c2 = fgetc(fp2);
+    } while(c1 == c2 && c1 != EOF);
+    fclose(fp1);
+    fclose(fp2);
+    return c1 != c2;
+}
+
+static void
+testZoneOutputCompare(zone_type* zone)
+{
+    names_view_type view;
+    view = zonelist_obtainresource(NULL, zone, NULL, offsetof(zone_type,outputview));
+    names_viewreset(view);
+    writezonelegacy(view, "legacy.zone");
+    logger_mark_performance("done legacy output");
+    CU_ASSERT_EQUAL(writezone(view, "buffered.zone", 1), 0);
+    logger_mark_performance("done buffered output");
+    CU_ASSERT_EQUAL(writezone(view, "threaded.zone", 4), 0);
+    logger_mark_performance("done threaded output");
+    zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type,outputview), view);
+    CU_ASSERT_EQUAL(comparefiles("legacy.zone", "buffered.zone"), 0);
+    CU_ASSERT_EQUAL(comparefiles("legacy.zone", "threaded.zone"), 0);
+    unlink("legacy.zone");
+    unlink("buffered.zone");
+    unlink("threaded.zone");
+}
+
+void
+testZoneOutput(void)
+{
+    zone_type* zone;
+    usefile("example.com.state", NULL);
+    usefile("zones.xml", "zones.xml.example");
+    usefile("unsigned.zone", "unsigned.zone.example");
+    usefile("signconf.xml", "signconf.xml.nsec3");
+    zonelist_update(engine->zonelist, engine->config->zonelist_filename_signer);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, "example.com", LDNS_RR_CLASS_IN);
+    signzone(zone);
+    testZoneOutputCompare(zone);
+    disposezone(zone);
+}
+
+void
+testZoneOutputPerformance(void)
+{
+    zone_type* zone;
+    logger_configurecls("performance", logger_INFO, logger_log_stdout);
+    usefile("nl.state", NULL);
+    usefile("zones.xml", "zones.xml.nl");
+    usefile("unsigned.zone", "unsigned.zone.nl.gz");
+    usefile("signed.zone", NULL);
+    usefile("signconf.xml", "signconf.xml.nl");
+    usefile("opendnssec.conf", "opendnssec.conf.dynamic");
+    zonelist_update(engine->zonelist, engine->config->zonelist_filename_signer);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, "nl", LDNS_RR_CLASS_IN);
+    signzone(zone);
+    logger_mark_performance("done setup zone");
+    testZoneOutputCompare(zone);
+    disposezone(zone);
+}
+
+void
+testZoneInput(void)
+{
+    zone_type* zone;
+    names_view_type view;
+    ldns_rdf* dname;
+    ldns_rr* rr;
+    usefile("example.com.state", NULL);
+    usefile("zones.xml", "zones.xml.example");
+    usefile("unsigned.zone", "unsigned.zone.example");
+    usefile("signconf.xml", "signconf.xml.nsec");
+    zonelist_update(engine->zonelist, engine->config->zonelist_filename_signer);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, "example.com", LDNS_RR_CLASS_IN);
+    signzone(zone);
+    dname = ldns_dname_new_frm_str("mail.example.com.");
+    /* drop an RR from the zone file and read it again */
+    usefile("unsigned.zone", NULL);
+    CU_ASSERT_EQUAL(system("grep -v '^mail.example.com.*AAAA' unsigned.zone.example > unsigned.zone"), 0);
+    view = zonelist_obtainresource(NULL, zone, NULL, offsetof(zone_type, inputview));
+    names_viewreset(view);
+    CU_ASSERT_EQUAL(adfile_read(zone, view, 4), ODS_STATUS_OK);
+    CU_ASSERT_EQUAL(names_viewcommit(view), 0);
+    rr = NULL;
+    names_viewlookupone(view, dname, LDNS_RR_TYPE_AAAA, NULL, &rr);
+    CU_ASSERT_PTR_NULL(rr);
+    rr = NULL;
+    names_viewlookupone(view, dname, LDNS_RR_TYPE_A, NULL, &rr);
+    CU_ASSERT_PTR_NOT_NULL(rr);
+    zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type, inputview), view);
+    ldns_rdf_deep_free(dname);
+    disposezone(zone);
+}
+
+static int
+comparestrings(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/* all RRs in the view as text, sorted */
+static long
+dumprrs(names_view_type view, char*** rrsptr)
+{
+    long count = 0, capacity = 0;
+    char** rrs = NULL;
+    recordset_type record;
+    ldns_rr_type recordtype;
+    ldns_rr* rr;
+    names_iterator domainiter;
+    names_iterator rrsetiter;
+    names_iterator rriter;
+    for (domainiter = names_viewiterator(view, NULL); names_iterate(&domainiter, &record); names_advance(&domainiter, NULL)) {
+        for (rrsetiter = names_recordalltypes(record); names_iterate(&rrsetiter, &recordtype); names_advance(&rrsetiter, NULL)) {
+            for (rriter = names_recordallvalues(record, recordtype); names_iterate(&rriter, &rr); names_advance(&rriter, NULL)) {
+                if (ldns_rr_get_type(rr) != recordtype)
+                    continue;
+                if (count == capacity) {
+                    capacity = (capacity ? capacity * 2 : 1024);
+                    rrs = realloc(rrs, capacity * sizeof(char*));
+                }
+                rrs[count++] = ldns_rr2str(rr);
+            }
+        }
+    }
+    qsort(rrs, count, sizeof(char*), comparestrings);
+    *rrsptr = rrs;
+    return count;
+}
+
+static void
+freerrs(char** rrs, long count)
+{
+    long i;
+    for (i = 0; i < count; i++)
+        free(rrs[i]);
+    free(rrs);
+}
+
+void
+testZoneInputChunks(void)
+{
+    zone_type* zone;
+    names_view_type view;
+    ldns_rdf* dname;
+    ldns_rr* rr;
+    struct stat statbuf;
+    char** sequential;
+    char** chunked;
+    long nsequential, nchunked;
+    FILE* fp;
+    int i;
+    usefile("example.com.state", NULL);
+    usefile("zones.xml", "zones.xml.example");
+    usefile("unsigned.zone", "unsigned.zone.example");
+    usefile("signconf.xml", "signconf.xml.nsec");
+    zonelist_update(engine->zonelist, engine->config->zonelist_filename_signer);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, "example.com", LDNS_RR_CLASS_IN);
+    signzone(zone);
+    /* a zone file with directives, comments and records spanning lines
+     * throughout, and one RR of the signed zone dropped */
+    usefile("unsigned.zone", NULL);
+    CU_ASSERT_EQUAL(system("grep -v '^mail.example.com.*AAAA' unsigned.zone.example > unsigned.zone"), 0);
+    fp = fopen("unsigned.zone", "a");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+    for (i = 0; i < 400; i++) {
+        if (i % 50 == 0) {
+            fprintf(fp, "$ORIGIN sub%d.example.com.\n", i / 50);
+            fprintf(fp, "$TTL %d ; ttl of (this) part\n", 3600 + i);
+        }
+        fprintf(fp, "host%d\tIN\tA\t192.0.2.%d\n", i, i % 250);
+        fprintf(fp, "\t\tIN\tAAAA\t2001:db8::%x\n", i);
+        fprintf(fp, "text%d\t600\tIN\tTXT\t( \"part (one)\" ; a comment with \" and (\n", i);
+        fprintf(fp, "\t\t\t\"part ; two\"\n");
+        fprintf(fp, "\t\t\t)\n");
+    }
+    fclose(fp);
+    CU_ASSERT_EQUAL(stat("unsigned.zone", &statbuf), 0);
+    view = zonelist_obtainresource(NULL, zone, NULL, offsetof(zone_type, inputview));
+    names_viewreset(view);
+    adfile_chunksize = 0;
+    CU_ASSERT_EQUAL(adfile_read(zone, view, 1), ODS_STATUS_OK);
+    nsequential = dumprrs(view, &sequential);
+    names_viewreset(view);
+    /* a few hundred bytes per chunk, so there are many chunk boundaries */
+    adfile_chunksize = 256;
+    CU_ASSERT(statbuf.st_size > 100 * (long) adfile_chunksize);
+    CU_ASSERT_EQUAL(adfile_read(zone, view, 4), ODS_STATUS_OK);
+    nchunked = dumprrs(view, &chunked);
+    adfile_chunksize = 4 * 1024 * 1024;
+    CU_ASSERT_EQUAL(nchunked, nsequential);
+    if (nchunked == nsequential) {
+        for (i = 0; i < nsequential; i++) {
+            CU_ASSERT_STRING_EQUAL(chunked[i], sequential[i]);
+        }
+    }
+    /* the RR dropped from the file is removed, the others are kept */
+    dname = ldns_dname_new_frm_str("mail.example.com.");
+    rr = NULL;
+    names_viewlookupone(view, dname, LDNS_RR_TYPE_AAAA, NULL, &rr);
+    CU_ASSERT_PTR_NULL(rr);
+    rr = NULL;
+    names_viewlookupone(view, dname, LDNS_RR_TYPE_A, NULL, &rr);
+    CU_ASSERT_PTR_NOT_NULL(rr);
+    ldns_rdf_deep_free(dname);
+    dname = ldns_dname_new_frm_str("host399.sub7.example.com.");
+    rr = NULL;
+    names_viewlookupone(view, dname, LDNS_RR_TYPE_AAAA, NULL, &rr);
+    CU_ASSERT_PTR_NOT_NULL(rr);
+    ldns_rdf_deep_free(dname);
+    names_viewreset(view);
+    zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type, inputview), view);
+    freerrs(sequential, nsequential);
+    freerrs(chunked, nchunked);
+    disposezone(zone);
+}
+
+static long
+countrrs(names_view_type view)
+{
+    long count = 0;
+    recordset_type record;
+    ldns_rr_type recordtype;
+    ldns_rr* rr;
+    names_iterator domainiter;
+    names_iterator rrsetiter;
+    names_iterator rriter;
+    for (domainiter = names_viewiterator(view, NULL); names_iterate(&domainiter, &record); names_advance(&domainiter, NULL)) {
+        for (rrsetiter = names_recordalltypes(record); names_iterate(&rrsetiter, &recordtype); names_advance(&rrsetiter, NULL)) {
+            for (rriter = names_recordallvalues(record, recordtype); names_iterate(&rriter, &rr); names_advance(&rriter, NULL)) {
+                if (ldns_rr_get_type(rr) == recordtype)
+                    ++count;
+            }
+        }
+    }
+    return count;
+}
+
+void
+testZoneInputPerformance(void)
+{
+    static const int nthreadsteps[] = { 1, 2, 4, 8, 0 };
+    zone_type* zone;
+    names_view_type view;
+    struct stat statbuf;
+    struct timespec start;
+    double elapsed;
+    long nrrs;
+    int step;
+    logger_configurecls("performance", logger_INFO, logger_log_stdout);
+    usefile("nl.state", NULL);
+    usefile("zones.xml", "zones.xml.nl");
+    usefile("unsigned.zone", "unsigned.zone.nl.gz");
+    usefile("signed.zone", NULL);
+    usefile("signconf.xml", "signconf.xml.nl");
+    usefile("opendnssec.conf", "opendnssec.conf.dynamic");
+    zonelist_update(engine->zonelist, engine->config->zonelist_filename_signer);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, "nl", LDNS_RR_CLASS_IN);
+    signzone(zone);
+    logger_mark_performance("done setup zone");
+    CU_ASSERT_EQUAL(stat("unsigned.zone", &statbuf), 0);
+    view = zonelist_obtainresource(NULL, zone, NULL, offsetof(zone_type, inputview));
+    names_viewreset(view);
+    nrrs = countrrs(view);
+    for (step=0; nthreadsteps[step]; step++) {
+        perfstart(&start);
+        CU_ASSERT_EQUAL(adfile_read(zone, view, nthreadsteps[step]), ODS_STATUS_OK);
+        elapsed = perfstop(&start);
+        names_viewreset(view);
+        printf("zone input with %d threads: %ld bytes, %ld RRs in %.3fs, %.1f MB/s, %.0f RRs/s\n",
+               nthreadsteps[step], (long) statbuf.st_size, nrrs, elapsed,
+               statbuf.st_size / elapsed / 1000000.0, nrrs / elapsed);
+    }
+    zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type, inputview), view);
+    disposezone(zone);
+}
+
+void
+testSignconfPerformance(void)
+{
+    const int nsignconfs = 50000;
+    signconf_type* signconf;
+    struct timespec start;
+    double elapsed;
+    int i;
+    usefile("signconf.xml", "signconf.xml.nsec3");
+    perfstart(&start);
+    for (i=0; i<nsignconfs; i++) {
+        signconf = NULL;
+        CU_ASSERT_EQUAL(signconf_update(&signconf, "signconf.xml", 0), ODS_STATUS_OK);
+        CU_ASSERT_PTR_NOT_NULL(signconf);
+        signconf_cleanup(signconf);
+    }
+    elapsed = perfstop(&start);
+    printf("signconf reload: %d files in %.3fs, %.0f files/s\n",
+           nsignconfs, elapsed, nsignconfs / elapsed);
+}
+
+static acl_type*
+createacls(tsig_type* tsig, int count, ...)
+{
+    va_list ap;
+    acl_type* acl = NULL;
+    acl_type* newacl;
+    char* address;
+    char* key;
+    va_start(ap, count);
+    while(count-- > 0) {
+        address = va_arg(ap, char*);
+        key = va_arg(ap, char*);
+        address = (address ? strdup(address) : NULL);
+        newacl = acl_create(address, NULL, key, tsig);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(newacl);
+        newacl->next = acl;
+        acl = newacl;
+        free(address);
+    }
+    va_end(ap);
+    return acl;
+}
+
+static void
+setaddress(struct sockaddr_storage* addr, const char* ip)
+{
+    memset(addr, 0, sizeof(struct sockaddr_storage));
+    if(strchr(ip, ':')) {
+        addr->ss_family = AF_INET6;
+        CU_ASSERT_EQUAL(inet_pton(AF_INET6, ip, &((struct sockaddr_in6*)addr)->sin6_addr), 1);
+    } else {
+        addr->ss_family = AF_INET;
+        CU_ASSERT_EQUAL(inet_pton(AF_INET, ip, &((struct sockaddr_in*)addr)->sin_addr), 1);
+    }
+}
+
+void
+testAcl(void)
+{
+    static const char* addresses[] = { "192.0.2.1", "192.0.2.10", "192.0.2.200", "10.0.0.5", "10.0.0.30",
+        "10.1.7.0", "10.1.7.10", "2001:db8::1", "2001:db9::1", "198.51.100.1", NULL };
+    const char* secret = "c2VjcmV0c2VjcmV0c2VjcmV0c2VjcmV0";
+    tsig_type* tsig;
+    acl_type* linear;
+    acl_type* compiled;
+    acl_type* found1;
+    acl_type* found2;
+    tsig_rr_type* trr;
+    struct sockaddr_storage addr;
+    int i;
+    tsig_handler_init();
+    tsig = tsig_create("key.example.", "hmac-sha256", (char*)secret);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(tsig);
+#define ACLS 7, "192.0.2.10", "key.example.", "192.0.2.0/25", NULL, "10.0.0.1-10.0.0.20", NULL, \
+             "10.1.0.0&255.255.0.255", NULL, "2001:db8::/32", NULL, "192.0.2.0/24", NULL, "0.0.0.0/0", "key.example."
+    linear = createacls(tsig, ACLS);
+    compiled = acl_compile(createacls(tsig, ACLS));
+#undef ACLS
+    trr = tsig_rr_create();
+    for(i=0; addresses[i]; i++) {
+        setaddress(&addr, addresses[i]);
+        found1 = acl_find(linear, &addr, trr);
+        found2 = acl_find(compiled, &addr, trr);
+        CU_ASSERT_EQUAL(found1 == NULL, found2 == NULL);
+        if(found1 && found2)
+            CU_ASSERT_STRING_EQUAL(found1->address, found2->address);
+    }
+    setaddress(&addr, "10.1.7.0");
+    found2 = acl_find(compiled, &addr, trr);
+    CU_ASSERT_PTR_NOT_NULL(found2);
+    setaddress(&addr, "10.1.7.10");
+    found2 = acl_find(compiled, &addr, trr);
+    CU_ASSERT_PTR_NULL(found2);
+    tsig_rr_cleanup(trr);
+    acl_cleanup(linear);
+    acl_cleanup(compiled);
+    tsig_cleanup(tsig);
+    tsig_handler_cleanup();
+}
+
+void
+testAclTsigPerformance(void)
+{
+    const int nacls = 4000;
+    const int npackets = 200000;
+    const char* secret = "c2VjcmV0c2VjcmV0c2VjcmV0c2VjcmV0";
+    tsig_type* tsig;
+    tsig_algo_type* algo;
+    acl_type* acls[2];
+    acl_type* acl;
+    tsig_rr_type* trr;
+    buffer_type* packet;
+    buffer_type* work;
+    ldns_rdf* qname;
+    struct sockaddr_storage addr;
+    struct timespec start;
+    double elapsed;
+    char address[32];
+    size_t size;
+    int i, j, pass, verified, matched;
+    tsig_handler_init();
+    tsig = tsig_create("key.example.", "hmac-sha256", (char*)secret);
+    algo = tsig_lookup_algo("hmac-sha256");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(tsig);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(algo);
+    /* the matching entry is created first, so ends up last in the list */
+    for(pass=0; pass<2; pass++) {
+        acls[pass] = NULL;
+        for(i=0; i<nacls; i++) {
+            snprintf(address, sizeof(address), "10.%d.%d.0/24", (nacls-i) / 256, (nacls-i) % 256);
+            acl = acl_create(address, NULL, "key.example.", tsig);
+            acl->next = acls[pass];
+            acls[pass] = acl;
+        }
+    }
+    acl_compile(acls[1]);
+    setaddress(&addr, "10.15.160.7");
+    /* create a signed notify */
+    packet = buffer_create(PACKET_BUFFER_SIZE);
+    work = buffer_create(PACKET_BUFFER_SIZE);
+    qname = ldns_dname_new_frm_str("example.com.");
+    buffer_pkt_notify(packet, qname, LDNS_RR_CLASS_IN);
+    trr = tsig_rr_create();
+    tsig_rr_reset(trr, algo, tsig->key);
+    trr->original_query_id = buffer_pkt_id(packet);
+    trr->algo_name = ldns_rdf_clone(algo->wf_name);
+    trr->key_name = ldns_rdf_clone(tsig->key->dname);
+    tsig_rr_prepare(trr);
+    tsig_rr_update(trr, packet, buffer_position(packet));
+    tsig_rr_sign(trr);
+    tsig_rr_append(trr, packet);
+    buffer_pkt_set_arcount(packet, buffer_pkt_arcount(packet)+1);
+    buffer_flip(packet);
+    size = buffer_remaining(packet);
+    tsig_rr_cleanup(trr);
+    for(pass=0; pass<2; pass++) {
+        trr = tsig_rr_create();
+        verified = matched = 0;
+        perfstart(&start);
+        for(j=0; j<npackets; j++) {
+            buffer_clear(work);
+            buffer_write(work, buffer_begin(packet), size);
+            buffer_flip(work);
+            tsig_rr_reset(trr, NULL, NULL);
+            if(tsig_rr_find(trr, work) && trr->status == TSIG_OK && tsig_rr_lookup(trr)) {
+                buffer_set_limit(work, trr->position);
+                buffer_pkt_set_arcount(work, buffer_pkt_arcount(work)-1);
+                tsig_rr_prepare(trr);
+                tsig_rr_update(trr, work, buffer_limit(work));
+                if(tsig_rr_verify(trr))
+                    ++verified;
+            }
+            if(acl_find(acls[pass], &addr, trr))
+                ++matched;
+        }
+        elapsed = perfstop(&start);
+        CU_ASSERT_EQUAL(verified, npackets);
+        CU_ASSERT_EQUAL(matched, npackets);
+        printf("acl+tsig %s over %d acls: %d packets in %.3fs, %.0f packets/s\n",
+               (pass ? "trie" : "list"), nacls, npackets, elapsed, npackets / elapsed);
+        tsig_rr_cleanup(trr);
+    }
+    ldns_rdf_deep_free(qname);
+    buffer_cleanup(packet);
+    buffer_cleanup(work);
+    acl_cleanup(acls[0]);
+    acl_cleanup(acls[1]);
+    tsig_cleanup(tsig);
+    tsig_handler_cleanup();
+}
+
+static int
+notifyreceiver(char* port, size_t portsize)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    struct timeval timeout = { 1, 0 };
+    int rcvbuf = 4 * 1024 * 1024;
+    int s;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    s = socket(AF_INET, SOCK_DGRAM, 0);
+    CU_ASSERT_FATAL(s != -1);
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    CU_ASSERT_EQUAL_FATAL(bind(s, (struct sockaddr*) &addr, sizeof(addr)), 0);
+    CU_ASSERT_EQUAL_FATAL(getsockname(s, (struct sockaddr*) &addr, &addrlen), 0);
+    snprintf(port, portsize, "%d", ntohs(addr.sin_port));
+    return s;
+}
+
+void
+testNotifyQueue(void)
+{
+    notifyq_type* notifyq;
+    notifyq_sock_type* sock;
+    notifyq_dest_type* dest1;
+    notifyq_dest_type* dest2;
+    notifyq_dest_type* dest3;
+    acl_type* acls;
+    acl_type* loopback;
+    notify_type notify1;
+    notify_type notify2;
+    uint8_t wire[12] = { 0x12, 0x34, 0x20, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    uint8_t buffer[512];
+    char port[8];
+    int receiver;
+    int i;
+
+    notifyq = notifyq_create(NULL);
+    acls = createacls(NULL, 3, "192.0.2.1", NULL, "192.0.2.1", NULL, "2001:db8::53", NULL);
+    /* createacls reverses the list */
+    dest1 = notifyq_lookup(notifyq, acls->next->next);
+    dest2 = notifyq_lookup(notifyq, acls->next);
+    dest3 = notifyq_lookup(notifyq, acls);
+    CU_ASSERT_PTR_EQUAL(dest1, dest2);
+    CU_ASSERT_PTR_NOT_EQUAL(dest1, dest3);
+
+    /* the bucket allows a burst, then refills at the rate */
+    for (i = 0; i < NOTIFY_BURST; i++)
+        CU_ASSERT_EQUAL(notifyq_admit(dest1, 1000), 1);
+    CU_ASSERT_EQUAL(notifyq_admit(dest1, 1000), 0);
+    CU_ASSERT_EQUAL(notifyq_admit(dest3, 1000), 1);
+    for (i = 0; i < NOTIFY_RATE; i++)
+        CU_ASSERT_EQUAL(notifyq_admit(dest1, 1001), 1);
+    CU_ASSERT_EQUAL(notifyq_admit(dest1, 1001), 0);
+    CU_ASSERT_EQUAL(dest1->nthrottled, 2);
+    CU_ASSERT_EQUAL(dest3->nthrottled, 0);
+
+    /* a retry goes out under a fresh id, a cancelled one not at all */
+    receiver = notifyreceiver(port, sizeof(port));
+    loopback = acl_create("127.0.0.1", port, NULL, NULL);
+    memset(&notify1, 0, sizeof(notify1));
+    memset(&notify2, 0, sizeof(notify2));
+    notify1.dest = notify2.dest = notifyq_lookup(notifyq, loopback);
+    notify1.wire = notify2.wire = wire;
+    notify1.wire_len = notify2.wire_len = sizeof(wire);
+    notify1.query_id = notify2.query_id = 0x1234;
+    for (i = 1; i <= 2; i++) {
+        notify1.retry = i;
+        notifyq_send(notifyq, &notify1);
+        CU_ASSERT_PTR_NOT_NULL(notify1.sock);
+        notifyq_flush(notifyq);
+        CU_ASSERT_EQUAL(recv(receiver, buffer, sizeof(buffer), 0), (ssize_t) sizeof(wire));
+        CU_ASSERT_EQUAL(memcmp(buffer, wire, sizeof(wire)), 0);
+        CU_ASSERT_EQUAL(ldns_read_uint16(buffer), notify1.query_id);
+    }
+    CU_ASSERT_NOT_EQUAL(notify1.query_id, 0x1234);
+    memcpy(wire, "\x12\x34", 2);
+    notify2.retry = 1;
+    notifyq_send(notifyq, &notify2);
+    sock = notify2.sock;
+    CU_ASSERT_PTR_NOT_NULL_FATAL(sock);
+    CU_ASSERT_EQUAL(sock->npending, 1);
+    notifyq_cancel(notifyq, &notify2);
+    CU_ASSERT_EQUAL(sock->npending, 0);
+    CU_ASSERT_PTR_NULL(notify2.sock);
+    CU_ASSERT_EQUAL(notify1.is_inflight, 1);
+    notifyq_cancel(notifyq, &notify1);
+    CU_ASSERT_EQUAL(notify1.is_inflight, 0);
+    CU_ASSERT_PTR_NULL(notifyq->inflight[0x1234 % NOTIFYQ_BUCKETS]);
+    CU_ASSERT_PTR_NULL(notifyq->inflight[notify1.query_id % NOTIFYQ_BUCKETS]);
+    CU_ASSERT_EQUAL(notify1.dest->nsent, 3);
+    CU_ASSERT_EQUAL(notify1.dest->nretried, 1);
+
+    close(receiver);
+    acl_cleanup(loopback);
+    acl_cleanup(acls);
+    notifyq_cleanup(notifyq);
+}
+
+void
+testNotifyFanout(void)
+{
+    const int nnotifies = 100000;
+    notifyq_type* notifyq;
+    notify_type* notifies;
+    acl_type* loopback;
+    uint8_t wire[64];
+    uint8_t buffer[512];
+    struct timespec start;
+    double elapsed;
+    long nreceived;
+    char port[8];
+    int receiver;
+    int pass, i;
+
+    memset(wire, 0, sizeof(wire));
+    receiver = notifyreceiver(port, sizeof(port));
+    loopback = acl_create("127.0.0.1", port, NULL, NULL);
+    notifyq = notifyq_create(NULL);
+    notifies = calloc(nnotifies, sizeof(notify_type));
+    for (i = 0; i < nnotifies; i++) {
+        notifies[i].dest = notifyq_lookup(notifyq, loopback);
+        notifies[i].wire = wire;
+        notifies[i].wire_len = sizeof(wire);
+        notifies[i].query_id = i;
+        notifies[i].retry = 1;
+    }
+    for (pass = 0; pass < 2; pass++) {
+        nreceived = 0;
+        perfstart(&start);
+        for (i = 0; i < nnotifies; i++) {
+            notifyq_send(notifyq, &notifies[i]);
+            if (pass == 0)
+                notifyq_flush(notifyq);
+            if (i % NOTIFYQ_BATCH == NOTIFYQ_BATCH - 1)
+                while (recv(receiver, buffer, sizeof(buffer), MSG_DONTWAIT) > 0)
+                    nreceived++;
+        }
+        notifyq_flush(notifyq);
+        elapsed = perfstop(&start);
+        while (recv(receiver, buffer, sizeof(buffer), MSG_DONTWAIT) > 0)
+            nreceived++;
+        printf("notify %s: %d sent, %ld received in %.3fs, %.0f notifies/s\n",
+               (pass ? "batched" : "one by one"), nnotifies, nreceived, elapsed, nnotifies / elapsed);
+        for (i = 0; i < nnotifies; i++)
+            notifyq_cancel(notifyq, &notifies[i]);
+    }
+    CU_ASSERT_EQUAL(notifies[0].dest->nsent, 2L * nnotifies);
+    free(notifies);
+    close(receiver);
+    acl_cleanup(loopback);
+    notifyq_cleanup(notifyq);
+}
+
 void
 testBasic(void)
 {
@@ -729,6 +2210,54 @@ testSignNSEC3(void)
 }
 
 
+void
+testSignPipeline(void)
+{
+    zone_type* zone;
+    usefile("example.com.state", NULL);
+    usefile("zones.xml", "zones.xml.example");
+    usefile("unsigned.zone", "unsigned.zone.example");
+    usefile("signconf.xml", "signconf.xml.nsec3");
+    engine->signpipeline = lhsm_pipeline_create(engine, 4);
+    zonelist_update(engine->zonelist, engine->config->zonelist_filename_signer);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, "example.com", LDNS_RR_CLASS_IN);
+    signzone(zone);
+    disposezone(zone);
+    CU_ASSERT(engine->signpipeline->nsigned > 0);
+    CU_ASSERT_EQUAL(engine->signpipeline->nfailed, 0);
+    lhsm_pipeline_report(engine->signpipeline, -1);
+    lhsm_pipeline_cleanup(engine->signpipeline);
+    engine->signpipeline = NULL;
+    CU_ASSERT_EQUAL((comparezone("unsigned.zone","signed.zone",0)), 0);
+    CU_ASSERT_EQUAL((system("ldns-verify-zone signed.zone")), 0);
+}
+
+
+void
+testOutputStage(void)
+{
+    zone_type* zone;
+    usefile("example.com.state", NULL);
+    usefile("zones.xml", "zones.xml.example");
+    usefile("unsigned.zone", "unsigned.zone.example");
+    usefile("signconf.xml", "signconf.xml.nsec3");
+    usefile("signed.zone", NULL);
+    engine->outputstage = outputstage_create(engine, 2);
+    zonelist_update(engine->zonelist, engine->config->zonelist_filename_signer);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, "example.com", LDNS_RR_CLASS_IN);
+    signzone(zone);
+    outputzone(zone);
+    outputzone(zone);
+    CU_ASSERT_EQUAL(engine->outputstage->nsubmitted, 3);
+    outputstage_cleanup(engine->outputstage);
+    engine->outputstage = NULL;
+    CU_ASSERT_EQUAL(zone->outputstate, OUTPUTSTAGE_IDLE);
+    disposezone(zone);
+    CU_ASSERT_EQUAL((comparezone("unsigned.zone","signed.zone",0)), 0);
+    CU_ASSERT_EQUAL((system("ldns-verify-zone signed.zone")), 0);
+}
+
+
 void
 testSignResign(void)
 {
@@ -898,6 +2427,92 @@ testSignFastChange(void)
     CU_ASSERT_EQUAL((system("ldns-verify-zone -t 20180926013741 signed.zone")), 0);
 }
 
+void
+testSignIncremental(void)
+{
+    int status;
+    zone_type* zone;
+    names_view_type inputview;
+    usefile("example.com.state", NULL);
+    usefile("signer.db", NULL);
+    usefile("zones.xml", "zones.xml.example");
+    usefile("unsigned.zone", "unsigned.zone.testing");
+    usefile("signconf.xml", "signconf.xml.nsec");
+    set_time_now(1537918509);
+    zonelist_update(engine->zonelist, engine->config->zonelist_filename_signer);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, "example.com", LDNS_RR_CLASS_IN);
+    signzone(zone);
+    CU_ASSERT_EQUAL(zone->denialrefresh, 0);
+
+    inputview = zonelist_obtainresource(NULL, zone, NULL, offsetof(zone_type, inputview));
+    names_viewreset(inputview);
+    status = httpd_dispatch(inputview, makecall(zone->name, "sub.example.com.", "sub.example.com. NS ns1.example.com.", NULL));
+    CU_ASSERT_EQUAL(status, 0);
+    status = names_viewcommit(inputview);
+    CU_ASSERT_EQUAL(status,0);
+    zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type, inputview), inputview);
+
+    /* only the changed name and its neighbours are revisited */
+    reresignzone(zone);
+    CU_ASSERT_EQUAL(zone->stats->full_pass, 0);
+    CU_ASSERT(zone->stats->change_count > 0);
+    CU_ASSERT(zone->stats->nsec_count > 0);
+
+    /* a pass over the entire denial chain should find nothing left to do */
+    zone->denialrefresh = 1;
+    reresignzone(zone);
+    CU_ASSERT_EQUAL(zone->stats->nsec_count, 0);
+
+    outputzone(zone);
+    disposezone(zone);
+    CU_ASSERT_EQUAL((system("ldns-verify-zone -t 20180926013741 signed.zone")), 0);
+}
+
+void
+testSignUndelegate(void)
+{
+    int status;
+    zone_type* zone;
+    names_view_type inputview;
+    recordset_type record;
+    usefile("example.com.state", NULL);
+    usefile("signer.db", NULL);
+    usefile("zones.xml", "zones.xml.example");
+    usefile("unsigned.zone", "unsigned.zone.testing");
+    usefile("signconf.xml", "signconf.xml.nsec");
+    set_time_now(1537918509);
+    zonelist_update(engine->zonelist, engine->config->zonelist_filename_signer);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, "example.com", LDNS_RR_CLASS_IN);
+    signzone(zone);
+
+    /* a name below a delegation is left out of the denial chain */
+    inputview = zonelist_obtainresource(NULL, zone, NULL, offsetof(zone_type, inputview));
+    names_viewreset(inputview);
+    status = httpd_dispatch(inputview, makecall(zone->name, "sub.example.com.", "sub.example.com. NS ns1.example.com.", "www.sub.example.com. A 192.0.2.3", NULL));
+    CU_ASSERT_EQUAL(status, 0);
+    status = names_viewcommit(inputview);
+    CU_ASSERT_EQUAL(status,0);
+    zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type, inputview), inputview);
+    reresignzone(zone);
+    outputzone(zone);
+    CU_ASSERT_NOT_EQUAL(system("grep -q '^www\\.sub\\.example\\.com\\..*NSEC' signed.zone"), 0);
+
+    /* and comes back once the delegation is removed */
+    inputview = zonelist_obtainresource(NULL, zone, NULL, offsetof(zone_type, inputview));
+    names_viewreset(inputview);
+    record = names_take(inputview, 0, "sub.example.com.");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(record);
+    names_recorddelall(record, LDNS_RR_TYPE_NS);
+    status = names_viewcommit(inputview);
+    CU_ASSERT_EQUAL(status,0);
+    zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type, inputview), inputview);
+    reresignzone(zone);
+    outputzone(zone);
+    disposezone(zone);
+    CU_ASSERT_EQUAL(system("grep -q '^www\\.sub\\.example\\.com\\..*NSEC' signed.zone"), 0);
+    CU_ASSERT_EQUAL((system("ldns-verify-zone -t 20180926013741 signed.zone")), 0);
+}
+
 void
 testDisposing(void)
 {
@@ -1005,6 +2620,16 @@ extern void testTransferfile(void);
 extern void testBasic(void);
 extern void testSignNSEC(void);
 extern void testSignNSEC3(void);
+extern void testSignPipeline(void);
+extern void testOutputStage(void);
+extern void testZoneInput(void);
+extern void testZoneInputChunks(void);
+extern void testZoneInputPerformance(void);
+extern void testSignconfPerformance(void);
+extern void testAcl(void);
+extern void testAclTsigPerformance(void);
+extern void testNotifyQueue(void);
+extern void testNotifyFanout(void);
 extern void testSignNL(void);
 extern void testSignFastRemove(void);
 extern void testSignFastInsert(void);
@@ -1026,16 +2651,38 @@ struct test_struct {
     { "signer", "testMarshalling",     "test marshalling" },
     { "signer", "testStatefile",       "test statefile usage" },
     { "signer", "testTransferfile",    "test transferfile usage" },
+    { "signer", "testZoneOutput",      "test zone file output" },
+    { "signer", "testZoneInput",       "test zone file input" },
+    { "signer", "testZoneInputChunks", "test zone file input in chunks" },
+    { "signer", "testAcl",             "test access control lists" },
+    { "signer", "testNetioTimers",     "test network event timeouts" },
+    { "signer", "testNotifyQueue",     "test notify dispatcher" },
     { "signer", "testBasic",           "test of start stop" },
     { "signer", "testSignNSEC",        "test NSEC signing" },
     { "signer", "testSignNSEC3",       "test NSEC3 signing" },
+    { "signer", "testSignPipeline",    "test signing through signing sessions" },
+    { "signer", "testOutputStage",     "test writing through output threads" },
     { "signer", "testSignResign",      "test resigning restart" },
     { "signer", "testSignFastRemove",  "test fast updates deletes" },
     { "signer", "testSignFastInsert",  "test fast updates inserts" },
     { "signer", "testSignFastChange",  "test fast updates changes" },
+    { "signer", "testSignIncremental", "test incremental denial chain" },
+    { "signer", "testSignUndelegate",  "test names below a removed delegation" },
     { "signer", "testDisposing",       "test dispose" },
     { "signer", "testBackup",          "test migration backup files" },
     { "signer", "-testSignNL",          "test NL signing" },
+    { "signer", "-testMarshallingPerformance", "test marshalling performance" },
+    { "signer", "-testSignQueue",       "test sign queue throughput" },
+    { "signer", "-testNSEC3Hashing",    "test nsec3 hashing throughput" },
+    { "signer", "-testZoneOutputPerformance", "test zone file output throughput" },
+    { "signer", "-testZoneInputPerformance", "test zone file input throughput" },
+    { "signer", "-testSignconfPerformance", "test signconf reload throughput" },
+    { "signer", "-testAclTsigPerformance", "test acl and tsig verification throughput" },
+    { "signer", "-testNotifyFanout",    "test notify sending throughput" },
+    { "signer", "-testArenaPerformance", "test record arena allocation" },
+    { "signer", "-testViewSharing",     "test memory use of view indices" },
+    { "signer", "-testNetioLoad",       "test network event dispatch with many handlers" },
+    { "signer", "-testQueryRate",       "test dns handler query throughput" },
     { NULL, NULL, NULL }
 };
 
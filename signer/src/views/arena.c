@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2018 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <ldns/ldns.h>
+#include "utilities.h"
+#include "proto.h"
+
+/* An arena hands out small blocks of memory in a number of fixed sizes,
+ * carved out of larger chunks.  Freed blocks are kept on a free list per
+ * size to be handed out again; the chunks themselves are only released
+ * all at once when the arena is destroyed.  This keeps the many small
+ * allocations made for the records of a zone close together and avoids the
+ * per allocation overhead of malloc.  Blocks larger than the largest size
+ * are allocated individually.  The caller needs to pass the size of a block
+ * when freeing it.
+ */
+
+#define ARENA_GRANULE    16
+#define ARENA_NSIZES     (NAMES_ARENA_MAXBLOCK / ARENA_GRANULE)
+#define ARENA_MINCHUNK   4096
+#define ARENA_MAXCHUNK   (256*1024)
+
+struct arenachunk {
+    struct arenachunk* next;
+    size_t size;
+};
+
+struct arenasize {
+    pthread_mutex_t lock;
+    void* freelist;
+    char* current;
+    char* end;
+    size_t chunksize;
+    struct arenachunk* chunks;
+    size_t reserved;
+    size_t inuse;
+};
+
+struct names_arena_struct {
+    struct arenasize sizes[ARENA_NSIZES];
+};
+
+names_arena_type
+names_arenacreate(void)
+{
+    int i;
+    names_arena_type arena;
+    CHECKALLOC(arena = malloc(sizeof(struct names_arena_struct)));
+    for(i=0; i<ARENA_NSIZES; i++) {
+        CHECK(pthread_mutex_init(&arena->sizes[i].lock, NULL));
+        arena->sizes[i].freelist = NULL;
+        arena->sizes[i].current = NULL;
+        arena->sizes[i].end = NULL;
+        arena->sizes[i].chunksize = ARENA_MINCHUNK;
+        arena->sizes[i].chunks = NULL;
+        arena->sizes[i].reserved = 0;
+        arena->sizes[i].inuse = 0;
+    }
+    return arena;
+}
+
+void
+names_arenadestroy(names_arena_type arena)
+{
+    int i;
+    struct arenachunk* chunk;
+    if(arena == NULL)
+        return;
+    for(i=0; i<ARENA_NSIZES; i++) {
+        while((chunk = arena->sizes[i].chunks) != NULL) {
+            arena->sizes[i].chunks = chunk->next;
+            free(chunk);
+        }
+        pthread_mutex_destroy(&arena->sizes[i].lock);
+    }
+    free(arena);
+}
+
+void*
+names_arenaalloc(names_arena_type arena, size_t size)
+{
+    void* ptr;
+    size_t blocksize;
+    struct arenachunk* chunk;
+    struct arenasize* sizes;
+    if(arena == NULL || size > NAMES_ARENA_MAXBLOCK) {
+        CHECKALLOC(ptr = malloc(size));
+        return ptr;
+    }
+    if(size == 0)
+        size = 1;
+    sizes = &arena->sizes[(size - 1) / ARENA_GRANULE];
+    blocksize = ((size - 1) / ARENA_GRANULE + 1) * ARENA_GRANULE;
+    CHECK(pthread_mutex_lock(&sizes->lock));
+    if(sizes->freelist) {
+        ptr = sizes->freelist;
+        sizes->freelist = *(void**)ptr;
+    } else {
+        if(sizes->current + blocksize > sizes->end) {
+            CHECKALLOC(chunk = malloc(sizeof(struct arenachunk) + sizes->chunksize));
+            chunk->size = sizes->chunksize;
+            chunk->next = sizes->chunks;
+            sizes->chunks = chunk;
+            sizes->current = (char*)&chunk[1];
+            sizes->end = sizes->current + chunk->size;
+            sizes->reserved += chunk->size;
+            if(sizes->chunksize < ARENA_MAXCHUNK)
+                sizes->chunksize *= 2;
+        }
+        ptr = sizes->current;
+        sizes->current += blocksize;
+    }
+    sizes->inuse += blocksize;
+    CHECK(pthread_mutex_unlock(&sizes->lock));
+    return ptr;
+}
+
+void
+names_arenafree(names_arena_type arena, void* ptr, size_t size)
+{
+    struct arenasize* sizes;
+    if(ptr == NULL)
+        return;
+    if(arena == NULL || size > NAMES_ARENA_MAXBLOCK) {
+        free(ptr);
+        return;
+    }
+    if(size == 0)
+        size = 1;
+    sizes = &arena->sizes[(size - 1) / ARENA_GRANULE];
+    CHECK(pthread_mutex_lock(&sizes->lock));
+    *(void**)ptr = sizes->freelist;
+    sizes->freelist = ptr;
+    sizes->inuse -= ((size - 1) / ARENA_GRANULE + 1) * ARENA_GRANULE;
+    CHECK(pthread_mutex_unlock(&sizes->lock));
+}
+
+void*
+names_arenarealloc(names_arena_type arena, void* ptr, size_t oldsize, size_t newsize)
+{
+    void* newptr;
+    if(arena == NULL) {
+        if(newsize == 0) {
+            free(ptr);
+            return NULL;
+        }
+        CHECKALLOC(newptr = realloc(ptr, newsize));
+        return newptr;
+    }
+    if(ptr != NULL && oldsize > 0 && newsize > 0 && oldsize <= NAMES_ARENA_MAXBLOCK && newsize <= NAMES_ARENA_MAXBLOCK &&
+       (oldsize - 1) / ARENA_GRANULE == (newsize - 1) / ARENA_GRANULE) {
+        return ptr;
+    }
+    newptr = (newsize > 0 ? names_arenaalloc(arena, newsize) : NULL);
+    if(ptr != NULL) {
+        if(newptr != NULL)
+            memcpy(newptr, ptr, (oldsize < newsize ? oldsize : newsize));
+        names_arenafree(arena, ptr, oldsize);
+    }
+    return newptr;
+}
+
+char*
+names_arenastrdup(names_arena_type arena, const char* str)
+{
+    char* ptr;
+    size_t len;
+    if(str == NULL)
+        return NULL;
+    len = strlen(str) + 1;
+    ptr = names_arenaalloc(arena, len);
+    memcpy(ptr, str, len);
+    return ptr;
+}
+
+void
+names_arenastatistics(names_arena_type arena, size_t* reserved, size_t* inuse)
+{
+    int i;
+    *reserved = *inuse = 0;
+    for(i=0; i<ARENA_NSIZES; i++) {
+        CHECK(pthread_mutex_lock(&arena->sizes[i].lock));
+        *reserved += arena->sizes[i].reserved;
+        *inuse += arena->sizes[i].inuse;
+        CHECK(pthread_mutex_unlock(&arena->sizes[i].lock));
+    }
+}
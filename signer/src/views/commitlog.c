@@ -44,20 +44,38 @@
 #include "utilities.h"
 #include "proto.h"
 
-struct names_table_struct {
-    ldns_rbtree_t* tree;
-    names_table_type next;
+/* The commit log of a zone is a chain of segments, each holding one
+ * committed changelog and numbered in order of commit.  Views subscribed
+ * to the commit log each keep a cursor at the last segment they have
+ * processed.  Segments are only appended at the end, under the lock, and
+ * the next pointer of a segment is only set once, so a view walks the
+ * chain from its cursor onwards without taking the lock.  Segments
+ * before the cursor of the view lagging most are no longer in use and
+ * are truncated.
+ */
+struct names_commitsegment {
+    struct names_commitsegment* next;
+    long sequence;
+    names_table_type changelog;
+};
+
+struct names_commitcursor_struct {
+    names_commitcursor_type next;
+    names_view_type view;
+    struct names_commitsegment* position; /* last segment processed */
+    struct names_commitsegment* current; /* segment being processed */
+    long nsegments;
+    long maxlag;
 };
 
 struct names_commitlog_struct {
     pthread_mutex_t lock;
     int nviews;
-    struct names_changelogchainentry {
-        names_view_type view;
-        names_table_type* nextchangelogptr;
-    } *views;
-    names_table_type firstchangelog;
-    names_table_type lastchangelog;
+    names_commitcursor_type cursors;
+    struct names_commitsegment* firstsegment;
+    struct names_commitsegment* lastsegment;
+    long sequence;
+    long ntruncated;
     marshall_handle store;
     void (*storefn)(names_table_type, marshall_handle);
 };
@@ -94,122 +112,181 @@ names_commitlogdestroyfull(names_table_type table)
 void
 names_commitlogdestroyall(names_commitlog_type commitlog, marshall_handle* store)
 {
-    names_table_type next;
+    struct names_commitsegment* segment;
+    names_commitcursor_type cursor;
     pthread_mutex_destroy(&commitlog->lock);
     if(store)
         *store = commitlog->store;
-    while(commitlog->firstchangelog) {
-        next = commitlog->firstchangelog->next;
-        names_commitlogdestroy(commitlog->firstchangelog);
-        commitlog->firstchangelog = next;
+    while(commitlog->firstsegment) {
+        segment = commitlog->firstsegment;
+        commitlog->firstsegment = segment->next;
+        if(segment->changelog)
+            names_commitlogdestroy(segment->changelog);
+        free(segment);
+    }
+    while(commitlog->cursors) {
+        cursor = commitlog->cursors;
+        commitlog->cursors = cursor->next;
+        free(cursor);
     }
-    free(commitlog->views);
     free(commitlog);
 }
 
+/* Drop the segments all views have processed.  The segment at which the
+ * view lagging most stands is kept as the start of the chain, but its
+ * changelog is no longer needed.  Must be called with the lock held.
+ */
+static void
+truncatelog(names_commitlog_type logs)
+{
+    struct names_commitsegment* segment;
+    struct names_commitsegment* position;
+    struct names_commitsegment* oldest = logs->lastsegment;
+    names_commitcursor_type cursor;
+    for(cursor=logs->cursors; cursor; cursor=cursor->next) {
+        position = __sync_fetch_and_add(&cursor->position, 0);
+        if(position->sequence < oldest->sequence)
+            oldest = position;
+    }
+    while(logs->firstsegment != oldest) {
+        segment = logs->firstsegment;
+        logs->firstsegment = segment->next;
+        if(segment->changelog)
+            names_commitlogdestroy(segment->changelog);
+        free(segment);
+        logs->ntruncated++;
+    }
+    if(oldest->changelog) {
+        names_commitlogdestroy(oldest->changelog);
+        oldest->changelog = NULL;
+    }
+}
+
 int
-names_commitlogpoppush(names_commitlog_type logs, int viewid, names_table_type* commitlog, names_table_type* submitlog)
+names_commitlogreplay(names_commitlog_type logs, names_commitcursor_type cursor, names_table_type* commitlog, names_table_type* submitlog)
 {
-    /* The basic idea of this function is simple, but the details make it
-     * complicated.  There are multiple views, which are accessed by
-     * individual threads.  Data between the views is updates by having
-     * changelogs that each thread responsible for a view incorporate in their
-     * own view.  When a thread synchronized, is goes over all the changelog
-     * it hasn't processed them, retrieving each one by one by calling this
-     * function iteratively).  When there are no changelogs present anymore
-     * it hasn't processed, it may optionally add its changelog to the last
-     * in this chain.
-     */ 
-    int backlog;
-    int i;
-    names_table_type poppedlog;
-    names_table_type previouslog = NULL;
-    CHECK(pthread_mutex_lock(&logs->lock));
-    
-    poppedlog = *(logs->views[viewid].nextchangelogptr);
-    if(poppedlog) {
-        logs->views[viewid].nextchangelogptr = &(poppedlog->next);
-        backlog = 1;
-    } else
-        backlog = 0;
-    if(*commitlog) {
-        if(*commitlog == logs->firstchangelog) {
-            previouslog = *commitlog;
-            for(i=0; i<logs->nviews; i++) {
-                if(&(logs->firstchangelog) == logs->views[i].nextchangelogptr)
-                    break;
-            }
-            if(i == logs->nviews) {
-                for(i=0; i<logs->nviews; i++) {
-                    if(logs->views[i].view)
-                        if(logs->views[i].nextchangelogptr == &(previouslog->next))
-                            logs->views[i].nextchangelogptr = &(logs->firstchangelog);
-                }
-                if(logs->lastchangelog == logs->firstchangelog)
-                    logs->lastchangelog = logs->firstchangelog->next;
-                logs->firstchangelog = logs->firstchangelog->next;
-                *commitlog = NULL;
-            } else {
-                previouslog = NULL;
-            }
+    /* A view calls this function repeatedly to obtain the changelogs
+     * committed by other views which it has not yet processed, one by one.
+     * Each call it returns the changelog it got the previous call, which
+     * moves its cursor past it.  When there are no changelogs left it
+     * hasn't processed, it may optionally append its own changelog to the
+     * chain, which is then returned for it to finish processing.
+     */
+    struct names_commitsegment* segment;
+    long lag;
+    if(cursor->current) {
+        __sync_bool_compare_and_swap(&cursor->position, cursor->position, cursor->current);
+        cursor->current = NULL;
+        if(pthread_mutex_trylock(&logs->lock) == 0) {
+            truncatelog(logs);
+            CHECK(pthread_mutex_unlock(&logs->lock));
         }
+    } else {
+        lag = __sync_fetch_and_add(&logs->sequence, 0) - cursor->position->sequence;
+        if(lag > cursor->maxlag)
+            cursor->maxlag = lag;
     }
-    if(poppedlog == NULL && submitlog) {
-        names_commitlogpersistincr(logs, *submitlog);
-        if(logs->firstchangelog == NULL) {
-            assert(logs->lastchangelog == NULL);
-            logs->lastchangelog = logs->firstchangelog = *submitlog;
-        } else {
-            logs->lastchangelog->next = *submitlog;
-            logs->lastchangelog = *submitlog;
+    segment = __sync_fetch_and_add(&cursor->position->next, 0);
+    if(segment == NULL && submitlog) {
+        CHECK(pthread_mutex_lock(&logs->lock));
+        /* another view may have appended in the mean time */
+        segment = cursor->position->next;
+        if(segment == NULL) {
+            names_commitlogpersistincr(logs, *submitlog);
+            segment = malloc(sizeof(struct names_commitsegment));
+            segment->next = NULL;
+            segment->sequence = logs->lastsegment->sequence + 1;
+            segment->changelog = *submitlog;
+            __sync_bool_compare_and_swap(&logs->lastsegment->next, NULL, segment);
+            logs->lastsegment = segment;
+            __sync_bool_compare_and_swap(&logs->sequence, logs->sequence, segment->sequence);
+            cursor->current = segment;
+            *commitlog = *submitlog;
+            *submitlog = names_tablecreate2(*submitlog);
+            CHECK(pthread_mutex_unlock(&logs->lock));
+            return 0;
         }
-        assert(*(logs->views[viewid].nextchangelogptr) == *submitlog);
-        logs->views[viewid].nextchangelogptr = &((*logs->views[viewid].nextchangelogptr)->next);
-        *commitlog = *submitlog;
-        *submitlog = names_tablecreate2(*submitlog);
+        CHECK(pthread_mutex_unlock(&logs->lock));
+    }
+    cursor->current = segment;
+    if(segment) {
+        cursor->nsegments++;
+        *commitlog = segment->changelog;
+        return 1;
     } else {
-        *commitlog = poppedlog;
+        *commitlog = NULL;
+        return 0;
     }
-    CHECK(pthread_mutex_unlock(&logs->lock));
-    if(previouslog)
-        names_commitlogdestroy(previouslog);
-    return backlog;
 }
 
 int
-names_commitlogsubscribe(names_view_type view, names_commitlog_type* commitlogptr)
+names_commitlogsubscribe(names_view_type view, names_commitlog_type* commitlogptr, names_commitcursor_type* cursorptr)
 {
     int viewid;
+    names_commitcursor_type cursor;
     if(*commitlogptr == NULL) {
         *commitlogptr = malloc(sizeof(struct names_commitlog_struct));
         CHECK(pthread_mutex_init(&(*commitlogptr)->lock, NULL));
         CHECK(pthread_mutex_lock(&(*commitlogptr)->lock));
         (*commitlogptr)->nviews = 1;
-        (*commitlogptr)->views = malloc(sizeof(struct names_changelogchainentry) * (*commitlogptr)->nviews);
-        (*commitlogptr)->firstchangelog = NULL;
-        (*commitlogptr)->lastchangelog = NULL;
+        (*commitlogptr)->cursors = NULL;
+        (*commitlogptr)->firstsegment = malloc(sizeof(struct names_commitsegment));
+        (*commitlogptr)->firstsegment->next = NULL;
+        (*commitlogptr)->firstsegment->sequence = 0;
+        (*commitlogptr)->firstsegment->changelog = NULL;
+        (*commitlogptr)->lastsegment = (*commitlogptr)->firstsegment;
+        (*commitlogptr)->sequence = 0;
+        (*commitlogptr)->ntruncated = 0;
         (*commitlogptr)->store = NULL;
     } else {
         CHECK(pthread_mutex_lock(&(*commitlogptr)->lock));
         (*commitlogptr)->nviews += 1;
-        (*commitlogptr)->views = realloc((*commitlogptr)->views, sizeof(struct names_changelogchainentry) * (*commitlogptr)->nviews);
     }
     viewid = (*commitlogptr)->nviews - 1;
-    (*commitlogptr)->views[viewid].nextchangelogptr = &((*commitlogptr)->firstchangelog);
-    (*commitlogptr)->views[viewid].view = view;
+    /* a new view starts at the oldest changelog still kept */
+    cursor = malloc(sizeof(struct names_commitcursor_struct));
+    cursor->view = view;
+    cursor->position = (*commitlogptr)->firstsegment;
+    cursor->current = NULL;
+    cursor->nsegments = 0;
+    cursor->maxlag = 0;
+    cursor->next = (*commitlogptr)->cursors;
+    (*commitlogptr)->cursors = cursor;
+    *cursorptr = cursor;
     CHECK(pthread_mutex_unlock(&(*commitlogptr)->lock));
     return viewid;
 }
 
 void
-names_commitlogunsubscribe(int viewid, names_commitlog_type commitlogptr)
+names_commitlogunsubscribe(names_commitcursor_type cursor, names_commitlog_type commitlogptr)
 {
+    names_commitcursor_type* cursorptr;
     CHECK(pthread_mutex_lock(&commitlogptr->lock));
-    commitlogptr->views[viewid].nextchangelogptr = NULL;
-    commitlogptr->views[viewid].view = NULL;
+    for(cursorptr=&commitlogptr->cursors; *cursorptr; cursorptr=&(*cursorptr)->next) {
+        if(*cursorptr == cursor) {
+            *cursorptr = cursor->next;
+            break;
+        }
+    }
+    free(cursor);
+    if(commitlogptr->cursors)
+        truncatelog(commitlogptr);
     CHECK(pthread_mutex_unlock(&commitlogptr->lock));
 }
 
+void
+names_commitlogstats(names_commitlog_type commitlog, names_commitcursor_type cursor, long* lag, long* maxlag, long* nsegments)
+{
+    struct names_commitsegment* position;
+    position = __sync_fetch_and_add(&cursor->position, 0);
+    if(lag)
+        *lag = __sync_fetch_and_add(&commitlog->sequence, 0) - position->sequence;
+    if(maxlag)
+        *maxlag = cursor->maxlag;
+    if(nsegments)
+        *nsegments = cursor->nsegments;
+}
+
 void
 names_commitlogpersistincr(names_commitlog_type views, names_table_type changelog)
 {
@@ -228,12 +305,12 @@ names_commitlogpersistappend(names_commitlog_type commitlog, void (*persistfn)(n
 }
 
 int
-names_commitlogpersistfull(names_commitlog_type commitlog, void (*persistfn)(names_table_type, marshall_handle), int viewid, marshall_handle store, marshall_handle* oldstore)
+names_commitlogpersistfull(names_commitlog_type commitlog, void (*persistfn)(names_table_type, marshall_handle), names_commitcursor_type cursor, marshall_handle store, marshall_handle* oldstore)
 {
-    names_table_type changelog;
+    struct names_commitsegment* segment;
     CHECK(pthread_mutex_lock(&commitlog->lock));
-    for(changelog = *(commitlog->views[viewid].nextchangelogptr); changelog; changelog=changelog->next) {
-        persistfn(changelog, store);
+    for(segment = cursor->position->next; segment; segment=segment->next) {
+        persistfn(segment->changelog, store);
     }
     *oldstore = commitlog->store;
     commitlog->store = store;
@@ -32,24 +32,363 @@
 #include <time.h>
 #include <ldns/ldns.h>
 #include "uthash.h"
+#include "utilities.h"
 #include "proto.h"
 
 typedef int (*comparefunction)(const void *, const void *);
 typedef int (*acceptfunction)(recordset_type newitem, recordset_type currentitem, int* cmp);
 
+/* The indices are persistent balanced (AVL) trees.  Nodes are reference
+ * counted and may be shared between indices, such that an index of a view
+ * can be cloned from that of another view in constant time.  A node that is
+ * shared is never modified, instead the path from the root down to it is
+ * copied on modification.  Nodes that are referenced by a single index only
+ * are modified in place.  An index of a view which is updated through the
+ * commit log therefore only duplicates those nodes on the paths to the
+ * records changed, while the unchanged parts remain shared with the other
+ * views.  Lookups and iterators never modify nodes, iterators hold a
+ * reference to the root of the tree such that they work on a snapshot.
+ */
+
+#define INDEX_MAXDEPTH 64
+
+struct indexnode {
+    recordset_type record;
+    struct indexnode* left;
+    struct indexnode* right;
+    int height;
+    int refcount;
+};
+
 struct names_index_struct {
     const char* keyname;
-    ldns_rbtree_t* tree;
     acceptfunction acceptfunc;
+    comparefunction comparfunc;
+    struct indexnode* root;
+    int count;
+};
+
+/* Number of index nodes in use, over all indices of all zones. */
+static long indexnodes = 0;
+
+struct indexcursor {
+    int depth;
+    struct indexnode* path[INDEX_MAXDEPTH];
 };
 
 struct names_iterator_struct {
     int (*iterate)(names_iterator*iter, void**);
     int (*advance)(names_iterator*iter, void**);
     int (*end)(names_iterator*iter);
-    ldns_rbnode_t* current;
+    struct indexnode* root;
+    struct indexcursor cursor;
 };
 
+static struct indexnode*
+nodecreate(recordset_type record)
+{
+    struct indexnode* node;
+    CHECKALLOC(node = malloc(sizeof(struct indexnode)));
+    __sync_add_and_fetch(&indexnodes, 1);
+    node->record = record;
+    node->left = NULL;
+    node->right = NULL;
+    node->height = 1;
+    node->refcount = 1;
+    return node;
+}
+
+static struct indexnode*
+nodeacquire(struct indexnode* node)
+{
+    if(node)
+        __sync_add_and_fetch(&node->refcount, 1);
+    return node;
+}
+
+static void
+nodefree(struct indexnode* node)
+{
+    __sync_sub_and_fetch(&indexnodes, 1);
+    free(node);
+}
+
+static void
+noderelease(struct indexnode* node)
+{
+    struct indexnode* right;
+    while(node && __sync_sub_and_fetch(&node->refcount, 1) == 0) {
+        noderelease(node->left);
+        right = node->right;
+        nodefree(node);
+        node = right;
+    }
+}
+
+/* Returns a node that may be modified in place, which is the node itself
+ * when it is not shared or a private copy otherwise.  The reference of the
+ * caller to the original node is transferred to the copy.
+ */
+static struct indexnode*
+nodeown(struct indexnode* node)
+{
+    struct indexnode* copy;
+    if(node->refcount == 1)
+        return node;
+    CHECKALLOC(copy = malloc(sizeof(struct indexnode)));
+    __sync_add_and_fetch(&indexnodes, 1);
+    copy->record = node->record;
+    copy->left = nodeacquire(node->left);
+    copy->right = nodeacquire(node->right);
+    copy->height = node->height;
+    copy->refcount = 1;
+    noderelease(node);
+    return copy;
+}
+
+static inline int
+nodeheight(struct indexnode* node)
+{
+    return (node ? node->height : 0);
+}
+
+static inline void
+nodeupdate(struct indexnode* node)
+{
+    int left = nodeheight(node->left);
+    int right = nodeheight(node->right);
+    node->height = (left > right ? left : right) + 1;
+}
+
+/* The rotations and rebalancing expect the node passed to be owned by the
+ * caller already.
+ */
+static struct indexnode*
+noderotateright(struct indexnode* node)
+{
+    struct indexnode* pivot;
+    pivot = nodeown(node->left);
+    node->left = pivot->right;
+    pivot->right = node;
+    nodeupdate(node);
+    nodeupdate(pivot);
+    return pivot;
+}
+
+static struct indexnode*
+noderotateleft(struct indexnode* node)
+{
+    struct indexnode* pivot;
+    pivot = nodeown(node->right);
+    node->right = pivot->left;
+    pivot->left = node;
+    nodeupdate(node);
+    nodeupdate(pivot);
+    return pivot;
+}
+
+static struct indexnode*
+nodebalance(struct indexnode* node)
+{
+    int balance;
+    nodeupdate(node);
+    balance = nodeheight(node->left) - nodeheight(node->right);
+    if(balance > 1) {
+        if(nodeheight(node->left->left) < nodeheight(node->left->right)) {
+            node->left = noderotateleft(nodeown(node->left));
+        }
+        return noderotateright(node);
+    } else if(balance < -1) {
+        if(nodeheight(node->right->right) < nodeheight(node->right->left)) {
+            node->right = noderotateright(nodeown(node->right));
+        }
+        return noderotateleft(node);
+    }
+    return node;
+}
+
+static struct indexnode*
+nodeinsert(struct indexnode* node, recordset_type record, comparefunction comparfunc)
+{
+    if(node == NULL)
+        return nodecreate(record);
+    node = nodeown(node);
+    if(comparfunc(record, node->record) < 0) {
+        node->left = nodeinsert(node->left, record, comparfunc);
+    } else {
+        node->right = nodeinsert(node->right, record, comparfunc);
+    }
+    return nodebalance(node);
+}
+
+/* Replaces the record in the node comparing equal to the given record. */
+static struct indexnode*
+nodereplace(struct indexnode* node, recordset_type record, comparefunction comparfunc)
+{
+    int cmp;
+    node = nodeown(node);
+    cmp = comparfunc(record, node->record);
+    if(cmp < 0) {
+        node->left = nodereplace(node->left, record, comparfunc);
+    } else if(cmp > 0) {
+        node->right = nodereplace(node->right, record, comparfunc);
+    } else {
+        node->record = record;
+    }
+    return node;
+}
+
+static struct indexnode*
+nodedeletemin(struct indexnode* node, recordset_type* record)
+{
+    struct indexnode* right;
+    node = nodeown(node);
+    if(node->left == NULL) {
+        *record = node->record;
+        right = node->right;
+        nodefree(node);
+        return right;
+    }
+    node->left = nodedeletemin(node->left, record);
+    return nodebalance(node);
+}
+
+/* Deletes the node comparing equal to the given record, which must be
+ * present in the tree.
+ */
+static struct indexnode*
+nodedelete(struct indexnode* node, recordset_type record, comparefunction comparfunc)
+{
+    int cmp;
+    struct indexnode* child;
+    node = nodeown(node);
+    cmp = comparfunc(record, node->record);
+    if(cmp < 0) {
+        node->left = nodedelete(node->left, record, comparfunc);
+    } else if(cmp > 0) {
+        node->right = nodedelete(node->right, record, comparfunc);
+    } else if(node->left == NULL || node->right == NULL) {
+        child = (node->left ? node->left : node->right);
+        nodefree(node);
+        return child;
+    } else {
+        node->right = nodedeletemin(node->right, &node->record);
+    }
+    return nodebalance(node);
+}
+
+static struct indexnode*
+nodesearch(names_index_type index, recordset_type find)
+{
+    int cmp;
+    struct indexnode* node;
+    for(node=index->root; node; node=(cmp < 0 ? node->left : node->right)) {
+        cmp = index->comparfunc(find, node->record);
+        if(cmp == 0)
+            break;
+    }
+    return node;
+}
+
+static inline struct indexnode*
+cursorcurrent(struct indexcursor* cursor)
+{
+    return (cursor->depth > 0 ? cursor->path[cursor->depth-1] : NULL);
+}
+
+static struct indexnode*
+cursorfirst(struct indexcursor* cursor, struct indexnode* node)
+{
+    cursor->depth = 0;
+    for(; node; node=node->left)
+        cursor->path[cursor->depth++] = node;
+    return cursorcurrent(cursor);
+}
+
+static struct indexnode*
+cursorlast(struct indexcursor* cursor, struct indexnode* node)
+{
+    cursor->depth = 0;
+    for(; node; node=node->right)
+        cursor->path[cursor->depth++] = node;
+    return cursorcurrent(cursor);
+}
+
+static struct indexnode*
+cursornext(struct indexcursor* cursor)
+{
+    struct indexnode* node;
+    struct indexnode* child;
+    if(cursor->depth == 0)
+        return NULL;
+    node = cursor->path[cursor->depth-1];
+    if(node->right) {
+        for(node=node->right; node; node=node->left)
+            cursor->path[cursor->depth++] = node;
+    } else {
+        do {
+            child = cursor->path[--cursor->depth];
+        } while(cursor->depth > 0 && cursor->path[cursor->depth-1]->right == child);
+    }
+    return cursorcurrent(cursor);
+}
+
+static struct indexnode*
+cursorprevious(struct indexcursor* cursor)
+{
+    struct indexnode* node;
+    struct indexnode* child;
+    if(cursor->depth == 0)
+        return NULL;
+    node = cursor->path[cursor->depth-1];
+    if(node->left) {
+        for(node=node->left; node; node=node->right)
+            cursor->path[cursor->depth++] = node;
+    } else {
+        do {
+            child = cursor->path[--cursor->depth];
+        } while(cursor->depth > 0 && cursor->path[cursor->depth-1]->left == child);
+    }
+    return cursorcurrent(cursor);
+}
+
+/* Positions the cursor at the record equal to the one given or otherwise at
+ * the greatest record smaller than it, in which case the cursor may be
+ * empty.  Returns non-zero only on an exact match, like
+ * ldns_rbtree_find_less_equal.
+ */
+static int
+cursorfindlessequal(struct indexcursor* cursor, names_index_type index, recordset_type find)
+{
+    int cmp, lessdepth = 0;
+    struct indexnode* node;
+    cursor->depth = 0;
+    for(node=index->root; node; node=(cmp < 0 ? node->left : node->right)) {
+        cursor->path[cursor->depth++] = node;
+        cmp = index->comparfunc(find, node->record);
+        if(cmp == 0)
+            return 1;
+        if(cmp > 0)
+            lessdepth = cursor->depth;
+    }
+    cursor->depth = lessdepth;
+    return 0;
+}
+
+/* Positions the cursor at the first record not smaller than the one given. */
+static struct indexnode*
+cursorfindgreaterequal(struct indexcursor* cursor, names_index_type index, recordset_type find)
+{
+    if(!cursorfindlessequal(cursor, index, find)) {
+        if(cursor->depth == 0) {
+            return cursorfirst(cursor, index->root);
+        } else {
+            return cursornext(cursor);
+        }
+    }
+    return cursorcurrent(cursor);
+}
+
 int
 names_indexcreate(names_index_type* index, const char* keyname)
 {
@@ -61,59 +400,102 @@ names_indexcreate(names_index_type* index, const char* keyname)
     assert(comparfunc);
     (*index)->keyname = strdup(keyname);
     (*index)->acceptfunc = acceptfunc;
-    (*index)->tree = ldns_rbtree_create(comparfunc);
+    (*index)->comparfunc = comparfunc;
+    (*index)->root = NULL;
+    (*index)->count = 0;
     return 0;
 }
 
-struct destroyinfo {
-    void (*free)(void* arg, void* key, void* val);
-    void* arg;
-};
+/* Creates a new index with the same content as the given one, sharing all
+ * of its nodes.
+ */
+names_index_type
+names_indexclone(names_index_type index)
+{
+    names_index_type clone;
+    clone = malloc(sizeof(struct names_index_struct));
+    clone->keyname = strdup(index->keyname);
+    clone->acceptfunc = index->acceptfunc;
+    clone->comparfunc = index->comparfunc;
+    clone->root = nodeacquire(index->root);
+    clone->count = index->count;
+    return clone;
+}
 
-static void
-disposenode(ldns_rbnode_t* node, void* cargo)
+const char*
+names_indexkeyname(names_index_type index)
 {
-    struct destroyinfo* user = cargo;
-    if(user && user->free) {
-        user->free(user->arg, (void*)node->key, (void*)node->data);
-    }
-    free(node);
+    return index->keyname;
+}
+
+int
+names_indexaccept(names_index_type index, recordset_type record)
+{
+    return index->acceptfunc(record, NULL, NULL);
+}
+
+int
+names_indexcount(names_index_type index)
+{
+    return index->count;
+}
+
+/* Returns whether two indices still are in the state in which one was cloned
+ * from the other.
+ */
+int
+names_indexshared(names_index_type index, names_index_type other)
+{
+    return index->root == other->root;
+}
+
+/* Returns the number of index nodes in use, which is less than the total
+ * number of records in all indices as far as nodes are shared.
+ */
+void
+names_indexstatistics(long* nodes, size_t* nodesize)
+{
+    *nodes = __sync_add_and_fetch(&indexnodes, 0);
+    *nodesize = sizeof(struct indexnode);
 }
 
 void
 names_indexdestroy(names_index_type index, void (*userfunc)(void* arg, void* key, void* val), void* userarg)
 {
-    struct destroyinfo cargo;
-    cargo.free = userfunc;
-    cargo.arg = userarg;
-    ldns_traverse_postorder(index->tree, disposenode, (userfunc?&cargo:NULL));
-    ldns_rbtree_free(index->tree);
+    struct indexcursor cursor;
+    struct indexnode* node;
+    if(userfunc) {
+        for(node=cursorfirst(&cursor, index->root); node; node=cursornext(&cursor)) {
+            userfunc(userarg, node->record, node->record);
+        }
+    }
+    noderelease(index->root);
     free((void*)index->keyname);
     free(index);
 }
 
+static void
+indexremove(names_index_type index, recordset_type record)
+{
+    index->root = nodedelete(index->root, record, index->comparfunc);
+    index->count -= 1;
+}
+
 int
 names_indexinsert(names_index_type index, recordset_type record, recordset_type* existing) {
     int cmp;
-    ldns_rbnode_t* node;
+    struct indexnode* node;
     if (existing && *existing) {
-        node = ldns_rbtree_delete(index->tree, *existing);
-        free(node);
+        names_indexremove(index, *existing);
     }
     if (record) {
         if (index->acceptfunc(record, NULL, NULL)) {
-            node = malloc(sizeof (ldns_rbnode_t));
-            assert(record);
-            node->key = record;
-            node->data = record;
-            if (!ldns_rbtree_insert(index->tree, node)) {
-                free(node);
-                node = ldns_rbtree_search(index->tree, record);
-                assert(node);
+            node = nodesearch(index, record);
+            if (node != NULL) {
                 if (existing && *existing == NULL) {
-                    *existing = (recordset_type) node->data;
+                    *existing = node->record;
                 }
-                switch (index->acceptfunc(record, (recordset_type) node->data, &cmp)) {
+                switch (index->acceptfunc(record, node->record, &cmp)) {
                     case 0:
                         logger_message(&names_logcommitlog, logger_noctx, logger_DIAG, "      record ignored from %s no match after found\n", index->keyname);
                         if(existing) {
@@ -122,29 +504,28 @@ names_indexinsert(names_index_type index, recordset_type record, recordset_type*
                         return 0;
                     case 1:
                         logger_message(&names_logcommitlog, logger_noctx, logger_DIAG, "      record rewritten in %s matched after found\n", index->keyname);
-                        node->key = record;
-                        node->data = record;
+                        index->root = nodereplace(index->root, record, index->comparfunc);
                         return 1;
                     case 2:
                         logger_message(&names_logcommitlog, logger_noctx, logger_DIAG, "      record deleted in %s dropped after found\n", index->keyname);
-                        node = ldns_rbtree_delete(index->tree, node->key);
-                        free(node);
+                        indexremove(index, node->record);
                         return 0;
                     default:
                         abort(); // FIXME
                 }
             } else {
                 logger_message(&names_logcommitlog, logger_noctx, logger_DIAG, "      record inserted in %s after not found\n", index->keyname);
+                index->root = nodeinsert(index->root, record, index->comparfunc);
+                index->count += 1;
                 return 1;
             }
         } else {
-            node = ldns_rbtree_search(index->tree, record);
+            node = nodesearch(index, record);
             if (node != NULL) {
-                if (index->acceptfunc(record, (recordset_type) node->data, &cmp) == 0) {
-                    if (cmp == 0 && node->key == record) {
+                if (index->acceptfunc(record, node->record, &cmp) == 0) {
+                    if (cmp == 0 && node->record == record) {
                         logger_message(&names_logcommitlog, logger_noctx, logger_DIAG, "      record not accepted and deleted from in %s\n", index->keyname);
-                        node = ldns_rbtree_delete(index->tree, node->key);
-                        free(node);
+                        indexremove(index, record);
                     } else {
                         logger_message(&names_logcommitlog, logger_noctx, logger_DIAG, "      record not accepted and withheld from deletion from in %s\n", index->keyname);
                     }
@@ -179,32 +560,50 @@ names_indexlookupkey(names_index_type index, const char* keyvalue)
 recordset_type
 names_indexlookup(names_index_type index, recordset_type find)
 {
-    ldns_rbnode_t* node;
-    node = ldns_rbtree_search(index->tree, find);
-    return (node != NULL && node != LDNS_RBTREE_NULL) ? (recordset_type) node->data : NULL;
+    struct indexnode* node;
+    node = nodesearch(index, find);
+    return (node != NULL ? node->record : NULL);
 }
 
 recordset_type
 names_indexlookupnext(names_index_type index, recordset_type find)
 {
-    ldns_rbnode_t* node;
-    node = ldns_rbtree_search(index->tree, find);
-    if(node != NULL && node != LDNS_RBTREE_NULL) {
-        node = ldns_rbtree_next(node);
-        if(node == NULL || node == LDNS_RBTREE_NULL) {
-            node = ldns_rbtree_first(index->tree);
+    struct indexcursor cursor;
+    struct indexnode* node = NULL;
+    if(cursorfindlessequal(&cursor, index, find)) {
+        node = cursornext(&cursor);
+        if(node == NULL) {
+            node = cursorfirst(&cursor, index->root);
         }
     }
-    return (node != NULL && node != LDNS_RBTREE_NULL) ? (recordset_type) node->data : NULL;
+    return (node != NULL ? node->record : NULL);
+}
+
+/* Returns the record preceding the position of the given record in the
+ * index, wrapping around to the last record, or NULL if there is none.
+ * The record looked up itself need not be present in the index.
+ */
+recordset_type
+names_indexlookupprevious(names_index_type index, recordset_type find)
+{
+    struct indexcursor cursor;
+    struct indexnode* node = NULL;
+    if(cursorfindlessequal(&cursor, index, find)) {
+        node = cursorprevious(&cursor);
+    } else {
+        node = cursorcurrent(&cursor);
+    }
+    if(node == NULL) {
+        node = cursorlast(&cursor, index->root);
+    }
+    return (node != NULL ? node->record : NULL);
 }
 
 int
 names_indexremove(names_index_type index, recordset_type d)
 {
-    ldns_rbnode_t* node;
-    node = ldns_rbtree_delete(index->tree, d);
-    if(node) {
-        free(node);
+    if(nodesearch(index, d) != NULL) {
+        indexremove(index, d);
         return 1;
     } else
         return 0;
@@ -214,14 +613,16 @@ static int
 iterateimpl(names_iterator* i, void** item)
 {
     struct names_iterator_struct** iter = i;
+    struct indexnode* node;
     if (item)
         *item = NULL;
     if (*iter) {
-        if ((*iter)->current != NULL && (*iter)->current != LDNS_RBTREE_NULL) {
+        if ((node = cursorcurrent(&(*iter)->cursor)) != NULL) {
             if (item)
-                *item = (void*) (*iter)->current->data;
+                *item = (void*) node->record;
             return 1;
         } else {
+            noderelease((*iter)->root);
             free(*iter);
             *iter = NULL;
         }
@@ -233,17 +634,16 @@ static int
 advanceimpl(names_iterator*i, void** item)
 {
     struct names_iterator_struct** iter = i;
+    struct indexnode* node;
     if (item)
         *item = NULL;
     if (*iter) {
-        if((*iter)->current != NULL && (*iter)->current != LDNS_RBTREE_NULL) {
-            (*iter)->current = ldns_rbtree_next((*iter)->current);
-            if((*iter)->current != NULL && (*iter)->current != LDNS_RBTREE_NULL) {
-                if(item)
-                    *item = (void*)  (*iter)->current->data;
-                return 1;
-            }
+        if((node = cursornext(&(*iter)->cursor)) != NULL) {
+            if(item)
+                *item = (void*) node->record;
+            return 1;
         }
+        noderelease((*iter)->root);
         free(*iter);
         *iter = NULL;
     }
@@ -253,8 +653,11 @@ advanceimpl(names_iterator*i, void** item)
 static int
 endimpl(names_iterator*iter)
 {
-    if(*iter) free(*iter);
-        *iter = NULL;
+    if(*iter) {
+        noderelease((*iter)->root);
+        free(*iter);
+    }
+    *iter = NULL;
     return 0;
 }
 
@@ -266,7 +669,8 @@ names_indexiterator(names_index_type index)
     iter->iterate = iterateimpl;
     iter->advance = advanceimpl;
     iter->end = endimpl;
-    iter->current = (index->tree != NULL ? ldns_rbtree_first(index->tree) : NULL);
+    iter->root = nodeacquire(index->root);
+    cursorfirst(&iter->cursor, iter->root);
     return iter;
 }
 
@@ -277,23 +681,23 @@ names_iteratordescendants(names_index_type index, va_list ap)
     const char* found;
     int findlen;
     recordset_type record;
-    ldns_rbnode_t* node;
+    struct indexcursor cursor;
+    struct indexnode* node;
     names_iterator iter;
     iter = names_iterator_createrefs(NULL);
     find = va_arg(ap, char*);
     findlen = strlen(find);
     record = names_recordcreatetemp(find);
-    (void) ldns_rbtree_find_less_equal(index->tree, record, &node);
+    (void) cursorfindlessequal(&cursor, index, record);
     names_recorddispose(record);
-    while (node && node != LDNS_RBTREE_NULL) {
-        record = (recordset_type) node->key;
+    for(node=cursorcurrent(&cursor); node; node=cursorprevious(&cursor)) {
+        record = node->record;
         found = names_recordgetname(record);
         if (!strncmp(find, found, findlen) && (found[findlen - 1] == '\0' || found[findlen - 1] == '.')) {
             names_iterator_addptr(iter, record);
         } else {
             break;
         }
-        node = ldns_rbtree_previous(node);
     }
     return iter;
 }
@@ -323,7 +727,7 @@ names_iterator
 names_iteratorancestors(names_index_type index, va_list ap)
 {
     recordset_type record;
-    ldns_rbnode_t* node;
+    recordset_type found;
     names_iterator iter;
     char* name;
     char* parent = NULL;
@@ -339,10 +743,10 @@ names_iteratorancestors(names_index_type index, va_list ap)
             parent = names_parent(name);
         if (parent) {
             record = names_recordcreatetemp(parent);
-            node = ldns_rbtree_search(index->tree, record);
+            found = names_indexlookup(index, record);
             names_recorddispose(record);
-            if (node && node != LDNS_RBTREE_NULL) {
-                names_iterator_addptr(iter, node->data);
+            if (found) {
+                names_iterator_addptr(iter, found);
             }
         }
     } while(parent);
@@ -357,7 +761,8 @@ names_iteratorchangedeletes(names_index_type index, va_list ap)
     recordset_type find;
     recordset_type found;
     int serial, since;
-    ldns_rbnode_t* node;
+    struct indexcursor cursor;
+    struct indexnode* node;
     names_iterator iter;
 
     serial = va_arg(ap, int);
@@ -365,15 +770,8 @@ names_iteratorchangedeletes(names_index_type index, va_list ap)
     names_recordsetvalidupto(find, serial);
     iter = names_iterator_createrefs(NULL);
 
-    if(!ldns_rbtree_find_less_equal(index->tree, find, &node)) {
-        if(node == NULL || node == LDNS_RBTREE_NULL) {
-            node = ldns_rbtree_first(index->tree);
-        } else {
-            node = ldns_rbtree_next(node);
-        }
-    }
-    while (node && node != LDNS_RBTREE_NULL) {
-        found = (recordset_type) node->key;
+    for(node=cursorfindgreaterequal(&cursor, index, find); node; node=cursornext(&cursor)) {
+        found = node->record;
         if(names_recordvalidfrom(found,&since)) {
             if(since <= serial) {
                 names_iterator_addptr(iter, found);
@@ -381,7 +779,6 @@ names_iteratorchangedeletes(names_index_type index, va_list ap)
         } else {
             abort(); // FIXME cannot happen
         }
-        node = ldns_rbtree_next(node);
     }
 
     names_recorddispose(find);
@@ -394,7 +791,8 @@ names_iteratorchangeinserts(names_index_type index, va_list ap)
     recordset_type find;
     recordset_type found;
     int serial, since;
-    ldns_rbnode_t* node;
+    struct indexcursor cursor;
+    struct indexnode* node;
     names_iterator iter;
 
     serial = va_arg(ap, int);
@@ -402,19 +800,11 @@ names_iteratorchangeinserts(names_index_type index, va_list ap)
     names_recordsetvalidfrom(find, serial);
     iter = names_iterator_createrefs(NULL);
 
-    if(!ldns_rbtree_find_less_equal(index->tree, find, &node)) {
-        if(node == NULL || node == LDNS_RBTREE_NULL) {
-            node = ldns_rbtree_first(index->tree);
-        } else {
-            node = ldns_rbtree_next(node);
-        }
-    }
-    while (node && node != LDNS_RBTREE_NULL) {
-        found = (recordset_type) node->key;
+    for(node=cursorfindgreaterequal(&cursor, index, find); node; node=cursornext(&cursor)) {
+        found = node->record;
         if(!names_recordvalidupto(found,NULL)) {
             names_iterator_addptr(iter, found);
         }
-        node = ldns_rbtree_next(node);
     }
 
     names_recorddispose(find);
@@ -428,7 +818,8 @@ names_iteratorchanges(names_index_type index, va_list ap)
     recordset_type found;
     const char* name;
     int serial;
-    ldns_rbnode_t* node;
+    struct indexcursor cursor;
+    struct indexnode* node;
     names_iterator iter;
 
     name = va_arg(ap, const char*);
@@ -438,20 +829,12 @@ names_iteratorchanges(names_index_type index, va_list ap)
     iter = names_iterator_createrefs(NULL);
             char*t= NULL;
 
-    if(!ldns_rbtree_find_less_equal(index->tree, find, &node)) {
-        if(node == NULL || node == LDNS_RBTREE_NULL) {
-            node = ldns_rbtree_first(index->tree);
-        } else {
-            node = ldns_rbtree_next(node);
-        }
-    }
-    while (node && node != LDNS_RBTREE_NULL) {
-        found = (recordset_type) node->key;
+    for(node=cursorfindgreaterequal(&cursor, index, find); node; node=cursornext(&cursor)) {
+        found = node->record;
         if(strcmp(names_recordgetname(found), name)) {
             break;
         }
         names_iterator_addptr(iter, found);
-        node = ldns_rbtree_next(node);
     }
 
     names_recorddispose(find);
@@ -465,7 +848,8 @@ names_iteratoroutdated(names_index_type index, va_list ap)
     recordset_type find;
     recordset_type found;
     int serial;
-    ldns_rbnode_t* node;
+    struct indexcursor cursor;
+    struct indexnode* node;
     names_iterator iter;
 
     serial = va_arg(ap, int);
@@ -474,17 +858,9 @@ names_iteratoroutdated(names_index_type index, va_list ap)
     iter = names_iterator_createrefs(NULL);
             char*t= NULL;
 
-    if(!ldns_rbtree_find_less_equal(index->tree, find, &node)) {
-        if(node == NULL || node == LDNS_RBTREE_NULL) {
-            node = ldns_rbtree_first(index->tree);
-        } else {
-            node = ldns_rbtree_next(node);
-        }
-    }
-    while (node && node != LDNS_RBTREE_NULL) {
-        found = (recordset_type) node->key;
+    for(node=cursorfindgreaterequal(&cursor, index, find); node; node=cursornext(&cursor)) {
+        found = node->record;
         names_iterator_addptr(iter, found);
-        node = ldns_rbtree_next(node);
     }
 
     names_recorddispose(find);
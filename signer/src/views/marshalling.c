@@ -41,6 +41,12 @@ enum marshall_func { BASIC, OBJECT, SELF };
 int optionaldummy;
 int* marshall_OPTIONAL = &optionaldummy;
 
+/* Size of the read-ahead or write-behind buffer used by the binary methods.
+ * The journal of a zone is mostly read or written sequentially in full, so
+ * a large buffer avoids a system call for each and every member.
+ */
+#define MARSHALL_BUFFERSIZE (256*1024)
+
 struct marshall_struct {
     enum marshall_mode mode;
     int fd;
@@ -48,8 +54,74 @@ struct marshall_struct {
     int indentincr;
     int indentlvl;
     int indentcount;
+    int binary;
+    char* buffer;
+    size_t bufferfill;
+    size_t bufferpos;
+    ldns_buffer* wire;
 };
 
+static int
+marshallread(marshall_handle h, void* data, size_t len)
+{
+    size_t count, done;
+    ssize_t size;
+    if(h->buffer == NULL)
+        return read(h->fd, data, len);
+    for(done=0; done<len; done+=count) {
+        if(h->bufferpos == h->bufferfill) {
+            size = read(h->fd, h->buffer, MARSHALL_BUFFERSIZE);
+            if(size <= 0)
+                break;
+            h->bufferfill = size;
+            h->bufferpos = 0;
+        }
+        count = h->bufferfill - h->bufferpos;
+        if(count > len - done)
+            count = len - done;
+        memcpy(&((char*)data)[done], &h->buffer[h->bufferpos], count);
+        h->bufferpos += count;
+    }
+    return done;
+}
+
+static int
+marshallwrite(marshall_handle h, const void* data, size_t len)
+{
+    if(h->buffer == NULL)
+        return write(h->fd, data, len);
+    if(h->bufferfill + len > MARSHALL_BUFFERSIZE) {
+        marshallflush(h);
+        if(len >= MARSHALL_BUFFERSIZE)
+            return write(h->fd, data, len);
+    }
+    memcpy(&h->buffer[h->bufferfill], data, len);
+    h->bufferfill += len;
+    return len;
+}
+
+int
+marshallreading(marshall_handle h)
+{
+    return h->mode == READ;
+}
+
+int
+marshallflush(marshall_handle h)
+{
+    size_t done;
+    ssize_t size;
+    if(h->buffer == NULL || h->mode != WRITE)
+        return 0;
+    for(done=0; done<h->bufferfill; done+=size) {
+        size = write(h->fd, &h->buffer[done], h->bufferfill - done);
+        if(size < 0)
+            return -1;
+    }
+    h->bufferfill = 0;
+    return 0;
+}
+
 marshall_handle
 marshallcreate(enum marshall_method method, ...)
 {
@@ -58,6 +130,11 @@ marshallcreate(enum marshall_method method, ...)
     h = malloc(sizeof(struct marshall_struct));
     h->fd = -1;
     h->fp = NULL;
+    h->binary = 0;
+    h->buffer = NULL;
+    h->bufferfill = 0;
+    h->bufferpos = 0;
+    h->wire = NULL;
     va_start(ap, method);
     switch(method) {
         case marshall_INPUT:
@@ -68,6 +145,18 @@ marshallcreate(enum marshall_method method, ...)
             h->mode = WRITE;
             h->fd = va_arg(ap, int);
             break;
+        case marshall_BINARYINPUT:
+            h->mode = READ;
+            h->fd = va_arg(ap, int);
+            h->binary = 1;
+            h->buffer = malloc(MARSHALL_BUFFERSIZE);
+            break;
+        case marshall_BINARYOUTPUT:
+            h->mode = WRITE;
+            h->fd = va_arg(ap, int);
+            h->binary = 1;
+            h->buffer = malloc(MARSHALL_BUFFERSIZE);
+            break;
         case marshall_PRINT:
             h->mode = PRINT;
             h->fp = va_arg(ap, FILE*);
@@ -75,10 +164,22 @@ marshallcreate(enum marshall_method method, ...)
         case marshall_APPEND:
             h->mode = WRITE;
             old = va_arg(ap, marshall_handle);
+            if(old->mode == READ && old->buffer != NULL) {
+                /* position the file after the last consumed member */
+                lseek(old->fd, -(off_t)(old->bufferfill - old->bufferpos), SEEK_CUR);
+                old->bufferfill = old->bufferpos = 0;
+            } else {
+                marshallflush(old);
+            }
             h->fd = old->fd;
             h->fp = old->fp;
+            h->binary = old->binary;
+            h->buffer = old->buffer;
+            h->wire = old->wire;
             old->fd = -1;
             old->fp = NULL;
+            old->buffer = NULL;
+            old->wire = NULL;
             break;
         case marshall_FREE:
             h->mode = FREE;
@@ -96,6 +197,11 @@ marshallclose(marshall_handle h)
 {
     if(!h)
         return;
+    marshallflush(h);
+    free(h->buffer);
+    if (h->wire) {
+        ldns_buffer_free(h->wire);
+    }
     if (h->fp && h->fp != stdout && h->fp != stderr) {
         fclose(h->fp);
     }
@@ -123,11 +229,11 @@ marshallinteger(marshall_handle h, void* member)
         case FREE:
             break;
         case READ:
-            size = read(h->fd, member, sizeof(int));
+            size = marshallread(h, member, sizeof(int));
             assert(size==sizeof(int));
             break;
         case WRITE:
-            size = write(h->fd, member, sizeof(int));
+            size = marshallwrite(h, member, sizeof(int));
             assert(size==sizeof(int));
             break;
         case COUNT:
@@ -152,11 +258,11 @@ marshallint64(marshall_handle h, void* member)
         case FREE:
             break;
         case READ:
-            size = read(h->fd, member, sizeof(int64_t));
+            size = marshallread(h, member, sizeof(int64_t));
             assert(size==sizeof(int64_t));
             break;
         case WRITE:
-            size = write(h->fd, member, sizeof(int64_t));
+            size = marshallwrite(h, member, sizeof(int64_t));
             assert(size==sizeof(int64_t));
             break;
         case COUNT:
@@ -181,10 +287,10 @@ marshallbyte(marshall_handle h, void* member)
         case FREE:
             break;
         case READ:
-            size = read(h->fd, member, 1);
+            size = marshallread(h, member, 1);
             break;
         case WRITE:
-            size = write(h->fd, member, 1);
+            size = marshallwrite(h, member, 1);
             break;
         case COUNT:
             break;
@@ -213,7 +319,7 @@ marshallstring(marshall_handle h, void* member)
             size = marshallinteger(h, &len);
             if(len >= 0) {
                 *str = malloc(len + 1);
-                read(h->fd, *str, sizeof(char)*len);
+                marshallread(h, *str, sizeof(char)*len);
                 (*str)[len] = '\0';
                 size += len;
             } else {
@@ -224,7 +330,7 @@ marshallstring(marshall_handle h, void* member)
             if(*str) {
                 len = strlen(*str);
                 size = marshallinteger(h, &len);
-                write(h->fd, *str, sizeof(char)*len);
+                marshallwrite(h, *str, sizeof(char)*len);
                 size += len;
             } else {
                 len = -1;
@@ -265,6 +371,7 @@ marshallldnsrr(marshall_handle h, void* member)
     ldns_rr** rr = (ldns_rr**)member;
     int size;
     int len;
+    size_t pos;
     char* str;
     switch(h->mode) {
         case COPY:
@@ -275,22 +382,42 @@ marshallldnsrr(marshall_handle h, void* member)
             break;
         case READ:
             size = marshallinteger(h, &len);
-            if(len >= 0) {
+            if(len >= 0 && h->binary) {
+                if(h->wire == NULL)
+                    h->wire = ldns_buffer_new(len);
+                ldns_buffer_clear(h->wire);
+                ldns_buffer_reserve(h->wire, len);
+                marshallread(h, ldns_buffer_begin(h->wire), len);
+                size += len;
+                pos = 0;
+                if(ldns_wire2rr(rr, ldns_buffer_begin(h->wire), len, &pos, LDNS_SECTION_ANSWER) != LDNS_STATUS_OK)
+                    *rr = NULL;
+            } else if(len >= 0) {
                 str = malloc(len + 1);
-                read(h->fd, str, sizeof(char)*len);
+                marshallread(h, str, sizeof(char)*len);
                 str[len] = '\0';
                 size += len;
                 ldns_rr_new_frm_str(rr, str, 0, NULL, NULL);
+                free(str);
             } else {
                 *rr = NULL;
             }
             break;
         case WRITE:
-            if(*rr) {
+            if(*rr && h->binary) {
+                if(h->wire == NULL)
+                    h->wire = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+                ldns_buffer_clear(h->wire);
+                ldns_rr2buffer_wire(h->wire, *rr, LDNS_SECTION_ANSWER);
+                len = ldns_buffer_position(h->wire);
+                size = marshallinteger(h, &len);
+                marshallwrite(h, ldns_buffer_begin(h->wire), len);
+                size += len;
+            } else if(*rr) {
                 str = ldns_rr2str(*rr);
                 len = strlen(str);
                 size = marshallinteger(h, &len);
-                write(h->fd, str, sizeof(char)*len);
+                marshallwrite(h, str, sizeof(char)*len);
                 size += len;
                 free(str);
             } else {
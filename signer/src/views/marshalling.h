@@ -33,11 +33,13 @@ extern "C" {
     
 #include <unistd.h>
 
-enum marshall_method { marshall_INPUT, marshall_OUTPUT, marshall_APPEND, marshall_PRINT, marshall_FREE };
+enum marshall_method { marshall_INPUT, marshall_OUTPUT, marshall_APPEND, marshall_PRINT, marshall_FREE, marshall_BINARYINPUT, marshall_BINARYOUTPUT };
 typedef struct marshall_struct* marshall_handle;
 
 marshall_handle marshallcreate(enum marshall_method method, ...);
 void marshallclose(marshall_handle h);
+int marshallflush(marshall_handle h);
+int marshallreading(marshall_handle h);
 int marshallself(marshall_handle h, void* member);
 int marshallbyte(marshall_handle h, void* member);
 int marshallinteger(marshall_handle h, void* member);
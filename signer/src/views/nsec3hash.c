@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2018 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ldns/ldns.h>
+#include "proto.h"
+
+/* NSEC3 owner name hashing (RFC 5155 section 5) for a group of names at
+ * once.  The SHA-1 compression is computed for NSEC3HASH_LANES independent
+ * messages in lock-step, with the lanes as innermost loop, such that the
+ * compiler can keep the lanes in vector registers.  All messages after the
+ * first iteration have the same length (digest plus salt), so the iterations
+ * never diverge.  No memory is allocated except for the resulting strings.
+ */
+
+#define NSEC3HASH_DIGESTLEN 20
+#define NSEC3HASH_HASHLEN   32
+#define NSEC3HASH_BUFSIZE   576 /* room for a padded 255 octet name plus 255 octet salt */
+
+struct lanes {
+    int nblocks[NSEC3HASH_LANES];
+    uint32_t state[5][NSEC3HASH_LANES];
+    uint8_t message[NSEC3HASH_LANES][NSEC3HASH_BUFSIZE];
+};
+
+#define ROL(x,n) (((x) << (n)) | ((x) >> (32-(n))))
+
+#define SHA1ROUNDS(from, to, f, k) \
+    for(t=from; t<to; t++) { \
+        for(l=0; l<NSEC3HASH_LANES; l++) { \
+            tmp = ROL(a[l], 5) + (f) + e[l] + (k) + w[t][l]; \
+            e[l] = d[l]; \
+            d[l] = c[l]; \
+            c[l] = ROL(bb[l], 30); \
+            bb[l] = a[l]; \
+            a[l] = tmp; \
+        } \
+    }
+
+static void
+sha1init(struct lanes* lanes)
+{
+    int l;
+    for(l=0; l<NSEC3HASH_LANES; l++) {
+        lanes->state[0][l] = 0x67452301;
+        lanes->state[1][l] = 0xEFCDAB89;
+        lanes->state[2][l] = 0x98BADCFE;
+        lanes->state[3][l] = 0x10325476;
+        lanes->state[4][l] = 0xC3D2E1F0;
+    }
+}
+
+static int
+sha1pad(uint8_t* buffer, size_t length)
+{
+    size_t padded;
+    uint64_t bits = ((uint64_t)length) << 3;
+    int i;
+    padded = (length + 1 + 8 + 63) & ~(size_t)63;
+    buffer[length] = 0x80;
+    memset(&buffer[length+1], 0, padded - length - 1 - 8);
+    for(i=0; i<8; i++)
+        buffer[padded-1-i] = (uint8_t)(bits >> (8*i));
+    return padded / 64;
+}
+
+static void
+sha1lanes(struct lanes* lanes)
+{
+    int b, t, l, maxblocks;
+    uint32_t w[80][NSEC3HASH_LANES];
+    uint32_t a[NSEC3HASH_LANES], bb[NSEC3HASH_LANES], c[NSEC3HASH_LANES], d[NSEC3HASH_LANES], e[NSEC3HASH_LANES];
+    uint32_t tmp;
+    const uint8_t* p;
+
+    maxblocks = 0;
+    for(l=0; l<NSEC3HASH_LANES; l++)
+        if(lanes->nblocks[l] > maxblocks)
+            maxblocks = lanes->nblocks[l];
+    for(b=0; b<maxblocks; b++) {
+        for(t=0; t<16; t++) {
+            for(l=0; l<NSEC3HASH_LANES; l++) {
+                p = &lanes->message[l][b*64+t*4];
+                w[t][l] = ((uint32_t)p[0]<<24) | ((uint32_t)p[1]<<16) | ((uint32_t)p[2]<<8) | (uint32_t)p[3];
+            }
+        }
+        for(t=16; t<80; t++) {
+            for(l=0; l<NSEC3HASH_LANES; l++) {
+                tmp = w[t-3][l] ^ w[t-8][l] ^ w[t-14][l] ^ w[t-16][l];
+                w[t][l] = ROL(tmp, 1);
+            }
+        }
+        for(l=0; l<NSEC3HASH_LANES; l++) {
+            a[l]  = lanes->state[0][l];
+            bb[l] = lanes->state[1][l];
+            c[l]  = lanes->state[2][l];
+            d[l]  = lanes->state[3][l];
+            e[l]  = lanes->state[4][l];
+        }
+        SHA1ROUNDS( 0, 20, (bb[l] & c[l]) | (~bb[l] & d[l]), 0x5A827999);
+        SHA1ROUNDS(20, 40, bb[l] ^ c[l] ^ d[l], 0x6ED9EBA1);
+        SHA1ROUNDS(40, 60, (bb[l] & c[l]) | (bb[l] & d[l]) | (c[l] & d[l]), 0x8F1BBCDC);
+        SHA1ROUNDS(60, 80, bb[l] ^ c[l] ^ d[l], 0xCA62C1D6);
+        for(l=0; l<NSEC3HASH_LANES; l++) {
+            if(b < lanes->nblocks[l]) {
+                lanes->state[0][l] += a[l];
+                lanes->state[1][l] += bb[l];
+                lanes->state[2][l] += c[l];
+                lanes->state[3][l] += d[l];
+                lanes->state[4][l] += e[l];
+            }
+        }
+    }
+}
+
+static void
+sha1digest(struct lanes* lanes, int lane, uint8_t* digest)
+{
+    int i;
+    for(i=0; i<5; i++) {
+        digest[i*4+0] = (uint8_t)(lanes->state[i][lane] >> 24);
+        digest[i*4+1] = (uint8_t)(lanes->state[i][lane] >> 16);
+        digest[i*4+2] = (uint8_t)(lanes->state[i][lane] >> 8);
+        digest[i*4+3] = (uint8_t)(lanes->state[i][lane]);
+    }
+}
+
+/* Convert a domain name in presentation format into canonical (lower case)
+ * wire format.  Returns the length of the wire format or -1 if the name
+ * could not be converted.
+ */
+static int
+wirename(const char* name, uint8_t* wire)
+{
+    int len = 0;
+    int labelstart = 0;
+    int labellen = 0;
+    int ch;
+    if(!strcmp(name, ".")) {
+        wire[0] = 0;
+        return 1;
+    }
+    len = 1;
+    while(*name) {
+        if(*name == '.') {
+            if(labellen == 0)
+                return -1;
+            wire[labelstart] = labellen;
+            labelstart = len++;
+            labellen = 0;
+            name++;
+            continue;
+        }
+        if(*name == '\\') {
+            if(name[1] >= '0' && name[1] <= '9' && name[2] >= '0' && name[2] <= '9' && name[3] >= '0' && name[3] <= '9') {
+                ch = (name[1]-'0')*100 + (name[2]-'0')*10 + (name[3]-'0');
+                if(ch > 255)
+                    return -1;
+                name += 4;
+            } else if(name[1]) {
+                ch = (unsigned char) name[1];
+                name += 2;
+            } else
+                return -1;
+        } else {
+            ch = (unsigned char) *name++;
+        }
+        if(ch >= 'A' && ch <= 'Z')
+            ch += 'a' - 'A';
+        if(++labellen > 63 || len >= LDNS_MAX_DOMAINLEN)
+            return -1;
+        wire[len++] = ch;
+    }
+    if(labellen > 0) {
+        wire[labelstart] = labellen;
+        labelstart = len++;
+    }
+    wire[labelstart] = 0;
+    return (len > LDNS_MAX_DOMAINLEN ? -1 : len);
+}
+
+static char*
+hashedname(const uint8_t* digest, const char* apex, size_t apexlen)
+{
+    static const char b32hex[] = "0123456789abcdefghijklmnopqrstuv";
+    char* str;
+    char* s;
+    int i;
+    /* 20 octets of digest are exactly 32 characters in base32 */
+    str = malloc(NSEC3HASH_HASHLEN + 1 + apexlen + 2);
+    s = str;
+    for(i=0; i<NSEC3HASH_DIGESTLEN; i+=5) {
+        *s++ = b32hex[  digest[i+0] >> 3];
+        *s++ = b32hex[((digest[i+0] & 0x07) << 2) | (digest[i+1] >> 6)];
+        *s++ = b32hex[ (digest[i+1] & 0x3e) >> 1];
+        *s++ = b32hex[((digest[i+1] & 0x01) << 4) | (digest[i+2] >> 4)];
+        *s++ = b32hex[((digest[i+2] & 0x0f) << 1) | (digest[i+3] >> 7)];
+        *s++ = b32hex[ (digest[i+3] & 0x7c) >> 2];
+        *s++ = b32hex[((digest[i+3] & 0x03) << 3) | (digest[i+4] >> 5)];
+        *s++ = b32hex[  digest[i+4] & 0x1f];
+    }
+    *s++ = '.';
+    if(apexlen > 0 && strcmp(apex, ".")) {
+        memcpy(s, apex, apexlen);
+        s += apexlen;
+        if(apex[apexlen-1] != '.')
+            *s++ = '.';
+    }
+    *s = '\0';
+    return str;
+}
+
+/**
+ * Compute the NSEC3 hashed owner names of count names, in the same
+ * presentation format as ldns_rdf2str() of the hashed label prepended to
+ * the apex.  The resulting strings are allocated and stored in hashes.
+ * Returns 0 on success, or non-zero when the algorithm is not supported or
+ * a name could not be converted, in which case no hashes are returned.
+ */
+int
+names_nsec3hash(int count, const char** names, char** hashes, const char* apex,
+                int algorithm, int iterations, int saltlen, const uint8_t* salt)
+{
+    struct lanes lanes;
+    uint8_t digest[NSEC3HASH_DIGESTLEN];
+    size_t apexlen;
+    int i, l, n, len, it;
+
+    if(algorithm != LDNS_SHA1 || saltlen > 255)
+        return 1;
+    apexlen = strlen(apex);
+    for(i=0; i<count; i+=NSEC3HASH_LANES) {
+        n = (count - i < NSEC3HASH_LANES ? count - i : NSEC3HASH_LANES);
+        sha1init(&lanes);
+        for(l=0; l<NSEC3HASH_LANES; l++) {
+            if(l < n) {
+                len = wirename(names[i+l], lanes.message[l]);
+                if(len < 0) {
+                    while(--i >= 0)
+                        free(hashes[i]);
+                    return 1;
+                }
+                if(saltlen > 0)
+                    memcpy(&lanes.message[l][len], salt, saltlen);
+                lanes.nblocks[l] = sha1pad(lanes.message[l], len + saltlen);
+            } else
+                lanes.nblocks[l] = 0;
+        }
+        sha1lanes(&lanes);
+        if(iterations > 0) {
+            /* the salt and padding stay in place, only the digest changes */
+            for(l=0; l<n; l++) {
+                sha1digest(&lanes, l, lanes.message[l]);
+                if(saltlen > 0)
+                    memcpy(&lanes.message[l][NSEC3HASH_DIGESTLEN], salt, saltlen);
+                lanes.nblocks[l] = sha1pad(lanes.message[l], NSEC3HASH_DIGESTLEN + saltlen);
+            }
+            for(it=0; it<iterations; it++) {
+                if(it > 0)
+                    for(l=0; l<n; l++)
+                        sha1digest(&lanes, l, lanes.message[l]);
+                sha1init(&lanes);
+                sha1lanes(&lanes);
+            }
+        }
+        for(l=0; l<n; l++) {
+            sha1digest(&lanes, l, digest);
+            hashes[i+l] = hashedname(digest, apex, apexlen);
+        }
+    }
+    return 0;
+}
@@ -32,9 +32,11 @@ typedef struct recordset_struct* recordset_type;
 typedef struct names_index_struct* names_index_type;
 typedef struct names_table_struct* names_table_type;
 typedef struct names_view_struct* names_view_type;
+typedef struct names_arena_struct* names_arena_type;
 
 #include "signer/signconf.h"
 #include "signer/zone.h"
+#include "hsm.h"
 #include "views/marshalling.h"
 #include "logging.h"
 
@@ -139,14 +141,18 @@ struct names_view_zone {
     signconf_type** signconf;
 };
 
-recordset_type names_recordcreate(char**name);
+recordset_type names_recordcreate(char**name, names_arena_type arena);
 recordset_type names_recordcreatetemp(const char*name);
 void names_recordannotate(recordset_type d, struct names_view_zone* zone);
-recordset_type names_recordcopy(recordset_type, int clear);
+void names_recordannotatebatch(recordset_type* records, int count, struct names_view_zone* zone);
+recordset_type names_recordcopy(recordset_type, int clear, names_arena_type arena);
 void names_recorddispose(recordset_type);
 void names_recorddisposal(recordset_type record, int doit);
 const char* names_recordgetname(recordset_type dict);
 int names_recordgetrevision(recordset_type dict);
+int names_recordgetcuts(recordset_type record);
+ldns_rr_type names_recordgetauthority(recordset_type record, long stamp);
+void names_recordsetauthority(recordset_type record, long stamp, ldns_rr_type status);
 const char *names_recordgetsummary(recordset_type dict, char**);
 const char* names_recordgetdenial(recordset_type dict);
 int names_recordcompare_namerevision(recordset_type a, recordset_type b);
@@ -157,6 +163,7 @@ void names_recorddelall(recordset_type, ldns_rr_type rrtype);
 names_iterator names_recordalltypes(recordset_type);
 names_iterator names_recordallvalues(recordset_type, ldns_rr_type rrtype);
 names_iterator names_recordallvaluestrings(recordset_type d, ldns_rr_type rrtype);
+void names_recordprint(recordset_type d, ldns_buffer* buffer);
 int names_recordvalidupto(recordset_type, int*);
 int names_recordgetvalidupto(recordset_type);
 int names_recordvalidfrom(recordset_type, int*);
@@ -180,8 +187,15 @@ struct dual {
 };
 
 int names_indexcreate(names_index_type*, const char* keyname);
+names_index_type names_indexclone(names_index_type);
+const char* names_indexkeyname(names_index_type);
+int names_indexaccept(names_index_type, recordset_type);
+int names_indexcount(names_index_type);
+int names_indexshared(names_index_type, names_index_type);
+void names_indexstatistics(long* nodes, size_t* nodesize);
 recordset_type names_indexlookup(names_index_type, recordset_type);
 recordset_type names_indexlookupnext(names_index_type index, recordset_type find);
+recordset_type names_indexlookupprevious(names_index_type index, recordset_type find);
 recordset_type names_indexlookupkey(names_index_type, const char* keyvalue);
 int names_indexremove(names_index_type, recordset_type);
 int names_indexremovekey(names_index_type,const char* keyvalue);
@@ -209,16 +223,18 @@ names_iterator names_tableitems(names_table_type table);
  */
 
 typedef struct names_commitlog_struct* names_commitlog_type;
+typedef struct names_commitcursor_struct* names_commitcursor_type;
 
 void names_commitlogdestroy(names_table_type changelog);
 void names_commitlogdestroyfull(names_table_type changelog);
 void names_commitlogdestroyall(names_commitlog_type views, marshall_handle* store);
-int names_commitlogpoppush(names_commitlog_type, int viewid, names_table_type* previous, names_table_type* mychangelog);
-int names_commitlogsubscribe(names_view_type view, names_commitlog_type*);
-void names_commitlogunsubscribe(int viewid, names_commitlog_type commitlogptr);
+int names_commitlogreplay(names_commitlog_type, names_commitcursor_type cursor, names_table_type* previous, names_table_type* mychangelog);
+int names_commitlogsubscribe(names_view_type view, names_commitlog_type*, names_commitcursor_type* cursor);
+void names_commitlogunsubscribe(names_commitcursor_type cursor, names_commitlog_type commitlogptr);
+void names_commitlogstats(names_commitlog_type, names_commitcursor_type cursor, long* lag, long* maxlag, long* nsegments);
 void names_commitlogpersistincr(names_commitlog_type, names_table_type changelog);
 void names_commitlogpersistappend(names_commitlog_type, void (*persistfn)(names_table_type, marshall_handle), marshall_handle store);
-int names_commitlogpersistfull(names_commitlog_type, void (*persistfn)(names_table_type, marshall_handle), int viewid, marshall_handle store, marshall_handle* oldstore);
+int names_commitlogpersistfull(names_commitlog_type, void (*persistfn)(names_table_type, marshall_handle), names_commitcursor_type cursor, marshall_handle store, marshall_handle* oldstore);
 
 void names_own(names_view_type view, recordset_type* record);
 void names_underwrite(names_view_type view, recordset_type* record);
@@ -249,7 +265,16 @@ names_iterator names_iteratorchanges(names_index_type index, va_list ap);
 names_iterator names_iteratoroutdated(names_index_type index, va_list ap);
 
 int names_viewcommit(names_view_type view);
+int names_viewpending(names_view_type view, recordset_type** records);
+void names_viewannotate(names_view_type view, recordset_type* records, int count);
 void names_viewreset(names_view_type view);
+names_iterator names_viewdirtyrecords(names_view_type view, int* count);
+names_iterator names_viewexcludedrecords(names_view_type view);
+names_iterator names_viewdirtydenialchain(names_view_type view, int* count);
+names_arena_type names_viewarena(names_view_type view);
+long names_viewindexentries(names_view_type view);
+long names_viewcutstamp(names_view_type view);
+recordset_type names_viewparent(names_view_type view, recordset_type record);
 int names_viewpersist(names_view_type view, int basefd, char* filename);
 int names_viewconfig(names_view_type view, signconf_type** signconf);
 int names_viewrestore(names_view_type view, const char* apex, int basefd, const char* filename);
@@ -269,16 +294,38 @@ void names__dumpindex(FILE* fp, names_index_type index);
 void writerecordcontent(recordset_type domainitem, FILE* fp);
 void writezonecontent(names_view_type view, FILE* fp);
 void writezoneapex(names_view_type view, FILE* fp);
-int writezone(names_view_type view, const char* filename);
+void writerrwire(ldns_rr* rr, ldns_buffer* wire, FILE* fp);
+void writerecordwire(recordset_type domainitem, ldns_buffer* wire, FILE* fp);
+void writezonewire(names_view_type view, FILE* fp);
+int writezone(names_view_type view, const char* filename, int nthreads);
 enum operation_enum { PLAIN, DELTAMINUS, DELTAPLUS };
 int readzone(names_view_type view, enum operation_enum operation, const char* filename, char** apexptr, int* defaultttlptr);
 void purgezone(zone_type* zone);
 
+/* Blocks up to this size are carved out of the chunks of an arena, larger
+ * ones are allocated individually.
+ */
+#define NAMES_ARENA_MAXBLOCK 512
+names_arena_type names_arenacreate(void);
+void names_arenadestroy(names_arena_type arena);
+void* names_arenaalloc(names_arena_type arena, size_t size);
+void names_arenafree(names_arena_type arena, void* ptr, size_t size);
+void* names_arenarealloc(names_arena_type arena, void* ptr, size_t oldsize, size_t newsize);
+char* names_arenastrdup(names_arena_type arena, const char* str);
+void names_arenastatistics(names_arena_type arena, size_t* reserved, size_t* inuse);
+
+#define NSEC3HASH_LANES 8
+int names_nsec3hash(int count, const char** names, char** hashes, const char* apex, int algorithm, int iterations, int saltlen, const uint8_t* salt);
+
 ldns_rr_type domain_is_occluded(names_view_type view, recordset_type record);
 ldns_rr_type domain_is_delegpt(names_view_type view, recordset_type record);
 ldns_rr* denial_nsecify(signconf_type* signconf, names_view_type view, recordset_type domain, ldns_rdf* nxt); // FIXME rename
 ods_status namedb_update_serial(zone_type* globalzone);
 ods_status rrset_sign(signconf_type* signconf, names_view_type view, recordset_type domain, ldns_rr_type rrtype, hsm_ctx_t* ctx, time_t signtime);
+ods_status rrset_signall(signconf_type* signconf, names_view_type view, recordset_type domain, hsm_ctx_t* ctx, time_t signtime);
+struct rrset_signbatch* rrset_signprepare(signconf_type* signconf, names_view_type view, recordset_type domain, time_t signtime, ods_status* status);
+int rrset_signjobs(struct rrset_signbatch* batch, lhsm_signjob_type** jobs);
+ods_status rrset_signfinish(struct rrset_signbatch* batch, recordset_type domain);
 ods_status rrset_getliteralrr(ldns_rr** dnskey, const char *resourcerecord, uint32_t ttl, ldns_rdf* apex);
 ods_status namedb_domain_entize(names_view_type view, recordset_type domain, ldns_rdf* dname, ldns_rdf* apex);
 
@@ -47,7 +47,12 @@ struct itemset {
     struct signatures_struct* signatures;
 };
 
+/* The members of a record are allocated from the arena of the views it is
+ * part of.  Records without arena, such as temporary records and records
+ * read back from a persisted state, use plain malloc.
+ */
 struct recordset_struct {
+    names_arena_type arena;
     char* name;
     int revision;
     int marker;
@@ -59,10 +64,11 @@ struct recordset_struct {
     int64_t* expiry;
     int nitemsets;
     struct itemset* itemsets;
+    volatile uint64_t authority;
 };
 
 static void
-disposesignature(struct signatures_struct** signatures)
+disposesignature(names_arena_type arena, struct signatures_struct** signatures)
 {
     int i;
     if(*signatures) {
@@ -70,21 +76,55 @@ disposesignature(struct signatures_struct** signatures)
             free((void*)(*signatures)->sigs[i].keylocator);
             ldns_rr_free((*signatures)->sigs[i].rr);
         }
-        free((*signatures)->sigs);
-        free((*signatures));
+        names_arenafree(arena, (*signatures)->sigs, sizeof(struct signature_struct) * (*signatures)->nsigs);
+        names_arenafree(arena, *signatures, sizeof(struct signatures_struct));
         *signatures = NULL;
     }
 }
 
-void
-disposeitemset(struct itemset* itemset)
+static void
+disposeitemset(names_arena_type arena, struct itemset* itemset)
 {
     int j;
     for(j=0; j<itemset->nitems; j++) {
         ldns_rr_free(itemset->items[j].rr);
     }
-    free(itemset->items);
-    disposesignature(&(itemset->signatures));
+    names_arenafree(arena, itemset->items, sizeof(struct item) * itemset->nitems);
+    disposesignature(arena, &(itemset->signatures));
+}
+
+static void
+disposestring(names_arena_type arena, char* str)
+{
+    if(str)
+        names_arenafree(arena, str, strlen(str) + 1);
+}
+
+/* Take over a string allocated using malloc into the arena of the record. */
+static char*
+adoptstring(recordset_type d, char* str)
+{
+    char* dup;
+    if(d->arena == NULL || str == NULL)
+        return str;
+    dup = names_arenastrdup(d->arena, str);
+    free(str);
+    return dup;
+}
+
+static void
+addsignature(names_arena_type arena, struct signatures_struct** signatures, ldns_rr* rrsig, const char* keylocator, int keyflags)
+{
+    if(!*signatures) {
+        *signatures = names_arenaalloc(arena, sizeof(struct signatures_struct));
+        (*signatures)->nsigs = 0;
+        (*signatures)->sigs = NULL;
+    }
+    (*signatures)->sigs = names_arenarealloc(arena, (*signatures)->sigs, sizeof(struct signature_struct) * (*signatures)->nsigs, sizeof(struct signature_struct) * ((*signatures)->nsigs + 1));
+    (*signatures)->sigs[(*signatures)->nsigs].rr = rrsig;
+    (*signatures)->sigs[(*signatures)->nsigs].keylocator = keylocator;
+    (*signatures)->sigs[(*signatures)->nsigs].keyflags = keyflags;
+    (*signatures)->nsigs += 1;
 }
 
 void
@@ -95,27 +135,9 @@ names_recordaddsignature(recordset_type d, ldns_rr_type rrtype, ldns_rr* rrsig,
         if(rrtype == d->itemsets[i].rrtype)
             break;
     if (i<d->nitemsets) {
-        if(!d->itemsets[i].signatures) {
-            d->itemsets[i].signatures = malloc(sizeof(struct signatures_struct));
-            d->itemsets[i].signatures->nsigs = 0;
-            d->itemsets[i].signatures->sigs = NULL;
-        }
-        d->itemsets[i].signatures->nsigs += 1;
-        d->itemsets[i].signatures->sigs = realloc(d->itemsets[i].signatures->sigs, sizeof(struct signature_struct) * d->itemsets[i].signatures->nsigs);
-        d->itemsets[i].signatures->sigs[d->itemsets[i].signatures->nsigs-1].rr = rrsig;
-        d->itemsets[i].signatures->sigs[d->itemsets[i].signatures->nsigs-1].keylocator = keylocator;
-        d->itemsets[i].signatures->sigs[d->itemsets[i].signatures->nsigs-1].keyflags = keyflags;
+        addsignature(d->arena, &d->itemsets[i].signatures, rrsig, keylocator, keyflags);
     } else if(rrtype == LDNS_RR_TYPE_NSEC || rrtype == LDNS_RR_TYPE_NSEC3) {
-        if(!d->spansignatures) {
-            d->spansignatures = malloc(sizeof(struct signatures_struct));
-            d->spansignatures->nsigs = 0;
-            d->spansignatures->sigs = NULL;            
-        }
-        d->spansignatures->nsigs += 1;
-        d->spansignatures->sigs = realloc(d->spansignatures->sigs, sizeof(struct signature_struct) * d->spansignatures->nsigs);
-        d->spansignatures->sigs[d->spansignatures->nsigs-1].rr = rrsig;
-        d->spansignatures->sigs[d->spansignatures->nsigs-1].keylocator = keylocator;
-        d->spansignatures->sigs[d->spansignatures->nsigs-1].keyflags = keyflags;
+        addsignature(d->arena, &d->spansignatures, rrsig, keylocator, keyflags);
     }
 }
 
@@ -133,10 +155,11 @@ names_recordcompare_namerevision(recordset_type a, recordset_type b)
 }
 
 static recordset_type
-recordcreate()
+recordcreate(names_arena_type arena)
 {
     struct recordset_struct* dict;
-    dict = malloc(sizeof(struct recordset_struct));
+    dict = names_arenaalloc(arena, sizeof(struct recordset_struct));
+    dict->arena = arena;
     dict->nitemsets = 0;
     dict->itemsets = NULL;
     dict->spanhash = NULL;
@@ -146,16 +169,17 @@ recordcreate()
     dict->validfrom = NULL;
     dict->expiry = NULL;
     dict->marker = 0;
+    dict->authority = 0;
     return dict;
 }
 
 recordset_type
-names_recordcreate(char** name)
+names_recordcreate(char** name, names_arena_type arena)
 {
     struct recordset_struct* dict;
-    dict = recordcreate();
+    dict = recordcreate(arena);
     if (name) {
-        dict->name = *name = ((*name) ? strdup(*name) : NULL);
+        dict->name = *name = ((*name) ? names_arenastrdup(arena, *name) : NULL);
     } else {
         dict->name = NULL;
     }
@@ -167,35 +191,45 @@ recordset_type
 names_recordcreatetemp(const char* name)
 {
     recordset_type dict;
-    dict = recordcreate();
+    dict = recordcreate(NULL);
     dict->name = (name ? strdup(name) : NULL);
     dict->revision = 0;
     return dict;
 }
 
+static void
+annotatensec3(recordset_type d, struct names_view_zone* zone, nsec3params_type* n3p)
+{
+    ldns_rdf* dname;
+    ldns_rdf* apex;
+    ldns_rdf* hashed_label;
+    ldns_rdf* hashed_ownername;
+    const char* name = d->name;
+    if(names_nsec3hash(1, &name, &d->spanhash, zone->apex, n3p->algorithm, n3p->iterations, n3p->salt_len, n3p->salt_data) == 0) {
+        d->spanhash = adoptstring(d, d->spanhash);
+        return;
+    }
+    dname = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, d->name);
+    apex = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, zone->apex);
+    /*
+     * The owner name of the NSEC3 RR is the hash of the original owner
+     * name, prepended as a single label to the zone name.
+     */
+    hashed_label = ldns_nsec3_hash_name(dname, n3p->algorithm, n3p->iterations, n3p->salt_len, n3p->salt_data);
+    hashed_ownername = ldns_dname_cat_clone(hashed_label, apex);
+    d->spanhash = adoptstring(d, ldns_rdf2str(hashed_ownername));
+    ldns_rdf_deep_free(hashed_ownername);
+    ldns_rdf_deep_free(hashed_label);
+    ldns_rdf_deep_free(apex);
+    ldns_rdf_deep_free(dname);
+}
+
 void
 names_recordannotate(recordset_type d, struct names_view_zone* zone)
 {
     if(zone) {
         if(zone->signconf && *(zone->signconf) && (*(zone->signconf))->nsec3params) {
-            nsec3params_type* n3p = (*zone->signconf)->nsec3params;
-            ldns_rdf* dname;
-            ldns_rdf* apex;
-            ldns_rdf* hashed_label;
-            ldns_rdf* hashed_ownername;
-            dname = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, d->name);
-            apex = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, zone->apex);
-            /*
-             * The owner name of the NSEC3 RR is the hash of the original owner
-             * name, prepended as a single label to the zone name.
-             */
-            hashed_label = ldns_nsec3_hash_name(dname, n3p->algorithm, n3p->iterations, n3p->salt_len, n3p->salt_data);
-            hashed_ownername = ldns_dname_cat_clone(hashed_label, apex);
-            d->spanhash = ldns_rdf2str(hashed_ownername);
-            ldns_rdf_deep_free(hashed_ownername);
-            ldns_rdf_deep_free(hashed_label);
-            ldns_rdf_deep_free(apex);
-            ldns_rdf_deep_free(dname);
+            annotatensec3(d, zone, (*zone->signconf)->nsec3params);
         } else {
             /* ldns_rdf* rdf;
              * ldns_rdf* revrdf;
@@ -208,7 +242,7 @@ names_recordannotate(recordset_type d, struct names_view_zone* zone)
              */
             int i, j, end, len, l;
             end = len = strlen(d->name);
-            d->spanhash = malloc(len+1);
+            d->spanhash = names_arenaalloc(d->arena, len+1);
             d->spanhash[end--] = '\0';
             for (i=0; i<len; ) {
                 for (j=0; d->name[i+j]; j++) {
@@ -227,8 +261,7 @@ names_recordannotate(recordset_type d, struct names_view_zone* zone)
             }
         }
     } else {
-        if(d->spanhash)
-            free(d->spanhash);
+        disposestring(d->arena, d->spanhash);
         if(d->spanhashrr)
             ldns_rr_free(d->spanhashrr);
         d->spanhash = NULL;
@@ -236,41 +269,81 @@ names_recordannotate(recordset_type d, struct names_view_zone* zone)
     }
 }
 
+/* Annotate a number of records at once.  With NSEC3 the hashes of the
+ * records are computed together per group of NSEC3HASH_LANES names.
+ * Records which are already annotated are skipped.
+ */
+void
+names_recordannotatebatch(recordset_type* records, int count, struct names_view_zone* zone)
+{
+    nsec3params_type* n3p;
+    recordset_type group[NSEC3HASH_LANES];
+    const char* names[NSEC3HASH_LANES];
+    char* hashes[NSEC3HASH_LANES];
+    int i, j, n;
+    if(zone == NULL || !(zone->signconf && *(zone->signconf) && (*(zone->signconf))->nsec3params)) {
+        for(i=0; i<count; i++)
+            if(zone == NULL || records[i]->spanhash == NULL)
+                names_recordannotate(records[i], zone);
+        return;
+    }
+    n3p = (*zone->signconf)->nsec3params;
+    for(i=0, n=0; i<=count; i++) {
+        if(i < count) {
+            if(records[i]->spanhash != NULL)
+                continue;
+            group[n] = records[i];
+            names[n] = records[i]->name;
+            ++n;
+        }
+        if(n == NSEC3HASH_LANES || (i == count && n > 0)) {
+            if(names_nsec3hash(n, names, hashes, zone->apex, n3p->algorithm, n3p->iterations, n3p->salt_len, n3p->salt_data) == 0) {
+                for(j=0; j<n; j++)
+                    group[j]->spanhash = adoptstring(group[j], hashes[j]);
+            } else {
+                for(j=0; j<n; j++)
+                    annotatensec3(group[j], zone, n3p);
+            }
+            n = 0;
+        }
+    }
+}
+
 recordset_type
-names_recordcopy(recordset_type dict, int clear)
+names_recordcopy(recordset_type dict, int clear, names_arena_type arena)
 {
     int i, j;
     struct recordset_struct* target;
     char* name = dict->name;
-    target = (struct recordset_struct*) names_recordcreate(&name);
+    target = (struct recordset_struct*) names_recordcreate(&name, arena);
     target->revision = dict->revision + 1;
     target->nitemsets = dict->nitemsets;
-    CHECKALLOC(target->itemsets = malloc(sizeof(struct itemset) * target->nitemsets));
+    target->itemsets = (target->nitemsets > 0 ? names_arenaalloc(arena, sizeof(struct itemset) * target->nitemsets) : NULL);
     for(i=0; i<target->nitemsets; i++) {
         target->itemsets[i].rrtype = dict->itemsets[i].rrtype;
         target->itemsets[i].nitems = dict->itemsets[i].nitems;
-        target->itemsets[i].items = malloc(sizeof(struct item) * dict->itemsets[i].nitems);
+        target->itemsets[i].items = names_arenaalloc(arena, sizeof(struct item) * dict->itemsets[i].nitems);
         target->itemsets[i].signatures = NULL;
         for(j=0; j<dict->itemsets[i].nitems; j++) {
             target->itemsets[i].items[j].rr = ldns_rr_clone(dict->itemsets[i].items[j].rr);
         }
     }
-    target->spanhash = (dict->spanhash ? strdup(dict->spanhash) : NULL);
+    target->spanhash = (dict->spanhash ? names_arenastrdup(arena, dict->spanhash) : NULL);
     target->spanhashrr = (dict->spanhashrr ? ldns_rr_clone(dict->spanhashrr) : NULL);
-    disposesignature(&target->spansignatures);
+    disposesignature(arena, &target->spansignatures);
     if(clear == 0) {
         if(dict->expiry) {
-            target->expiry = malloc(sizeof(int64_t));
+            target->expiry = names_arenaalloc(arena, sizeof(int64_t));
             *(target->expiry) = *(dict->expiry);
         } else
             target->expiry = NULL;
         if(dict->validfrom) {
-            target->validfrom = malloc(sizeof(int));
+            target->validfrom = names_arenaalloc(arena, sizeof(int));
             *(target->validfrom) = *(dict->validfrom);
         } else
             target->validfrom = NULL;
         if(dict->validupto) {
-            target->validupto = malloc(sizeof(int));
+            target->validupto = names_arenaalloc(arena, sizeof(int));
             *(target->validupto) = *(dict->validupto);
         } else
             target->validupto = NULL;
@@ -321,8 +394,8 @@ names_recordadddata(recordset_type d, ldns_rr* rr)
         if(rrtype == d->itemsets[i].rrtype)
             break;
     if (i==d->nitemsets) {
+        d->itemsets = names_arenarealloc(d->arena, d->itemsets, sizeof(struct itemset) * d->nitemsets, sizeof(struct itemset) * (d->nitemsets + 1));
         d->nitemsets += 1;
-        CHECKALLOC(d->itemsets = realloc(d->itemsets, sizeof(struct itemset) * d->nitemsets));
         d->itemsets[i].rrtype = rrtype;
         d->itemsets[i].items = NULL;
         d->itemsets[i].nitems = 0;
@@ -332,8 +405,8 @@ names_recordadddata(recordset_type d, ldns_rr* rr)
         if(!ldns_rr_compare(rr, d->itemsets[i].items[j].rr))
             break;
     if (j==d->itemsets[i].nitems) {
+        d->itemsets[i].items = names_arenarealloc(d->arena, d->itemsets[i].items, sizeof(struct item) * d->itemsets[i].nitems, sizeof(struct item) * (d->itemsets[i].nitems + 1));
         d->itemsets[i].nitems += 1;
-        d->itemsets[i].items = realloc(d->itemsets[i].items, sizeof(struct item) * d->itemsets[i].nitems);
         d->itemsets[i].items[j].rr = ldns_rr_clone(rr);
     }
 }
@@ -357,36 +430,28 @@ names_recorddeldata(recordset_type d, ldns_rr_type rrtype, ldns_rr* rr)
                     d->itemsets[i].items[j] = d->itemsets[i].items[j+1];
                 }
                 if(d->itemsets[i].nitems > 0) {
-                    d->itemsets[i].items = realloc(d->itemsets[i].items, sizeof(struct item) * d->itemsets[i].nitems);
+                    d->itemsets[i].items = names_arenarealloc(d->arena, d->itemsets[i].items, sizeof(struct item) * (d->itemsets[i].nitems + 1), sizeof(struct item) * d->itemsets[i].nitems);
                 } else {
-                    free(d->itemsets[i].items);
+                    names_arenafree(d->arena, d->itemsets[i].items, sizeof(struct item));
                     d->itemsets[i].items = NULL;
+                    disposesignature(d->arena, &d->itemsets[i].signatures);
                     d->nitemsets -= 1;
                     for(; i<d->nitemsets; i++)
                         d->itemsets[i] = d->itemsets[i+1];
-                    if(d->nitemsets > 0) {
-                        CHECKALLOC(d->itemsets = realloc(d->itemsets, sizeof(struct itemset) * d->nitemsets));
-                    } else {
-                        free(d->itemsets);
-                        d->itemsets = NULL;
-                    }
+                    d->itemsets = names_arenarealloc(d->arena, d->itemsets, sizeof(struct itemset) * (d->nitemsets + 1), sizeof(struct itemset) * d->nitemsets);
                 }
             }
         } else {
             for(j=0; j<d->itemsets[i].nitems; j++) {
                 ldns_rr_free(d->itemsets[i].items[j].rr);
             }
-            free(d->itemsets[i].items);
+            names_arenafree(d->arena, d->itemsets[i].items, sizeof(struct item) * d->itemsets[i].nitems);
             d->itemsets[i].items = NULL;
+            disposesignature(d->arena, &d->itemsets[i].signatures);
             d->nitemsets -= 1;
             for(; i<d->nitemsets; i++)
                 d->itemsets[i] = d->itemsets[i+1];
-            if(d->nitemsets > 0) {
-                CHECKALLOC(d->itemsets = realloc(d->itemsets, sizeof(struct itemset) * d->nitemsets));
-            } else {
-                free(d->itemsets);
-                d->itemsets = NULL;
-            }
+            d->itemsets = names_arenarealloc(d->arena, d->itemsets, sizeof(struct itemset) * (d->nitemsets + 1), sizeof(struct itemset) * d->nitemsets);
         }
     }
 }
@@ -397,13 +462,13 @@ names_recorddelall(recordset_type d, ldns_rr_type rrtype)
     int i, j;
     for(i=0; i<d->nitemsets; i++) {
         if(rrtype==0 || d->itemsets[i].rrtype == rrtype) {
-            disposeitemset(&(d->itemsets[i]));
+            disposeitemset(d->arena, &(d->itemsets[i]));
             if(rrtype != 0)
                 break;
         }
     }
     if(rrtype == 0) {
-        free(d->itemsets);
+        names_arenafree(d->arena, d->itemsets, sizeof(struct itemset) * d->nitemsets);
         d->itemsets = NULL;
         d->nitemsets = 0;
     } else if(i<d->nitemsets) {
@@ -411,14 +476,7 @@ names_recorddelall(recordset_type d, ldns_rr_type rrtype)
         d->nitemsets -= 1;
         for (; i < d->nitemsets; i++)
             d->itemsets[i] = d->itemsets[i + 1];
-        if (d->nitemsets > 0) {
-            CHECKALLOC(d->itemsets = realloc(d->itemsets, sizeof (struct itemset) * d->nitemsets));
-        } else {
-            for(i=0; i<d->nitemsets; i++)
-                disposeitemset(&(d->itemsets[i]));
-            free(d->itemsets);
-            d->itemsets = NULL;
-        }        
+        d->itemsets = names_arenarealloc(d->arena, d->itemsets, sizeof(struct itemset) * (d->nitemsets + 1), sizeof(struct itemset) * d->nitemsets);
     }
 }
 
@@ -483,6 +541,98 @@ names_recordallvaluestrings(recordset_type d, ldns_rr_type rrtype)
     }
 }
 
+static void
+names_recordprintrr(ldns_buffer* buffer, ldns_rr* rr)
+{
+    size_t position = ldns_buffer_position(buffer);
+    if (ldns_rr2buffer_str_fmt(buffer, ldns_output_format_default, rr) != LDNS_STATUS_OK) {
+        /* same as ldns_rr2str returning NULL, the record is left out */
+        ldns_buffer_set_position(buffer, position);
+    }
+}
+
+/* Print all records of the domain in zone file presentation format into
+ * the buffer.  The output is identical to the concatenation of the strings
+ * produced by names_recordallvaluestrings for all types followed by the
+ * NSEC(3) record, but avoids the intermediate string allocations.  The apex
+ * SOA record is left out, as the zone file writer places it itself.
+ */
+static void
+names_recordprintitemset(ldns_buffer* buffer, struct itemset* itemset, int skip)
+{
+    int j;
+    for(j=0; j<itemset->nitems; j++) {
+        if(skip > 0)
+            --skip;
+        else
+            names_recordprintrr(buffer, itemset->items[j].rr);
+    }
+    if(itemset->signatures) {
+        for(j=0; j<itemset->signatures->nsigs; j++) {
+            if(skip > 0)
+                --skip;
+            else
+                names_recordprintrr(buffer, itemset->signatures->sigs[j].rr);
+        }
+    }
+}
+
+void
+names_recordprint(recordset_type d, ldns_buffer* buffer)
+{
+    int i, j;
+    for(i=0; i<d->nitemsets; i++) {
+        names_recordprintitemset(buffer, &d->itemsets[i], (d->itemsets[i].rrtype == LDNS_RR_TYPE_SOA ? 1 : 0));
+    }
+    for(i=0; i<d->nitemsets; i++) {
+        if(d->itemsets[i].rrtype == LDNS_RR_TYPE_NSEC)
+            break;
+    }
+    if(i<d->nitemsets) {
+        names_recordprintitemset(buffer, &d->itemsets[i], 0);
+    } else {
+        names_recordprintrr(buffer, d->spanhashrr);
+        if(d->spansignatures) {
+            for(j=0; j<d->spansignatures->nsigs; j++) {
+                names_recordprintrr(buffer, d->spansignatures->sigs[j].rr);
+            }
+        }
+    }
+}
+
+names_iterator
+names_recordallvalues(recordset_type d, ldns_rr_type rrtype)
+{
+    int i, j;
+    names_iterator iter;
+    for(i=0; i<d->nitemsets; i++) {
+        if(rrtype == d->itemsets[i].rrtype)
+            break;
+    }
+    if(i<d->nitemsets) {
+        iter = names_iterator_createrefs(NULL);
+        for(j=0; j<d->itemsets[i].nitems; j++) {
+            names_iterator_addptr(iter, d->itemsets[i].items[j].rr);
+        }
+        if(d->itemsets[i].signatures) {
+            for(j=0; j<d->itemsets[i].signatures->nsigs; j++) {
+                names_iterator_addptr(iter, d->itemsets[i].signatures->sigs[j].rr);
+            }
+        }
+        return iter;
+    } else if((rrtype == LDNS_RR_TYPE_NSEC || rrtype == LDNS_RR_TYPE_NSEC3) && d->spanhashrr) {
+        iter = names_iterator_createrefs(NULL);
+        names_iterator_addptr(iter, d->spanhashrr);
+        if(d->spansignatures) {
+            for(j=0; j<d->spansignatures->nsigs; j++) {
+                names_iterator_addptr(iter, d->spansignatures->sigs[j].rr);
+            }
+        }
+        return iter;
+    }
+    return NULL;
+}
+
 void
 names_recorddispose(recordset_type dict)
 {
@@ -491,20 +641,20 @@ names_recorddispose(recordset_type dict)
         for(j=0; j<dict->itemsets[i].nitems; j++) {
             ldns_rr_free(dict->itemsets[i].items[j].rr);
         }
-        disposesignature(&dict->itemsets[i].signatures);
-        free(dict->itemsets[i].items);
+        disposesignature(dict->arena, &dict->itemsets[i].signatures);
+        names_arenafree(dict->arena, dict->itemsets[i].items, sizeof(struct item) * dict->itemsets[i].nitems);
     }
-    free(dict->itemsets);
-    free(dict->name);
-    free(dict->spanhash);
+    names_arenafree(dict->arena, dict->itemsets, sizeof(struct itemset) * dict->nitemsets);
+    disposestring(dict->arena, dict->name);
+    disposestring(dict->arena, dict->spanhash);
     if(dict->spanhashrr) {
         ldns_rr_free(dict->spanhashrr);
     }
-    disposesignature(&dict->spansignatures);
-    free(dict->validupto);
-    free(dict->validfrom);
-    free(dict->expiry);
-    free(dict);
+    disposesignature(dict->arena, &dict->spansignatures);
+    names_arenafree(dict->arena, dict->validupto, sizeof(int));
+    names_arenafree(dict->arena, dict->validfrom, sizeof(int));
+    names_arenafree(dict->arena, dict->expiry, sizeof(int64_t));
+    names_arenafree(dict->arena, dict, sizeof(struct recordset_struct));
 }
 
 void
@@ -530,6 +680,55 @@ names_recordgetrevision(recordset_type record)
     return record->revision;
 }
 
+/* Returns which of the SOA, NS and DNAME RRsets, that determine the
+ * authority of the names below it, are present for the record.
+ */
+int
+names_recordgetcuts(recordset_type record)
+{
+    int i, cuts = 0;
+    if(!record)
+        return 0;
+    for(i=0; i<record->nitemsets; i++) {
+        if(record->itemsets[i].nitems > 0) {
+            switch(record->itemsets[i].rrtype) {
+                case LDNS_RR_TYPE_SOA:
+                    cuts |= 1;
+                    break;
+                case LDNS_RR_TYPE_NS:
+                    cuts |= 2;
+                    break;
+                case LDNS_RR_TYPE_DNAME:
+                    cuts |= 4;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    return cuts;
+}
+
+/* The authority status of a record is cached in the record together with
+ * the cut stamp of the view it was computed for, in a single word such
+ * that views sharing the record can read and replace it concurrently.
+ * Returns LDNS_RR_TYPE_FIRST if no status is cached for the stamp.
+ */
+ldns_rr_type
+names_recordgetauthority(recordset_type record, long stamp)
+{
+    uint64_t authority = record->authority;
+    if((authority >> 16) != (uint64_t)stamp)
+        return LDNS_RR_TYPE_FIRST;
+    return (ldns_rr_type)(authority & 0xffff);
+}
+
+void
+names_recordsetauthority(recordset_type record, long stamp, ldns_rr_type status)
+{
+    record->authority = ((uint64_t)stamp << 16) | (uint64_t)status;
+}
+
 const char *
 names_recordgetsummary(recordset_type dict, char** dest)
 {
@@ -565,7 +764,7 @@ void
 names_recordsetvalidupto(recordset_type record, int value)
 {
     assert(record->validupto == NULL);
-    record->validupto = malloc(sizeof(int));
+    record->validupto = names_arenaalloc(record->arena, sizeof(int));
     *(record->validupto) = value;
 }
 
@@ -581,7 +780,7 @@ void
 names_recordsetvalidfrom(recordset_type record, int value)
 {
     assert(record->validfrom == NULL);
-    record->validfrom = malloc(sizeof(int));
+    record->validfrom = names_arenaalloc(record->arena, sizeof(int));
     *(record->validfrom) = value;
 }
 
@@ -618,7 +817,7 @@ void
 names_recordsetexpiry(recordset_type record, int64_t value)
 {
     assert(record->expiry == NULL);
-    record->expiry = malloc(sizeof(int64_t));
+    record->expiry = names_arenaalloc(record->arena, sizeof(int64_t));
     *(record->expiry) = value;
 }
 
@@ -628,6 +827,8 @@ marshall(marshall_handle h, void* ptr)
     recordset_type d = ptr;
     int size = 0;
     int i, j;
+    if(marshallreading(h))
+        d->arena = NULL;
     size += marshalling(h, "name", &(d->name), NULL, 0, marshallstring);
     size += marshalling(h, "marker", &(d->marker), NULL, 0, marshallinteger);
     size += marshalling(h, "revision", &(d->revision), NULL, 0, marshallinteger);
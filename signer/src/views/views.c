@@ -38,6 +38,7 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
 #include <ldns/ldns.h>
 #include "uthash.h"
 #include "utilities.h"
@@ -61,6 +62,17 @@ struct searchfunc {
     names_indexrange_func search;
 };
 
+/* The indices of the last view created of some kind, together with the
+ * state of the base view at that time.  As long as the base view did not
+ * change, another view of the same kind can share them.
+ */
+struct viewtemplate {
+    const char* viewname;
+    names_index_type baseindex;
+    int nindices;
+    names_index_type* indices;
+};
+
 struct names_view_struct {
     const char* viewname;
     names_view_type base;
@@ -68,12 +80,44 @@ struct names_view_struct {
     names_table_type changelog;
     int viewid;
     names_commitlog_type commitlog;
+    names_commitcursor_type cursor;
+    int nreplayed;
+    int maxreplayed;
+    struct replayed* replayed;
+    long cutstamp;
+    int cutchanged;
+    names_index_type ancestorindex;
     int nsearchfuncs;
     struct searchfunc* searchfuncs;
+    int deferannotate;
+    int npending;
+    int maxpending;
+    recordset_type* pending;
+    int trackdirty;
+    int alldirty;
+    int ndirty;
+    int maxdirty;
+    char** dirty;
+    names_arena_type arena;
+    pthread_mutex_t templatelock;
+    int ntemplates;
+    struct viewtemplate* templates;
     int nindices;
     names_index_type indices[];
 };
 
+/* A change replayed from the commit log into the primary index, of which
+ * the secondary indices still need to be updated.  The cuts of the name
+ * as found through the ancestor index before the change are kept to
+ * detect whether the change added or removed a cut.
+ */
+struct replayed {
+    recordset_type record;
+    recordset_type existing;
+    const char* name;
+    int cuts;
+};
+
 struct names_change_struct {
     recordset_type record;
     recordset_type oldrecord;
@@ -81,6 +125,38 @@ struct names_change_struct {
 typedef struct names_change_struct* names_change_type;
 enum changetype { ADD, DEL, MOD, UPD };
 
+/* Source of the cut stamps of all views.  A view takes a new stamp each
+ * time a SOA, NS or DNAME RRset appears or disappears in it, which
+ * invalidates the authority status cached in its records.
+ */
+static long cutstamps = 0;
+
+/* Remember the name of a record that changed in the view through the commit
+ * log, such that the next sign pass only needs to revisit these names and
+ * not the entire zone.
+ */
+static void
+markdirty(names_view_type view, recordset_type record)
+{
+    if(!view->trackdirty || view->alldirty || record == NULL)
+        return;
+    if(view->ndirty == view->maxdirty) {
+        view->maxdirty = (view->maxdirty ? view->maxdirty * 2 : 1024);
+        CHECKALLOC(view->dirty = realloc(view->dirty, sizeof(char*) * view->maxdirty));
+    }
+    CHECKALLOC(view->dirty[view->ndirty++] = strdup(names_recordgetname(record)));
+}
+
+static void
+cleardirty(names_view_type view)
+{
+    int i;
+    for(i=0; i<view->ndirty; i++)
+        free(view->dirty[i]);
+    view->ndirty = 0;
+    view->alldirty = 0;
+}
+
 static void
 changed(names_view_type view, recordset_type record, enum changetype type, recordset_type** target)
 {
@@ -156,7 +232,7 @@ names_underwrite(names_view_type view, recordset_type* record)
     changed(view, *record, MOD, &dict);
     if(dict && *dict == NULL) {
         names_indexremove(view->indices[0], *record);
-        *dict = names_recordcopy(*record, 1);
+        *dict = names_recordcopy(*record, 1, view->arena);
         names_indexinsert(view->indices[0], *dict, NULL);
     }
     *record = *dict;
@@ -169,7 +245,7 @@ names_overwrite(names_view_type view, recordset_type* record)
     changed(view, *record, MOD, &dict);
     if(dict && *dict == NULL) {
         names_indexremove(view->indices[0], *record);
-        *dict = names_recordcopy(*record, -1);
+        *dict = names_recordcopy(*record, -1, view->arena);
         names_indexinsert(view->indices[0], *dict, NULL);
     }
     *record = *dict;
@@ -182,7 +258,7 @@ names_update(names_view_type view, recordset_type* record)
     changed(view, *record, UPD, &dict);
     if(dict && *dict == NULL) {
         names_indexremove(view->indices[0], *record);
-        *dict = names_recordcopy(*record, 0);
+        *dict = names_recordcopy(*record, 0, view->arena);
         names_indexinsert(view->indices[0], *dict, NULL);
     }
     *record = *dict;
@@ -202,8 +278,16 @@ names_place(names_view_type view, const char* name)
     content = names_indexlookupkey(view->indices[0], name);
     if(content == NULL) {
         newname = (char*)name;
-        content = names_recordcreate(&newname);
-        names_recordannotate(content, &view->zonedata);
+        content = names_recordcreate(&newname, view->arena);
+        if(view->deferannotate) {
+            if(view->npending == view->maxpending) {
+                view->maxpending = (view->maxpending ? view->maxpending * 2 : 1024);
+                CHECKALLOC(view->pending = realloc(view->pending, sizeof(recordset_type) * view->maxpending));
+            }
+            view->pending[view->npending++] = content;
+        } else {
+            names_recordannotate(content, &view->zonedata);
+        }
         names_indexinsert(view->indices[0], content, NULL);
         changed(view, content, ADD, NULL);
     }
@@ -229,13 +313,98 @@ names_remove(names_view_type view, recordset_type record)
     changed(view, record, DEL, NULL);
 }
 
+static void
+disposetemplate(struct viewtemplate* template)
+{
+    int i;
+    names_indexdestroy(template->baseindex, NULL, NULL);
+    for(i=0; i<template->nindices; i++)
+        names_indexdestroy(template->indices[i], NULL, NULL);
+    free(template->indices);
+    free((void*)template->viewname);
+}
+
+/* Drops the templates that no longer match the base view, or all of them.
+ * This releases the index nodes only kept for the templates.
+ */
+static void
+droptemplates(names_view_type base, int all)
+{
+    int i, j;
+    CHECK(pthread_mutex_lock(&base->templatelock));
+    for(i=j=0; i<base->ntemplates; i++) {
+        if(all || !names_indexshared(base->templates[i].baseindex, base->indices[0])) {
+            disposetemplate(&base->templates[i]);
+        } else {
+            base->templates[j++] = base->templates[i];
+        }
+    }
+    base->ntemplates = j;
+    CHECK(pthread_mutex_unlock(&base->templatelock));
+}
+
+/* Fills the indices of a new view with the records of the base view.  The
+ * indices are not built but cloned, sharing their nodes, if possible.  This
+ * is the case for indices of the same kind as those of the base view, or
+ * when a view of the same kind was created before while the base view has
+ * not changed since.  The nodes only get duplicated by the views as far as
+ * they are changed later on.
+ */
+static void
+createindices(names_view_type view, names_view_type base, const char** keynames)
+{
+    int i, j;
+    names_iterator iter;
+    recordset_type content;
+    struct viewtemplate* template;
+    CHECK(pthread_mutex_lock(&base->templatelock));
+    for(i=0; i<base->ntemplates; i++)
+        if(!strcmp(base->templates[i].viewname, view->viewname) && names_indexshared(base->templates[i].baseindex, base->indices[0]))
+            break;
+    if(i < base->ntemplates) {
+        template = &base->templates[i];
+        for(i=0; i<view->nindices; i++)
+            view->indices[i] = names_indexclone(template->indices[i]);
+        CHECK(pthread_mutex_unlock(&base->templatelock));
+        return;
+    }
+    for(i=0; i<view->nindices; i++) {
+        for(j=0; j<base->nindices; j++)
+            if(!strcmp(keynames[0], names_indexkeyname(base->indices[0])) && !strcmp(keynames[i], names_indexkeyname(base->indices[j])))
+                break;
+        if(j < base->nindices) {
+            view->indices[i] = names_indexclone(base->indices[j]);
+        } else {
+            names_indexcreate(&view->indices[i], keynames[i]);
+            for(iter=names_indexiterator(i==0 ? base->indices[0] : view->indices[0]); names_iterate(&iter, &content); names_advance(&iter, NULL)) {
+                names_indexinsert(view->indices[i], content, NULL);
+            }
+        }
+    }
+    for(i=0; i<base->ntemplates; i++)
+        if(!strcmp(base->templates[i].viewname, view->viewname))
+            break;
+    if(i < base->ntemplates) {
+        disposetemplate(&base->templates[i]);
+    } else {
+        CHECKALLOC(base->templates = realloc(base->templates, sizeof(struct viewtemplate) * (base->ntemplates + 1)));
+        base->ntemplates += 1;
+    }
+    template = &base->templates[i];
+    template->viewname = strdup(view->viewname);
+    template->baseindex = names_indexclone(base->indices[0]);
+    template->nindices = view->nindices;
+    CHECKALLOC(template->indices = malloc(sizeof(names_index_type) * view->nindices));
+    for(i=0; i<view->nindices; i++)
+        template->indices[i] = names_indexclone(view->indices[i]);
+    CHECK(pthread_mutex_unlock(&base->templatelock));
+}
+
 names_view_type
 names_viewcreate(names_view_type base, const char* viewname, const char** keynames)
 {
     names_view_type view;
     int i, nindices;
-    names_iterator iter;
-    recordset_type content;
     if(base && base->base) {
         base = base->base;
     }
@@ -253,9 +422,37 @@ names_viewcreate(names_view_type base, const char* viewname, const char** keynam
     view->changelog = names_tablecreate(comparfunc);
     view->nsearchfuncs = 0;
     view->searchfuncs = NULL;
+    /* New records in the input view are annotated in bulk at the latest
+     * on commit, see names_viewpending.
+     */
+    view->deferannotate = !strcmp(viewname,names_view_INPUT[0]);
+    view->npending = 0;
+    view->maxpending = 0;
+    view->pending = NULL;
+    /* The views that maintain the denial chain keep track of which names
+     * changed, a new view starts out with all of them changed.
+     */
+    view->trackdirty = (!strcmp(viewname,names_view_NEIGHB[0]) || !strcmp(viewname,names_view_SIGN[0]));
+    view->alldirty = view->trackdirty;
+    view->ndirty = 0;
+    view->maxdirty = 0;
+    view->dirty = NULL;
+    /* All records of a zone are allocated from a single arena, owned by
+     * the base view and released at once when the base view is destroyed.
+     */
+    view->arena = (base ? base->arena : names_arenacreate());
+    CHECK(pthread_mutex_init(&view->templatelock, NULL));
+    view->ntemplates = 0;
+    view->templates = NULL;
     view->nindices = nindices;
+    if(base != NULL) {
+        createindices(view, base, keynames);
+    } else {
+        for(i=0; i<nindices; i++) {
+            names_indexcreate(&view->indices[i], keynames[i]);
+        }
+    }
     for(i=0; i<nindices; i++) {
-        names_indexcreate(&view->indices[i], keynames[i]);
         names_indexsearchfunction(view->indices[i], view, keynames[i]);
     }
     if(!strcmp(viewname,names_view_PREPARE[0])) {
@@ -266,19 +463,21 @@ names_viewcreate(names_view_type base, const char* viewname, const char** keynam
         names_viewaddsearchfunction2(view, view->indices[0], view->indices[2], names_iteratordenialchainupdates);
     }
     if(base != NULL) {
-        for(iter=names_indexiterator(base->indices[0]); names_iterate(&iter, &content); names_advance(&iter, NULL)) {
-            names_indexinsert(view->indices[0], content, NULL);
-        }
-        for(iter=names_indexiterator(view->indices[0]); names_iterate(&iter, &content); names_advance(&iter, NULL)) {
-            for(i=1; i<nindices; i++) {
-                names_indexinsert(view->indices[i], content, NULL);
-            }
-        }
         view->commitlog = base->commitlog;
     } else {
         view->commitlog = NULL;
     }
-    view->viewid = names_commitlogsubscribe(view, &view->commitlog);
+    view->viewid = names_commitlogsubscribe(view, &view->commitlog, &view->cursor);
+    view->nreplayed = 0;
+    view->maxreplayed = 0;
+    view->replayed = NULL;
+    view->cutstamp = __sync_add_and_fetch(&cutstamps, 1);
+    view->cutchanged = 0;
+    view->ancestorindex = view->indices[0];
+    for(i=0; i<view->nsearchfuncs; i++) {
+        if(view->searchfuncs[i].search == names_iteratorancestors)
+            view->ancestorindex = view->searchfuncs[i].index;
+    }
     return view;
 }
 
@@ -296,7 +495,11 @@ names_viewdestroy(names_view_type view)
 {
     int i;
     marshall_handle store = NULL;
-    names_commitlogunsubscribe(view->viewid, view->commitlog);
+    long lag, maxlag, nsegments;
+    names_commitlogstats(view->commitlog, view->cursor, &lag, &maxlag, &nsegments);
+    logger_message(&names_logcommitlog,logger_noctx,logger_DIAG,"view %s replayed %ld commits, lag %ld (max %ld)\n",view->viewname,nsegments,lag,maxlag);
+    names_commitlogunsubscribe(view->cursor, view->commitlog);
+    free(view->replayed);
     names_commitlogdestroy(view->changelog);
     for(i=1; i<view->nindices; i++) {
         names_indexdestroy(view->indices[i], NULL, NULL);
@@ -314,21 +517,24 @@ names_viewdestroy(names_view_type view)
     if(view->viewid == 0)
         free((void*)view->zonedata.apex);
     free(view->searchfuncs);
+    free(view->pending);
+    cleardirty(view);
+    free(view->dirty);
+    droptemplates(view, 1);
+    free(view->templates);
+    pthread_mutex_destroy(&view->templatelock);
+    if(view->base == NULL || view->base == view)
+        names_arenadestroy(view->arena);
     free(view);
 }
 
-typedef int (*acceptfunction)(recordset_type newitem, recordset_type currentitem, int* cmp);
-struct names_index_struct {
-    const char* keyname;
-    ldns_rbtree_t* tree;
-    acceptfunction acceptfunc;
-};
-
 void
 names_viewvalidate(names_view_type view)
 {
     int fail = 0;
     int count, size, i;
+    long nodes;
+    size_t nodesize;
     char* temp1 = NULL;
     char* temp2 = NULL;
     names_iterator iter;
@@ -343,7 +549,8 @@ names_viewvalidate(names_view_type view)
         }
     }
     if(view->viewid == 0) {
-        fprintf(stderr,"total memory size of records is %d, index nodes are %lu\n",size,sizeof(ldns_rbnode_t));
+        names_indexstatistics(&nodes, &nodesize);
+        fprintf(stderr,"total memory size of records is %d, index nodes are %lu in use %ld\n",size,(unsigned long)nodesize,nodes);
     }
     fprintf(stderr,"view %s contains %d records in primary index%s",view->viewname,count,(view->nindices>1?" in other indices:":""));
     for(i=1; i<view->nindices; i++) {
@@ -351,19 +558,19 @@ names_viewvalidate(names_view_type view)
         for(iter=names_indexiterator(view->indices[i]); names_iterate(&iter,&record); names_advance(&iter,NULL)) {
             compare = names_indexlookup(view->indices[0], record);
             if(compare == NULL) {
-                fprintf(stderr,"RECORD IN INDEX %s NOT PRESENT IN MAIN INDEX: %s\n",*(char**)view->indices[i],names_recordgetsummary(record,&temp1));
+                fprintf(stderr,"RECORD IN INDEX %s NOT PRESENT IN MAIN INDEX: %s\n",names_indexkeyname(view->indices[i]),names_recordgetsummary(record,&temp1));
                 // names_dumprecord(stderr,record);
                 fail = 1; // assert(compare != NULL);
             } else if(compare != record) {
-                fprintf(stderr,"RECORD IN INDEX %s NOT SAME IN MAIN INDEX %s vs %s\n",*(char**)view->indices[i],names_recordgetsummary(record,&temp1),names_recordgetsummary(compare,&temp2));
+                fprintf(stderr,"RECORD IN INDEX %s NOT SAME IN MAIN INDEX %s vs %s\n",names_indexkeyname(view->indices[i]),names_recordgetsummary(record,&temp1),names_recordgetsummary(compare,&temp2));
                 //names_dumprecord(stderr,record);
                 //names_dumprecord(stderr,compare);
                 fail = 1; // assert(compare == record);
             }
-            if(view->indices[i]->acceptfunc(record,NULL,NULL) != 1) {
-                fprintf(stderr,"RECORD IN INDEX %s SHOULD NOT BE IN INDEX %s\n",*(char**)view->indices[i],names_recordgetsummary(record,&temp1));
+            if(names_indexaccept(view->indices[i],record) != 1) {
+                fprintf(stderr,"RECORD IN INDEX %s SHOULD NOT BE IN INDEX %s\n",names_indexkeyname(view->indices[i]),names_recordgetsummary(record,&temp1));
                 //names_dumprecord(stderr,record);
-                assert(view->indices[i]->acceptfunc(record,NULL,NULL) == 1);
+                assert(names_indexaccept(view->indices[i],record) == 1);
             }
             ++count;
         }
@@ -491,6 +698,7 @@ resetchangelog(names_view_type view)
         // FIXME we should assert(change->record != change->oldrecord); as we cannot handle updates like amends  but this assertion currently fails without known reason
         if(change->record != NULL) {
             names_indexremove(view->indices[0], change->record);
+            markdirty(view, change->record);
         }
         if(change->oldrecord != NULL) {
             names_indexinsert(view->indices[0], change->oldrecord, NULL);
@@ -501,10 +709,35 @@ resetchangelog(names_view_type view)
     view->changelog = newchangelog;
 }
 
+/* Update the secondary indices with the changes replayed into the primary
+ * index, one index at a time rather than one change at a time.  Returns
+ * whether a cut appeared or disappeared for one of the names.
+ */
+static int
+flushreplayed(names_view_type view)
+{
+    int i, j, cutchanged = 0;
+    recordset_type existing;
+    for(i=1; i<view->nindices; i++) {
+        for(j=0; j<view->nreplayed; j++) {
+            existing = view->replayed[j].existing;
+            names_indexinsert(view->indices[i], view->replayed[j].record, (existing ? &existing : NULL));
+        }
+    }
+    for(j=0; j<view->nreplayed && !cutchanged; j++) {
+        existing = names_indexlookupkey(view->ancestorindex, view->replayed[j].name);
+        if(names_recordgetcuts(existing) != view->replayed[j].cuts)
+            cutchanged = 1;
+    }
+    view->nreplayed = 0;
+    return cutchanged;
+}
+
 static int
 updateview(names_view_type view, names_table_type* mychangelog)
 {
     int i, conflict = 0;
+    int cutchanged = 0;
     names_iterator iter;
     names_change_type change;
     names_table_type changelog;
@@ -516,7 +749,7 @@ updateview(names_view_type view, names_table_type* mychangelog)
     changelog = NULL;
 
     logger_message(&names_logcommitlog,logger_noctx,logger_DIAG,"update view %s commit %p\n",view->viewname,(mychangelog?(void*)*mychangelog:NULL));
-    while((names_commitlogpoppush(view->commitlog, view->viewid, &changelog, mychangelog))) {
+    while((names_commitlogreplay(view->commitlog, view->cursor, &changelog, mychangelog))) {
         logger_message(&names_logcommitlog,logger_noctx,logger_DIAG,"  process commit log %p into %s\n",(void*)changelog,view->viewname);
         for(iter = names_tableitems(changelog); names_iterate(&iter, &change); names_advance(&iter, NULL)) {
             logger_message(&names_logcommitlog,logger_noctx,logger_DIAG,"    processing %s\n",names_recordgetsummary(change->record,&temp1));
@@ -528,15 +761,27 @@ updateview(names_view_type view, names_table_type* mychangelog)
                 conflict = 1;
                 mychangelog = NULL;
             }
+            /* the primary index may hold several revisions of a name, the
+             * ancestor index has the one that determines the authority */
+            if(view->nreplayed == view->maxreplayed) {
+                view->maxreplayed = (view->maxreplayed ? view->maxreplayed * 2 : 256);
+                CHECKALLOC(view->replayed = realloc(view->replayed, sizeof(struct replayed) * view->maxreplayed));
+            }
+            view->replayed[view->nreplayed].name = names_recordgetname(change->record);
+            view->replayed[view->nreplayed].cuts = names_recordgetcuts(names_indexlookupkey(view->ancestorindex, names_recordgetname(change->record)));
             existing = NULL;
             accepted = names_indexinsert(view->indices[0], change->record, &existing);
+            markdirty(view, change->record);
+            if(accepted && names_recordgetcuts(change->record) != names_recordgetcuts(existing))
+                cutchanged = 1;
             logger_message(&names_logcommitlog,logger_noctx,logger_DIAG,"      update %s %s%s%s\n",names_recordgetsummary(change->record,&temp1),(accepted?"accepted":"dropped"),(existing?" replaces ":""),names_recordgetsummary(existing,&temp2));
-            for(i=1; i<view->nindices; i++) {
-                recordset_type tmp = existing;
-                names_indexinsert(view->indices[i], (accepted ? change->record : NULL), (existing ? &tmp : NULL));
-            }
+            view->replayed[view->nreplayed].record = (accepted ? change->record : NULL);
+            view->replayed[view->nreplayed].existing = existing;
+            view->nreplayed++;
         }
     }
+    if(flushreplayed(view))
+        cutchanged = 1;
     if(!conflict && mychangelog) {
         logger_message(&names_logcommitlog,logger_noctx,logger_DIAG,"  process submit commit log %p into %s\n",(void*)changelog,view->viewname);
         for(iter=names_tableitems(changelog); names_iterate(&iter, &change); names_advance(&iter, NULL)) {
@@ -546,6 +791,8 @@ updateview(names_view_type view, names_table_type* mychangelog)
                 existing = change->oldrecord;
                 names_indexinsert(view->indices[i], change->record, &existing);
             }
+            if(names_recordgetcuts(change->record) != names_recordgetcuts(change->oldrecord))
+                cutchanged = 1;
             if(change->record == NULL) {
                 change->record = change->oldrecord;
                 change->oldrecord = NULL;
@@ -555,6 +802,12 @@ updateview(names_view_type view, names_table_type* mychangelog)
     }
     names_recordgetsummary(NULL,&temp1);
     names_recordgetsummary(NULL,&temp2);
+    if(cutchanged) {
+        view->cutstamp = __sync_add_and_fetch(&cutstamps, 1);
+        view->cutchanged = 1;
+    }
+    if(view->ntemplates > 0)
+        droptemplates(view, 0);
     return conflict;
 }
 
@@ -562,16 +815,242 @@ int
 names_viewcommit(names_view_type view)
 {
     int conflict;
+    if(view->npending > 0) {
+        names_recordannotatebatch(view->pending, view->npending, &view->zonedata);
+        view->npending = 0;
+    }
     conflict = updateview(view, &(view->changelog));
     assert(!conflict);
     return conflict;
 }
 
+/* Returns the records placed in the view that still need to be annotated
+ * before the view is committed.  The caller may annotate them, possibly
+ * from multiple threads, otherwise this is done on commit.
+ */
+int
+names_viewpending(names_view_type view, recordset_type** records)
+{
+    *records = view->pending;
+    return view->npending;
+}
+
+void
+names_viewannotate(names_view_type view, recordset_type* records, int count)
+{
+    names_recordannotatebatch(records, count, &view->zonedata);
+}
+
 void
 names_viewreset(names_view_type view)
 {
+    view->npending = 0;
     resetchangelog(view);
     updateview(view, NULL);
+    view->cutstamp = __sync_add_and_fetch(&cutstamps, 1);
+}
+
+static int
+comparedirtyname(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int
+comparedirtyrecord(const void* a, const void* b)
+{
+    uintptr_t left = (uintptr_t) *(recordset_type const*)a;
+    uintptr_t right = (uintptr_t) *(recordset_type const*)b;
+    return (left > right) - (left < right);
+}
+
+/* Sort the names of the changed records and remove duplicates.  Returns
+ * non-zero if instead all records need to be revisited, which is also the
+ * case when such a large part of the zone changed that a walk over all
+ * records is cheaper.
+ */
+static int
+takedirty(names_view_type view)
+{
+    int i, j;
+    if(view->ndirty > names_indexcount(view->indices[0]) / 4)
+        view->alldirty = 1;
+    if(view->alldirty) {
+        cleardirty(view);
+        return 1;
+    }
+    qsort(view->dirty, view->ndirty, sizeof(char*), comparedirtyname);
+    for(i=j=0; i<view->ndirty; i++) {
+        if(j > 0 && !strcmp(view->dirty[j-1], view->dirty[i])) {
+            free(view->dirty[i]);
+        } else {
+            view->dirty[j++] = view->dirty[i];
+        }
+    }
+    view->ndirty = j;
+    return 0;
+}
+
+static struct searchfunc*
+denialchainsearch(names_view_type view)
+{
+    int i;
+    for(i=0; i<view->nsearchfuncs; i++) {
+        if(view->searchfuncs[i].search == names_iteratordenialchainupdates)
+            return &view->searchfuncs[i];
+    }
+    ods_fatal_exit("internal error finding index search function");
+    return NULL;
+}
+
+/* Returns the current records for all names changed in the view since the
+ * previous call, or NULL if all records in the view need to be visited.
+ */
+names_arena_type
+names_viewarena(names_view_type view)
+{
+    return view->arena;
+}
+
+/* Returns the total number of entries in all indices of the view, which
+ * is the number of index nodes the view would use if it shared none.
+ */
+long
+names_viewindexentries(names_view_type view)
+{
+    int i;
+    long count = 0;
+    for(i=0; i<view->nindices; i++)
+        count += names_indexcount(view->indices[i]);
+    return count;
+}
+
+/* Returns the stamp under which authority status cached in records is
+ * valid for this view.  Local changes that add or remove SOA, NS or DNAME
+ * RRsets are only accounted for once the view is committed.
+ */
+long
+names_viewcutstamp(names_view_type view)
+{
+    return view->cutstamp;
+}
+
+/* Returns the nearest ancestor of the record that is present in the view,
+ * or NULL if there is none.
+ */
+recordset_type
+names_viewparent(names_view_type view, recordset_type record)
+{
+    const char* name;
+    recordset_type parent = NULL;
+    for(name = names_recordgetname(record); name && *name && !parent; ) {
+        while(*name && *name != '.') {
+            if(*name == '\\' && name[1])
+                ++name;
+            ++name;
+        }
+        if(*name == '.' && name[1]) {
+            ++name;
+            parent = names_indexlookupkey(view->ancestorindex, name);
+        } else
+            name = NULL;
+    }
+    return parent;
+}
+
+/* Returns the records left out of the denial chain if a cut appeared or
+ * disappeared in the view since the previous call, as names that were
+ * occluded may have come back.  Returns NULL otherwise.
+ */
+names_iterator
+names_viewexcludedrecords(names_view_type view)
+{
+    recordset_type record;
+    names_iterator iter;
+    names_iterator result;
+    if(!view->cutchanged)
+        return NULL;
+    view->cutchanged = 0;
+    result = names_iterator_createrefs(NULL);
+    for(iter = names_indexiterator(view->ancestorindex); names_iterate(&iter, &record); names_advance(&iter, NULL)) {
+        if(names_recordgetdenial(record) == NULL)
+            names_iterator_addptr(result, record);
+    }
+    return result;
+}
+
+names_iterator
+names_viewdirtyrecords(names_view_type view, int* count)
+{
+    int i;
+    recordset_type record;
+    names_iterator iter;
+    struct searchfunc* search = denialchainsearch(view);
+    if(takedirty(view)) {
+        *count = 0;
+        return NULL;
+    }
+    *count = view->ndirty;
+    iter = names_iterator_createrefs(NULL);
+    for(i=0; i<view->ndirty; i++) {
+        record = names_indexlookupkey(search->index, view->dirty[i]);
+        if(record)
+            names_iterator_addptr(iter, record);
+    }
+    cleardirty(view);
+    return iter;
+}
+
+/* Like names_iteratordenialchainupdates, but restricted to the part of the
+ * denial chain affected by the names changed in the view since the previous
+ * call.  Those are the changed records themselves and the records preceding
+ * them in the chain, which are the ones whose next name may have changed.
+ * Returns NULL if the entire chain needs to be visited.
+ */
+names_iterator
+names_viewdirtydenialchain(names_view_type view, int* count)
+{
+    int i, j, nrecords;
+    struct dual entry;
+    recordset_type temp;
+    recordset_type record;
+    recordset_type* records;
+    names_iterator result;
+    struct searchfunc* search = denialchainsearch(view);
+    if(takedirty(view)) {
+        *count = 0;
+        return NULL;
+    }
+    *count = view->ndirty;
+    nrecords = 0;
+    CHECKALLOC(records = malloc(sizeof(recordset_type) * (view->ndirty * 2 + 1)));
+    for(i=0; i<view->ndirty; i++) {
+        temp = names_recordcreatetemp(view->dirty[i]);
+        names_recordannotate(temp, &view->zonedata);
+        record = names_indexlookup(search->index, temp);
+        if(record && names_recordgetdenial(record))
+            records[nrecords++] = record;
+        if(names_recordgetdenial(temp)) {
+            record = names_indexlookupprevious(search->index2, temp);
+            if(record)
+                records[nrecords++] = record;
+        }
+        names_recorddispose(temp);
+    }
+    cleardirty(view);
+    qsort(records, nrecords, sizeof(recordset_type), comparedirtyrecord);
+    result = names_iterator_createdata(sizeof(struct dual));
+    for(i=j=0; i<nrecords; i++) {
+        if(j > 0 && records[j-1] == records[i])
+            continue;
+        records[j++] = records[i];
+        entry.src = records[i];
+        entry.dst = names_indexlookupnext(search->index2, records[i]);
+        if(entry.dst)
+            names_iterator_adddata(result, &entry);
+    }
+    free(records);
+    return result;
 }
 
 static void
@@ -584,6 +1063,7 @@ persistfn(names_table_type table, marshall_handle store)
             names_recordmarshall(&(change->record), store);
     }
     names_recordmarshall(NULL, store);
+    marshallflush(store);
 }
 
 int
@@ -593,7 +1073,13 @@ names_viewconfig(names_view_type view, signconf_type** signconf)
     return 0;
 }
 
-static char filemagic[8] = "\0ODS-S1\n";
+/* Version S1 stores records in textual presentation format, S2 stores
+ * resource records in wire format and is read and written buffered.  Files
+ * in the older format are still accepted and are rewritten in the current
+ * format when restored.
+ */
+static char filemagic[8] = "\0ODS-S2\n";
+static char filemagicv1[8] = "\0ODS-S1\n";
 
 int
 names_viewrestore(names_view_type view, const char* apex, int basefd, const char* filename)
@@ -613,8 +1099,21 @@ names_viewrestore(names_view_type view, const char* apex, int basefd, const char
             fd = open(filename, O_RDWR|O_LARGEFILE);
         if(fd >= 0) {
             read(fd,buffer,sizeof(buffer));
+            if(memcmp(buffer,filemagicv1,sizeof(filemagicv1))==0) {
+                input = marshallcreate(marshall_INPUT, fd);
+                do {
+                    names_recordmarshall(&record, input);
+                    if(record) {
+                        names_indexinsert(view->indices[0], record, NULL);
+                    }
+                } while(record);
+                marshallclose(input);
+                /* migrate to the current format, this also opens the journal */
+                names_viewpersist(view, (basefd >= 0 ? basefd : AT_FDCWD), (char*)filename);
+                return 0;
+            }
             assert(memcmp(buffer,filemagic,sizeof(filemagic))==0);
-            input = marshallcreate(marshall_INPUT, fd);
+            input = marshallcreate(marshall_BINARYINPUT, fd);
             do {
                 names_recordmarshall(&record, input);
                 if(record) {
@@ -655,7 +1154,7 @@ names_viewpersist(names_view_type view, int basefd, char* filename)
     else
         CHECK((fd = open(tmpfilename, O_CREAT|O_WRONLY|O_LARGEFILE|O_TRUNC,0666)) < 0);
     write(fd,filemagic,sizeof(filemagic));
-    marsh = marshallcreate(marshall_OUTPUT, fd);
+    marsh = marshallcreate(marshall_BINARYOUTPUT, fd);
 
     iter = names_indexiterator(view->indices[0]);
     if(names_iterate(&iter, &record)) {
@@ -665,7 +1164,8 @@ names_viewpersist(names_view_type view, int basefd, char* filename)
         names_recordmarshall(NULL, marsh);
     }
     names_end(&iter);
-    names_commitlogpersistfull(view->commitlog, persistfn, view->viewid, marsh, &oldmarsh);
+    names_commitlogpersistfull(view->commitlog, persistfn, view->cursor, marsh, &oldmarsh);
+    marshallflush(marsh);
 
     marshallclose(oldmarsh);
     CHECK(renameat(basefd, tmpfilename, basefd, filename));
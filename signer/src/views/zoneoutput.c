@@ -38,8 +38,10 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
 #include <ldns/ldns.h>
 #include "uthash.h"
+#include "utilities.h"
 #include "proto.h"
 
 void
@@ -93,35 +95,289 @@ writezoneapex(names_view_type view, FILE* fp)
     }
 }
 
-int
-writezone(names_view_type view, const char* filename)
+/* Write a single resource record in the transfer image format, which is the
+ * uncompressed wire format of the record prefixed by its length in network
+ * order, just like messages on a TCP stream.
+ */
+void
+writerrwire(ldns_rr* rr, ldns_buffer* wire, FILE* fp)
 {
-    FILE* fp;
-    int defaultttl = 0;
-    ldns_rdf* origin = NULL;
-    char* apex = NULL;
+    uint8_t len[2];
+    ldns_buffer_clear(wire);
+    if(ldns_rr2buffer_wire(wire, rr, LDNS_SECTION_ANSWER) == LDNS_STATUS_OK) {
+        ldns_write_uint16(len, ldns_buffer_position(wire));
+        fwrite(len, sizeof(len), 1, fp);
+        fwrite(ldns_buffer_begin(wire), ldns_buffer_position(wire), 1, fp);
+    }
+}
 
-    fp = fopen(filename,"w");
-    if (!fp) {
-        fprintf(stderr,"unable to open file \"%s\"\n",filename);
+void
+writerecordwire(recordset_type domainitem, ldns_buffer* wire, FILE* fp)
+{
+    int first;
+    ldns_rr* rr;
+    ldns_rr_type recordtype;
+    names_iterator rrsetiter;
+    names_iterator rriter;
+    for (rrsetiter = names_recordalltypes(domainitem); names_iterate(&rrsetiter, &recordtype); names_advance(&rrsetiter, NULL)) {
+        first = 1;
+        for (rriter = names_recordallvalues(domainitem, recordtype); names_iterate(&rriter, &rr); names_advance(&rriter, NULL)) {
+            if (recordtype == LDNS_RR_TYPE_SOA && first) {
+                first = 0;
+                continue;
+            }
+            writerrwire(rr, wire, fp);
+        }
     }
+    for (rriter = names_recordallvalues(domainitem, LDNS_RR_TYPE_NSEC); names_iterate(&rriter, &rr); names_advance(&rriter, NULL)) {
+        writerrwire(rr, wire, fp);
+    }
+}
+
+void
+writezonewire(names_view_type view, FILE* fp)
+{
+    ldns_rr* soa = NULL;
+    ldns_buffer* wire;
+    recordset_type record;
+    names_iterator domainiter;
+    wire = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+    record = names_take(view,0,NULL);
+    if(record) {
+        names_recordlookupone(record,LDNS_RR_TYPE_SOA,NULL,&soa);
+    }
+    if(soa)
+        writerrwire(soa, wire, fp);
+    for (domainiter = names_viewiterator(view, NULL); names_iterate(&domainiter, &record); names_advance(&domainiter, NULL)) {
+        writerecordwire(record, wire, fp);
+    }
+    if(soa)
+        writerrwire(soa, wire, fp);
+    ldns_buffer_free(wire);
+}
+
+/* The zone file is rendered into a large memory buffer which is written
+ * out whenever it fills up past the flush size.  When multiple threads are
+ * used, the domains are handed out in ranges of consecutive names to be
+ * rendered each in their own buffer, which are then written in order.  The
+ * number of ranges outstanding at any time is bounded to limit the memory
+ * used.
+ */
+#define ZONEOUTPUT_BUFFERSIZE (1024*1024)
+#define ZONEOUTPUT_RANGESIZE 1024
+#define ZONEOUTPUT_RANGESPERTHREAD 4
+
+struct writerange {
+    int count;
+    int rendered;
+    ldns_buffer* buffer;
+    recordset_type records[ZONEOUTPUT_RANGESIZE];
+};
+
+struct writer {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int nranges;
+    struct writerange* ranges;
+    long rendering; /* sequence number of the next range to render */
+    long submitted; /* number of ranges handed out for rendering */
+    long written;   /* number of ranges written out */
+    int done;
+};
+
+static int
+writebuffer(ldns_buffer* buffer, FILE* fp)
+{
+    size_t length = ldns_buffer_position(buffer);
+    ldns_buffer_clear(buffer);
+    if (length > 0 && fwrite(ldns_buffer_begin(buffer), length, 1, fp) != 1)
+        return 1;
+    return 0;
+}
+
+static void
+writezoneheader(names_view_type view, ldns_buffer* buffer)
+{
+    int defaultttl = 0;
+    ldns_rdf* origin = NULL;
+    char* apex;
 
     names_viewgetapex(view, &origin);
     if (origin) {
         apex = ldns_rdf2str(origin);
-        fprintf(fp, "$ORIGIN %s\n", apex);
+        ldns_buffer_printf(buffer, "$ORIGIN %s\n", apex);
         ldns_rdf_deep_free(origin);
+        free(apex);
     }
     if (names_viewgetdefaultttl(view, &defaultttl)) {
-        fprintf(fp, "$TTL %d\n",defaultttl);
+        ldns_buffer_printf(buffer, "$TTL %d\n",defaultttl);
     }
+}
 
-    writezoneapex(view, fp);
-    writezonecontent(view, fp);
-    writezoneapex(view, fp);
+static void
+writezoneapexbuffer(names_view_type view, ldns_buffer* buffer)
+{
+    ldns_rr* rr = NULL;
+    recordset_type record;
+    record = names_take(view,0,NULL);
+    if(record) {
+        names_recordlookupone(record,LDNS_RR_TYPE_SOA,NULL,&rr);
+        ldns_rr2buffer_str_fmt(buffer, ldns_output_format_default, rr);
+    }
+}
 
-    fclose(fp);
-    if(apex)
-        free(apex);
-    return 0;
+static void*
+writerangesrender(void* arg)
+{
+    struct writer* writer = arg;
+    struct writerange* range;
+    int i;
+    CHECK(pthread_mutex_lock(&writer->lock));
+    for(;;) {
+        while (writer->rendering == writer->submitted && !writer->done)
+            CHECK(pthread_cond_wait(&writer->cond, &writer->lock));
+        if (writer->rendering == writer->submitted)
+            break;
+        range = &writer->ranges[writer->rendering % writer->nranges];
+        writer->rendering += 1;
+        CHECK(pthread_mutex_unlock(&writer->lock));
+        for (i=0; i<range->count; i++) {
+            names_recordprint(range->records[i], range->buffer);
+        }
+        CHECK(pthread_mutex_lock(&writer->lock));
+        range->rendered = 1;
+        CHECK(pthread_cond_broadcast(&writer->cond));
+    }
+    CHECK(pthread_mutex_unlock(&writer->lock));
+    return NULL;
+}
+
+static int
+writerangeflush(struct writer* writer, FILE* fp)
+{
+    int status;
+    struct writerange* range = &writer->ranges[writer->written % writer->nranges];
+    CHECK(pthread_mutex_lock(&writer->lock));
+    while (!range->rendered)
+        CHECK(pthread_cond_wait(&writer->cond, &writer->lock));
+    CHECK(pthread_mutex_unlock(&writer->lock));
+    status = writebuffer(range->buffer, fp);
+    range->count = 0;
+    range->rendered = 0;
+    writer->written += 1;
+    return status;
+}
+
+static void
+writerangesubmit(struct writer* writer)
+{
+    CHECK(pthread_mutex_lock(&writer->lock));
+    writer->submitted += 1;
+    CHECK(pthread_cond_broadcast(&writer->cond));
+    CHECK(pthread_mutex_unlock(&writer->lock));
+}
+
+static int
+writezonecontentparallel(names_view_type view, FILE* fp, int nthreads)
+{
+    int i, status = 0;
+    struct writer writer;
+    struct writerange* range = NULL;
+    pthread_t* threads;
+    names_iterator domainiter;
+    recordset_type domainitem;
+
+    CHECK(pthread_mutex_init(&writer.lock, NULL));
+    CHECK(pthread_cond_init(&writer.cond, NULL));
+    writer.nranges = nthreads * ZONEOUTPUT_RANGESPERTHREAD;
+    writer.rendering = writer.submitted = writer.written = 0;
+    writer.done = 0;
+    CHECKALLOC(writer.ranges = malloc(sizeof(struct writerange) * writer.nranges));
+    for (i=0; i<writer.nranges; i++) {
+        writer.ranges[i].count = 0;
+        writer.ranges[i].rendered = 0;
+        CHECKALLOC(writer.ranges[i].buffer = ldns_buffer_new(ZONEOUTPUT_BUFFERSIZE / writer.nranges + LDNS_MAX_PACKETLEN));
+    }
+    CHECKALLOC(threads = malloc(sizeof(pthread_t) * nthreads));
+    for (i=0; i<nthreads; i++) {
+        CHECK(pthread_create(&threads[i], NULL, writerangesrender, &writer));
+    }
+
+    for (domainiter = names_viewiterator(view, NULL); names_iterate(&domainiter, &domainitem); names_advance(&domainiter, NULL)) {
+        if (range == NULL) {
+            if (writer.submitted - writer.written == writer.nranges)
+                status |= writerangeflush(&writer, fp);
+            range = &writer.ranges[writer.submitted % writer.nranges];
+        }
+        range->records[range->count++] = domainitem;
+        if (range->count == ZONEOUTPUT_RANGESIZE) {
+            writerangesubmit(&writer);
+            range = NULL;
+        }
+    }
+    if (range != NULL)
+        writerangesubmit(&writer);
+    CHECK(pthread_mutex_lock(&writer.lock));
+    writer.done = 1;
+    CHECK(pthread_cond_broadcast(&writer.cond));
+    CHECK(pthread_mutex_unlock(&writer.lock));
+    while (writer.written < writer.submitted)
+        status |= writerangeflush(&writer, fp);
+
+    for (i=0; i<nthreads; i++) {
+        CHECK(pthread_join(threads[i], NULL));
+    }
+    free(threads);
+    for (i=0; i<writer.nranges; i++) {
+        ldns_buffer_free(writer.ranges[i].buffer);
+    }
+    free(writer.ranges);
+    pthread_cond_destroy(&writer.cond);
+    pthread_mutex_destroy(&writer.lock);
+    return status;
+}
+
+static int
+writezonecontentbuffer(names_view_type view, ldns_buffer* buffer, FILE* fp)
+{
+    int status = 0;
+    names_iterator domainiter;
+    recordset_type domainitem;
+    for (domainiter = names_viewiterator(view, NULL); names_iterate(&domainiter, &domainitem); names_advance(&domainiter, NULL)) {
+        names_recordprint(domainitem, buffer);
+        if (ldns_buffer_position(buffer) >= ZONEOUTPUT_BUFFERSIZE)
+            status |= writebuffer(buffer, fp);
+    }
+    return status;
+}
+
+int
+writezone(names_view_type view, const char* filename, int nthreads)
+{
+    FILE* fp;
+    int status = 0;
+    ldns_buffer* buffer;
+
+    fp = fopen(filename,"w");
+    if (!fp) {
+        fprintf(stderr,"unable to open file \"%s\"\n",filename);
+        return 1;
+    }
+    CHECKALLOC(buffer = ldns_buffer_new(ZONEOUTPUT_BUFFERSIZE + LDNS_MAX_PACKETLEN));
+
+    writezoneheader(view, buffer);
+    writezoneapexbuffer(view, buffer);
+    if (nthreads > 1) {
+        status |= writebuffer(buffer, fp);
+        status |= writezonecontentparallel(view, fp, nthreads);
+    } else {
+        status |= writezonecontentbuffer(view, buffer, fp);
+    }
+    writezoneapexbuffer(view, buffer);
+    status |= writebuffer(buffer, fp);
+
+    ldns_buffer_free(buffer);
+    if (fclose(fp))
+        status = 1;
+    return status;
 }
@@ -37,6 +37,36 @@
 
 static const char* acl_str = "acl";
 
+/**
+ * ACL entry in the prefix trie, order is its position in the list.
+ *
+ */
+struct acl_trie_entry {
+    int order;
+    acl_type* acl;
+};
+
+/**
+ * Node in the prefix trie, holding the ACLs whose prefix ends here.
+ *
+ */
+struct acl_trie_node {
+    struct acl_trie_node* child[2];
+    int nentries;
+    struct acl_trie_entry* entries;
+};
+
+/**
+ * Prefix tries.
+ *
+ */
+struct acl_trie_struct {
+    struct acl_trie_node* root4;
+    struct acl_trie_node* root6;
+    int nany;
+    struct acl_trie_entry* any;
+};
+
 
 /**
  * Returns range type.
@@ -133,6 +163,7 @@ acl_create(char* address, char* port,
     acl->address = NULL;
     acl->next = NULL;
     acl->tsig = NULL;
+    acl->trie = NULL;
     if (tsig_name) {
         acl->tsig = tsig_lookup_by_name(tsig, tsig_name);
         if (!acl->tsig) {
@@ -247,11 +278,11 @@ acl_addr_matches_range(uint32_t* minval, uint32_t* x, uint32_t* maxval,
     /* check treats x as one huge number */
     sz /= 4;
     for (i=0; i<sz; ++i) {
-        /* if outside bounds, we are done */
-        if (checkmin && minval[i] > x[i]) {
+        /* if outside bounds, we are done (words are in network order) */
+        if (checkmin && ntohl(minval[i]) > ntohl(x[i])) {
             return 0;
         }
-        if (checkmax && maxval[i] < x[i]) {
+        if (checkmax && ntohl(maxval[i]) < ntohl(x[i])) {
             return 0;
         }
         /* if x is equal to a bound, that bound needs further checks */
@@ -429,6 +460,183 @@ addr2ip(struct sockaddr_storage addr, char* ip, size_t len)
 }
 
 
+/**
+ * Number of leading bits of the address that every address matched by
+ * the ACL has in common.
+ *
+ */
+static int
+acl_prefix_bits(acl_type* acl, int maxbits)
+{
+    const uint8_t* mask = (const uint8_t*) &acl->range_mask;
+    const uint8_t* addr = (const uint8_t*) &acl->addr;
+    int bits = 0;
+    switch (acl->range_type) {
+        case ACL_RANGE_MASK:
+        case ACL_RANGE_SUBNET:
+            while (bits < maxbits && (mask[bits/8] & (0x80 >> (bits%8)))) {
+                ++bits;
+            }
+            return bits;
+        case ACL_RANGE_MINMAX:
+            while (bits < maxbits && ((addr[bits/8] ^ mask[bits/8]) &
+                (0x80 >> (bits%8))) == 0) {
+                ++bits;
+            }
+            return bits;
+        case ACL_RANGE_SINGLE:
+        default:
+            return maxbits;
+    }
+}
+
+
+/**
+ * Add entry to list of trie entries.
+ *
+ */
+static void
+acl_trie_add(int* nentries, struct acl_trie_entry** entries, int order,
+    acl_type* acl)
+{
+    CHECKALLOC(*entries = (struct acl_trie_entry*) realloc(*entries,
+        sizeof(struct acl_trie_entry) * (*nentries + 1)));
+    (*entries)[*nentries].order = order;
+    (*entries)[*nentries].acl = acl;
+    *nentries += 1;
+}
+
+
+/**
+ * Insert ACL in prefix trie.
+ *
+ */
+static void
+acl_trie_insert(struct acl_trie_node** root, acl_type* acl, int order,
+    int maxbits)
+{
+    const uint8_t* addr = (const uint8_t*) &acl->addr;
+    struct acl_trie_node** node = root;
+    int bits = acl_prefix_bits(acl, maxbits);
+    int depth, bit;
+    for (depth = 0; ; depth++) {
+        if (!*node) {
+            CHECKALLOC(*node = (struct acl_trie_node*) calloc(1,
+                sizeof(struct acl_trie_node)));
+        }
+        if (depth == bits) {
+            break;
+        }
+        bit = (addr[depth/8] >> (7 - depth%8)) & 1;
+        node = &(*node)->child[bit];
+    }
+    acl_trie_add(&(*node)->nentries, &(*node)->entries, order, acl);
+}
+
+
+/**
+ * Clean up prefix trie.
+ *
+ */
+static void
+acl_trie_cleanup(struct acl_trie_node* node)
+{
+    if (!node) {
+        return;
+    }
+    acl_trie_cleanup(node->child[0]);
+    acl_trie_cleanup(node->child[1]);
+    free(node->entries);
+    free(node);
+}
+
+
+/**
+ * Compile ACL list.
+ *
+ */
+acl_type*
+acl_compile(acl_type* acl)
+{
+    acl_trie_type* trie = NULL;
+    acl_type* entry = NULL;
+    int order = 0;
+    if (!acl) {
+        return acl;
+    }
+    CHECKALLOC(trie = (acl_trie_type*) calloc(1, sizeof(acl_trie_type)));
+    for (entry = acl; entry; entry = entry->next, order++) {
+        if (!entry->address) {
+            acl_trie_add(&trie->nany, &trie->any, order, entry);
+        } else if (entry->family == AF_INET6) {
+            acl_trie_insert(&trie->root6, entry, order, 128);
+        } else {
+            acl_trie_insert(&trie->root4, entry, order, 32);
+        }
+    }
+    acl->trie = trie;
+    return acl;
+}
+
+
+/**
+ * Find the first ACL in list order amongst the candidates.
+ *
+ */
+static void
+acl_trie_match(int nentries, struct acl_trie_entry* entries,
+    struct sockaddr_storage* addr, tsig_rr_type* trr,
+    struct acl_trie_entry** best)
+{
+    int i;
+    for (i = 0; i < nentries; i++) {
+        if (*best && (*best)->order < entries[i].order) {
+            return;
+        }
+        if (acl_addr_matches(entries[i].acl, addr) &&
+            acl_tsig_matches(entries[i].acl, trr)) {
+            *best = &entries[i];
+            return;
+        }
+    }
+}
+
+
+/**
+ * Find ACL using the prefix trie.  Only the ACLs on the path of the
+ * address through the trie are candidates, of which the one that comes
+ * first in the list wins, like with a walk over the list.
+ *
+ */
+static acl_type*
+acl_trie_find(acl_trie_type* trie, struct sockaddr_storage* addr,
+    tsig_rr_type* trr)
+{
+    struct acl_trie_entry* best = NULL;
+    struct acl_trie_node* node = NULL;
+    const uint8_t* bytes = NULL;
+    int depth, maxbits;
+    if (addr->ss_family == AF_INET6) {
+        node = trie->root6;
+        bytes = (const uint8_t*) &((struct sockaddr_in6*)addr)->sin6_addr;
+        maxbits = 128;
+    } else {
+        node = trie->root4;
+        bytes = (const uint8_t*) &((struct sockaddr_in*)addr)->sin_addr;
+        maxbits = 32;
+    }
+    acl_trie_match(trie->nany, trie->any, addr, trr, &best);
+    for (depth = 0; node; depth++) {
+        acl_trie_match(node->nentries, node->entries, addr, trr, &best);
+        if (depth == maxbits) {
+            break;
+        }
+        node = node->child[(bytes[depth/8] >> (7 - depth%8)) & 1];
+    }
+    return (best ? best->acl : NULL);
+}
+
+
 /**
  * Find ACL.
  *
@@ -437,6 +645,13 @@ acl_type*
 acl_find(acl_type* acl, struct sockaddr_storage* addr, tsig_rr_type* trr)
 {
     acl_type* find = acl;
+    if (acl && acl->trie) {
+        find = acl_trie_find(acl->trie, addr, trr);
+        if (find) {
+            ods_log_debug("[%s] match %s", acl_str, find->address);
+        }
+        return find;
+    }
     while (find) {
         if (acl_addr_matches(find, addr) && acl_tsig_matches(find, trr)) {
             ods_log_debug("[%s] match %s", acl_str, find->address);
@@ -459,6 +674,12 @@ acl_cleanup(acl_type* acl)
         return;
     }
     acl_cleanup(acl->next);
+    if (acl->trie) {
+        acl_trie_cleanup(acl->trie->root4);
+        acl_trie_cleanup(acl->trie->root6);
+        free(acl->trie->any);
+        free(acl->trie);
+    }
     free(acl->address);
     free(acl);
 }
@@ -55,6 +55,7 @@ typedef enum acl_range_enum acl_range_type;
  *
  */
 typedef struct acl_struct acl_type;
+typedef struct acl_trie_struct acl_trie_type;
 struct acl_struct {
     acl_type* next;
     /* address */
@@ -69,6 +70,8 @@ struct acl_struct {
     tsig_type* tsig;
     /* cache */
     time_t ixfr_disabled;
+    /* prefix trie over the entire list, set on the head of the list */
+    acl_trie_type* trie;
 };
 
 /**
@@ -84,6 +87,15 @@ struct acl_struct {
 acl_type* acl_create(char* address,
     char* port, char* tsig_name, tsig_type* tsig);
 
+/**
+ * Compile the ACL list into prefix tries, one per address family, such
+ * that acl_find() does not need to walk the entire list.
+ * \param[in] acl head of the ACL list
+ * \return acl_type* the same ACL list
+ *
+ */
+acl_type* acl_compile(acl_type* acl);
+
 /**
  * Find ACL.
  * \param[in] acl ACL
@@ -39,9 +39,89 @@
 #include "wire/sock.h"
 
 #define AXFR_TSIG_SIGN_EVERY_NTH 96 /* tsig sign every N packets. */
+#define AXFR_MAX_RR_LEN (LDNS_MAX_DOMAINLEN + 10 + 65535) /* owner, fixed fields, rdata */
 
 const char* axfr_str = "axfr";
 
+
+/**
+ * Open the transfer image for a zone.  The image is pre-rendered when
+ * the zone is output, if it is not there render it now.
+ *
+ */
+static FILE*
+axfr_open(zone_type* zone)
+{
+    char* filename = NULL;
+    FILE* fd = NULL;
+    filename = xfrfile(zone, ".axfr");
+    if (filename) {
+        fd = ods_fopen(filename, NULL, "r");
+        free((void*)filename);
+    }
+    if (!fd) {
+        fd = getxfr(zone, ".xfr", NULL);
+    }
+    return fd;
+}
+
+
+/**
+ * Read the next record from a transfer image.
+ * \return int 1 if a record was read, 0 at end of file, -1 if corrupted.
+ *
+ */
+static int
+axfr_read_wire(FILE* fd, uint8_t* data, size_t* len)
+{
+    uint8_t lenbuf[2];
+    if (fread(lenbuf, sizeof(lenbuf), 1, fd) != 1) {
+        return (feof(fd) ? 0 : -1);
+    }
+    *len = ldns_read_uint16(lenbuf);
+    if (*len == 0 || fread(data, *len, 1, fd) != 1) {
+        return -1;
+    }
+    return 1;
+}
+
+
+/**
+ * Get the type of a record in uncompressed wire format.
+ *
+ */
+static ldns_rr_type
+axfr_wire_type(const uint8_t* data, size_t len)
+{
+    size_t pos = 0;
+    while (pos < len && data[pos] != 0) {
+        pos += data[pos] + 1;
+    }
+    pos++;
+    if (pos + sizeof(uint16_t) > len) {
+        return 0;
+    }
+    return (ldns_rr_type) ldns_read_uint16(&data[pos]);
+}
+
+
+/**
+ * Convert a record in uncompressed wire format.
+ *
+ */
+static ldns_rr*
+axfr_wire2rr(const uint8_t* data, size_t len)
+{
+    ldns_rr* rr = NULL;
+    size_t pos = 0;
+    if (ldns_wire2rr(&rr, data, len, &pos, LDNS_SECTION_ANSWER) !=
+        LDNS_STATUS_OK) {
+        return NULL;
+    }
+    return rr;
+}
+
+
 /**
  * Handle SOA request.
  *
@@ -49,41 +129,30 @@ const char* axfr_str = "axfr";
 query_state
 soa_request(query_type* q, engine_type* engine)
 {
-    char* xfrfile = NULL;
     ldns_rr* rr = NULL;
-    ldns_rdf* prev = NULL;
-    ldns_rdf* orig = NULL;
-    uint32_t ttl = 0;
     time_t expire = 0;
-    ldns_status status = LDNS_STATUS_OK;
-    char line[SE_ADFILE_MAXLINE];
-    unsigned l = 0;
+    uint8_t data[AXFR_MAX_RR_LEN];
+    size_t len = 0;
     FILE* fd = NULL;
     ods_log_assert(q);
     ods_log_assert(q->buffer);
     ods_log_assert(q->zone);
     ods_log_assert(q->zone->name);
     ods_log_assert(engine);
-    xfrfile = ods_build_path(q->zone->name, ".axfr", 0, 1);
-    if (xfrfile) {
-        fd = ods_fopen(xfrfile, NULL, "r");
-    }
+    fd = axfr_open(q->zone);
     if (!fd) {
-        ods_log_error("[%s] unable to open file %s for zone %s",
-            axfr_str, xfrfile, q->zone->name);
-        free((void*)xfrfile);
+        ods_log_error("[%s] unable to open axfr file for zone %s",
+            axfr_str, q->zone->name);
         buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
         return QUERY_PROCESSED;
     }
-    free((void*)xfrfile);
     if (q->tsig_rr->status == TSIG_OK) {
         q->tsig_sign_it = 1; /* sign first packet in stream */
     }
-    /* compression? */
 
     /* add SOA RR */
-    rr = addns_read_rr(fd, line, &orig, &prev, &ttl, &status, &l);
-    if (!rr) {
+    if (axfr_read_wire(fd, data, &len) != 1 ||
+        (rr = axfr_wire2rr(data, len)) == NULL) {
         /* no SOA no transfer */
         ods_log_error("[%s] bad axfr zone %s, corrupted file", axfr_str,
             q->zone->name);
@@ -113,17 +182,16 @@ soa_request(query_type* q, engine_type* engine)
             return QUERY_PROCESSED;
         }
     }
+    ldns_rr_free(rr);
+    rr = NULL;
     /* does it fit? */
-    if (query_add_rr(q, rr)) {
+    if (query_add_wire(q, data, len)) {
         ods_log_debug("[%s] set soa in response %s", axfr_str,
             q->zone->name);
         buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
-        ldns_rr_free(rr);
-        rr = NULL;
     } else {
         ods_log_error("[%s] soa does not fit in response %s",
             axfr_str, q->zone->name);
-        ldns_rr_free(rr);
         buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
         ods_fclose(fd);
         return QUERY_PROCESSED;
@@ -149,13 +217,11 @@ query_state
 axfr(query_type* q, engine_type* engine, int fallback)
 {
     ldns_rr* rr = NULL;
-    ldns_rdf* prev = NULL;
-    ldns_rdf* orig = NULL;
     uint16_t total_added = 0;
-    uint32_t ttl = 0;
     time_t expire = 0;
-    ldns_status status = LDNS_STATUS_OK;
-    char line[SE_ADFILE_MAXLINE];
+    uint8_t data[AXFR_MAX_RR_LEN];
+    size_t len = 0;
+    int status = 0;
     unsigned l = 0;
     long fpos = 0;
     size_t bufpos = 0;
@@ -185,7 +251,7 @@ axfr(query_type* q, engine_type* engine, int fallback)
     ods_log_assert(q->tsig_rr);
     if (q->axfr_fd == NULL) {
         /* start AXFR */
-        q->axfr_fd = getxfr(q->zone, ".axfr", NULL);
+        q->axfr_fd = axfr_open(q->zone);
         if (!q->axfr_fd) {
             ods_log_error("[%s] unable to open axfr file for zone %s",
                 axfr_str, q->zone->name);
@@ -195,20 +261,10 @@ axfr(query_type* q, engine_type* engine, int fallback)
         if (q->tsig_rr->status == TSIG_OK) {
             q->tsig_sign_it = 1; /* sign first packet in stream */
         }
-        /* compression? */
 
         /* add SOA RR */
-        fpos = ftell(q->axfr_fd);
-        if (fpos < 0) {
-            ods_log_error("[%s] unable to read axfr for zone %s: "
-                "ftell() failed (%s)", axfr_str, q->zone->name,
-                strerror(errno));
-            buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
-            return QUERY_PROCESSED;
-        }
-        rr = addns_read_rr(q->axfr_fd, line, &orig, &prev, &ttl, &status,
-            &l);
-        if (!rr) {
+        if (axfr_read_wire(q->axfr_fd, data, &len) != 1 ||
+            (rr = axfr_wire2rr(data, len)) == NULL) {
             /* no SOA no transfer */
             ods_log_error("[%s] bad axfr zone %s, corrupted file",
                 axfr_str, q->zone->name);
@@ -241,20 +297,18 @@ axfr(query_type* q, engine_type* engine, int fallback)
                 return QUERY_PROCESSED;
             }
         }
+        ldns_rr_free(rr);
+        rr = NULL;
         /* does it fit? */
-        if (query_add_rr(q, rr)) {
+        if (query_add_wire(q, data, len)) {
             ods_log_debug("[%s] set soa in axfr zone %s", axfr_str,
                 q->zone->name);
             buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
             total_added++;
-            ldns_rr_free(rr);
-            rr = NULL;
             bufpos = buffer_position(q->buffer);
         } else {
             ods_log_error("[%s] soa does not fit in axfr zone %s",
                 axfr_str, q->zone->name);
-            ldns_rr_free(rr);
-            rr = NULL;
             buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
             ods_fclose(q->axfr_fd);
             q->axfr_fd = NULL;
@@ -280,40 +334,17 @@ axfr(query_type* q, engine_type* engine, int fallback)
         q->axfr_fd = NULL;
         return QUERY_PROCESSED;
     }
-    while ((rr = addns_read_rr(q->axfr_fd, line, &orig, &prev, &ttl,
-        &status, &l)) != NULL) {
-        ods_log_deeebug("[%s] read rr at line %d", axfr_str, l);
-        if (status != LDNS_STATUS_OK) {
-            ldns_rr_free(rr);
-            rr = NULL;
-            ods_log_error("[%s] error reading rr at line %i (%s): %s",
-                axfr_str, l, ldns_get_errorstr_by_id(status), line);
-            buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
-            ods_fclose(q->axfr_fd);
-            q->axfr_fd = NULL;
-            return QUERY_PROCESSED;
-        }
+    while ((status = axfr_read_wire(q->axfr_fd, data, &len)) > 0) {
+        l++;
+        ods_log_deeebug("[%s] read rr %u", axfr_str, l);
         /* does it fit? */
-        if (query_add_rr(q, rr)) {
-            ods_log_deeebug("[%s] add rr at line %d", axfr_str, l);
-            ldns_rr_free(rr);
-            rr = NULL;
-            fpos = ftell(q->axfr_fd);
-            if (fpos < 0) {
-                ods_log_error("[%s] unable to read axfr for zone %s: "
-                    "ftell() failed (%s)", axfr_str, q->zone->name,
-                    strerror(errno));
-                buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
-                ods_fclose(q->axfr_fd);
-                q->axfr_fd = NULL;
-                return QUERY_PROCESSED;
-            }
+        if (query_add_wire(q, data, len)) {
+            ods_log_deeebug("[%s] add rr %u", axfr_str, l);
+            fpos += sizeof(uint16_t) + len;
             buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
             total_added++;
         } else {
-            ods_log_deeebug("[%s] rr at line %d does not fit", axfr_str, l);
-            ldns_rr_free(rr);
-            rr = NULL;
+            ods_log_deeebug("[%s] rr %u does not fit", axfr_str, l);
             if (fseek(q->axfr_fd, fpos, SEEK_SET) != 0) {
                 ods_log_error("[%s] unable to reset file position in axfr "
                     "file: fseek() failed (%s)", axfr_str, strerror(errno));
@@ -328,6 +359,14 @@ axfr(query_type* q, engine_type* engine, int fallback)
             }
         }
     }
+    if (status < 0) {
+        ods_log_error("[%s] bad axfr zone %s, corrupted file after rr %u",
+            axfr_str, q->zone->name, l);
+        buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
+        ods_fclose(q->axfr_fd);
+        q->axfr_fd = NULL;
+        return QUERY_PROCESSED;
+    }
     ods_log_debug("[%s] axfr zone %s is done", axfr_str, q->zone->name);
     q->tsig_sign_it = 1; /* sign last packet */
     q->axfr_is_done = 1;
@@ -380,13 +419,12 @@ query_state
 ixfr(query_type* q, engine_type* engine)
 {
     ldns_rr* rr = NULL;
-    ldns_rdf* prev = NULL;
-    ldns_rdf* orig = NULL;
+    ldns_rr_type rrtype;
     uint16_t total_added = 0;
-    uint32_t ttl = 0;
     time_t expire = 0;
-    ldns_status status = LDNS_STATUS_OK;
-    char line[SE_ADFILE_MAXLINE];
+    uint8_t data[AXFR_MAX_RR_LEN];
+    size_t len = 0;
+    int status = 0;
     unsigned l = 0;
     long fpos = 0;
     size_t bufpos = 0;
@@ -426,23 +464,10 @@ ixfr(query_type* q, engine_type* engine)
         if (q->tsig_rr->status == TSIG_OK) {
             q->tsig_sign_it = 1; /* sign first packet in stream */
         }
-        /* compression? */
 
         /* add SOA RR */
-        fpos = ftell(q->axfr_fd);
-        if (fpos < 0) {
-            ods_log_error("[%s] unable to read ixfr for zone %s: ftell() "
-                "failed (%s)", axfr_str, q->zone->name, strerror(errno));
-            ods_log_info("[%s] axfr fallback zone %s", axfr_str,
-                q->zone->name);
-            ods_fclose(q->axfr_fd);
-            q->axfr_fd = NULL;
-            buffer_set_position(q->buffer, q->startpos);
-            return axfr(q, engine, 1);
-        }
-        rr = addns_read_rr(q->axfr_fd, line, &orig, &prev, &ttl, &status,
-            &l);
-        if (!rr) {
+        if (axfr_read_wire(q->axfr_fd, data, &len) != 1 ||
+            (rr = axfr_wire2rr(data, len)) == NULL) {
             /* no SOA no transfer */
             ods_log_error("[%s] bad ixfr zone %s, corrupted file",
                 axfr_str, q->zone->name);
@@ -474,21 +499,19 @@ ixfr(query_type* q, engine_type* engine)
         /* newest serial */
         new_serial = ldns_rdf2native_int32(
             ldns_rr_rdf(rr, SE_SOA_RDATA_SERIAL));
+        ldns_rr_free(rr);
+        rr = NULL;
         /* does it fit? */
         buffer_set_position(q->buffer, q->startpos);
-        if (query_add_rr(q, rr)) {
+        if (query_add_wire(q, data, len)) {
             ods_log_debug("[%s] set soa in ixfr zone %s", axfr_str,
                 q->zone->name);
             buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
             total_added++;
-            ldns_rr_free(rr);
-            rr = NULL;
             bufpos = buffer_position(q->buffer);
         } else {
             ods_log_error("[%s] soa does not fit in ixfr zone %s",
                 axfr_str, q->zone->name);
-            ldns_rr_free(rr);
-            rr = NULL;
             buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
             return QUERY_PROCESSED;
         }
@@ -517,54 +540,38 @@ ixfr(query_type* q, engine_type* engine)
         buffer_set_position(q->buffer, q->startpos);
         return axfr(q, engine, 1);
     }
-    while ((rr = addns_read_rr(q->axfr_fd, line, &orig, &prev, &ttl,
-        &status, &l)) != NULL) {
-        ods_log_deeebug("[%s] read rr at line %d", axfr_str, l);
-        if (status != LDNS_STATUS_OK) {
-            ldns_rr_free(rr);
-            rr = NULL;
-            ods_log_error("[%s] error reading rr at line %i (%s): %s",
-                axfr_str, l, ldns_get_errorstr_by_id(status), line);
-            goto axfr_fallback;
-        }
-        if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA) {
+    while ((status = axfr_read_wire(q->axfr_fd, data, &len)) > 0) {
+        l++;
+        ods_log_deeebug("[%s] read rr %u", axfr_str, l);
+        rrtype = axfr_wire_type(data, len);
+        if (rrtype == LDNS_RR_TYPE_SOA) {
             del_mode = !del_mode;
         }
         if (!soa_found) {
-            if (del_mode && ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA &&
+            if (del_mode && rrtype == LDNS_RR_TYPE_SOA &&
+                (rr = axfr_wire2rr(data, len)) != NULL &&
                 q->serial == ldns_rdf2native_int32(
                 ldns_rr_rdf(rr, SE_SOA_RDATA_SERIAL))) {
                 soa_found = 1;
             } else {
-                ods_log_deeebug("[%s] soa serial %u not found for rr at line %d",
+                ods_log_deeebug("[%s] soa serial %u not found for rr %u",
                     axfr_str, q->serial, l);
-                ldns_rr_free(rr);
-                rr = NULL;
-                continue;
             }
-        }
-        /* does it fit? */
-        if (query_add_rr(q, rr)) {
-            ods_log_deeebug("[%s] add rr at line %d", axfr_str, l);
             ldns_rr_free(rr);
             rr = NULL;
-            fpos = ftell(q->axfr_fd);
-            if (fpos < 0) {
-                ods_log_error("[%s] unable to read ixfr for zone %s: ftell() "
-                    "failed (%s)", axfr_str, q->zone->name, strerror(errno));
-                ods_log_info("[%s] axfr fallback zone %s", axfr_str,
-                    q->zone->name);
-                ods_fclose(q->axfr_fd);
-                q->axfr_fd = NULL;
-                buffer_set_position(q->buffer, q->startpos);
-                return axfr(q, engine, 1);
+            if (!soa_found) {
+                fpos += sizeof(uint16_t) + len;
+                continue;
             }
+        }
+        /* does it fit? */
+        if (query_add_wire(q, data, len)) {
+            ods_log_deeebug("[%s] add rr %u", axfr_str, l);
+            fpos += sizeof(uint16_t) + len;
             buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
             total_added++;
         } else {
-            ods_log_deeebug("[%s] rr at line %d does not fit", axfr_str, l);
-            ldns_rr_free(rr);
-            rr = NULL;
+            ods_log_deeebug("[%s] rr %u does not fit", axfr_str, l);
             if (fseek(q->axfr_fd, fpos, SEEK_SET) != 0) {
                 ods_log_error("[%s] unable to reset file position in ixfr "
                     "file: fseek() failed (%s)", axfr_str, strerror(errno));
@@ -577,6 +584,11 @@ ixfr(query_type* q, engine_type* engine)
             }
         }
     }
+    if (status < 0) {
+        ods_log_error("[%s] bad ixfr zone %s, corrupted file after rr %u",
+            axfr_str, q->zone->name, l);
+        goto axfr_fallback;
+    }
     if (!soa_found) {
         ods_log_warning("[%s] zone %s journal not found for serial %u",
             axfr_str, q->zone->name, q->serial);
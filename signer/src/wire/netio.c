@@ -9,7 +9,9 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <sys/time.h>
+#include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -42,9 +44,266 @@ netio_create()
     CHECKALLOC(netio = (netio_type*) malloc(sizeof(netio_type)));
     netio->handlers = NULL;
     netio->dispatch_next = NULL;
+    netio->dispatching = NULL;
+    netio->timers = NULL;
+    netio->timer_count = 0;
+    netio->timer_capacity = 0;
+    netio->changed = NULL;
+    pthread_mutex_init(&netio->lock, NULL);
+    netio->epollfd = -1;
+#ifdef USE_EPOLL
+    netio->events = NULL;
+    netio->nevents = 0;
+    netio->epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (netio->epollfd == -1) {
+        ods_log_warning("[%s] unable to create epoll instance, falling back "
+            "to pselect: %s", netio_str, strerror(errno));
+    } else {
+        CHECKALLOC(netio->events = (struct epoll_event*) malloc(
+            NETIO_EPOLL_EVENTS * sizeof(struct epoll_event)));
+    }
+#endif
     return netio;
 }
 
+
+/**
+ * Compare timespec.
+ *
+ */
+static int
+timespec_compare(const struct timespec* left,
+    const struct timespec* right)
+{
+    if (left->tv_sec < right->tv_sec) {
+        return -1;
+    } else if (left->tv_sec > right->tv_sec) {
+        return 1;
+    } else if (left->tv_nsec < right->tv_nsec) {
+        return -1;
+    } else if (left->tv_nsec > right->tv_nsec) {
+         return 1;
+    }
+    return 0;
+}
+
+
+/*
+ * Place a handler at a position in the timeout heap.
+ *
+ */
+static void
+netio_timer_place(netio_type* netio, netio_handler_list_type* l, long i)
+{
+    netio->timers[i] = l;
+    l->timer_index = i;
+}
+
+/*
+ * Restore the heap order around a handler whose timeout changed.
+ *
+ */
+static void
+netio_timer_sift(netio_type* netio, long i)
+{
+    netio_handler_list_type* l = netio->timers[i];
+    long parent, child;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (timespec_compare(&netio->timers[parent]->timer, &l->timer) <= 0) {
+            break;
+        }
+        netio_timer_place(netio, netio->timers[parent], i);
+        i = parent;
+    }
+    for (;;) {
+        child = 2 * i + 1;
+        if (child >= netio->timer_count) {
+            break;
+        }
+        if (child + 1 < netio->timer_count &&
+            timespec_compare(&netio->timers[child+1]->timer,
+            &netio->timers[child]->timer) < 0) {
+            child++;
+        }
+        if (timespec_compare(&l->timer, &netio->timers[child]->timer) <= 0) {
+            break;
+        }
+        netio_timer_place(netio, netio->timers[child], i);
+        i = child;
+    }
+    netio_timer_place(netio, l, i);
+}
+
+/*
+ * Remove a handler from the timeout heap.
+ *
+ */
+static void
+netio_timer_remove(netio_type* netio, netio_handler_list_type* l)
+{
+    long i = l->timer_index;
+    if (i < 0) {
+        return;
+    }
+    l->timer_index = -1;
+    netio->timer_count--;
+    if (i < netio->timer_count) {
+        netio_timer_place(netio, netio->timers[netio->timer_count], i);
+        netio_timer_sift(netio, i);
+    }
+}
+
+/*
+ * Bring the position of a handler in the timeout heap up to date.
+ *
+ */
+static void
+netio_timer_update(netio_type* netio, netio_handler_list_type* l)
+{
+    netio_handler_type* handler = l->handler;
+    if (!handler->timeout || !(handler->event_types & NETIO_EVENT_TIMEOUT)) {
+        netio_timer_remove(netio, l);
+        return;
+    }
+    l->timer = *handler->timeout;
+    if (l->timer_index < 0) {
+        if (netio->timer_count == netio->timer_capacity) {
+            netio->timer_capacity = (netio->timer_capacity ?
+                netio->timer_capacity * 2 : 64);
+            CHECKALLOC(netio->timers = (netio_handler_list_type**) realloc(
+                netio->timers, netio->timer_capacity *
+                sizeof(netio_handler_list_type*)));
+        }
+        netio_timer_place(netio, l, netio->timer_count++);
+    }
+    netio_timer_sift(netio, l->timer_index);
+}
+
+#ifdef USE_EPOLL
+/*
+ * Translate the event types of a handler to epoll(7) events.
+ *
+ */
+static unsigned int
+netio_epoll_events(netio_handler_type* handler)
+{
+    unsigned int events = 0;
+    if (handler->fd < 0) {
+        return 0;
+    }
+    if (handler->event_types & NETIO_EVENT_READ) {
+        events |= EPOLLIN;
+    }
+    if (handler->event_types & NETIO_EVENT_WRITE) {
+        events |= EPOLLOUT;
+    }
+    if (handler->event_types & NETIO_EVENT_EXCEPT) {
+        events |= EPOLLPRI;
+    }
+    return events;
+}
+
+/*
+ * Remove the registration of a handler from epoll and forget about
+ * pending events for it.
+ *
+ */
+static void
+netio_epoll_unregister(netio_type* netio, netio_handler_list_type* l)
+{
+    struct epoll_event event;
+    int i;
+    if (netio->epollfd == -1) {
+        return;
+    }
+    if (l->registered_fd != -1) {
+        /* the file descriptor may already have been closed */
+        memset(&event, 0, sizeof(event));
+        (void) epoll_ctl(netio->epollfd, EPOLL_CTL_DEL, l->registered_fd,
+            &event);
+        l->registered_fd = -1;
+        l->registered_events = 0;
+    }
+    for (i = 0; i < netio->nevents; i++) {
+        if (netio->events[i].data.ptr == l) {
+            netio->events[i].data.ptr = NULL;
+        }
+    }
+}
+
+/*
+ * Bring the registration of a handler with epoll up to date.  As a
+ * closed file descriptor is silently dropped by the kernel, a missing
+ * registration is added and an existing one is modified.
+ *
+ */
+static void
+netio_epoll_register(netio_type* netio, netio_handler_list_type* l)
+{
+    struct epoll_event event;
+    unsigned int events = netio_epoll_events(l->handler);
+    int fd = (events ? l->handler->fd : -1);
+    int op;
+
+    if (l->registered_fd != -1 && l->registered_fd != fd) {
+        netio_epoll_unregister(netio, l);
+    }
+    if (fd == -1 || (fd == l->registered_fd && events == l->registered_events
+        && !l->registered_stale)) {
+        return;
+    }
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = l;
+    op = (l->registered_fd == fd ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+    if (epoll_ctl(netio->epollfd, op, fd, &event) == -1) {
+        op = (op == EPOLL_CTL_MOD ? EPOLL_CTL_ADD : EPOLL_CTL_MOD);
+        if ((errno != ENOENT && errno != EEXIST) ||
+            epoll_ctl(netio->epollfd, op, fd, &event) == -1) {
+            ods_log_error("[%s] unable to register fd %d with epoll: %s",
+                netio_str, fd, strerror(errno));
+            l->registered_fd = -1;
+            return;
+        }
+    }
+    l->registered_fd = fd;
+    l->registered_events = events;
+    l->registered_stale = 0;
+}
+#endif
+
+/*
+ * Bring the registration and timeout of a handler up to date.  Called
+ * with the lock held.
+ *
+ */
+static void
+netio_sync(netio_type* netio, netio_handler_list_type* l)
+{
+#ifdef USE_EPOLL
+    if (netio->epollfd != -1) {
+        netio_epoll_register(netio, l);
+    }
+#endif
+    netio_timer_update(netio, l);
+}
+
+/*
+ * Queue a handler to be brought up to date on the next dispatch.
+ * Called with the lock held.
+ *
+ */
+static void
+netio_mark_changed(netio_type* netio, netio_handler_list_type* l)
+{
+    if (!l->changed) {
+        l->changed = 1;
+        l->changed_next = netio->changed;
+        netio->changed = l;
+    }
+}
+
 /*
  * Add a new handler to netio.
  *
@@ -58,12 +317,41 @@ netio_add_handler(netio_type* netio, netio_handler_type* handler)
     ods_log_assert(handler);
 
     CHECKALLOC(l = (netio_handler_list_type*) malloc(sizeof(netio_handler_list_type)));
-    l->next = netio->handlers;
     l->handler = handler;
+    l->registered_fd = -1;
+    l->registered_events = 0;
+    l->registered_stale = 0;
+    l->timer_index = -1;
+    l->timer.tv_sec = 0;
+    l->timer.tv_nsec = 0;
+    l->changed_next = NULL;
+    l->changed = 0;
+    pthread_mutex_lock(&netio->lock);
+    handler->entry = l;
+    l->next = netio->handlers;
     netio->handlers = l;
+    netio_mark_changed(netio, l);
+    pthread_mutex_unlock(&netio->lock);
     ods_log_debug("[%s] handler added", netio_str);
 }
 
+/*
+ * Bring netio up to date after a handler changed.
+ *
+ */
+void
+netio_update_handler(netio_type* netio, netio_handler_type* handler)
+{
+    if (!netio || !handler) {
+        return;
+    }
+    pthread_mutex_lock(&netio->lock);
+    if (handler->entry) {
+        netio_mark_changed(netio, handler->entry);
+    }
+    pthread_mutex_unlock(&netio->lock);
+}
+
 /*
  * Remove the handler from netio. Caller is responsible for freeing
  * handler afterwards.
@@ -75,18 +363,35 @@ netio_remove_handler(netio_type* netio, netio_handler_type* handler)
     if (!netio || !handler) {
         return;
     }
+    pthread_mutex_lock(&netio->lock);
     for (lptr = &netio->handlers; *lptr; lptr = &(*lptr)->next) {
         if ((*lptr)->handler == handler) {
-            netio_handler_list_type* next = (*lptr)->next;
-            if ((*lptr) == netio->dispatch_next) {
-                netio->dispatch_next = next;
+            netio_handler_list_type* l = *lptr;
+            if (l == netio->dispatch_next) {
+                netio->dispatch_next = l->next;
             }
-            (*lptr)->handler = NULL;
-	    free(*lptr);
-            *lptr = next;
+            if (l == netio->dispatching) {
+                netio->dispatching = NULL;
+            }
+            if (l->changed) {
+                netio_handler_list_type** cptr = &netio->changed;
+                while (*cptr != l) {
+                    cptr = &(*cptr)->changed_next;
+                }
+                *cptr = l->changed_next;
+            }
+#ifdef USE_EPOLL
+            netio_epoll_unregister(netio, l);
+#endif
+            netio_timer_remove(netio, l);
+            handler->entry = NULL;
+            *lptr = l->next;
+            l->handler = NULL;
+	    free(l);
             break;
         }
     }
+    pthread_mutex_unlock(&netio->lock);
     ods_log_debug("[%s] handler removed", netio_str);
 }
 
@@ -102,26 +407,6 @@ timeval_to_timespec(struct timespec* left, const struct timeval* right)
     left->tv_nsec = 1000 * right->tv_usec;
 }
 
-/**
- * Compare timespec.
- *
- */
-static int
-timespec_compare(const struct timespec* left,
-    const struct timespec* right)
-{
-    if (left->tv_sec < right->tv_sec) {
-        return -1;
-    } else if (left->tv_sec > right->tv_sec) {
-        return 1;
-    } else if (left->tv_nsec < right->tv_nsec) {
-        return -1;
-    } else if (left->tv_nsec > right->tv_nsec) {
-         return 1;
-    }
-    return 0;
-}
-
 
 /**
  * Add timespecs.
@@ -179,6 +464,53 @@ netio_current_time(netio_type* netio)
 }
 
 
+/*
+ * Get the handler with the earliest timeout.  As handlers may still
+ * change their timeout in place, the timeout at the top of the heap is
+ * checked against the handler before it is believed.  Called with the
+ * lock held.
+ *
+ */
+static netio_handler_list_type*
+netio_first_timer(netio_type* netio)
+{
+    netio_handler_list_type* l = NULL;
+    while (netio->timer_count > 0) {
+        l = netio->timers[0];
+        if (l->handler->timeout &&
+            (l->handler->event_types & NETIO_EVENT_TIMEOUT) &&
+            timespec_compare(&l->timer, l->handler->timeout) == 0) {
+            return l;
+        }
+        netio_timer_update(netio, l);
+    }
+    return NULL;
+}
+
+
+/*
+ * Call a handler, and bring it up to date afterwards unless it removed
+ * itself.  Called with the lock held, which is released during the
+ * call.
+ *
+ */
+static void
+netio_call(netio_type* netio, netio_handler_list_type* l,
+    netio_events_type event_types)
+{
+    netio_handler_type* handler = l->handler;
+    netio->dispatching = l;
+    l->registered_stale = 1;
+    pthread_mutex_unlock(&netio->lock);
+    handler->event_handler(netio, handler, event_types);
+    pthread_mutex_lock(&netio->lock);
+    if (netio->dispatching == l) {
+        netio_sync(netio, l);
+    }
+    netio->dispatching = NULL;
+}
+
+
 /*
  * Check for events and dispatch them to the handlers.
  *
@@ -191,10 +523,14 @@ netio_dispatch(netio_type* netio, const struct timespec* timeout,
     int max_fd;
     int have_timeout = 0;
     struct timespec minimum_timeout;
-    netio_handler_type* timeout_handler = NULL;
+    netio_handler_list_type* timeout_list = NULL;
     netio_handler_list_type* l = NULL;
     int rc = 0;
     int result = 0;
+#ifdef USE_EPOLL
+    long timeout_ms = -1;
+    int i;
+#endif
 
     if (!netio || !netio->handlers) {
         return 0;
@@ -206,44 +542,66 @@ netio_dispatch(netio_type* netio, const struct timespec* timeout,
         have_timeout = 1;
         memcpy(&minimum_timeout, timeout, sizeof(struct timespec));
     }
-    /* Initialize the fd_sets and timeout based on the handler
-     * information */
     max_fd = -1;
     FD_ZERO(&readfds);
     FD_ZERO(&writefds);
     FD_ZERO(&exceptfds);
-    for (l = netio->handlers; l; l = l->next) {
-        netio_handler_type* handler = l->handler;
-        if (handler->fd >= 0 && handler->fd < (int) FD_SETSIZE) {
-            if (handler->fd > max_fd) {
-                max_fd = handler->fd;
-            }
-            if (handler->event_types & NETIO_EVENT_READ) {
-                FD_SET(handler->fd, &readfds);
-            }
-            if (handler->event_types & NETIO_EVENT_WRITE) {
-                FD_SET(handler->fd, &writefds);
-            }
-            if (handler->event_types & NETIO_EVENT_EXCEPT) {
-                FD_SET(handler->fd, &exceptfds);
-            }
+    pthread_mutex_lock(&netio->lock);
+#ifdef USE_EPOLL
+    /* drop registrations of file descriptors no longer in use first,
+     * they may have been reused by another handler that changed */
+    for (l = netio->changed; l && netio->epollfd != -1; l = l->changed_next) {
+        if (l->registered_fd != -1 && (l->registered_fd != l->handler->fd
+            || !netio_epoll_events(l->handler))) {
+            netio_epoll_unregister(netio, l);
         }
-        if (handler->timeout &&
-            (handler->event_types & NETIO_EVENT_TIMEOUT)) {
-            struct timespec relative;
-            relative.tv_sec = handler->timeout->tv_sec;
-            relative.tv_nsec = handler->timeout->tv_nsec;
-            timespec_subtract(&relative, netio_current_time(netio));
-
-            if (!have_timeout ||
-                timespec_compare(&relative, &minimum_timeout) < 0) {
-                have_timeout = 1;
-                minimum_timeout.tv_sec = relative.tv_sec;
-                minimum_timeout.tv_nsec = relative.tv_nsec;
-                timeout_handler = handler;
+    }
+#endif
+    /* Bring the handlers that changed up to date */
+    while (netio->changed) {
+        l = netio->changed;
+        netio->changed = l->changed_next;
+        l->changed_next = NULL;
+        l->changed = 0;
+        netio_sync(netio, l);
+    }
+    /* The earliest timeout is at the top of the heap */
+    timeout_list = netio_first_timer(netio);
+    if (timeout_list) {
+        struct timespec relative;
+        relative.tv_sec = timeout_list->timer.tv_sec;
+        relative.tv_nsec = timeout_list->timer.tv_nsec;
+        timespec_subtract(&relative, netio_current_time(netio));
+        if (!have_timeout ||
+            timespec_compare(&relative, &minimum_timeout) < 0) {
+            have_timeout = 1;
+            minimum_timeout.tv_sec = relative.tv_sec;
+            minimum_timeout.tv_nsec = relative.tv_nsec;
+        } else {
+            timeout_list = NULL;
+        }
+    }
+    /* Without epoll the descriptors are collected on each dispatch */
+    if (netio->epollfd == -1) {
+        for (l = netio->handlers; l; l = l->next) {
+            netio_handler_type* handler = l->handler;
+            if (handler->fd >= 0 && handler->fd < (int) FD_SETSIZE) {
+                if (handler->fd > max_fd) {
+                    max_fd = handler->fd;
+                }
+                if (handler->event_types & NETIO_EVENT_READ) {
+                    FD_SET(handler->fd, &readfds);
+                }
+                if (handler->event_types & NETIO_EVENT_WRITE) {
+                    FD_SET(handler->fd, &writefds);
+                }
+                if (handler->event_types & NETIO_EVENT_EXCEPT) {
+                    FD_SET(handler->fd, &exceptfds);
+                }
             }
         }
     }
+    pthread_mutex_unlock(&netio->lock);
 
     if (have_timeout && minimum_timeout.tv_sec < 0) {
         /*
@@ -252,22 +610,47 @@ netio_dispatch(netio_type* netio, const struct timespec* timeout,
          */
         ods_log_debug("[%s] dispatch timeout event without checking for "
             "other events", netio_str);
-        if (timeout_handler &&
-            (timeout_handler->event_types & NETIO_EVENT_TIMEOUT)) {
-            timeout_handler->event_handler(netio, timeout_handler,
-                NETIO_EVENT_TIMEOUT);
+        if (timeout_list) {
+            pthread_mutex_lock(&netio->lock);
+            if (netio_first_timer(netio) == timeout_list) {
+                netio_call(netio, timeout_list, NETIO_EVENT_TIMEOUT);
+            }
+            pthread_mutex_unlock(&netio->lock);
         }
         return result;
     }
     /* Check for events. */
-    rc = pselect(max_fd + 1, &readfds, &writefds, &exceptfds,
-        have_timeout ? &minimum_timeout : NULL, sigmask);
-    if (rc == -1) {
-        if(errno == EINVAL || errno == EACCES || errno == EBADF) {
-            ods_fatal_exit("[%s] fatal error pselect: %s", netio_str,
-                strerror(errno));
+    if (netio->epollfd != -1) {
+#ifdef USE_EPOLL
+        if (have_timeout) {
+            /* round up, waking up early would only spin */
+            timeout_ms = (minimum_timeout.tv_nsec + 999999L) / 1000000L;
+            if (minimum_timeout.tv_sec > (INT_MAX - timeout_ms) / 1000) {
+                timeout_ms = INT_MAX;
+            } else {
+                timeout_ms += minimum_timeout.tv_sec * 1000L;
+            }
+        }
+        rc = epoll_pwait(netio->epollfd, netio->events, NETIO_EPOLL_EVENTS,
+            (int) timeout_ms, sigmask);
+        if (rc == -1) {
+            if (errno == EINVAL || errno == EBADF) {
+                ods_fatal_exit("[%s] fatal error epoll_pwait: %s", netio_str,
+                    strerror(errno));
+            }
+            return -1;
+        }
+#endif
+    } else {
+        rc = pselect(max_fd + 1, &readfds, &writefds, &exceptfds,
+            have_timeout ? &minimum_timeout : NULL, sigmask);
+        if (rc == -1) {
+            if(errno == EINVAL || errno == EACCES || errno == EBADF) {
+                ods_fatal_exit("[%s] fatal error pselect: %s", netio_str,
+                    strerror(errno));
+            }
+            return -1;
         }
-        return -1;
     }
 
     /* Clear the cached current_time (pselect(2) may block for
@@ -279,13 +662,51 @@ netio_dispatch(netio_type* netio, const struct timespec* timeout,
             "expired", netio_str);
         /*
          * No events before the minimum timeout expired.
-         * Dispatch to handler if interested.
+         * Dispatch to handler if interested.  The handler may have
+         * been removed by another thread while waiting.
          */
-        if (timeout_handler &&
-            (timeout_handler->event_types & NETIO_EVENT_TIMEOUT)) {
-            timeout_handler->event_handler(netio, timeout_handler,
-                NETIO_EVENT_TIMEOUT);
+        if (timeout_list) {
+            pthread_mutex_lock(&netio->lock);
+            if (netio_first_timer(netio) == timeout_list) {
+                netio_call(netio, timeout_list, NETIO_EVENT_TIMEOUT);
+            }
+            pthread_mutex_unlock(&netio->lock);
+        }
+    } else if (netio->epollfd != -1) {
+#ifdef USE_EPOLL
+        /*
+         * Dispatch only the handlers that have events.  Handlers
+         * removed during the dispatch have their pending events
+         * cleared by netio_remove_handler.
+         */
+        pthread_mutex_lock(&netio->lock);
+        netio->nevents = rc;
+        for (i = 0; i < rc; i++) {
+            netio_events_type event_types = NETIO_EVENT_NONE;
+            netio_handler_type* handler;
+            l = (netio_handler_list_type*) netio->events[i].data.ptr;
+            if (!l) {
+                continue;
+            }
+            handler = l->handler;
+            /* like pselect(2), report errors as readable and writable */
+            if (netio->events[i].events & (EPOLLIN|EPOLLERR|EPOLLHUP)) {
+                event_types |= NETIO_EVENT_READ;
+            }
+            if (netio->events[i].events & (EPOLLOUT|EPOLLERR|EPOLLHUP)) {
+                event_types |= NETIO_EVENT_WRITE;
+            }
+            if (netio->events[i].events & EPOLLPRI) {
+                event_types |= NETIO_EVENT_EXCEPT;
+            }
+            if (event_types & handler->event_types) {
+                netio_call(netio, l, event_types & handler->event_types);
+                ++result;
+            }
         }
+        netio->nevents = 0;
+        pthread_mutex_unlock(&netio->lock);
+#endif
     } else {
         /*
          * Dispatch all the events to interested handlers
@@ -294,6 +715,7 @@ netio_dispatch(netio_type* netio, const struct timespec* timeout,
          * calling the current handler!
          */
 	ods_log_assert(netio->dispatch_next == NULL);
+        pthread_mutex_lock(&netio->lock);
         for (l = netio->handlers; l && rc; ) {
             netio_handler_type* handler = l->handler;
             netio->dispatch_next = l->next;
@@ -315,19 +737,39 @@ netio_dispatch(netio_type* netio, const struct timespec* timeout,
                     rc--;
                 }
                 if (event_types & handler->event_types) {
-                    handler->event_handler(netio, handler,
-                        event_types & handler->event_types);
+                    netio_call(netio, l, event_types & handler->event_types);
                     ++result;
                 }
             }
             l = netio->dispatch_next;
         }
         netio->dispatch_next = NULL;
+        pthread_mutex_unlock(&netio->lock);
     }
     return result;
 }
 
 
+/**
+ * Release the epoll instance.
+ *
+ */
+static void
+netio_cleanup_epoll(netio_type* netio)
+{
+    if (netio->epollfd != -1) {
+        close(netio->epollfd);
+        netio->epollfd = -1;
+    }
+#ifdef USE_EPOLL
+    free(netio->events);
+    netio->events = NULL;
+#endif
+    free(netio->timers);
+    netio->timers = NULL;
+    pthread_mutex_destroy(&netio->lock);
+}
+
 /**
  * Clean up netio instance
  *
@@ -339,12 +781,14 @@ netio_cleanup(netio_type* netio)
     while (netio->handlers) {
         netio_handler_list_type* handler = netio->handlers;
         netio->handlers = handler->next;
+        handler->handler->entry = NULL;
         if (handler->handler->free_handler) {
             free(handler->handler->user_data);
             free(handler->handler);
         }
         free(handler);
     }
+    netio_cleanup_epoll(netio);
     free(netio);
 }
 
@@ -356,6 +800,6 @@ netio_cleanup_shallow(netio_type* netio)
 {
     ods_log_assert(netio);
     free(netio->handlers);
+    netio_cleanup_epoll(netio);
     free(netio);
 }
-
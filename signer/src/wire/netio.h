@@ -35,6 +35,14 @@
  * events and dispatch them to the handlers.  An additional timeout
  * can be specified as well as the signal mask to install while
  * blocked in pselect(2).
+ *
+ * Where available, epoll(7) is used instead of pselect(2).  The
+ * handlers are then registered with the kernel when they are added or
+ * changed, which removes the FD_SETSIZE limit on the descriptors that
+ * can be watched.  Timeouts are kept in a heap, so a dispatch does not
+ * visit handlers that have no events.  A handler is brought up to date
+ * after its callback returns; code that changes a handler outside of
+ * its own callback must call netio_update_handler.
  */
 
 /**
@@ -49,11 +57,20 @@
 #include <sys/select.h>
 #endif
 
+#include <pthread.h>
 #include <signal.h>
 
 #include "config.h"
 #include "status.h"
 
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_CREATE1) && defined(HAVE_EPOLL_PWAIT)
+#define USE_EPOLL 1
+#include <sys/epoll.h>
+#endif
+
+/* Maximum number of events retrieved with a single epoll_pwait(2). */
+#define NETIO_EPOLL_EVENTS 1024
+
 #ifndef PF_INET
 #define PF_INET AF_INET
 #endif
@@ -93,6 +110,24 @@ typedef void (*netio_event_handler_type)(netio_type *netio,
 struct netio_handler_list_struct {
     netio_handler_list_type* next;
     netio_handler_type* handler;
+    /*
+     * The file descriptor and events as last registered with
+     * epoll(7), or -1 if not registered.  The registration is
+     * refreshed when the handler has been called, as the handler may
+     * have closed and reopened its file descriptor.
+     */
+    int registered_fd;
+    unsigned int registered_events;
+    int registered_stale;
+    /*
+     * Position in the timeout heap, or -1, and the timeout as it was
+     * when the handler was last brought up to date.
+     */
+    long timer_index;
+    struct timespec timer;
+    /* Link in the list of handlers that changed */
+    netio_handler_list_type* changed_next;
+    int changed;
 };
 
 /**
@@ -130,6 +165,12 @@ struct netio_handler_struct {
      */
     netio_event_handler_type event_handler;
     int free_handler;
+    /*
+     * Registration with netio, maintained by netio.  Must be NULL
+     * before the handler is added if netio_update_handler may be
+     * called for it before then.
+     */
+    netio_handler_list_type* entry;
 };
 
 /**
@@ -154,6 +195,34 @@ struct netio_struct {
      * To make sure that deletes respect the state of the iterator.
      */
     netio_handler_list_type* dispatch_next;
+    /*
+     * Handler being called, cleared when it removes itself so that it
+     * is not brought up to date afterwards.
+     */
+    netio_handler_list_type* dispatching;
+    /*
+     * Heap of handlers with a timeout, earliest first.
+     */
+    netio_handler_list_type** timers;
+    long timer_count;
+    long timer_capacity;
+    /*
+     * Handlers changed since the last dispatch.  Handlers may be added,
+     * changed and removed from other threads, the lock protects the
+     * handler list, the heap and the registrations.
+     */
+    netio_handler_list_type* changed;
+    pthread_mutex_t lock;
+    /*
+     * The epoll(7) instance, or -1 when falling back to pselect(2).
+     * The events of the current dispatch are kept so that handlers
+     * removed during the dispatch are no longer called.
+     */
+    int epollfd;
+#ifdef USE_EPOLL
+    struct epoll_event* events;
+    int nevents;
+#endif
 };
 
 /*
@@ -180,6 +249,15 @@ void netio_add_handler(netio_type* netio, netio_handler_type* handler);
  */
 void netio_remove_handler(netio_type* netio, netio_handler_type* handler);
 
+/*
+ * Bring netio up to date after the file descriptor, event types or
+ * timeout of a handler have been changed outside of its own callback.
+ * \param[in] netio netio instance
+ * \param[in] handler handler
+ *
+ */
+void netio_update_handler(netio_type* netio, netio_handler_type* handler);
+
 /*
  * Retrieve the current time (using gettimeofday(2)).
  * \param[in] netio netio instance
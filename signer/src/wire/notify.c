@@ -36,7 +36,7 @@
 #include "wire/notify.h"
 #include "wire/xfrd.h"
 
-#include <sys/socket.h>
+#include <string.h>
 
 static const char* notify_str = "notify";
 
@@ -57,6 +57,18 @@ notify_time(notify_type* notify)
 }
 
 
+/**
+ * Let netio know that the handler changed.
+ *
+ */
+static void
+notify_update_handler(notify_type* notify)
+{
+    xfrhandler_type* xfrhandler = (xfrhandler_type*) notify->xfrhandler;
+    netio_update_handler(xfrhandler->netio, &notify->handler);
+}
+
+
 /**
  * Set timer.
  *
@@ -88,6 +100,7 @@ notify_set_timer(notify_type* notify, time_t t)
     notify->handler.timeout = &notify->timeout;
     notify->timeout.tv_sec = t;
     notify->timeout.tv_nsec = 0;
+    notify_update_handler(notify);
 }
 
 
@@ -106,24 +119,48 @@ notify_create(xfrhandler_type* xfrhandler, zone_type* zone)
     notify->zone = zone;
     notify->xfrhandler = xfrhandler;
     notify->waiting_next = NULL;
+    notify->inflight_next = NULL;
     notify->secondary = NULL;
+    notify->dest = NULL;
+    notify->sock = NULL;
     notify->soa = NULL;
     notify->tsig_rr = tsig_rr_create();
+    notify->wire = NULL;
+    notify->wire_len = 0;
     notify->retry = 0;
     notify->query_id = 0;
     notify->is_waiting = 0;
+    notify->is_inflight = 0;
+    notify->is_queued = 0;
     notify->handler.fd = -1;
     notify->timeout.tv_sec = 0;
     notify->timeout.tv_nsec = 0;
     notify->handler.timeout = NULL;
     notify->handler.user_data = notify;
-    notify->handler.event_types =
-        NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
+    notify->handler.event_types = NETIO_EVENT_TIMEOUT;
     notify->handler.event_handler = notify_handle_zone;
+    notify->handler.entry = NULL;
     return notify;
 }
 
 
+/**
+ * Drop the packet for the current secondary.
+ *
+ */
+static void
+notify_forget(notify_type* notify)
+{
+    ods_log_assert(notify);
+    ods_log_assert(notify->xfrhandler);
+    notifyq_cancel(notify->xfrhandler->notifyq, notify);
+    free(notify->wire);
+    notify->wire = NULL;
+    notify->wire_len = 0;
+    notify->dest = NULL;
+}
+
+
 /**
  * Setup notify.
  *
@@ -168,10 +205,8 @@ notify_disable(notify_type* notify)
     ods_log_assert(zone->name);
     notify->secondary = NULL;
     notify->handler.timeout = NULL;
-    if (notify->handler.fd != -1) {
-        close(notify->handler.fd);
-        notify->handler.fd = -1;
-    }
+    notify_update_handler(notify);
+    notify_forget(notify);
     if (xfrhandler->notify_udp_num == NOTIFY_MAX_UDP) {
         while (xfrhandler->notify_waiting_first) {
             notify_type* wn = xfrhandler->notify_waiting_first;
@@ -204,6 +239,7 @@ notify_next(notify_type* notify)
     if (!notify || !notify->secondary) {
         return;
     }
+    notify_forget(notify);
     notify->secondary = notify->secondary->next;
     notify->retry = 0;
     if (!notify->secondary) {
@@ -217,67 +253,40 @@ notify_next(notify_type* notify)
 }
 
 
-/**
- * Read packet from udp.
- *
- */
-static int
-notify_udp_read_packet(notify_type* notify)
-{
-    xfrhandler_type* xfrhandler = NULL;
-    ssize_t received = 0;
-    ods_log_assert(notify);
-    xfrhandler = (xfrhandler_type*) notify->xfrhandler;
-    ods_log_assert(xfrhandler);
-    buffer_clear(xfrhandler->packet);
-    received = recvfrom(notify->handler.fd, buffer_begin(xfrhandler->packet),
-        buffer_remaining(xfrhandler->packet), 0, NULL, NULL);
-    if (received == -1) {
-        ods_log_error("[%s] unable to read packet: recvfrom() failed fd %d "
-            "(%s)", notify_str, notify->handler.fd, strerror(errno));
-        return 0;
-    }
-    buffer_set_limit(xfrhandler->packet, received);
-    return 1;
-}
-
-
 /**
  * Handle notify reply.
  *
  */
 static int
-notify_handle_reply(notify_type* notify)
+notify_handle_reply(notify_type* notify, buffer_type* packet)
 {
-    xfrhandler_type* xfrhandler = NULL;
     zone_type* zone = NULL;
     ods_log_assert(notify);
     ods_log_assert(notify->secondary);
     ods_log_assert(notify->secondary->address);
-    xfrhandler = (xfrhandler_type*) notify->xfrhandler;
+    ods_log_assert(packet);
     zone = (zone_type*) notify->zone;
-    ods_log_assert(xfrhandler);
     ods_log_assert(zone);
     ods_log_assert(zone->name);
-    if (xfrhandler->packet->limit < 3 ||
-        (buffer_pkt_opcode(xfrhandler->packet) != LDNS_PACKET_NOTIFY) ||
-        (buffer_pkt_qr(xfrhandler->packet) == 0)) {
+    if (packet->limit < 3 ||
+        (buffer_pkt_opcode(packet) != LDNS_PACKET_NOTIFY) ||
+        (buffer_pkt_qr(packet) == 0)) {
         ods_log_error("[%s] zone %s received bad notify reply opcode/qr from %s",
             notify_str, zone->name, notify->secondary->address);
         return 0;
     }
-    if (buffer_pkt_id(xfrhandler->packet) != notify->query_id) {
+    if (buffer_pkt_id(packet) != notify->query_id) {
         ods_log_error("[%s] zone %s received bad notify reply id from %s",
             notify_str, zone->name, notify->secondary->address);
         return 0;
     }
     /* could check tsig */
-    if (buffer_pkt_rcode(xfrhandler->packet) != LDNS_RCODE_NOERROR) {
-        const char* str = buffer_rcode2str(buffer_pkt_rcode(xfrhandler->packet));
+    if (buffer_pkt_rcode(packet) != LDNS_RCODE_NOERROR) {
+        const char* str = buffer_rcode2str(buffer_pkt_rcode(packet));
         ods_log_error("[%s] zone %s received bad notify rcode %s from %s",
             notify_str, zone->name, str?str:"UNKNOWN",
             notify->secondary->address);
-        if (buffer_pkt_rcode(xfrhandler->packet) != LDNS_RCODE_NOTIMPL) {
+        if (buffer_pkt_rcode(packet) != LDNS_RCODE_NOTIMPL) {
             return 1;
         }
         return 0;
@@ -288,82 +297,6 @@ notify_handle_reply(notify_type* notify)
 }
 
 
-/**
- * Send notify over udp.
- *
- */
-static int
-notify_send_udp(notify_type* notify, buffer_type* buffer)
-{
-    struct sockaddr_storage to;
-    socklen_t to_len = 0;
-    int fd = -1;
-    int family = PF_INET;
-    ssize_t nb = 0;
-    ods_log_assert(buffer);
-    ods_log_assert(notify);
-    ods_log_assert(notify->secondary);
-    ods_log_assert(notify->secondary->address);
-    /* this will set the remote port to acl->port or TCP_PORT */
-    to_len = xfrd_acl_sockaddr_to(notify->secondary, &to);
-    /* get the address family of the remote host */
-    if (notify->secondary->family == AF_INET6) {
-        family = PF_INET6;
-    }
-    /* create socket */
-    fd = socket(family, SOCK_DGRAM, IPPROTO_UDP);
-    if (fd == -1) {
-        ods_log_error("[%s] unable to send data over udp to %s: "
-            "socket() failed (%s)", notify_str, notify->secondary->address,
-            strerror(errno));
-        return -1;
-    }
-    /* bind it */
-    interface_type interface = notify->xfrhandler->engine->dnshandler->interfaces->interfaces[0];
-    if (!interface.address) {
-        ods_log_error("[%s] unable to get the address of interface", notify_str);
-        close(fd);
-        return -1;
-    }
-    if (acl_parse_family(interface.address) == AF_INET) {
-        struct sockaddr_in addr;
-        addr.sin_family = acl_parse_family(interface.address);
-        addr.sin_addr = interface.addr.addr;
-        addr.sin_port = 0;
-        if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
-            ods_log_error("[%s] unable to bind address %s: bind failed %s", notify_str, interface.address, strerror(errno));
-            close(fd);
-            return -1;
-        }
-    }
-    else {
-        struct sockaddr_in6 addr6;
-        addr6.sin6_family = acl_parse_family(interface.address);
-        addr6.sin6_addr = interface.addr.addr6;
-        addr6.sin6_port = 0;
-        if (bind(fd, (struct sockaddr *) &addr6, sizeof(addr6)) != 0) {
-            ods_log_error("[%s] unable to bind address %s: bind() failed %s", notify_str, interface.address, strerror(errno));
-            close(fd);
-            return -1;
-        }
-    }
-
-    /* send it (udp) */
-    ods_log_deeebug("[%s] send %ld bytes over udp to %s", notify_str,
-        (unsigned long)buffer_remaining(buffer), notify->secondary->address);
-    nb = sendto(fd, buffer_current(buffer), buffer_remaining(buffer), 0,
-        (struct sockaddr*)&to, to_len);
-    if (nb == -1) {
-        ods_log_error("[%s] unable to send data over udp to %s: "
-            "sendto() failed (%s)", notify_str, notify->secondary->address,
-            strerror(errno));
-        close(fd);
-        return -1;
-    }
-    return fd;
-}
-
-
 /**
  * Sign notify.
  *
@@ -401,27 +334,21 @@ notify_tsig_sign(notify_type* notify, buffer_type* buffer)
 
 
 /**
- * Send notify.
+ * Encode notify for the current secondary.
  *
  */
-void
-notify_send(notify_type* notify)
+static void
+notify_encode(notify_type* notify)
 {
     xfrhandler_type* xfrhandler = NULL;
     zone_type* zone = NULL;
     ods_log_assert(notify);
     ods_log_assert(notify->secondary);
-    ods_log_assert(notify->secondary->address);
     xfrhandler = (xfrhandler_type*) notify->xfrhandler;
     zone = (zone_type*) notify->zone;
     ods_log_assert(xfrhandler);
     ods_log_assert(zone);
-    ods_log_assert(zone->name);
-    if (notify->handler.fd != -1) {
-        close(notify->handler.fd);
-    }
-    notify->handler.fd = -1;
-    notify->timeout.tv_sec = notify_time(notify) + NOTIFY_RETRY_TIMEOUT;
+    notifyq_cancel(xfrhandler->notifyq, notify);
     buffer_pkt_notify(xfrhandler->packet, zone->apex, LDNS_RR_CLASS_IN);
     notify->query_id = buffer_pkt_id(xfrhandler->packet);
     buffer_pkt_set_aa(xfrhandler->packet);
@@ -435,20 +362,83 @@ notify_send(notify_type* notify)
         notify_tsig_sign(notify, xfrhandler->packet);
     }
     buffer_flip(xfrhandler->packet);
-    notify->handler.fd = notify_send_udp(notify, xfrhandler->packet);
-    if (notify->handler.fd == -1) {
-        ods_log_error("[%s] unable to send notify retry %u for zone %s to "
-            "%s: notify_send_udp() failed", notify_str, notify->retry,
-            zone->name, notify->secondary->address);
-        return;
+    free(notify->wire);
+    notify->wire_len = buffer_remaining(xfrhandler->packet);
+    CHECKALLOC(notify->wire = (uint8_t*) malloc(notify->wire_len));
+    memcpy(notify->wire, buffer_current(xfrhandler->packet),
+        notify->wire_len);
+    if (!notify->dest) {
+        notify->dest = notifyq_lookup(xfrhandler->notifyq, notify->secondary);
     }
+}
+
+
+/**
+ * Send notify.  The packet is encoded and signed once per secondary,
+ * retries send it again under a fresh query id.
+ *
+ */
+void
+notify_send(notify_type* notify)
+{
+    xfrhandler_type* xfrhandler = NULL;
+    zone_type* zone = NULL;
+    ods_log_assert(notify);
+    ods_log_assert(notify->secondary);
+    ods_log_assert(notify->secondary->address);
+    xfrhandler = (xfrhandler_type*) notify->xfrhandler;
+    zone = (zone_type*) notify->zone;
+    ods_log_assert(xfrhandler);
+    ods_log_assert(zone);
+    ods_log_assert(zone->name);
+    notify->timeout.tv_sec = notify_time(notify) + NOTIFY_RETRY_TIMEOUT;
+    notify_update_handler(notify);
+    if (!notify->wire) {
+        notify_encode(notify);
+    }
+    notifyq_send(xfrhandler->notifyq, notify);
     ods_log_verbose("[%s] notify retry %u for zone %s sent to %s", notify_str,
         notify->retry, zone->name, notify->secondary->address);
 }
 
 
 /**
- * Handle notify.
+ * Continue with the current secondary, or the next one.
+ *
+ */
+static void
+notify_continue(notify_type* notify)
+{
+    zone_type* zone = (zone_type*) notify->zone;
+    /* see if notify is still enabled */
+    if (!notify->secondary) {
+        return;
+    }
+    ods_log_assert(notify->secondary->address);
+    if (notify->retry >= NOTIFY_MAX_RETRY) {
+        ods_log_verbose("[%s] notify max retry for zone %s, %s unreachable",
+            notify_str, zone->name, notify->secondary->address);
+        notify_next(notify);
+        return;
+    }
+    if (!notify->dest) {
+        notify->dest = notifyq_lookup(notify->xfrhandler->notifyq,
+            notify->secondary);
+    }
+    if (!notifyq_admit(notify->dest, notify_time(notify))) {
+        ods_log_debug("[%s] notify for zone %s to %s throttled", notify_str,
+            zone->name, notify->secondary->address);
+        notify->timeout.tv_sec = notify_time(notify) + 1;
+        notify_update_handler(notify);
+        return;
+    }
+    notify->retry++;
+    notify_send(notify);
+}
+
+
+/**
+ * Handle notify timeout.
  *
  */
 static void
@@ -456,16 +446,14 @@ notify_handle_zone(netio_type* ATTR_UNUSED(netio),
     netio_handler_type* handler, netio_events_type event_types)
 {
     notify_type* notify = NULL;
-    xfrhandler_type* xfrhandler = NULL;
     zone_type* zone = NULL;
     if (!handler) {
         return;
     }
     notify = (notify_type*) handler->user_data;
     ods_log_assert(notify);
-    xfrhandler = (xfrhandler_type*) notify->xfrhandler;
+    ods_log_assert(notify->xfrhandler);
     zone = (zone_type*) notify->zone;
-    ods_log_assert(xfrhandler);
     ods_log_assert(zone);
     ods_log_assert(zone->name);
     ods_log_debug("[%s] handle notify for zone %s", notify_str, zone->name);
@@ -473,35 +461,41 @@ notify_handle_zone(netio_type* ATTR_UNUSED(netio),
     if (notify->is_waiting) {
         ods_log_debug("[%s] already waiting, skipping notify for zone %s",
             notify_str, zone->name);
-        ods_log_assert(notify->handler.fd == -1);
+        ods_log_assert(!notify->is_inflight);
         return;
     }
-    if (event_types & NETIO_EVENT_READ) {
-        ods_log_debug("[%s] read notify ok for zone %s", notify_str,
-            zone->name);
-        ods_log_assert(notify->handler.fd != -1);
-        if (notify_udp_read_packet(notify)) {
-            if (notify_handle_reply(notify)) {
-                notify_next(notify);
-            }
-        }
-    } else if(event_types & NETIO_EVENT_TIMEOUT) {
+    if (event_types & NETIO_EVENT_TIMEOUT) {
         ods_log_debug("[%s] notify timeout for zone %s", notify_str,
             zone->name);
         /* timeout, try again */
     }
-    /* see if notify is still enabled */
-    if (notify->secondary) {
-        ods_log_assert(notify->secondary->address);
-        notify->retry++;
-        if (notify->retry > NOTIFY_MAX_RETRY) {
-            ods_log_verbose("[%s] notify max retry for zone %s, %s unreachable",
-                notify_str, zone->name, notify->secondary->address);
-            notify_next(notify);
-        } else {
-            notify_send(notify);
-        }
+    notify_continue(notify);
+}
+
+
+/**
+ * Handle notify reply.
+ *
+ */
+int
+notify_receive(notify_type* notify, buffer_type* packet)
+{
+    zone_type* zone = NULL;
+    int result = 0;
+    ods_log_assert(notify);
+    zone = (zone_type*) notify->zone;
+    ods_log_assert(zone);
+    ods_log_assert(zone->name);
+    ods_log_debug("[%s] read notify ok for zone %s", notify_str, zone->name);
+    if (!notify->secondary) {
+        return 0;
     }
+    result = notify_handle_reply(notify, packet);
+    if (result) {
+        notify_next(notify);
+    }
+    notify_continue(notify);
+    return result;
 }
 
 
@@ -519,6 +513,8 @@ notify_update_soa(notify_type* notify, ldns_rr* soa)
         ldns_rr_free(notify->soa);
     }
     notify->soa = soa;
+    /* the packet carries the soa */
+    notify_forget(notify);
 }
 
 
@@ -549,7 +545,7 @@ notify_enable(notify_type* notify, ldns_rr* soa)
             zone->name);
         return; /* nothing to do */
     }
-    if (notify->is_waiting || notify->handler.fd != -1) {
+    if (notify->is_waiting || notify->secondary) {
         ods_log_debug("[%s] zone %s already on waiting list", notify_str,
             zone->name);
        return;
@@ -573,6 +569,7 @@ notify_enable(notify_type* notify, ldns_rr* soa)
     }
     xfrhandler->notify_waiting_last = notify;
     notify->handler.timeout = NULL;
+    notify_update_handler(notify);
     ods_log_debug("[%s] zone %s notify on waiting list", notify_str,
         zone->name);
 }
@@ -588,10 +585,7 @@ notify_cleanup(notify_type* notify)
     if (!notify) {
         return;
     }
-    if (notify->handler.fd != -1) {
-        close(notify->handler.fd);
-        notify->handler.fd = -1;
-    }
+    notify_forget(notify);
     if (notify->soa) {
         ldns_rr_free(notify->soa);
     }
@@ -41,6 +41,7 @@ typedef struct notify_struct notify_type;
 #include "wire/acl.h"
 #include "wire/buffer.h"
 #include "wire/netio.h"
+#include "wire/notifyq.h"
 #include "wire/tsig.h"
 #include "daemon/xfrhandler.h"
 #include "signer/zone.h"
@@ -55,16 +56,24 @@ typedef struct notify_struct notify_type;
  */
 struct notify_struct {
     notify_type* waiting_next;
+    notify_type* inflight_next;
     ldns_rr* soa;
     tsig_rr_type* tsig_rr;
     acl_type* secondary;
+    notifyq_dest_type* dest;
+    notifyq_sock_type* sock;
     zone_type* zone;
     xfrhandler_type* xfrhandler;
     netio_handler_type handler;
     struct timespec timeout;
+    /* packet for the current secondary, reused on retries */
+    uint8_t* wire;
+    size_t wire_len;
     uint16_t query_id;
     uint8_t retry;
     unsigned is_waiting : 1;
+    unsigned is_inflight : 1;
+    unsigned is_queued : 1;
 };
 
 /**
@@ -91,6 +100,15 @@ void notify_enable(notify_type* notify, ldns_rr* soa);
  */
 void notify_send(notify_type* notify);
 
+/**
+ * Handle notify reply.
+ * \param[in] notify notify structure
+ * \param[in] packet reply
+ * \return int 1 if the secondary accepted the notify, 0 otherwise
+ *
+ */
+int notify_receive(notify_type* notify, buffer_type* packet);
+
 /**
  * Cleanup notify structure.
  * \param[in] notify notify structure.
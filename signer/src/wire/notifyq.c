@@ -0,0 +1,629 @@
+/*
+ * Copyright (c) 2026 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Notify dispatcher.  The notifies of all zones are sent over a small pool
+ * of shared sockets per address family instead of a socket per zone.
+ * Notifies that become due together are collected and sent with a single
+ * sendmmsg(2), and every destination has a token bucket so that a mass
+ * resign does not flood a secondary.  Every send picks a socket, and so a
+ * source port, from the pool and a resend gets a fresh query id.  Replies
+ * are matched to the notify by socket, query id and source address.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* sendmmsg */
+#endif
+
+#include "config.h"
+#include "daemon/engine.h"
+#include "daemon/xfrhandler.h"
+#include "wire/notifyq.h"
+#include "wire/xfrd.h"
+#include "clientpipe.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+static const char* notifyq_str = "notifyq";
+
+static void notifyq_handle_sock(netio_type* netio,
+    netio_handler_type* handler, netio_events_type event_types);
+
+
+/**
+ * Initialize shared socket.
+ *
+ */
+static void
+notifyq_sock_init(notifyq_type* notifyq, notifyq_sock_type* sock, int family)
+{
+    sock->notifyq = notifyq;
+    sock->family = family;
+    sock->npending = 0;
+    sock->timeout.tv_sec = 0;
+    sock->timeout.tv_nsec = 0;
+    sock->handler.fd = -1;
+    sock->handler.timeout = NULL;
+    sock->handler.user_data = sock;
+    sock->handler.event_types = NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
+    sock->handler.event_handler = notifyq_handle_sock;
+    sock->handler.free_handler = 0;
+    sock->handler.entry = NULL;
+}
+
+
+/**
+ * Let netio know that the handler of a shared socket changed.
+ *
+ */
+static void
+notifyq_sock_update(notifyq_sock_type* sock)
+{
+    if (sock->notifyq->xfrhandler) {
+        netio_update_handler(sock->notifyq->xfrhandler->netio,
+            &sock->handler);
+    }
+}
+
+
+/**
+ * Create notify dispatcher.
+ *
+ */
+notifyq_type*
+notifyq_create(xfrhandler_type* xfrhandler)
+{
+    notifyq_type* notifyq = NULL;
+    int i;
+    CHECKALLOC(notifyq = (notifyq_type*) malloc(sizeof(notifyq_type)));
+    notifyq->xfrhandler = xfrhandler;
+    notifyq->dests = NULL;
+    notifyq->nbatches = 0;
+    for (i = 0; i < NOTIFYQ_BUCKETS; i++) {
+        notifyq->inflight[i] = NULL;
+    }
+    for (i = 0; i < NOTIFYQ_SOCKETS; i++) {
+        notifyq_sock_init(notifyq, &notifyq->sock4[i], AF_INET);
+        notifyq_sock_init(notifyq, &notifyq->sock6[i], AF_INET6);
+    }
+    pthread_mutex_init(&notifyq->lock, NULL);
+    return notifyq;
+}
+
+
+/**
+ * Compare socket addresses, including the port.
+ *
+ */
+static int
+notifyq_sockaddr_equal(struct sockaddr_storage* a, struct sockaddr_storage* b)
+{
+    if (a->ss_family != b->ss_family) {
+        return 0;
+    }
+    if (a->ss_family == AF_INET6) {
+        struct sockaddr_in6* a6 = (struct sockaddr_in6*) a;
+        struct sockaddr_in6* b6 = (struct sockaddr_in6*) b;
+        return a6->sin6_port == b6->sin6_port &&
+            memcmp(&a6->sin6_addr, &b6->sin6_addr,
+            sizeof(struct in6_addr)) == 0;
+    } else {
+        struct sockaddr_in* a4 = (struct sockaddr_in*) a;
+        struct sockaddr_in* b4 = (struct sockaddr_in*) b;
+        return a4->sin_port == b4->sin_port &&
+            a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+    }
+}
+
+
+/**
+ * Look up destination.
+ *
+ */
+notifyq_dest_type*
+notifyq_lookup(notifyq_type* notifyq, acl_type* acl)
+{
+    notifyq_dest_type* dest = NULL;
+    struct sockaddr_storage to;
+    socklen_t to_len = 0;
+    ods_log_assert(notifyq);
+    ods_log_assert(acl);
+    to_len = xfrd_acl_sockaddr_to(acl, &to);
+    pthread_mutex_lock(&notifyq->lock);
+    for (dest = notifyq->dests; dest; dest = dest->next) {
+        if (notifyq_sockaddr_equal(&dest->to, &to)) {
+            break;
+        }
+    }
+    if (!dest) {
+        CHECKALLOC(dest = (notifyq_dest_type*) malloc(sizeof(notifyq_dest_type)));
+        dest->address = strdup(acl->address ? acl->address : "");
+        memcpy(&dest->to, &to, sizeof(struct sockaddr_storage));
+        dest->to_len = to_len;
+        dest->stamp = 0;
+        dest->tokens = NOTIFY_BURST;
+        dest->nsent = 0;
+        dest->nacked = 0;
+        dest->nretried = 0;
+        dest->nthrottled = 0;
+        dest->next = notifyq->dests;
+        notifyq->dests = dest;
+    }
+    pthread_mutex_unlock(&notifyq->lock);
+    return dest;
+}
+
+
+/**
+ * Take a token from the bucket of a destination.
+ *
+ */
+int
+notifyq_admit(notifyq_dest_type* dest, time_t now)
+{
+    ods_log_assert(dest);
+    if (now > dest->stamp) {
+        if (now - dest->stamp > NOTIFY_BURST / NOTIFY_RATE) {
+            dest->tokens = NOTIFY_BURST;
+        } else {
+            dest->tokens += (long) (now - dest->stamp) * NOTIFY_RATE;
+            if (dest->tokens > NOTIFY_BURST) {
+                dest->tokens = NOTIFY_BURST;
+            }
+        }
+        dest->stamp = now;
+    }
+    if (dest->tokens > 0) {
+        dest->tokens--;
+        return 1;
+    }
+    dest->nthrottled++;
+    return 0;
+}
+
+
+/**
+ * Open shared socket.
+ *
+ */
+static int
+notifyq_sock_open(notifyq_sock_type* sock)
+{
+    xfrhandler_type* xfrhandler = sock->notifyq->xfrhandler;
+    interface_type* interface = NULL;
+    int fd = -1;
+    fd = socket(sock->family == AF_INET6 ? PF_INET6 : PF_INET, SOCK_DGRAM,
+        IPPROTO_UDP);
+    if (fd == -1) {
+        ods_log_error("[%s] unable to open notify socket: socket() failed "
+            "(%s)", notifyq_str, strerror(errno));
+        return -1;
+    }
+    if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
+        ods_log_error("[%s] unable to set notify socket nonblocking: "
+            "fcntl() failed (%s)", notifyq_str, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    /* bind it to the first interface, if it is of the same family */
+    if (xfrhandler && xfrhandler->engine && xfrhandler->engine->dnshandler &&
+        xfrhandler->engine->dnshandler->interfaces &&
+        xfrhandler->engine->dnshandler->interfaces->count > 0) {
+        interface = &xfrhandler->engine->dnshandler->interfaces->interfaces[0];
+    }
+    if (interface && interface->address &&
+        acl_parse_family(interface->address) == sock->family) {
+        if (sock->family == AF_INET) {
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr = interface->addr.addr;
+            addr.sin_port = 0;
+            if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+                ods_log_error("[%s] unable to bind address %s: bind() failed "
+                    "%s", notifyq_str, interface->address, strerror(errno));
+                close(fd);
+                return -1;
+            }
+        } else {
+            struct sockaddr_in6 addr6;
+            memset(&addr6, 0, sizeof(addr6));
+            addr6.sin6_family = AF_INET6;
+            addr6.sin6_addr = interface->addr.addr6;
+            addr6.sin6_port = 0;
+            if (bind(fd, (struct sockaddr *) &addr6, sizeof(addr6)) != 0) {
+                ods_log_error("[%s] unable to bind address %s: bind() failed "
+                    "%s", notifyq_str, interface->address, strerror(errno));
+                close(fd);
+                return -1;
+            }
+        }
+    }
+    sock->handler.fd = fd;
+    if (xfrhandler) {
+        netio_add_handler(xfrhandler->netio, &sock->handler);
+    }
+    return fd;
+}
+
+
+/**
+ * Send the queued notifies of a shared socket.
+ *
+ */
+static void
+notifyq_sock_flush(notifyq_sock_type* sock)
+{
+    size_t i = 0;
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[NOTIFYQ_BATCH];
+    struct iovec iovs[NOTIFYQ_BATCH];
+    int nb = 0;
+#else
+    ssize_t nb = 0;
+#endif
+    if (sock->handler.timeout) {
+        sock->handler.timeout = NULL;
+        notifyq_sock_update(sock);
+    }
+    if (sock->npending == 0) {
+        return;
+    }
+#ifdef HAVE_SENDMMSG
+    memset(msgs, 0, sizeof(struct mmsghdr) * sock->npending);
+    for (i = 0; i < sock->npending; i++) {
+        notify_type* notify = sock->pending[i];
+        iovs[i].iov_base = notify->wire;
+        iovs[i].iov_len = notify->wire_len;
+        msgs[i].msg_hdr.msg_name = &notify->dest->to;
+        msgs[i].msg_hdr.msg_namelen = notify->dest->to_len;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    i = 0;
+    while (i < sock->npending) {
+        nb = sendmmsg(sock->handler.fd, &msgs[i], sock->npending - i, 0);
+        if (nb == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /* skip the message that failed, it is retried on timeout */
+            ods_log_error("[%s] unable to send notify to %s: sendmmsg() "
+                "failed (%s)", notifyq_str, sock->pending[i]->dest->address,
+                strerror(errno));
+            nb = 1;
+        }
+        i += nb;
+    }
+#else
+    for (i = 0; i < sock->npending; i++) {
+        notify_type* notify = sock->pending[i];
+        nb = sendto(sock->handler.fd, notify->wire, notify->wire_len, 0,
+            (struct sockaddr*) &notify->dest->to, notify->dest->to_len);
+        if (nb == -1) {
+            ods_log_error("[%s] unable to send notify to %s: sendto() "
+                "failed (%s)", notifyq_str, notify->dest->address,
+                strerror(errno));
+        }
+    }
+#endif
+    ods_log_deeebug("[%s] sent batch of %u notifies", notifyq_str,
+        (unsigned) sock->npending);
+    for (i = 0; i < sock->npending; i++) {
+        sock->pending[i]->is_queued = 0;
+    }
+    sock->npending = 0;
+    sock->notifyq->nbatches++;
+}
+
+
+/**
+ * Queue notify.
+ *
+ */
+void
+notifyq_send(notifyq_type* notifyq, notify_type* notify)
+{
+    notifyq_sock_type* sock = NULL;
+    uint16_t id = 0;
+    int bucket = 0;
+    ods_log_assert(notifyq);
+    ods_log_assert(notify);
+    ods_log_assert(notify->dest);
+    ods_log_assert(notify->wire);
+    if (notify->is_inflight) {
+        /**
+         * Sent before: stop listening for replies to the old id and send
+         * under a new one.  TSIG covers the original id, so the signature
+         * of the packet still holds.
+         */
+        notifyq_cancel(notifyq, notify);
+        do {
+            id = (uint16_t) ldns_get_random();
+        } while (id == notify->query_id);
+        notify->query_id = id;
+        ldns_write_uint16(notify->wire, id);
+    }
+    if (notify->dest->to.ss_family == AF_INET6) {
+        sock = &notifyq->sock6[ldns_get_random() % NOTIFYQ_SOCKETS];
+    } else {
+        sock = &notifyq->sock4[ldns_get_random() % NOTIFYQ_SOCKETS];
+    }
+    if (sock->handler.fd == -1 && notifyq_sock_open(sock) == -1) {
+        return; /* retried on timeout */
+    }
+    bucket = notify->query_id % NOTIFYQ_BUCKETS;
+    notify->inflight_next = notifyq->inflight[bucket];
+    notifyq->inflight[bucket] = notify;
+    notify->is_inflight = 1;
+    notify->sock = sock;
+    notify->dest->nsent++;
+    if (notify->retry > 1) {
+        notify->dest->nretried++;
+    }
+    notify->is_queued = 1;
+    sock->pending[sock->npending++] = notify;
+    if (sock->npending == NOTIFYQ_BATCH) {
+        notifyq_sock_flush(sock);
+    } else if (sock->npending == 1 && notifyq->xfrhandler) {
+        /**
+         * Notifies whose timers expired in the same pass are dispatched
+         * before this slightly later timeout, and go out in one batch.
+         */
+        sock->timeout = *netio_current_time(notifyq->xfrhandler->netio);
+        sock->timeout.tv_nsec += NOTIFYQ_FLUSH_DELAY;
+        if (sock->timeout.tv_nsec >= 1000000000L) {
+            sock->timeout.tv_sec++;
+            sock->timeout.tv_nsec -= 1000000000L;
+        }
+        sock->handler.timeout = &sock->timeout;
+        notifyq_sock_update(sock);
+    }
+}
+
+
+/**
+ * Send all queued notifies.
+ *
+ */
+void
+notifyq_flush(notifyq_type* notifyq)
+{
+    int i;
+    if (!notifyq) {
+        return;
+    }
+    for (i = 0; i < NOTIFYQ_SOCKETS; i++) {
+        notifyq_sock_flush(&notifyq->sock4[i]);
+        notifyq_sock_flush(&notifyq->sock6[i]);
+    }
+}
+
+
+/**
+ * Forget notify.
+ *
+ */
+void
+notifyq_cancel(notifyq_type* notifyq, notify_type* notify)
+{
+    notify_type** prev = NULL;
+    notifyq_sock_type* sock = NULL;
+    size_t i = 0;
+    if (!notifyq || !notify) {
+        return;
+    }
+    if (notify->is_inflight) {
+        prev = &notifyq->inflight[notify->query_id % NOTIFYQ_BUCKETS];
+        while (*prev && *prev != notify) {
+            prev = &(*prev)->inflight_next;
+        }
+        if (*prev) {
+            *prev = notify->inflight_next;
+        }
+        notify->inflight_next = NULL;
+        notify->is_inflight = 0;
+    }
+    sock = notify->sock;
+    if (notify->is_queued && sock) {
+        for (i = 0; i < sock->npending; i++) {
+            if (sock->pending[i] == notify) {
+                sock->npending--;
+                memmove(&sock->pending[i], &sock->pending[i+1],
+                    (sock->npending - i) * sizeof(notify_type*));
+                break;
+            }
+        }
+        if (sock->npending == 0) {
+            sock->handler.timeout = NULL;
+            notifyq_sock_update(sock);
+        }
+    }
+    notify->is_queued = 0;
+    notify->sock = NULL;
+}
+
+
+/**
+ * Read replies from a shared socket.
+ *
+ */
+static void
+notifyq_sock_read(notifyq_sock_type* sock)
+{
+    notifyq_type* notifyq = sock->notifyq;
+    buffer_type* packet = notifyq->xfrhandler->packet;
+    notifyq_dest_type* dest = NULL;
+    notify_type* notify = NULL;
+    struct sockaddr_storage from;
+    socklen_t from_len = 0;
+    ssize_t received = 0;
+    uint16_t id = 0;
+    int i;
+    for (i = 0; i < NOTIFYQ_READ_MAX; i++) {
+        buffer_clear(packet);
+        from_len = sizeof(from);
+        memset(&from, 0, sizeof(from));
+        received = recvfrom(sock->handler.fd, buffer_begin(packet),
+            buffer_remaining(packet), 0, (struct sockaddr*) &from, &from_len);
+        if (received == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                ods_log_error("[%s] unable to read packet: recvfrom() failed "
+                    "fd %d (%s)", notifyq_str, sock->handler.fd,
+                    strerror(errno));
+            }
+            return;
+        }
+        buffer_set_limit(packet, received);
+        if (received < BUFFER_PKT_HEADER_SIZE) {
+            continue;
+        }
+        id = buffer_pkt_id(packet);
+        for (notify = notifyq->inflight[id % NOTIFYQ_BUCKETS]; notify;
+            notify = notify->inflight_next) {
+            if (notify->sock == sock && notify->query_id == id &&
+                notifyq_sockaddr_equal(&notify->dest->to, &from)) {
+                break;
+            }
+        }
+        if (!notify) {
+            ods_log_debug("[%s] dropped notify reply id=%u: no notify in "
+                "flight", notifyq_str, id);
+            continue;
+        }
+        dest = notify->dest;
+        if (notify_receive(notify, packet)) {
+            dest->nacked++;
+        }
+    }
+}
+
+
+/**
+ * Handle shared socket.
+ *
+ */
+static void
+notifyq_handle_sock(netio_type* ATTR_UNUSED(netio),
+    netio_handler_type* handler, netio_events_type event_types)
+{
+    notifyq_sock_type* sock = NULL;
+    if (!handler) {
+        return;
+    }
+    sock = (notifyq_sock_type*) handler->user_data;
+    ods_log_assert(sock);
+    if (event_types & NETIO_EVENT_READ) {
+        notifyq_sock_read(sock);
+    }
+    if (event_types & NETIO_EVENT_TIMEOUT) {
+        notifyq_sock_flush(sock);
+    }
+}
+
+
+/**
+ * Report the counters per destination.
+ *
+ */
+void
+notifyq_report(notifyq_type* notifyq, int fd)
+{
+    notifyq_dest_type* dest = NULL;
+    if (!notifyq) {
+        return;
+    }
+    pthread_mutex_lock(&notifyq->lock);
+    if (fd >= 0 && notifyq->dests) {
+        client_printf(fd, "\nNotifies sent in %ld batches:\n",
+            notifyq->nbatches);
+    }
+    for (dest = notifyq->dests; dest; dest = dest->next) {
+        if (fd >= 0) {
+            client_printf(fd, "%s: %ld sent, %ld acked, %ld retried, "
+                "%ld throttled.\n", dest->address, dest->nsent, dest->nacked,
+                dest->nretried, dest->nthrottled);
+        } else {
+            ods_log_info("[%s] notifies to %s: %ld sent, %ld acked, "
+                "%ld retried, %ld throttled", notifyq_str, dest->address,
+                dest->nsent, dest->nacked, dest->nretried, dest->nthrottled);
+        }
+    }
+    pthread_mutex_unlock(&notifyq->lock);
+}
+
+
+/**
+ * Close shared socket.
+ *
+ */
+static void
+notifyq_sock_close(notifyq_sock_type* sock)
+{
+    if (sock->handler.fd == -1) {
+        return;
+    }
+    if (sock->notifyq->xfrhandler) {
+        netio_remove_handler(sock->notifyq->xfrhandler->netio, &sock->handler);
+    }
+    close(sock->handler.fd);
+    sock->handler.fd = -1;
+}
+
+
+/**
+ * Cleanup notify dispatcher.
+ *
+ */
+void
+notifyq_cleanup(notifyq_type* notifyq)
+{
+    notifyq_dest_type* dest = NULL;
+    int i;
+    if (!notifyq) {
+        return;
+    }
+    notifyq_report(notifyq, -1);
+    for (i = 0; i < NOTIFYQ_SOCKETS; i++) {
+        notifyq_sock_close(&notifyq->sock4[i]);
+        notifyq_sock_close(&notifyq->sock6[i]);
+    }
+    while (notifyq->dests) {
+        dest = notifyq->dests;
+        notifyq->dests = dest->next;
+        free(dest->address);
+        free(dest);
+    }
+    pthread_mutex_destroy(&notifyq->lock);
+    free(notifyq);
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2026 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Notify dispatcher.
+ *
+ */
+
+#ifndef WIRE_NOTIFYQ_H
+#define WIRE_NOTIFYQ_H
+
+#include "config.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <time.h>
+
+typedef struct notifyq_dest_struct notifyq_dest_type;
+typedef struct notifyq_sock_struct notifyq_sock_type;
+typedef struct notifyq_struct notifyq_type;
+
+#include "status.h"
+#include "wire/acl.h"
+#include "wire/buffer.h"
+#include "wire/netio.h"
+#include "wire/notify.h"
+#include "daemon/xfrhandler.h"
+
+/* notifies sent to a single destination per second, and the burst allowed */
+#define NOTIFY_RATE 20
+#define NOTIFY_BURST 100
+/* notifies sent with a single system call */
+#define NOTIFYQ_BATCH 64
+/* replies read per event on a shared socket */
+#define NOTIFYQ_READ_MAX 64
+/* delay before a partial batch is sent, in nanoseconds */
+#define NOTIFYQ_FLUSH_DELAY 1000000L
+#define NOTIFYQ_BUCKETS 256
+/* shared sockets per address family, each on its own ephemeral port */
+#define NOTIFYQ_SOCKETS 8
+
+/**
+ * Notify destination, with its token bucket and counters.
+ *
+ */
+struct notifyq_dest_struct {
+    notifyq_dest_type* next;
+    char* address;
+    struct sockaddr_storage to;
+    socklen_t to_len;
+    /* token bucket */
+    time_t stamp;
+    long tokens;
+    /* statistics */
+    long nsent;
+    long nacked;
+    long nretried;
+    long nthrottled;
+};
+
+/**
+ * Shared socket, with the notifies to be sent on it.
+ *
+ */
+struct notifyq_sock_struct {
+    netio_handler_type handler;
+    struct timespec timeout;
+    notifyq_type* notifyq;
+    int family;
+    notify_type* pending[NOTIFYQ_BATCH];
+    size_t npending;
+};
+
+/**
+ * Notify dispatcher.
+ * Sends the notifies of all zones over a pool of shared sockets in batches,
+ * and routes the replies back to the notify by socket, query id and source
+ * address.
+ *
+ */
+struct notifyq_struct {
+    xfrhandler_type* xfrhandler;
+    notifyq_sock_type sock4[NOTIFYQ_SOCKETS];
+    notifyq_sock_type sock6[NOTIFYQ_SOCKETS];
+    notify_type* inflight[NOTIFYQ_BUCKETS];
+    pthread_mutex_t lock;
+    notifyq_dest_type* dests;
+    long nbatches;
+};
+
+/**
+ * Create notify dispatcher.
+ * \param[in] xfrhandler zone transfer handler, its netio serves the sockets
+ * \return notifyq_type* created notify dispatcher
+ *
+ */
+notifyq_type* notifyq_create(xfrhandler_type* xfrhandler);
+
+/**
+ * Look up the destination of a secondary, create it if not yet known.
+ * \param[in] notifyq notify dispatcher
+ * \param[in] acl secondary
+ * \return notifyq_dest_type* destination
+ *
+ */
+notifyq_dest_type* notifyq_lookup(notifyq_type* notifyq, acl_type* acl);
+
+/**
+ * Take a token from the bucket of a destination.
+ * \param[in] dest destination
+ * \param[in] now current time
+ * \return int 1 if a notify may be sent now, 0 if throttled
+ *
+ */
+int notifyq_admit(notifyq_dest_type* dest, time_t now);
+
+/**
+ * Queue the encoded packet of a notify for sending to its destination, on
+ * a socket picked from the pool.  A notify that is sent again goes out under
+ * a fresh query id.  The notify stays registered for replies until cancelled.
+ * \param[in] notifyq notify dispatcher
+ * \param[in] notify notify with packet and destination set
+ *
+ */
+void notifyq_send(notifyq_type* notifyq, notify_type* notify);
+
+/**
+ * Send all queued notifies.
+ * \param[in] notifyq notify dispatcher
+ *
+ */
+void notifyq_flush(notifyq_type* notifyq);
+
+/**
+ * Forget a notify, drop it from the queue and stop routing replies to it.
+ * \param[in] notifyq notify dispatcher
+ * \param[in] notify notify
+ *
+ */
+void notifyq_cancel(notifyq_type* notifyq, notify_type* notify);
+
+/**
+ * Report the counters per destination.
+ * \param[in] notifyq notify dispatcher
+ * \param[in] fd client to print to, or -1 to log
+ *
+ */
+void notifyq_report(notifyq_type* notifyq, int fd);
+
+/**
+ * Cleanup notify dispatcher.
+ * \param[in] notifyq notify dispatcher
+ *
+ */
+void notifyq_cleanup(notifyq_type* notifyq);
+
+#endif /* WIRE_NOTIFYQ_H */
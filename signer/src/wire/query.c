@@ -835,7 +835,6 @@ query_process(query_type* q, engine_type* engine)
         ods_log_debug("[%s] no RRset in query section, ignoring", query_str);
         return QUERY_DISCARDED; /* no RRset in query */
     }
-    pthread_mutex_lock(&engine->zonelist->zl_lock);
     /* we can just lookup the zone, because we will only handle SOA queries,
        zone transfers, updates and notifies */
     q->zone = zonelist_lookup_zone_by_dname(engine->zonelist, ldns_rr_owner(rr),
@@ -847,7 +846,6 @@ query_process(query_type* q, engine_type* engine)
             query_str, q->zone->name);
         q->zone = NULL;
     }
-    pthread_mutex_unlock(&engine->zonelist->zl_lock);
     if (!q->zone) {
         ods_log_debug("[%s] zone not found", query_str);
         return query_servfail(q);
@@ -1048,6 +1046,26 @@ query_add_rr_tc:
 }
 
 
+/**
+ * Add RR in uncompressed wire format to query.
+ *
+ */
+int
+query_add_wire(query_type* q, const uint8_t* data, size_t len)
+{
+    ods_log_assert(q);
+    ods_log_assert(q->buffer);
+    ods_log_assert(data);
+
+    if (!buffer_available(q->buffer, len) ||
+        buffer_position(q->buffer) + len > (q->maxlen - q->reserved_space)) {
+        return 0;
+    }
+    buffer_write(q->buffer, data, len);
+    return 1;
+}
+
+
 /**
  * Cleanup query.
  *
@@ -151,6 +151,16 @@ void query_add_optional(query_type* q, engine_type* engine);
  */
 int query_add_rr(query_type* q, ldns_rr* rr);
 
+/**
+ * Add RR in uncompressed wire format to query.
+ * \param[in] q query
+ * \param[in] data RR in wire format
+ * \param[in] len length of data
+ * \return int 1 if ok, 0 if overflow.
+ *
+ */
+int query_add_wire(query_type* q, const uint8_t* data, size_t len);
+
 /**
  * Cleanup query.
  * \param[in] q query
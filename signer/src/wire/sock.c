@@ -54,7 +54,7 @@ static const char* sock_str = "socket";
  */
 static ods_status
 sock_fcntl_and_bind(sock_type* sock, const char* node, const char* port,
-    const char* stype, const char* fam)
+    const char* stype, const char* fam, int reuseport)
 {
     ods_log_assert(sock);
     ods_log_assert(port);
@@ -66,6 +66,15 @@ sock_fcntl_and_bind(sock_type* sock, const char* node, const char* port,
             node?node:"localhost", port, strerror(errno));
         return ODS_STATUS_SOCK_FCNTL_NONBLOCK;
     }
+#ifdef SO_REUSEPORT
+    if (reuseport && setsockopt(sock->s, SOL_SOCKET, SO_REUSEPORT, &reuseport,
+        sizeof(reuseport)) < 0) {
+        ods_log_error("[%s] unable to set %s/%s socket '%s:%s' to "
+            "reuse-port: setsockopt() failed (%s)", sock_str, stype, fam,
+            node?node:"localhost", port, strerror(errno));
+        return ODS_STATUS_SOCK_SETSOCKOPT_REUSEPORT;
+    }
+#endif
     ods_log_debug("[%s] bind %s/%s socket '%s:%s': %s", sock_str, stype, fam,
         node?node:"localhost", port, strerror(errno));
     if (bind(sock->s, (struct sockaddr *) sock->addr->ai_addr,
@@ -152,7 +161,7 @@ sock_tcp_listen(sock_type* sock, const char* node, const char* port,
  */
 static ods_status
 sock_server_udp(sock_type* sock, const char* node, const char* port,
-    unsigned* ip6_support)
+    unsigned* ip6_support, int reuseport)
 {
     int on = 0;
     ods_status status = ODS_STATUS_OK;
@@ -176,7 +185,8 @@ sock_server_udp(sock_type* sock, const char* node, const char* port,
     }
     /* ipv4 */
     if (sock->addr->ai_family == AF_INET) {
-        status = sock_fcntl_and_bind(sock, node, port, "udp", "ipv4");
+        status = sock_fcntl_and_bind(sock, node, port, "udp", "ipv4",
+            reuseport);
     }
     /* ipv6 */
     else if (sock->addr->ai_family == AF_INET6) {
@@ -184,7 +194,8 @@ sock_server_udp(sock_type* sock, const char* node, const char* port,
         if (status != ODS_STATUS_OK) {
             return status;
         }
-        status = sock_fcntl_and_bind(sock, node, port, "udp", "ipv6");
+        status = sock_fcntl_and_bind(sock, node, port, "udp", "ipv6",
+            reuseport);
     }
     return status;
 }
@@ -196,7 +207,7 @@ sock_server_udp(sock_type* sock, const char* node, const char* port,
  */
 static ods_status
 sock_server_tcp(sock_type* sock, const char* node, const char* port,
-    unsigned* ip6_support)
+    unsigned* ip6_support, int reuseport)
 {
     int on = 0;
     ods_status status = ODS_STATUS_OK;
@@ -221,7 +232,8 @@ sock_server_tcp(sock_type* sock, const char* node, const char* port,
     /* ipv4 */
     if (sock->addr->ai_family == AF_INET) {
         sock_tcp_reuseaddr(sock, node, port, on, "ipv4");
-        status = sock_fcntl_and_bind(sock, node, port, "tcp", "ipv4");
+        status = sock_fcntl_and_bind(sock, node, port, "tcp", "ipv4",
+            reuseport);
         if (status == ODS_STATUS_OK) {
             status = sock_tcp_listen(sock, node, port, "ipv4");
         }
@@ -233,7 +245,8 @@ sock_server_tcp(sock_type* sock, const char* node, const char* port,
             return status;
         }
         sock_tcp_reuseaddr(sock, node, port, on, "ipv6");
-        status = sock_fcntl_and_bind(sock, node, port, "tcp", "ipv6");
+        status = sock_fcntl_and_bind(sock, node, port, "tcp", "ipv6",
+            reuseport);
         if (status == ODS_STATUS_OK) {
             status = sock_tcp_listen(sock, node, port, "ipv6");
         }
@@ -248,7 +261,7 @@ sock_server_tcp(sock_type* sock, const char* node, const char* port,
  */
 static ods_status
 socket_listen(sock_type* sock, struct addrinfo hints, int socktype,
-    const char* node, const char* port, unsigned* ip6_support)
+    const char* node, const char* port, unsigned* ip6_support, int reuseport)
 {
     ods_status status = ODS_STATUS_OK;
     int r = 0;
@@ -274,9 +287,9 @@ socket_listen(sock_type* sock, struct addrinfo hints, int socktype,
     }
     /* socket */
     if (socktype == SOCK_DGRAM) {
-        status = sock_server_udp(sock, node, port, ip6_support);
+        status = sock_server_udp(sock, node, port, ip6_support, reuseport);
     } else if (socktype == SOCK_STREAM) {
-        status = sock_server_tcp(sock, node, port, ip6_support);
+        status = sock_server_tcp(sock, node, port, ip6_support, reuseport);
     }
     ods_log_debug("[%s] socket listening to %s:%s", sock_str,
         node?node:"localhost", port);
@@ -289,7 +302,7 @@ socket_listen(sock_type* sock, struct addrinfo hints, int socktype,
  *
  */
 ods_status
-sock_listen(socklist_type* sockets, listener_type* listener)
+sock_listen(socklist_type* sockets, listener_type* listener, int reuseport)
 {
     ods_status status = ODS_STATUS_OK;
     struct addrinfo hints[MAX_INTERFACES];
@@ -326,7 +339,7 @@ sock_listen(socklist_type* sockets, listener_type* listener)
         }
         /* udp */
         status = socket_listen(&sockets->udp[i], hints[i], SOCK_DGRAM,
-            node, port, &ip6_support);
+            node, port, &ip6_support, reuseport);
         if (status != ODS_STATUS_OK) {
             if (!ip6_support) {
                 ods_log_warning("[%s] fallback to udp/ipv4, no udp/ipv6: "
@@ -338,7 +351,7 @@ sock_listen(socklist_type* sockets, listener_type* listener)
         }
         /* tcp */
         status = socket_listen(&sockets->tcp[i], hints[i], SOCK_STREAM,
-            node, port, &ip6_support);
+            node, port, &ip6_support, reuseport);
         if (status != ODS_STATUS_OK) {
             if (!ip6_support) {
                 ods_log_warning("[%s] fallback to udp/ipv4, no udp/ipv6: "
@@ -491,6 +504,7 @@ sock_handle_tcp_accept(netio_type* netio, netio_handler_type* handler,
     tcp_handler->user_data = tcp_data;
     tcp_handler->event_types = NETIO_EVENT_READ | NETIO_EVENT_TIMEOUT;
     tcp_handler->event_handler = sock_handle_tcp_read;
+    tcp_handler->entry = NULL;
     netio_add_handler(netio, tcp_handler);
 }
 
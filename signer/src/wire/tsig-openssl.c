@@ -42,6 +42,7 @@ static void *create_context();
 static void init_context(void *context,
                          tsig_algo_type *algorithm,
                          tsig_key_type *key);
+static void copy_context(void *context, const void *keyed);
 static void update(void *context, const void *data, size_t size);
 static void final(void *context, uint8_t *digest, size_t *size);
 
@@ -83,6 +84,7 @@ tsig_openssl_init_algorithm(const char* digest, const char* name, const char* wi
     algorithm->data = hmac_algorithm;
     algorithm->hmac_create = create_context;
     algorithm->hmac_init = init_context;
+    algorithm->hmac_copy = copy_context;
     algorithm->hmac_update = update;
     algorithm->hmac_final = final;
     tsig_handler_add_algo(algorithm);
@@ -169,6 +171,17 @@ init_context(void* context, tsig_algo_type *algorithm, tsig_key_type *key)
     HMAC_Init_ex(ctx, key->data, key->size, md, NULL);
 }
 
+/* Copying a keyed context takes over the inner and outer digest states
+ * in which the key has already been absorbed, rather than hashing the
+ * key again for every message.
+ */
+static void
+copy_context(void* context, const void* keyed)
+{
+    HMAC_CTX* ctx = (HMAC_CTX*) context;
+    HMAC_CTX_copy(ctx, (HMAC_CTX*) keyed);
+}
+
 static void
 update(void* context, const void* data, size_t size)
 {
@@ -43,6 +43,7 @@
 #include "wire/tsig-openssl.h"
 
 #include <arpa/inet.h>
+#include <ctype.h>
 
 #define TSIG_SIGNED_TIME_FUDGE 300
 
@@ -51,9 +52,13 @@ static const char* tsig_str = "tsig";
 typedef struct tsig_key_table_struct tsig_key_table_type;
 struct tsig_key_table_struct {
         tsig_key_table_type* next;
+        tsig_key_table_type* bucketnext;
         tsig_key_type* key;
 };
 static tsig_key_table_type* tsig_key_table = NULL;
+/** key table indexed by the hash of the wire format key name */
+#define TSIG_KEY_BUCKETS 1024
+static tsig_key_table_type* tsig_key_buckets[TSIG_KEY_BUCKETS];
 /** algorithm table */
 typedef struct tsig_algo_table_struct tsig_algo_table_type;
 struct tsig_algo_table_struct {
@@ -65,6 +70,23 @@ static tsig_algo_table_type* tsig_algo_table = NULL;
 static size_t max_algo_digest_size = 0;
 
 
+/**
+ * Hash wire format key name, case insensitive.
+ *
+ */
+static unsigned int
+tsig_key_hash(ldns_rdf* dname)
+{
+    const uint8_t* data = ldns_rdf_data(dname);
+    size_t i, size = ldns_rdf_size(dname);
+    uint32_t hash = 2166136261U;
+    for (i = 0; i < size; i++) {
+        hash = (hash ^ (uint8_t) tolower(data[i])) * 16777619U;
+    }
+    return hash % TSIG_KEY_BUCKETS;
+}
+
+
 /**
  * Add key to TSIG handler.
  *
@@ -73,13 +95,17 @@ void
 tsig_handler_add_key(tsig_key_type* key)
 {
     tsig_key_table_type* entry = NULL;
+    unsigned int bucket;
     if (!key) {
         return;
     }
+    bucket = tsig_key_hash(key->dname);
     CHECKALLOC(entry = (tsig_key_table_type *) malloc(sizeof(tsig_key_table_type)));
     entry->key = key;
     entry->next = tsig_key_table;
+    entry->bucketnext = tsig_key_buckets[bucket];
     tsig_key_table = entry;
+    tsig_key_buckets[bucket] = entry;
 }
 
 
@@ -112,6 +138,7 @@ ods_status
 tsig_handler_init()
 {
     tsig_key_table = NULL;
+    memset(tsig_key_buckets, 0, sizeof(tsig_key_buckets));
     tsig_algo_table = NULL;
 #ifdef HAVE_SSL
     ods_log_debug("[%s] init openssl", tsig_str);
@@ -154,6 +181,9 @@ tsig_handler_cleanup(void)
         free(kentry);
         kentry = knext;
     }
+    tsig_key_table = NULL;
+    memset(tsig_key_buckets, 0, sizeof(tsig_key_buckets));
+    tsig_algo_table = NULL;
 }
 
 
@@ -191,6 +221,13 @@ tsig_key_create(tsig_type* tsig)
     key->dname = dname;
     key->size = size;
     key->data = data;
+    /* key the HMAC context once, messages start from a copy of it */
+    key->algo = tsig_lookup_algo(tsig->algorithm);
+    key->keyed = NULL;
+    if (key->algo && key->algo->hmac_copy) {
+        key->keyed = key->algo->hmac_create();
+        key->algo->hmac_init(key->keyed, key->algo, key);
+    }
     tsig_handler_add_key(key);
     return key;
 }
@@ -474,7 +511,8 @@ tsig_rr_lookup(tsig_rr_type* trr)
     ods_log_assert(trr->status == TSIG_OK);
     ods_log_assert(!trr->algo);
     ods_log_assert(!trr->key);
-    for (kentry = tsig_key_table; kentry; kentry = kentry->next) {
+    for (kentry = tsig_key_buckets[tsig_key_hash(trr->key_name)]; kentry;
+        kentry = kentry->bucketnext) {
         if (ldns_dname_compare(trr->key_name, kentry->key->dname) == 0) {
             key = kentry->key;
             break;
@@ -537,7 +575,11 @@ tsig_rr_prepare(tsig_rr_type* trr)
         trr->context = trr->algo->hmac_create();
         CHECKALLOC(trr->prior_mac_data = (uint8_t *) malloc(trr->algo->max_digest_size));
     }
-    trr->algo->hmac_init(trr->context, trr->algo, trr->key);
+    if (trr->key->keyed && trr->key->algo == trr->algo) {
+        trr->algo->hmac_copy(trr->context, trr->key->keyed);
+    } else {
+        trr->algo->hmac_init(trr->context, trr->algo, trr->key);
+    }
     if (trr->prior_mac_size > 0) {
         uint16_t mac_size = htons(trr->prior_mac_size);
         trr->algo->hmac_update(trr->context, &mac_size, sizeof(mac_size));
@@ -74,18 +74,21 @@ struct tsig_lookup_table_struct
  * TSIG key.
  *
  */
+typedef struct tsig_algo_struct tsig_algo_type;
 typedef struct tsig_key_struct tsig_key_type;
 struct tsig_key_struct {
     ldns_rdf* dname;
     size_t size;
     const uint8_t* data;
+    /* HMAC context already keyed for the configured algorithm */
+    tsig_algo_type* algo;
+    void* keyed;
 };
 
 /**
  * TSIG algorithm.
  *
  */
-typedef struct tsig_algo_struct tsig_algo_type;
 struct tsig_algo_struct {
     const char* txt_name;
     ldns_rdf* wf_name;
@@ -96,6 +99,8 @@ struct tsig_algo_struct {
     /* initialize an HMAC context */
     void(*hmac_init)(void* context, tsig_algo_type* algo,
         tsig_key_type* key);
+    /* initialize an HMAC context from an already keyed one */
+    void(*hmac_copy)(void* context, const void* keyed);
     /* update the HMAC context */
     void(*hmac_update)(void* context, const void* data, size_t size);
     /* finalize digest */
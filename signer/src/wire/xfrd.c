@@ -55,6 +55,8 @@ static void xfrd_make_request(xfrd_type* xfrd);
 static socklen_t xfrd_acl_sockaddr(acl_type* acl, unsigned int port,
     struct sockaddr_storage *sck);
 
+static int xfrd_spool_write(FILE* fd, uint8_t kind, const uint8_t* data,
+    uint16_t len);
 static void xfrd_write_soa(xfrd_type* xfrd, buffer_type* buffer);
 static int xfrd_parse_soa(xfrd_type* xfrd, buffer_type* buffer,
     unsigned rdata_only, unsigned update, uint32_t t,
@@ -100,6 +102,7 @@ xfrd_create(xfrhandler_type* xfrhandler, zone_type* zone)
     CHECKALLOC(xfrd = (xfrd_type*) malloc(sizeof(xfrd_type)));
     pthread_mutex_init(&xfrd->serial_lock, NULL);
     pthread_mutex_init(&xfrd->rw_lock, NULL);
+    xfrd->spool = NULL;
 
     xfrd->xfrhandler = xfrhandler;
     xfrd->zone = zone;
@@ -148,6 +151,7 @@ xfrd_create(xfrhandler_type* xfrhandler, zone_type* zone)
     xfrd->handler.event_types =
         NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
     xfrd->handler.event_handler = xfrd_handle_zone;
+    xfrd->handler.entry = NULL;
     xfrd_set_timer_time(xfrd, 0);
     return xfrd;
 }
@@ -166,6 +170,20 @@ xfrd_time(xfrd_type* xfrd)
 }
 
 
+/**
+ * Let netio know that the handler changed.
+ *
+ */
+static void
+xfrd_update_handler(xfrd_type* xfrd)
+{
+    xfrhandler_type* xfrhandler = (xfrhandler_type*) xfrd->xfrhandler;
+    if (xfrhandler) {
+        netio_update_handler(xfrhandler->netio, &xfrd->handler);
+    }
+}
+
+
 /**
  * Set timer.
  *
@@ -197,6 +215,7 @@ xfrd_set_timer(xfrd_type* xfrd, time_t t)
     xfrd->handler.timeout = &xfrd->timeout;
     xfrd->timeout.tv_sec = t;
     xfrd->timeout.tv_nsec = 0;
+    xfrd_update_handler(xfrd);
 }
 
 
@@ -209,6 +228,7 @@ xfrd_unset_timer(xfrd_type* xfrd)
 {
     ods_log_assert(xfrd);
     xfrd->handler.timeout = NULL;
+    xfrd_update_handler(xfrd);
 }
 
 
@@ -446,19 +466,22 @@ xfrd_commit_packet(xfrd_type* xfrd)
     pthread_mutex_lock(&xfrd->rw_lock);
     pthread_mutex_lock(&xfrd->serial_lock);
     /* mark end packet */
-    fd = ods_fopen(xfrfile, NULL, "a");
+    if (!xfrd->spool) {
+        xfrd->spool = ods_fopen(xfrfile, NULL, "a");
+    }
     free((void*)xfrfile);
-    if (fd) {
-        fprintf(fd, ";;ENDPACKET\n");
-        ods_fclose(fd);
-    } else {
+    if (!xfrd->spool || xfrd_spool_write(xfrd->spool, XFRD_SPOOL_END, NULL, 0)
+        || fflush(xfrd->spool) != 0) {
+        xfrd_spool_close(xfrd);
         pthread_mutex_unlock(&xfrd->rw_lock);
         pthread_mutex_unlock(&zone->zone_lock);
         pthread_mutex_unlock(&xfrd->serial_lock);
-        ods_log_crit("[%s] unable to commit xfr zone %s: ods_fopen() failed "
+        ods_log_crit("[%s] unable to commit xfr zone %s: write failed "
             "(%s)", xfrd_str, zone->name, strerror(errno));
         return;
     }
+    ods_fclose(xfrd->spool);
+    xfrd->spool = NULL;
     /* update soa serial management */
     xfrd->serial_disk = xfrd->msg_new_serial;
     serial_disk_acq = xfrd->serial_disk_acquired;
@@ -495,7 +518,43 @@ xfrd_commit_packet(xfrd_type* xfrd)
 
 
 /**
- * Dump answer to disk.
+ * Write a record to the xfrd spool.
+ *
+ */
+static int
+xfrd_spool_write(FILE* fd, uint8_t kind, const uint8_t* data, uint16_t len)
+{
+    uint8_t header[3];
+    header[0] = kind;
+    header[1] = (uint8_t) (len >> 8);
+    header[2] = (uint8_t) (len & 0xff);
+    if (fwrite(header, sizeof(header), 1, fd) != 1) {
+        return 1;
+    }
+    if (len && fwrite(data, len, 1, fd) != 1) {
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Close the xfrd spool.
+ *
+ */
+void
+xfrd_spool_close(xfrd_type* xfrd)
+{
+    if (xfrd && xfrd->spool) {
+        ods_fclose(xfrd->spool);
+        xfrd->spool = NULL;
+    }
+}
+
+
+/**
+ * Dump answer to disk. The answer RRs are decompressed and appended to the
+ * spool in wire format, the spool stays open for the rest of the transfer.
  *
  */
 static void
@@ -503,49 +562,84 @@ xfrd_dump_packet(xfrd_type* xfrd, buffer_type* buffer)
 {
     zone_type* zone = NULL;
     char* xfrfile = NULL;
-    FILE* fd = NULL;
-    ldns_pkt* pkt = NULL;
+    ldns_rr* rr = NULL;
+    ldns_buffer* wire = NULL;
     ldns_status status = LDNS_STATUS_OK;
+    size_t pos = BUFFER_PKT_HEADER_SIZE;
+    uint16_t qdcount = 0;
+    uint16_t ancount = 0;
+    uint16_t i = 0;
     ods_log_assert(buffer);
     ods_log_assert(xfrd);
     zone = (zone_type*) xfrd->zone;
     ods_log_assert(zone);
     ods_log_assert(zone->name);
-    status = ldns_wire2pkt(&pkt, buffer_begin(buffer), buffer_limit(buffer));
-    if (status != LDNS_STATUS_OK) {
-        ods_log_crit("[%s] unable to dump packet zone %s: ldns_wire2pkt() "
-            "failed (%s)", xfrd_str, zone->name,
-            ldns_get_errorstr_by_id(status));
-        return;
-    }
-    ods_log_assert(pkt);
-    xfrfile = ods_build_path(zone->name, ".xfrd", 0, 1);
-    if (!xfrfile) {
-        ods_log_crit("[%s] unable to dump packet zone %s: build path failed",
-            xfrd_str, zone->name);
-        return;
-    }
+    qdcount = buffer_pkt_qdcount(buffer);
+    ancount = buffer_pkt_ancount(buffer);
+    CHECKALLOC(wire = ldns_buffer_new(LDNS_MAX_PACKETLEN));
     pthread_mutex_lock(&xfrd->rw_lock);
-    if (xfrd->msg_do_retransfer && !xfrd->msg_seq_nr && !xfrd->msg_is_ixfr) {
-        fd = ods_fopen(xfrfile, NULL, "w");
-    } else {
-        fd = ods_fopen(xfrfile, NULL, "a");
+    if (xfrd->msg_seq_nr == 0) {
+        /* a previous transfer that did not complete is left as is */
+        xfrd_spool_close(xfrd);
+    }
+    if (!xfrd->spool) {
+        xfrfile = ods_build_path(zone->name, ".xfrd", 0, 1);
+        if (!xfrfile) {
+            ods_log_crit("[%s] unable to dump packet zone %s: build path "
+                "failed", xfrd_str, zone->name);
+            pthread_mutex_unlock(&xfrd->rw_lock);
+            ldns_buffer_free(wire);
+            return;
+        }
+        if (xfrd->msg_do_retransfer && !xfrd->msg_seq_nr &&
+            !xfrd->msg_is_ixfr) {
+            xfrd->spool = ods_fopen(xfrfile, NULL, "w");
+        } else {
+            xfrd->spool = ods_fopen(xfrfile, NULL, "a");
+        }
+        free((void*) xfrfile);
+        if (!xfrd->spool) {
+            ods_log_crit("[%s] unable to dump packet zone %s: ods_fopen() "
+                "failed (%s)", xfrd_str, zone->name, strerror(errno));
+            pthread_mutex_unlock(&xfrd->rw_lock);
+            ldns_buffer_free(wire);
+            return;
+        }
     }
-    free((void*) xfrfile);
-    if (!fd) {
-        ods_log_crit("[%s] unable to dump packet zone %s: ods_fopen() failed "
-            "(%s)", xfrd_str, zone->name, strerror(errno));
-        pthread_mutex_unlock(&xfrd->rw_lock);
-        return;
+    if (xfrd->msg_seq_nr == 0 &&
+        xfrd_spool_write(xfrd->spool, XFRD_SPOOL_BEGIN,
+            (const uint8_t*) XFRD_SPOOL_MAGIC, strlen(XFRD_SPOOL_MAGIC))) {
+        status = LDNS_STATUS_FILE_ERR;
+    }
+    for (i = 0; status == LDNS_STATUS_OK && i < qdcount; i++) {
+        status = ldns_wire2rr(&rr, buffer_begin(buffer), buffer_limit(buffer),
+            &pos, LDNS_SECTION_QUESTION);
+        ldns_rr_free(rr);
+        rr = NULL;
+    }
+    for (i = 0; status == LDNS_STATUS_OK && i < ancount; i++) {
+        status = ldns_wire2rr(&rr, buffer_begin(buffer), buffer_limit(buffer),
+            &pos, LDNS_SECTION_ANSWER);
+        if (status != LDNS_STATUS_OK) {
+            break;
+        }
+        ldns_buffer_clear(wire);
+        status = ldns_rr2buffer_wire(wire, rr, LDNS_SECTION_ANSWER);
+        ldns_rr_free(rr);
+        rr = NULL;
+        if (status == LDNS_STATUS_OK &&
+            xfrd_spool_write(xfrd->spool, XFRD_SPOOL_RR,
+                ldns_buffer_begin(wire), ldns_buffer_position(wire))) {
+            status = LDNS_STATUS_FILE_ERR;
+        }
     }
-    ods_log_assert(fd);
-    if (xfrd->msg_seq_nr == 0) {
-        fprintf(fd, ";;BEGINPACKET\n");
+    if (status != LDNS_STATUS_OK) {
+        ods_log_crit("[%s] unable to dump packet zone %s: %s", xfrd_str,
+            zone->name, ldns_get_errorstr_by_id(status));
+        xfrd_spool_close(xfrd);
     }
-    ldns_rr_list_print(fd, ldns_pkt_answer(pkt));
-    ods_fclose(fd);
     pthread_mutex_unlock(&xfrd->rw_lock);
-    ldns_pkt_free(pkt);
+    ldns_buffer_free(wire);
 }
 
 
@@ -982,6 +1076,9 @@ xfrd_handle_packet(xfrd_type* xfrd, buffer_type* buffer)
                 ods_log_info("[%s] zone %s xfr rollback", xfrd_str,
                     zone->name);
                 buffer_flip(buffer);
+                pthread_mutex_lock(&xfrd->rw_lock);
+                xfrd_spool_close(xfrd);
+                pthread_mutex_unlock(&xfrd->rw_lock);
             }
             return res;
             break;
@@ -1089,6 +1186,7 @@ xfrd_tcp_write(xfrd_type* xfrd, tcp_set_type* set)
     tcp->is_reading = 1;
     tcp_conn_ready(tcp);
     xfrd->handler.event_types = NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
+    xfrd_update_handler(xfrd);
     xfrd_tcp_read(xfrd, set);
 }
 
@@ -1177,6 +1275,7 @@ xfrd_tcp_open(xfrd_type* xfrd, tcp_set_type* set)
     }
     xfrd->handler.fd = fd;
     xfrd->handler.event_types = NETIO_EVENT_WRITE|NETIO_EVENT_TIMEOUT;
+    /* this updates the handler with netio too */
     xfrd_set_timer(xfrd, xfrd_time(xfrd) + XFRD_TCP_TIMEOUT);
     return 1;
 }
@@ -1363,6 +1462,7 @@ xfrd_tcp_release(xfrd_type* xfrd, tcp_set_type* set, int open_waiting)
     xfrd->tcp_waiting = 0;
     xfrd->handler.fd = -1;
     xfrd->handler.event_types = NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
+    xfrd_update_handler(xfrd);
 
     if (set->tcp_conn[conn]->fd != -1) {
         close(set->tcp_conn[conn]->fd);
@@ -1522,6 +1622,7 @@ xfrd_udp_obtain(xfrd_type* xfrd)
             if (xfrd->handler.fd == -1) {
                     xfrhandler->udp_use_num--;
             }
+            xfrd_update_handler(xfrd);
             return;
     }
     /* queue the zone as last */
@@ -1636,6 +1737,7 @@ xfrd_udp_release(xfrd_type* xfrd)
     if(xfrd->handler.fd != -1)
         close(xfrd->handler.fd);
     xfrd->handler.fd = -1;
+    xfrd_update_handler(xfrd);
     xfrhandler = (xfrhandler_type*) xfrd->xfrhandler;
     ods_log_assert(xfrhandler);
     /* see if there are waiting zones */
@@ -1652,6 +1754,7 @@ xfrd_udp_release(xfrd_type* xfrd)
             /* see if this zone needs udp connection */
             if (wf->tcp_conn == -1) {
                 wf->handler.fd = xfrd_udp_send_request_ixfr(wf);
+                xfrd_update_handler(wf);
                 if (wf->handler.fd != -1) {
                     return;
                 }
@@ -1965,6 +2068,7 @@ xfrd_cleanup(xfrd_type* xfrd, int backup)
         xfrd_unlink(xfrd);
     }
 
+    xfrd_spool_close(xfrd);
     tsig_rr_cleanup(xfrd->tsig_rr);
     pthread_mutex_destroy(&xfrd->serial_lock);
     pthread_mutex_destroy(&xfrd->rw_lock);
@@ -34,6 +34,7 @@
 
 #include "config.h"
 #include <stdint.h>
+#include <stdio.h>
 #include <time.h>
 
 /**
@@ -68,6 +69,18 @@ typedef struct xfrd_struct xfrd_type;
 #define XFRD_TCP_TIMEOUT 120 /* seconds, before a tcp request times out */
 #define XFRD_UDP_TIMEOUT 5 /* seconds, before a udp request times out */
 
+/*
+ * The <zone>.xfrd spool holds the received transfers as records of a one
+ * octet kind, a two octet length in network order and that many octets.
+ * Every transfer starts with a BEGIN record carrying XFRD_SPOOL_MAGIC,
+ * followed by one RR record per answer RR in uncompressed wire format and an
+ * END record once the transfer is complete.
+ */
+#define XFRD_SPOOL_BEGIN 'B'
+#define XFRD_SPOOL_RR 'R'
+#define XFRD_SPOOL_END 'E'
+#define XFRD_SPOOL_MAGIC "ODSX"
+
 /*
  * Zone transfer SOA information.
  */
@@ -96,6 +109,7 @@ struct xfrd_struct
     zone_type* zone;
     pthread_mutex_t serial_lock; /* mutexes soa serial management */
     pthread_mutex_t rw_lock; /* mutexes <zone>.xfrd file */
+    FILE* spool; /* <zone>.xfrd while a transfer is written */
 
     /* transfer request handling */
     int tcp_conn;
@@ -180,6 +194,15 @@ void xfrd_set_timer_refresh(xfrd_type* xfrd);
 socklen_t xfrd_acl_sockaddr_to(acl_type* acl,
     struct sockaddr_storage* to);
 
+/**
+ * Flush and close the <zone>.xfrd spool if a transfer is being written to
+ * it. Must be called with rw_lock held before the file is moved or replaced,
+ * the remainder of the transfer is then appended to a new file.
+ * \param[in] xfrd zone transfer structure.
+ *
+ */
+void xfrd_spool_close(xfrd_type* xfrd);
+
 /**
  * Cleanup zone transfer structure.
  * \param[in] xfrd zone transfer structure.
@@ -0,0 +1,50 @@
+ZONE_STEPS="1000 2000 4000 8000"
+ZONE_COUNTER=0
+STATUS=0
+MYEND=0
+MYSTART=0
+RUN=0
+DEBUG_OUTPUT=/dev/null
+#DEBUG_OUTPUT=/tmp/log
+RESULTS_OUTPUT="performance_results.log"
+
+[ x$DEBUG_OUTPUT != "x/dev/null" ] && rm -f $DEBUG_OUTPUT
+
+killall fakesigner.sh >> $DEBUG_OUTPUT 2>&1
+killall nc >> $DEBUG_OUTPUT 2>&1
+
+echo "******** WORKING ********" >> $DEBUG_OUTPUT 2>&1
+echo $RESULTS_TITLE > $RESULTS_OUTPUT 2>&1
+log_this fakesignerlog ./fakesigner.sh &
+for ZONES in $ZONE_STEPS ; do
+  [ $STATUS -ne 0 ] && exit 1
+  # Add the zones missing for this step, the previous ones stay in place
+  if [ $ZONES -gt $ZONE_COUNTER ] ; then
+    generate_zonelist_xml $ZONES 1
+    cp -- zonelist.1-$ZONES.xml $INSTALL_ROOT/etc/opendnssec/zonelist.xml
+    log_this test_output "Importing zonelist zonelist.1-$ZONES.xml"
+    $INSTALL_ROOT/$KSM_UTIL zonelist import >> $DEBUG_OUTPUT 2>&1
+    STATUS=$?
+    check_status zonelist_import q
+    rm zonelist.1-*
+    ZONE_COUNTER=$ZONES
+  fi
+  $INSTALL_ROOT/$KSM_UTIL hsm key gen -d P1Y >> $DEBUG_OUTPUT 2>&1
+  # The newest zone is enforced for the first time, so its signconf only
+  # gets a locator once the whole pass has reached it.
+  MYSTART=`date +%s%N`
+  $INSTALL_ROOT/$KSM_UTIL enforce >> $DEBUG_OUTPUT 2>&1
+  log_this test_output "Enforcing $ZONE_COUNTER zones"
+  while [ 1 ] ; do
+    [ 0`grep -c Locator $INSTALL_ROOT/var/opendnssec/signconf/txt$ZONE_COUNTER.xml 2>/dev/null` -gt 0 ] && break
+    sleep 1
+  done
+  MYEND=`date +%s%N`
+  calc_runtime
+  PERZONE=`echo "3k $MYEND $MYSTART - 1000000 / $ZONE_COUNTER / p" | dc`
+  echo "$ZONE_COUNTER,$RUN,$PERZONE" >> $RESULTS_OUTPUT 2>&1
+done
+
+killall fakesigner.sh >> $DEBUG_OUTPUT 2>&1
+killall nc >> $DEBUG_OUTPUT 2>&1
+exit 0
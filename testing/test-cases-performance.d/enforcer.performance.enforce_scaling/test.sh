@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+#
+#TEST: Measures the time of a full enforce pass for a growing number of zones.
+#TEST: With zone scoped database fetches the time per zone should stay flat.
+#TEST: Designed to work in CentOS on titan - portability is questionable
+
+if [ -n "$HAVE_MYSQL" ]; then
+        ods_setup_conf conf.xml conf-mysql.xml
+fi &&
+
+ods_reset_env &&
+source performance_test_utils.sh &&
+
+ods_start_enforcer &&
+
+source ./performance_test.sh &&
+
+ods_stop_enforcer &&
+
+echo && 
+echo "************OK******************" &&
+echo &&
+cat performance_results.log &&
+
+return 0
+
+echo
+echo "************ERROR******************"
+echo
+ods_kill
+return 1
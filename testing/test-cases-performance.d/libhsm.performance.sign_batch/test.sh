@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+#
+#TEST: Measures the signing speed of SoftHSM through libhsm, signing RRsets
+#TEST: one by one and in batches as the signer does for the RRsets of a domain.
+
+ITERATIONS=20000
+
+ods_reset_env_noenforcer &&
+
+rm -f performance_results.log &&
+for BATCH in 1 16 64; do
+	log_this ods-hsmspeed-$BATCH ods-hsmspeed -r SoftHSM -s 2048 -i $ITERATIONS -t 1 -b $BATCH &&
+	log_grep ods-hsmspeed-$BATCH stdout "sig/s" &&
+	grep "sig/s" _log.$BUILD_TAG.ods-hsmspeed-$BATCH.stdout >> performance_results.log ||
+	break
+done &&
+test `wc -l < performance_results.log` -eq 3 &&
+
+echo && 
+echo "************OK******************" &&
+echo &&
+cat performance_results.log &&
+
+return 0
+
+echo
+echo "************ERROR******************"
+echo
+ods_kill
+return 1